@@ -47,6 +47,13 @@ AS_IF([test -d "$with_ucx"],
 		],
 		[AC_MSG_NOTICE([UCX: native bit-wise atomics NOT found])
 		])
+	      # read-only memory registration for fspace snapshots
+	      AS_IF([fgrep -q UCP_MEM_MAP_PROT_REMOTE_READ $ucp_hdr],
+		[AC_MSG_NOTICE([UCX: memory map protection flags found])
+ 	         AC_DEFINE([HAVE_UCP_MEM_MAP_PROT], [1], [UCX has memory map protection flags])
+		],
+		[AC_MSG_NOTICE([UCX: memory map protection flags NOT found])
+		])
 	      # check for non-blocking put/get
 	      AC_COMPILE_IFELSE(
 		[AC_LANG_PROGRAM([[#include <ucp/api/ucp.h>]], [ucp_put_nb])],
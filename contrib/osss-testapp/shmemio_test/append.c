@@ -0,0 +1,145 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "timer.h"
+
+#define NRECS 1000
+#define NSTATS 1000
+
+typedef struct {
+  int pe;
+  int seq;
+} rec_t;
+
+/*
+ * Read bytes of the log back the way the file is striped over its pes
+ */
+void get_striped(shmem_fp_t *fp, void *buf, size_t foff, size_t len)
+{
+  size_t done = 0;
+  while (done < len) {
+    size_t unit = (foff + done) / fp->unit_size;
+    size_t uoff = (foff + done) % fp->unit_size;
+    size_t nbytes = fp->unit_size - uoff;
+    if (nbytes > (len - done))
+      nbytes = len - done;
+    
+    int pe = fp->pe_start + (unit % fp->pe_size) * fp->pe_stride;
+    char *addr = (char*)fp->addr + (unit / fp->pe_size) * fp->unit_size + uoff;
+    
+    shmem_getmem((char*)buf + done, addr, nbytes, pe);
+    done += nbytes;
+  }
+}
+
+void append_file(shmem_fspace_t fid)
+{
+  int me = shmem_my_pe ();
+  int npes = shmem_n_pes ();
+  
+  shmem_fopen_attr_t attr;
+  attr.flags = SHMEM_FOPEN_APPEND_LOG;
+  attr.nreplicas = 0;
+
+  int err;
+  shmem_fp_t *fp = shmem_open_attr(fid, "/tmp/shmemio_logfile", 4096, -1, -1, 2, -1, &attr, &err);
+
+  if (fp == NULL) {
+    printf ("Failed to open log. Got NULL pointer. Error code is %d\n", err);
+    return;
+  }
+
+  printf ("%d: log fp %p, addr=%lx, size=%lu, unit size=%d, pe [%d:%d] by %d\n",
+	  me, fp, (long unsigned)fp->addr, fp->size, fp->unit_size, fp->pe_start,
+	  fp->pe_start + fp->pe_size - 1, fp->pe_stride);
+
+  shmem_barrier_all();
+  
+  for (int idx = 0; idx < NRECS; idx++) {
+    rec_t rec = { me, idx };
+    ssize_t off = shmem_fp_append(fp, &rec, sizeof(rec));
+    if (off < 0) {
+      printf ("%d: append %d failed with %ld\n", me, idx, (long)off);
+      break;
+    }
+  }
+
+  shmem_barrier_all();
+
+  if (me == 0) {
+    const size_t hdr = (size_t)fp->unit_size * fp->pe_size;
+    const size_t nrecs = (size_t)NRECS * npes;
+    uint64_t tail;
+    int *seen = calloc(nrecs, sizeof(int));
+    int bad = 0;
+
+    shmem_getmem(&tail, fp->addr, sizeof(tail), fp->pe_start);
+    printf ("Log tail is %lu, expect %lu. Log size is %lu\n",
+	    (long unsigned)tail, (long unsigned)(nrecs * sizeof(rec_t)), fp->size);
+
+    for (size_t idx = 0; idx < nrecs; idx++) {
+      rec_t rec;
+      get_striped(fp, &rec, hdr + idx * sizeof(rec_t), sizeof(rec_t));
+      if ((rec.pe < 0) || (rec.pe >= npes) || (rec.seq < 0) || (rec.seq >= NRECS)) {
+	bad++;
+	continue;
+      }
+      seen[rec.pe * NRECS + rec.seq]++;
+    }
+
+    for (size_t idx = 0; idx < nrecs; idx++) {
+      if (seen[idx] != 1)
+	bad++;
+    }
+    
+    printf ("Append log check %s: %d bad records\n", bad ? "FAILED" : "passed", bad);
+    free(seen);
+  }
+
+  //Appenders watch the log size, see how long a stat takes
+  my_timer_t timer;
+  timer_reset(&timer);
+  for (int idx = 0; idx < NSTATS; idx++) {
+    timer_start(&timer);
+    if (shmem_fp_stat(fp) != 0) {
+      printf ("%d: stat %d failed\n", me, idx);
+      break;
+    }
+    timer_stop(&timer);
+  }
+  printf ("%d: log size %lu of %lu reserved, stat takes %.2f us\n",
+	  me, fp->size, fp->capacity, timer.avg_seconds * 1e6);
+
+  shmem_barrier_all();
+  shmem_close(fp, 0);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+  
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("append: connect failed\n");
+  }
+  else {
+    append_file(fid);
+    shmem_disconnect(fid);
+  }
+  
+  shmem_finalize();
+}
@@ -25,6 +25,23 @@ void do_stat(shmem_fspace_t fid)
   printf ("\t# loaded files  = %d\n", fstat.nfiles);
   printf ("\tused size       = %d\n", fstat.used_size);
   printf ("\tfree size       = %d\n", fstat.free_size);
+  printf ("\thole size       = %lu\n", (long unsigned)fstat.hole_size);
+  printf ("\tempty regions   = %d\n", fstat.empty_regions);
+  printf ("\tcompact moves   = %lu\n", fstat.compact_moves);
+
+  static const char *classes[SHMEM_FSPACE_NCLASSES] = { "latency", "normal", "bulk" };
+  for (int cls = 0; cls < SHMEM_FSPACE_NCLASSES; cls++) {
+    printf ("\t%-8s reqs    = %lu, p50 %lu us, p99 %lu us, max %lu us\n", classes[cls],
+	    fstat.nreqs[cls], fstat.lat_p50[cls], fstat.lat_p99[cls], fstat.lat_max[cls]);
+  }
+  printf ("\tcrc failures    = %lu\n", fstat.crc_failures);
+  printf ("\tcrc MB/s        = %lu\n", fstat.crc_mbps);
+  printf ("\tlz ratio        = %lu.%02lu\n", fstat.lz_ratio_x100 / 100, fstat.lz_ratio_x100 % 100);
+  printf ("\tlz MB/s         = %lu\n", fstat.lz_mbps);
+  printf ("\tparity MB/s     = %lu\n", fstat.parity_mbps);
+  printf ("\tparity overhead = %lu%%\n", fstat.parity_overhead_pct);
+  printf ("\tfilter MB/s     = %lu\n", fstat.filter_mbps);
+  printf ("\tfilter sent     = %lu%%\n", fstat.filter_sent_pct);
 }
 
 int main (int argc, char **argv)
@@ -0,0 +1,182 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+//Needs a server with checksums on (fspace_server -k) on this host, the
+//test changes the backing file behind its back
+#define FILE_PATH  "/tmp/shmemio_crcfile"
+#define FILE_SIZE  20000
+#define BAD_OFFSET 9000
+
+//shmemio_err_checksum, an open that failed its checksums
+#define ERR_CHECKSUM -19
+
+static inline char pattern(size_t off) { return (char)((off * 13) + 5); }
+
+shmem_fp_t *open_crcfile(shmem_fspace_t fid, int *err)
+{
+  return shmem_open(fid, FILE_PATH, FILE_SIZE, -1, -1, 1, -1, err);
+}
+
+/*
+ * Read the whole file back and count bytes that are not the pattern
+ */
+int check_file(shmem_fp_t *fp)
+{
+  char *buf = malloc(FILE_SIZE);
+  int bad = 0;
+
+  if (shmem_fp_read(fp, 0, buf, FILE_SIZE) != FILE_SIZE) {
+    printf ("Failed to read back %d bytes\n", FILE_SIZE);
+    free(buf);
+    return 1;
+  }
+
+  for (size_t idx = 0; idx < FILE_SIZE; idx++) {
+    if (buf[idx] != pattern(idx))
+      bad++;
+  }
+  free(buf);
+  return bad;
+}
+
+/*
+ * Flip the bits of one byte of the backing file, keeping its mtime as a
+ * media error would. A changed mtime makes the server skip the checks
+ */
+int flip_byte(size_t offset)
+{
+  struct stat st;
+  char c;
+  int fd = open(FILE_PATH, O_RDWR);
+
+  if ((fd < 0) || (fstat(fd, &st) != 0)) {
+    printf ("Failed to open backing file %s\n", FILE_PATH);
+    return 1;
+  }
+
+  int ret = (pread(fd, &c, 1, offset) != 1);
+  c = ~c;
+  ret |= (pwrite(fd, &c, 1, offset) != 1);
+
+  struct timespec times[2] = { st.st_atim, st.st_mtim };
+  ret |= fsync(fd) | futimens(fd, times);
+  close(fd);
+  return ret;
+}
+
+/*
+ * Write the file back, then load it unchanged, corrupted and repaired
+ */
+int crc_file(shmem_fspace_t fid)
+{
+  char errstr[SHMEM_MAX_ERRSTR];
+  int err;
+  int bad = 0;
+
+  unlink(FILE_PATH);
+  unlink(FILE_PATH ".crc");
+
+  shmem_fp_t *fp = open_crcfile(fid, &err);
+  if (fp == NULL) {
+    printf ("Failed to open %s, error code %d\n", FILE_PATH, err);
+    return 1;
+  }
+
+  char *buf = malloc(FILE_SIZE);
+  for (size_t idx = 0; idx < FILE_SIZE; idx++)
+    buf[idx] = pattern(idx);
+  bad += (shmem_fp_write(fp, 0, buf, FILE_SIZE) != FILE_SIZE);
+  free(buf);
+
+  //Unload, so the file and its checksums are written back
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+
+  if (access(FILE_PATH ".crc", R_OK) != 0) {
+    printf ("No checksum file written, is the server running with -k?\n");
+    return 1;
+  }
+
+  //Clean load checks out and has the data
+  fp = open_crcfile(fid, &err);
+  if (fp == NULL) {
+    printf ("Clean reload failed, error code %d\n", err);
+    return 1;
+  }
+  bad += check_file(fp);
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+
+  printf ("Clean reload check %s\n", bad ? "FAILED" : "passed");
+
+  //A corrupted unit must fail the load
+  bad += flip_byte(BAD_OFFSET);
+  fp = open_crcfile(fid, &err);
+  if (fp != NULL) {
+    printf ("Corrupted backing file opened\n");
+    shmem_close(fp, 0);
+    bad++;
+  }
+  else if (err != ERR_CHECKSUM) {
+    memset(errstr, 0, sizeof(errstr));
+    shmem_strerror(err, errstr);
+    printf ("Corrupted backing file failed with %d (%s), not a checksum error\n", err, errstr);
+    bad++;
+  }
+
+  printf ("Corrupted reload check %s\n", bad ? "FAILED" : "passed");
+
+  //Repaired, it loads again
+  bad += flip_byte(BAD_OFFSET);
+  fp = open_crcfile(fid, &err);
+  if (fp == NULL) {
+    printf ("Repaired reload failed, error code %d\n", err);
+    return bad + 1;
+  }
+  bad += check_file(fp);
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+
+  printf ("Repaired reload check %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  int me = shmem_my_pe ();
+  int bad = 0;
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("crc: connect failed\n");
+    bad = 1;
+  }
+  else {
+    //One pe is enough, the checks are on the server
+    if (me == 0) {
+      bad = crc_file(fid);
+      printf ("Checksum test %s\n", bad ? "FAILED" : "passed");
+    }
+    shmem_barrier_all();
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+  return bad ? 1 : 0;
+}
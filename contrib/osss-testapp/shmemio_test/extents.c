@@ -0,0 +1,133 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Not a whole number of units, so the first extent ends part way into one
+#define FILE_SIZE  5000
+#define GROW_SIZE  20000
+
+static inline char pattern(size_t off) { return (char)((off * 7) + 3); }
+
+/*
+ * Check len bytes read back at foff against the pattern
+ */
+int check_range(shmem_fp_t *fp, size_t foff, size_t len)
+{
+  char *buf = malloc(len);
+  int bad = 0;
+
+  ssize_t got = shmem_fp_read(fp, foff, buf, len);
+  if (got != (ssize_t)len) {
+    printf ("Read of %lu bytes at %lu returned %ld\n",
+	    (long unsigned)len, (long unsigned)foff, (long)got);
+    free(buf);
+    return 1;
+  }
+
+  for (size_t idx = 0; idx < len; idx++) {
+    if (buf[idx] != pattern(foff + idx))
+      bad++;
+  }
+  free(buf);
+  return bad;
+}
+
+/*
+ * Write the pattern at foff
+ */
+int write_range(shmem_fp_t *fp, size_t foff, size_t len)
+{
+  char *buf = malloc(len);
+  for (size_t idx = 0; idx < len; idx++)
+    buf[idx] = pattern(foff + idx);
+
+  ssize_t put = shmem_fp_write(fp, foff, buf, len);
+  free(buf);
+  return (put == (ssize_t)len) ? 0 : 1;
+}
+
+void extent_file(shmem_fspace_t fid)
+{
+  int me = shmem_my_pe ();
+
+  shmem_fopen_attr_t attr;
+  attr.flags = SHMEM_FOPEN_EXTENTS;
+  attr.nreplicas = 0;
+
+  int err;
+  shmem_fp_t *fp = shmem_open_attr(fid, "/tmp/shmemio_extentfile", FILE_SIZE, -1, -1, 2, -1, &attr, &err);
+
+  if (fp == NULL) {
+    printf ("Failed to open extent file. Got NULL pointer. Error code is %d\n", err);
+    return;
+  }
+
+  printf ("%d: extent fp %p, addr=%lx, size=%lu, unit size=%d, pe [%d:%d] by %d\n",
+	  me, fp, (long unsigned)fp->addr, fp->size, fp->unit_size, fp->pe_start,
+	  fp->pe_start + fp->pe_size - 1, fp->pe_stride);
+
+  int bad = 0;
+
+  if (me == 0)
+    bad += write_range(fp, 0, FILE_SIZE);
+
+  shmem_barrier_all();
+
+  //Grow the file, new bytes go on a new extent after the first
+  if (me == 0) {
+    int ret = shmem_fextend(fp, GROW_SIZE);
+    if (ret != 0) {
+      printf ("%d: fextend failed with %d\n", me, ret);
+      bad++;
+    }
+    else {
+      bad += write_range(fp, FILE_SIZE, GROW_SIZE);
+    }
+  }
+
+  shmem_barrier_all();
+
+  //Other pes see the new size with a stat, and find the new extent on
+  //first use past the old end
+  bad += check_range(fp, 0, FILE_SIZE);
+  if (shmem_fp_stat(fp) != 0) {
+    printf ("%d: fp stat failed\n", me);
+    bad++;
+  }
+  bad += check_range(fp, FILE_SIZE, GROW_SIZE);
+
+  printf ("%d: Extent file check %s: %d bad bytes\n", me, bad ? "FAILED" : "passed", bad);
+
+  shmem_barrier_all();
+  shmem_close(fp, 0);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("extents: connect failed\n");
+  }
+  else {
+    extent_file(fid);
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "timer.h"
+
+#define NEDGES  100000  /* per pe */
+#define MAXV    1000
+#define SELECT  10      /* edges with x below this match, 1% */
+
+//Same layout as the gbuild tuples
+typedef struct {
+  unsigned x, y;
+  double w;
+} edge_t;
+
+void filter_test(shmem_fspace_t fid)
+{
+  int me = shmem_my_pe ();
+  int npes = shmem_n_pes ();
+  const size_t nedges = (size_t)NEDGES * npes;
+  const size_t fsize = nedges * sizeof(edge_t);
+
+  int err;
+  shmem_fp_t *fp = NULL;
+  if (me == 0) {
+    fp = shmem_open(fid, "/tmp/shmemio_edgefile", fsize, -1, -1, -1, -1, &err);
+  }
+  shmem_barrier_all();
+  if (me != 0) {
+    fp = shmem_open(fid, "/tmp/shmemio_edgefile", fsize, -1, -1, -1, -1, &err);
+  }
+
+  if (fp == NULL) {
+    printf ("%d: Failed to open edge file. Error code is %d\n", me, err);
+    shmem_global_exit(1);
+  }
+
+  edge_t *mine = malloc(NEDGES * sizeof(edge_t));
+  srand(me + 1);
+  for (int idx = 0; idx < NEDGES; idx++) {
+    mine[idx].x = rand() % MAXV;
+    mine[idx].y = (me * NEDGES) + idx;
+    mine[idx].w = (rand() % MAXV) / 10.0;
+  }
+  shmem_fp_write(fp, (size_t)me * NEDGES * sizeof(edge_t), mine, NEDGES * sizeof(edge_t));
+  shmem_quiet();
+  shmem_barrier_all();
+
+  //Fetch it all and filter here
+  my_timer_t timer;
+  timer_reset(&timer);
+  timer_start(&timer);
+  edge_t *all = malloc(fsize);
+  shmem_fp_read(fp, 0, all, fsize);
+  size_t nlocal = 0;
+  for (size_t idx = 0; idx < nedges; idx++) {
+    if (all[idx].x < SELECT)
+      nlocal++;
+  }
+  timer_stop(&timer);
+  const double read_sec = timer.tot_seconds;
+
+  //Filter on the server, only matches come back
+  shmem_filter_t filt;
+  filt.rec_size = sizeof(edge_t);
+  filt.field_offset = 0;
+  filt.type = SHMEM_FILTER_UINT32;
+  filt.flags = 0;
+  filt.lo.u = 0;
+  filt.hi.u = SELECT - 1;
+
+  edge_t *hits = malloc(nedges * sizeof(edge_t));
+  size_t start = 0;
+  int bad = 0;
+
+  timer_reset(&timer);
+  timer_start(&timer);
+  ssize_t nhits = shmem_fp_filter(fp, &filt, &start, hits, nedges);
+  timer_stop(&timer);
+
+  if ((nhits < 0) || ((size_t)nhits != nlocal) || (start != nedges))
+    bad++;
+  for (ssize_t idx = 0; idx < nhits; idx++) {
+    if ((hits[idx].x >= SELECT) || (memcmp(&hits[idx], &all[hits[idx].y], sizeof(edge_t)) != 0))
+      bad++;
+  }
+
+  //Indices only, in pages of 100
+  uint64_t idxs[100];
+  size_t nidx = 0;
+  filt.flags = SHMEM_FILTER_INDEX;
+  for (start = 0; start < nedges; ) {
+    ssize_t n = shmem_fp_filter(fp, &filt, &start, idxs, 100);
+    if (n < 0) {
+      bad++;
+      break;
+    }
+    for (ssize_t idx = 0; idx < n; idx++) {
+      if (all[idxs[idx]].x >= SELECT)
+	bad++;
+    }
+    nidx += n;
+  }
+  if (nidx != nlocal)
+    bad++;
+
+  printf ("%d: %ld of %lu edges match, read and filter %.4f s, server filter %.4f s\n",
+	  me, (long)nhits, (long unsigned)nedges, read_sec, timer.tot_seconds);
+  printf ("%d: filter check %s: %d bad\n", me, bad ? "FAILED" : "passed", bad);
+
+  free(hits);
+  free(all);
+  free(mine);
+  shmem_barrier_all();
+  shmem_close(fp, 0);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("filter: connect failed\n");
+  }
+  else {
+    filter_test(fid);
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+}
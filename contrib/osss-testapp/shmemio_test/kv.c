@@ -0,0 +1,268 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NKEYS   10000  /* per pe */
+#define BATCH   64
+#define KEYSIZE 16
+#define NHOT    8      /* keys every pe writes and reads at once */
+#define NRACE   20000  /* per pe */
+
+typedef struct {
+  int pe;
+  int seq;
+  long value;
+  long check[4];       /* all from pe and seq, a torn read mixes them */
+} val_t;
+
+static long
+val_check(int pe, int seq)
+{
+  return ((long)pe << 32) ^ ((long)seq * 2654435761L);
+}
+
+static void
+make_val(val_t *val, int pe, int seq, long value)
+{
+  val->pe = pe;
+  val->seq = seq;
+  val->value = value;
+  for (int idx = 0; idx < 4; idx++)
+    val->check[idx] = val_check(pe, seq) + idx;
+}
+
+static int
+val_ok(const val_t *val)
+{
+  for (int idx = 0; idx < 4; idx++) {
+    if (val->check[idx] != val_check(val->pe, val->seq) + idx)
+      return 0;
+  }
+  return 1;
+}
+
+static double
+now_sec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static void
+make_key(char *key, int pe, int seq)
+{
+  memset(key, 0, KEYSIZE);
+  snprintf(key, KEYSIZE, "k%d.%d", pe, seq);
+}
+
+/*
+ * Sum the ops/s of every pe on pe 0 and print them
+ */
+static void
+report(double *rates, const char *what, long nops, double sec)
+{
+  int me = shmem_my_pe ();
+  int npes = shmem_n_pes ();
+  double rate = nops / sec;
+
+  shmem_double_p(&(rates[me]), rate, 0);
+  shmem_barrier_all();
+
+  if (me == 0) {
+    double total = 0;
+    for (int idx = 0; idx < npes; idx++)
+      total += rates[idx];
+    printf ("%-5s %d pes: %.0f ops/s per pe, %.0f ops/s total\n",
+	    what, npes, total / npes, total);
+  }
+  shmem_barrier_all();
+}
+
+/*
+ * Every pe updates and reads the same few keys at once. A get must
+ * return a whole value one pe put, and never an older put of that pe
+ * than one it returned before
+ */
+static int
+kv_race(shmemx_kv_t kv)
+{
+  int me = shmem_my_pe ();
+  int npes = shmem_n_pes ();
+  int *last = malloc(NHOT * npes * sizeof(int));
+  char key[KEYSIZE];
+  val_t val;
+  int bad = 0;
+
+  for (int idx = 0; idx < NHOT * npes; idx++)
+    last[idx] = -1;
+
+  if (me == 0) {
+    for (int hdx = 0; hdx < NHOT; hdx++) {
+      make_key(key, -1, hdx);
+      make_val(&val, 0, -1, hdx);
+      if (shmemx_kv_put(kv, key, &val) != 0)
+	bad++;
+    }
+  }
+  shmem_barrier_all();
+
+  for (int idx = 0; idx < NRACE; idx++) {
+    const int hdx = idx % NHOT;
+    make_key(key, -1, hdx);
+
+    //Writes and reads take turns, pes start on different ones
+    if (((idx / NHOT) + me) % 2 == 0) {
+      make_val(&val, me, idx, hdx);
+      if (shmemx_kv_put(kv, key, &val) != 0)
+	bad++;
+      continue;
+    }
+
+    if ((shmemx_kv_get(kv, key, &val) != 0) || !val_ok(&val) || (val.value != hdx) ||
+	(val.pe < 0) || (val.pe >= npes)) {
+      bad++;
+      continue;
+    }
+    int *seen = &(last[(hdx * npes) + val.pe]);
+    if (val.seq < *seen)
+      bad++;
+    *seen = val.seq;
+  }
+
+  shmem_barrier_all();
+  printf ("%d: concurrent key-value check %s: %d bad\n", me, bad ? "FAILED" : "passed", bad);
+
+  free(last);
+  return bad;
+}
+
+void kv_test(shmem_fspace_t fid)
+{
+  int me = shmem_my_pe ();
+  int npes = shmem_n_pes ();
+  double *rates = shmem_malloc(npes * sizeof(double));
+
+  //Room for every key at half the slots, and overflow for bad luck
+  shmemx_kv_attr_t attr;
+  attr.create = (me == 0);
+  attr.slots = 4;
+  attr.nbuckets = ((size_t)NKEYS * npes * 2) / attr.slots;
+  attr.noverflow = attr.nbuckets / 4;
+  attr.key_size = KEYSIZE;
+  attr.value_size = sizeof(val_t);
+
+  int err;
+  shmemx_kv_t kv = NULL;
+  if (me == 0) {
+    kv = shmemx_kv_open(fid, "/tmp/shmemio_kvfile", &attr, -1, -1, -1, -1, &err);
+  }
+  shmem_barrier_all();
+  if (me != 0) {
+    kv = shmemx_kv_open(fid, "/tmp/shmemio_kvfile", &attr, -1, -1, -1, -1, &err);
+  }
+
+  if (kv == NULL) {
+    printf ("%d: Failed to open key-value store. Error code is %d\n", me, err);
+    shmem_global_exit(1);
+  }
+
+  char key[KEYSIZE];
+  val_t val;
+  int bad = 0;
+
+  shmem_barrier_all();
+  double start = now_sec();
+  for (int idx = 0; idx < NKEYS; idx++) {
+    make_key(key, me, idx);
+    make_val(&val, me, idx, idx);
+    if (shmemx_kv_put(kv, key, &val) != 0)
+      bad++;
+  }
+  report(rates, "put", NKEYS, now_sec() - start);
+
+  //Read the keys of the next pe
+  const int other = (me + 1) % npes;
+  start = now_sec();
+  for (int idx = 0; idx < NKEYS; idx++) {
+    make_key(key, other, idx);
+    if ((shmemx_kv_get(kv, key, &val) != 0) || (val.pe != other) || (val.seq != idx) ||
+	!val_ok(&val))
+      bad++;
+  }
+  report(rates, "get", NKEYS, now_sec() - start);
+
+  char *keys = malloc(BATCH * KEYSIZE);
+  val_t *vals = malloc(BATCH * sizeof(val_t));
+  int status[BATCH];
+
+  start = now_sec();
+  for (int idx = 0; idx < NKEYS; idx += BATCH) {
+    for (int bdx = 0; bdx < BATCH; bdx++) {
+      make_key(keys + (bdx * KEYSIZE), me, (idx + bdx) % NKEYS);
+      make_val(&(vals[bdx]), me, (idx + bdx) % NKEYS, -1);
+    }
+    if (shmemx_kv_mput(kv, BATCH, keys, vals, status) != 0)
+      bad++;
+  }
+  report(rates, "mput", ((NKEYS + BATCH - 1) / BATCH) * BATCH, now_sec() - start);
+
+  start = now_sec();
+  for (int idx = 0; idx < NKEYS; idx += BATCH) {
+    for (int bdx = 0; bdx < BATCH; bdx++)
+      make_key(keys + (bdx * KEYSIZE), other, (idx + bdx) % NKEYS);
+    if (shmemx_kv_mget(kv, BATCH, keys, vals, status) != 0)
+      bad++;
+    for (int bdx = 0; bdx < BATCH; bdx++) {
+      if ((status[bdx] != 0) || (vals[bdx].pe != other) || (vals[bdx].value != -1) ||
+	  !val_ok(&(vals[bdx])))
+	bad++;
+    }
+  }
+  report(rates, "mget", ((NKEYS + BATCH - 1) / BATCH) * BATCH, now_sec() - start);
+
+  make_key(key, me, 0);
+  if ((shmemx_kv_delete(kv, key) != 0) || (shmemx_kv_get(kv, key, &val) == 0))
+    bad++;
+
+  bad += kv_race(kv);
+
+  printf ("%d: key-value check %s: %d bad\n", me, bad ? "FAILED" : "passed", bad);
+
+  free(vals);
+  free(keys);
+  shmem_barrier_all();
+  shmemx_kv_close(kv, 0);
+  shmem_free(rates);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("kv: connect failed\n");
+  }
+  else {
+    kv_test(fid);
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+}
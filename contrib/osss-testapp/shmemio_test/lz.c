@@ -0,0 +1,157 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+//Needs a server with compression on (fspace_server -z) on this host, the
+//test looks at the backing file it writes
+#define FILE_PATH  "/tmp/shmemio_lzfile"
+#define FILE_SIZE  (1 << 20)
+#define LZ_MAGIC   "SHIOLZ01"
+
+/*
+ * First half sorted keys that compress well, second half random bytes
+ * that get stored as is
+ */
+void fill_data(char *buf)
+{
+  int *keys = (int*)buf;
+  for (size_t idx = 0; idx < (FILE_SIZE / 2) / sizeof(int); idx++)
+    keys[idx] = (int)(idx / 3);
+
+  srand(1234);
+  for (size_t idx = FILE_SIZE / 2; idx < FILE_SIZE; idx++)
+    buf[idx] = (char)rand();
+}
+
+/*
+ * The backing file must have the compressed header and be smaller than
+ * the data
+ */
+int check_backing_file()
+{
+  char magic[8];
+  struct stat st;
+  FILE *fp = fopen(FILE_PATH, "r");
+
+  if ((fp == NULL) || (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) ||
+      (fstat(fileno(fp), &st) != 0)) {
+    printf ("Failed to read backing file %s\n", FILE_PATH);
+    if (fp != NULL)
+      fclose(fp);
+    return 1;
+  }
+  fclose(fp);
+
+  if (memcmp(magic, LZ_MAGIC, sizeof(magic)) != 0) {
+    printf ("Backing file is not compressed, is the server running with -z?\n");
+    return 1;
+  }
+
+  printf ("Backing file holds %d bytes in %ld\n", FILE_SIZE, (long)st.st_size);
+  return (st.st_size >= FILE_SIZE);
+}
+
+/*
+ * Compare len bytes read back at offset with the data
+ */
+int check_range(shmem_fp_t *fp, const char *data, size_t offset, size_t len)
+{
+  char *buf = malloc(len);
+  int bad = 0;
+
+  if (shmem_fp_read(fp, offset, buf, len) != (ssize_t)len) {
+    printf ("Failed to read back %lu bytes at %lu\n", (long unsigned)len, (long unsigned)offset);
+    bad = 1;
+  }
+  else if (memcmp(buf, data + offset, len) != 0) {
+    for (size_t idx = 0; idx < len; idx++) {
+      if (buf[idx] != data[offset + idx])
+	bad++;
+    }
+    printf ("%d bytes differ in %lu bytes at %lu\n", bad, (long unsigned)len, (long unsigned)offset);
+  }
+
+  free(buf);
+  return bad;
+}
+
+int lz_file(shmem_fspace_t fid)
+{
+  int err;
+  int bad = 0;
+  char *data = malloc(FILE_SIZE);
+  fill_data(data);
+
+  unlink(FILE_PATH);
+
+  shmem_fp_t *fp = shmem_open(fid, FILE_PATH, FILE_SIZE, -1, -1, 1, -1, &err);
+  if (fp == NULL) {
+    printf ("Failed to open %s, error code %d\n", FILE_PATH, err);
+    free(data);
+    return 1;
+  }
+
+  bad += (shmem_fp_write(fp, 0, data, FILE_SIZE) != FILE_SIZE);
+
+  //Unload, so the file is compressed into its backing file
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+  bad += check_backing_file();
+
+  //Load it back, decompressed, and compare all of it and some odd ranges
+  fp = shmem_open(fid, FILE_PATH, FILE_SIZE, -1, -1, 1, -1, &err);
+  if (fp == NULL) {
+    printf ("Reload of compressed file failed, error code %d\n", err);
+    free(data);
+    return bad + 1;
+  }
+
+  bad += check_range(fp, data, 0, FILE_SIZE);
+  bad += check_range(fp, data, 1, 4095);
+  bad += check_range(fp, data, (FILE_SIZE / 2) - 777, 2000);
+  bad += check_range(fp, data, FILE_SIZE - 3, 3);
+
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+  free(data);
+  return bad;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  int me = shmem_my_pe ();
+  int bad = 0;
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("lz: connect failed\n");
+    bad = 1;
+  }
+  else {
+    //One pe is enough, compression is on the server
+    if (me == 0) {
+      bad = lz_file(fid);
+      printf ("Compressed round trip check %s\n", bad ? "FAILED" : "passed");
+    }
+    shmem_barrier_all();
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+/*
+ * Collective connect and file open. Pe 0 connects and opens the file for
+ * all pes, each pe writes its part and reads its neighbour's, then all
+ * close it and disconnect together
+ */
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  const int me = shmem_my_pe ();
+  const int npes = shmem_n_pes ();
+  const size_t perpe = 128;
+
+  shmem_fspace_t fid = shmem_connect_all(&conx, 0, 0, npes);
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("openall: connect failed\n");
+    shmem_finalize();
+    return 1;
+  }
+
+  int err;
+  shmem_fp_t *fp = shmem_open_all(fid, "/tmp/shmemio_openall", perpe * npes, -1, -1, 1, -1,
+				  0, 0, npes, &err);
+  if (fp == NULL) {
+    printf ("%d: Failed to open file for all. Error code is %d\n", me, err);
+  }
+  else {
+    int ibuf[2] = { me, me + 1 };
+    shmem_int_put((int*)((char*)fp->addr + (perpe * me)), ibuf, 2, fp->pe_start);
+    shmem_barrier_all();
+
+    const int next_pe = (me + 1) % npes;
+    shmem_int_get(ibuf, (int*)((char*)fp->addr + (perpe * next_pe)), 2, fp->pe_start);
+    printf ("%d: PE %d has two ints in the file: %d, %d (%s)\n", me, next_pe, ibuf[0], ibuf[1],
+	    ((ibuf[0] == next_pe) && (ibuf[1] == next_pe + 1)) ? "ok" : "WRONG");
+
+    if (me != 0) {
+      char buf[SHMEM_MAX_ERRSTR];
+      int s = shmem_fp_stat(fp);
+      shmem_strerror(s, buf);
+      printf ("%d: stat from a non-root pe returned %d: %s\n", me, s, buf);
+    }
+
+    int s = shmem_close_all(fp, SHMEM_IO_WAIT, 0, 0, npes);
+    printf ("%d: File close returned status %d\n", me, s);
+  }
+
+  shmem_disconnect_all(fid, 0, 0, npes);
+  shmem_finalize();
+  return 0;
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include <stdio.h>
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Striped over 3 pes, the server needs a 4th for the parity
+#define FILE_PES   3
+#define FILE_SIZE  (3 * 65536 + 1000)
+#define LOST_PE    1
+
+static inline char pattern(size_t off) { return (char)((off * 11) + 7); }
+
+/*
+ * Count bytes read back that are not the pattern. Bytes on the lost pe
+ * are expected to be zero instead if lost is set
+ */
+int check_file(shmem_fp_t *fp, int lost)
+{
+  char *buf = malloc(FILE_SIZE);
+  int bad = 0;
+
+  if (shmem_fp_read(fp, 0, buf, FILE_SIZE) != FILE_SIZE) {
+    printf ("Failed to read back %d bytes\n", FILE_SIZE);
+    free(buf);
+    return 1;
+  }
+
+  for (size_t idx = 0; idx < FILE_SIZE; idx++) {
+    const int on_lost = (((idx / fp->unit_size) % fp->pe_size) == LOST_PE);
+    const char want = (lost && on_lost) ? 0 : pattern(idx);
+    if (buf[idx] != want)
+      bad++;
+  }
+  free(buf);
+  return bad;
+}
+
+/*
+ * Zero every unit of the file on the pe at LOST_PE in its set
+ */
+void wipe_stripe(shmem_fp_t *fp)
+{
+  const size_t unit = fp->unit_size;
+  char *zeros = calloc(unit, 1);
+
+  for (size_t off = LOST_PE * unit; off < FILE_SIZE; off += unit * fp->pe_size) {
+    const size_t n = ((FILE_SIZE - off) < unit) ? (FILE_SIZE - off) : unit;
+    shmem_fp_write(fp, off, zeros, n);
+  }
+  shmem_quiet();
+  free(zeros);
+}
+
+int parity_file(shmem_fspace_t fid)
+{
+  shmem_fopen_attr_t attr;
+  attr.flags = SHMEM_FOPEN_PARITY;
+  attr.nreplicas = 0;
+
+  int err;
+  shmem_fp_t *fp = shmem_open_attr(fid, "/tmp/shmemio_parityfile", FILE_SIZE, -1, -1,
+				   FILE_PES, -1, &attr, &err);
+  if (fp == NULL) {
+    printf ("Failed to open parity file, error code %d\n", err);
+    return 1;
+  }
+
+  int bad = 0;
+  char *buf = malloc(FILE_SIZE);
+  for (size_t idx = 0; idx < FILE_SIZE; idx++)
+    buf[idx] = pattern(idx);
+  bad += (shmem_fp_write(fp, 0, buf, FILE_SIZE) != FILE_SIZE);
+  free(buf);
+
+  //Parity is brought up to date by the flush
+  bad += (shmem_fp_flush(fp, 0) != 0);
+
+  wipe_stripe(fp);
+  const int wiped = check_file(fp, 1);
+  printf ("Wiped stripe of pe %d check %s\n", LOST_PE, wiped ? "FAILED" : "passed");
+  bad += wiped;
+
+  int ret = shmem_fp_rebuild(fp, LOST_PE, 0);
+  if (ret != 0) {
+    char errstr[SHMEM_MAX_ERRSTR];
+    memset(errstr, 0, sizeof(errstr));
+    shmem_strerror(ret, errstr);
+    printf ("Rebuild of pe %d failed with %d (%s)\n", LOST_PE, ret, errstr);
+    bad++;
+  }
+
+  const int rebuilt = check_file(fp, 0);
+  printf ("Rebuilt stripe check %s: %d bad bytes\n", rebuilt ? "FAILED" : "passed", rebuilt);
+  bad += rebuilt;
+
+  shmem_close(fp, SHMEM_IO_DEALLOC);
+  return bad;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  int me = shmem_my_pe ();
+  int bad = 0;
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("parity: connect failed\n");
+    bad = 1;
+  }
+  else {
+    //One pe is enough, parity is kept by the server
+    if (me == 0) {
+      bad = parity_file(fid);
+      printf ("Parity rebuild test %s\n", bad ? "FAILED" : "passed");
+    }
+    shmem_barrier_all();
+    shmem_disconnect(fid);
+  }
+
+  shmem_finalize();
+  return bad ? 1 : 0;
+}
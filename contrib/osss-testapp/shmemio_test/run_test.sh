@@ -3,21 +3,40 @@
 
 SERVER_IPOIB=10.0.0.50
 SERVER_PORT=13333
+PROXY_PORT=13338
+EMBED_PORT=13339
 
-NPES=2
+NPES=${NPES:-2}
 
 run_server() {
     fspace_server -n 4 -p ${SERVER_PORT} -v
 }
 
+# One proxy per node, pes connect to it when USE_PROXY=1
+run_proxy() {
+    fspace_proxy -s ${SERVER_IPOIB} -P ${SERVER_PORT} -p ${PROXY_PORT} -v
+}
+
 run_client() {
-    oshrun -n ${NPES} $@ ${SERVER_IPOIB} ${SERVER_PORT}
+    if [ "${USE_PROXY}" == "1" ]; then
+	oshrun -n ${NPES} $@ 127.0.0.1 ${PROXY_PORT}
+    elif [ "${USE_EMBED}" == "1" ]; then
+	# pe 0 hosts the fspace server in a service thread
+	SHMEM_IO_SERVER_PE=0 SHMEM_IO_SERVER_PORT=${EMBED_PORT} SHMEM_IO_SERVER_NFPES=4 \
+	    oshrun -n ${NPES} $@ 127.0.0.1 ${EMBED_PORT}
+    else
+	oshrun -n ${NPES} $@ ${SERVER_IPOIB} ${SERVER_PORT}
+    fi
 }
 
 if [ "$1" == "server" ]; then
     run_server
 fi
 
+if [ "$1" == "proxy" ]; then
+    run_proxy
+fi
+
 if [ "$1" == "sharing" ]; then
     run_client ./sharing.x
 fi
@@ -26,6 +45,46 @@ if [ "$1" == "fopen" ]; then
     run_client ./fopen.x "/tmp/shmemio_testfile" 0
 fi
 
+if [ "$1" == "append" ]; then
+    run_client ./append.x
+fi
+
+if [ "$1" == "xlate" ]; then
+    run_client ./xlate.x
+fi
+
+if [ "$1" == "extents" ]; then
+    run_client ./extents.x
+fi
+
+if [ "$1" == "filter" ]; then
+    run_client ./filter.x
+fi
+
+if [ "$1" == "openall" ]; then
+    run_client ./openall.x
+fi
+
+# Needs the server started with -k on this host, or USE_EMBED=1
+if [ "$1" == "crc" ]; then
+    export SHMEM_IO_SERVER_CRC=1
+    run_client ./crc.x
+fi
+
+# Needs the server started with -z on this host, or USE_EMBED=1
+if [ "$1" == "lz" ]; then
+    export SHMEM_IO_SERVER_LZ=1
+    run_client ./lz.x
+fi
+
+if [ "$1" == "parity" ]; then
+    run_client ./parity.x
+fi
+
+if [ "$1" == "kv" ]; then
+    run_client ./kv.x
+fi
+
 if [ "$1" == "connect" ]; then
     run_client ./connect.x
 fi
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+/*
+ * Cost of fspace address translation as the number of open files grows.
+ * Each pe opens more and more small files, and after each step times
+ * small puts to one file, then puts walking over all the open files
+ */
+
+#include <shmem.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "timer.h"
+
+#define MAX_FILES 256
+#define NOPS      (1<<16)
+
+const size_t fsize = 4096;
+
+static shmem_fp_t *fps[MAX_FILES];
+
+double time_puts(int nfiles, int walk)
+{
+  my_timer_t timer;
+  long val = 0;
+
+  timer_reset(&timer);
+  timer_start(&timer);
+
+  for (int idx = 0; idx < NOPS; idx++) {
+    shmem_fp_t *fp = fps[walk ? (idx % nfiles) : (nfiles - 1)];
+    const size_t off = (idx * sizeof(long)) % fsize;
+    shmem_long_put_nbi((long*)((char*)fp->addr + off), &val, 1, fp->pe_start);
+    val++;
+  }
+  shmem_quiet();
+
+  timer_stop(&timer);
+  return timer.tot_seconds * 1e9 / NOPS;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    printf ("Usage: %s HOST PORT\n", argv[0]);
+    return 1;
+  }
+
+  shmem_fspace_conx_t conx;
+  conx.storage_server_name = argv[1];
+  conx.storage_server_port = atoi(argv[2]);
+
+  shmem_init();
+
+  const int me = shmem_my_pe ();
+
+  shmem_fspace_t fid = shmem_connect(&conx);
+  if (fid == SHMEM_NULL_FSPACE) {
+    printf ("xlate: connect failed\n");
+    shmem_finalize();
+    return 1;
+  }
+
+  if (me == 0) {
+    printf ("files,\tns/put one file,\tns/put all files\n");
+  }
+
+  int nfiles = 0;
+  for (int step = 1; step <= MAX_FILES; step <<= 1) {
+    for (; nfiles < step; nfiles++) {
+      char fname[256];
+      int err;
+      snprintf(fname, sizeof(fname), "/tmp/shmemio_xlate_%d_%d", me, nfiles);
+
+      fps[nfiles] = shmem_open(fid, fname, fsize, -1, -1, 1, -1, &err);
+      if (fps[nfiles] == NULL) {
+	printf ("%d: Failed to open file %s. Error code is %d\n", me, fname, err);
+	goto done;
+      }
+    }
+
+    const double one = time_puts(nfiles, 0);
+    const double all = time_puts(nfiles, 1);
+
+    if (me == 0) {
+      printf ("%d,\t%.1f,\t%.1f\n", nfiles, one, all);
+    }
+  }
+
+ done:
+  for (int idx = 0; idx < nfiles; idx++) {
+    shmem_close(fps[idx], 0);
+  }
+
+  shmem_disconnect(fid);
+  shmem_barrier_all();
+  shmem_finalize();
+  return 0;
+}
@@ -17,28 +17,125 @@ extern "C"
 
   int shmem_disconnect(shmem_fspace_t fspace);
 
+  shmem_fspace_t shmem_connect_all(shmem_fspace_conx_t *conx,
+				   int PE_start, int logPE_stride, int PE_size);
+
+  int shmem_disconnect_all(shmem_fspace_t fspace, int PE_start, int logPE_stride, int PE_size);
+
   int shmem_fspace_stat(shmem_fspace_t fspace, shmem_fspace_stat_t *stat);
 
 
   
   shmem_fp_t *shmem_open(shmem_fspace_t fspace, const char *file, size_t fsize,
 			 int pe_start, int pe_stride, int pe_size, int unit_size, int *err);
+
+  shmem_fp_t *shmem_open_attr(shmem_fspace_t fspace, const char *file, size_t fsize,
+			      int pe_start, int pe_stride, int pe_size, int unit_size,
+			      const shmem_fopen_attr_t *attr, int *err);
+
+  int shmem_open_nb(shmem_fspace_t fspace, const char *file, size_t fsize,
+		    int pe_start, int pe_stride, int pe_size, int unit_size,
+		    shmem_fp_t **fp, shmem_fio_t *handle);
+
+  int shmem_open_attr_nb(shmem_fspace_t fspace, const char *file, size_t fsize,
+			 int pe_start, int pe_stride, int pe_size, int unit_size,
+			 const shmem_fopen_attr_t *attr, shmem_fp_t **fp, shmem_fio_t *handle);
+
+  shmem_fp_t *shmem_open_all(shmem_fspace_t fspace, const char *file, size_t fsize,
+			     int pe_start, int pe_stride, int pe_size, int unit_size,
+			     int PE_start, int logPE_stride, int PE_size, int *err);
+
+  int shmem_close_all(shmem_fp_t *fp, int ioflags, int PE_start, int logPE_stride, int PE_size);
   
 
   int shmem_fp_stat(shmem_fp_t *fp);
   
   int shmem_fextend(shmem_fp_t *fp, size_t bytes);
 
+  int shmem_fextend_nb(shmem_fp_t *fp, size_t bytes, shmem_fio_t *handle);
+
   int shmem_ftrunc(shmem_fp_t *fp, size_t bytes, int ioflags);
 
   int shmem_close (shmem_fp_t *fp, int ioflags);
 
+  int shmem_close_nb(shmem_fp_t *fp, int ioflags, shmem_fio_t *handle);
+
+  ssize_t shmem_fp_append(shmem_fp_t *fp, const void *buf, size_t len);
+
+  ssize_t shmem_fp_write(shmem_fp_t *fp, size_t offset, const void *buf, size_t len);
+
+  ssize_t shmem_fp_read(shmem_fp_t *fp, size_t offset, void *buf, size_t len);
+
+  int shmem_fp_write_nbi(shmem_fp_t *fp, size_t offset, const void *buf, size_t len);
+
+  ssize_t shmem_fp_read_nbi(shmem_fp_t *fp, size_t offset, void *buf, size_t len);
+
+  void *shmem_fp_ptr(shmem_fp_t *fp, size_t offset, size_t *len);
+
+  int shmem_fp_prefetch(shmem_fp_t *fp, size_t offset, size_t len, shmem_prefetch_t *handle);
+
+  int shmem_fp_prefetch_buf(shmem_fp_t *fp, size_t offset, size_t len, void *buf,
+			    shmem_prefetch_t *handle);
+
+  int shmem_prefetch_test(shmem_prefetch_t handle);
+
+  void *shmem_prefetch_wait(shmem_prefetch_t handle);
+
+  void shmem_prefetch_release(shmem_prefetch_t handle);
+
   
 
   int shmem_fp_flush(shmem_fp_t *fp, int ioflags);
 
+  int shmem_fp_flush_nb(shmem_fp_t *fp, int ioflags, shmem_fio_t *handle);
+
+  int shmem_fp_put_persist(shmem_fp_t *fp, size_t offset, const void *src, size_t len);
+
+  int shmem_fp_put_persist_nbi(shmem_fp_t *fp, size_t offset, const void *src, size_t len);
+
+  int shmem_fp_persist_quiet(shmem_fp_t *fp);
+
+  int shmem_fsnapshot(shmem_fp_t *fp, const char *name);
+
+  int shmem_fp_rebuild(shmem_fp_t *fp, int pe_index, int ioflags);
+
+  ssize_t shmem_fp_filter(shmem_fp_t *fp, const shmem_filter_t *filt, size_t *start,
+			  void *buf, size_t max);
+
+  shmemx_kv_t shmemx_kv_open(shmem_fspace_t fspace, const char *file,
+			     const shmemx_kv_attr_t *attr, int pe_start, int pe_stride,
+			     int pe_size, int unit_size, int *err);
+
+  int shmemx_kv_close(shmemx_kv_t kv, int ioflags);
+
+  int shmemx_kv_flush(shmemx_kv_t kv, int ioflags);
+
+  int shmemx_kv_get(shmemx_kv_t kv, const void *key, void *value);
+
+  int shmemx_kv_put(shmemx_kv_t kv, const void *key, const void *value);
+
+  int shmemx_kv_delete(shmemx_kv_t kv, const void *key);
+
+  int shmemx_kv_mget(shmemx_kv_t kv, int n, const void *keys, void *values, int *status);
+
+  int shmemx_kv_mput(shmemx_kv_t kv, int n, const void *keys, const void *values, int *status);
+
+  void shmem_fp_invalidate(shmem_fp_t *fp);
+
   void shmem_fspace_flush(shmem_fspace_t fspace, int ioflags);
 
+  int shmem_fspace_flush_nb(shmem_fspace_t fspace, int ioflags, shmem_fio_t *handle);
+
+  int shmem_fio_test(shmem_fio_t *handle, int *status);
+
+  int shmem_fio_wait(shmem_fio_t *handle);
+
+  int shmem_fio_waitall(int n, shmem_fio_t *handles);
+
+  void shmem_wc_stat(shmem_wc_stat_t *stat);
+
+  void shmem_wc_stat_reset(void);
+
   void shmem_strerror(int errnum, char *strbuf);
 
   void shmemio_set_loglvl(char *lvl);
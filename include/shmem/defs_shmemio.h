@@ -15,6 +15,29 @@
 #define SHMEM_IO_WAIT              0x8
 #define SHMEM_IO_RELOC             0x10
 
+// flags for file open attributes
+#define SHMEM_FOPEN_REPLICATE      0x1
+#define SHMEM_FOPEN_REPLICA_LOAD   0x2
+#define SHMEM_FOPEN_APPEND_LOG     0x4
+#define SHMEM_FOPEN_CACHE          0x8
+#define SHMEM_FOPEN_READAHEAD      0x10
+#define SHMEM_FOPEN_EXTENTS        0x20
+#define SHMEM_FOPEN_PARITY         0x40
+#define SHMEM_FOPEN_RESERVE        0x80
+
+// field types and flags for shmem_fp_filter
+#define SHMEM_FILTER_INT32         1
+#define SHMEM_FILTER_INT64         2
+#define SHMEM_FILTER_UINT32        3
+#define SHMEM_FILTER_UINT64        4
+#define SHMEM_FILTER_FLOAT         5
+#define SHMEM_FILTER_DOUBLE        6
+
+#define SHMEM_FILTER_INDEX         0x1
+
+// server request classes reported by shmem_fspace_stat
+#define SHMEM_FSPACE_NCLASSES      3
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -43,8 +66,31 @@ extern "C"
     time_t atime; //time of last file open
     time_t mtime; //time of last ftrunc or fextend
     time_t ftime; //time of last flush
+
+    size_t capacity; //bytes reserved for the file, size can grow to it cheaply
   } shmem_fp_t;
 
+  typedef struct shmem_fopen_attr_s {
+    int flags;     //SHMEM_FOPEN_* flags
+    int nreplicas; //copies to keep with SHMEM_FOPEN_REPLICATE, the file is then read-only
+    size_t reserve; //bytes to reserve up front with SHMEM_FOPEN_RESERVE
+  } shmem_fopen_attr_t;
+
+  //Signed types use i, unsigned types u, and floating types d
+  typedef union shmem_filter_val_u {
+    int64_t i;
+    uint64_t u;
+    double d;
+  } shmem_filter_val_t;
+
+  typedef struct shmem_filter_s {
+    size_t rec_size;     //the file is an array of records of this size
+    size_t field_offset; //offset in a record of the field tested
+    int type;            //SHMEM_FILTER_* type of the field
+    int flags;           //SHMEM_FILTER_INDEX for record indices, not records
+    shmem_filter_val_t lo, hi; //records with lo <= field <= hi match
+  } shmem_filter_t;
+
   typedef struct shmem_fspace_stat_s {
     int pe_start;
     int pe_size;
@@ -54,7 +100,54 @@ extern "C"
     
     size_t used_size;
     size_t free_size;
+
+    size_t hole_size;          //free bytes stuck between files
+    int empty_regions;         //regions with no files, reused for new ones
+    unsigned long compact_moves;
+
+    //per server request class: lookups, file requests, bulk fspace work
+    unsigned long nreqs[SHMEM_FSPACE_NCLASSES];
+    unsigned long lat_p50[SHMEM_FSPACE_NCLASSES]; //wait plus service, usecs
+    unsigned long lat_p99[SHMEM_FSPACE_NCLASSES];
+    unsigned long lat_max[SHMEM_FSPACE_NCLASSES];
+
+    unsigned long crc_failures;  //backing file loads that failed checksums
+    unsigned long crc_mbps;      //checksum throughput, MB/s
+
+    unsigned long lz_ratio_x100; //backing file compression ratio, times 100
+    unsigned long lz_mbps;       //compression throughput, MB/s
+
+    unsigned long parity_mbps;   //parity XOR throughput, MB/s
+    unsigned long parity_overhead_pct; //parity time over data flush time, percent
+
+    unsigned long filter_mbps;     //filter scan throughput, MB/s
+    unsigned long filter_sent_pct; //filter bytes sent over bytes scanned, percent
   } shmem_fspace_stat_t;
+
+  typedef struct shmemio_prefetch_s *shmem_prefetch_t;
+
+  typedef struct shmemio_fio_req_s *shmem_fio_t;
+
+  typedef struct shmemio_kv_s *shmemx_kv_t;
+
+  typedef struct shmemx_kv_attr_s {
+    int create;        //format the file as a new, empty store
+    size_t nbuckets;
+    int slots;         //entries per bucket
+    int key_size;      //keys and values are fixed size
+    int value_size;
+    size_t noverflow;  //buckets for overflow chains, shared by all buckets
+  } shmemx_kv_attr_t;
+
+  typedef struct shmem_wc_stat_s {
+    size_t buffer_size;       //0 when write combining is off
+    size_t max_put;
+    unsigned long puts;       //puts taken into a buffer
+    unsigned long combined;   //puts that joined a buffered run
+    unsigned long bypassed;   //puts too big to buffer
+    unsigned long writes;     //puts issued to write out buffers
+    size_t put_bytes;
+  } shmem_wc_stat_t;
   
 #ifdef __cplusplus
 }
@@ -11,12 +11,184 @@
 
 #include "shmemio.h"
 #include "shmemio_client.h"
+#include "shmemio_client_stripe.h"
 
 #include "shmemio_test_util.h"
 #include "shmemio_stream_util.h"
 
+#include "allocator/memalloc.h"
+
 #include <string.h>    /* memset */
 #include <stdlib.h>    /* atoi */
+#include <stddef.h>    /* offsetof */
+
+/*
+ * Collective opens and connects. The root pe talks to the server and
+ * broadcasts a header with the response, then what it got back, fspace
+ * descriptors and regions with their packed rkeys, so the other pes need
+ * not ask the server. The packed data is only broadcast if there is any,
+ * and only as many bytes as were packed. Lives in symmetric memory
+ */
+#define SHMEMIO_OPEN_ALL_BUF 8192
+
+typedef struct shmemio_open_all_hdr_s {
+  int status;
+  int rstart, rmax;       // packed regions, none if rstart == rmax
+  size_t len;             // packed bytes
+  shmemio_req_t req;      // fopen response
+} shmemio_open_all_hdr_t;
+
+typedef struct shmemio_open_all_s {
+  long bcast_sync[2][SHMEM_BCAST_SYNC_SIZE];  // header, data
+  long barrier_sync[SHMEM_BARRIER_SYNC_SIZE];
+
+  /* root fills in the sources, the other pes get the copies */
+  shmemio_open_all_hdr_t src_hdr, hdr;
+  uint64_t src_data[SHMEMIO_OPEN_ALL_BUF / 8];
+  uint64_t data[SHMEMIO_OPEN_ALL_BUF / 8];
+} shmemio_open_all_t;
+
+#define SHMEMIO_OPEN_ALL_HDR_NELEMS ((sizeof(shmemio_open_all_hdr_t) + 7) / 8)
+
+static inline void
+shmemio_init_open_all()
+{
+  shmemio_open_all_t *oa = (shmemio_open_all_t*)shmema_malloc(sizeof(shmemio_open_all_t));
+  shmemio_assert(oa != NULL, "Failed to allocate collective open buffer\n");
+
+  for (int idx = 0; idx < SHMEM_BCAST_SYNC_SIZE; idx++) {
+    oa->bcast_sync[0][idx] = SHMEM_SYNC_VALUE;
+    oa->bcast_sync[1][idx] = SHMEM_SYNC_VALUE;
+  }
+  for (int idx = 0; idx < SHMEM_BARRIER_SYNC_SIZE; idx++) {
+    oa->barrier_sync[idx] = SHMEM_SYNC_VALUE;
+  }
+
+  proc.io.open_all = oa;
+}
+
+/*
+ * Broadcast len bytes of buf from the root of the active set, a piece of
+ * the symmetric collective buffer at a time
+ */
+static void
+coll_bcast_bytes(char *buf, size_t len, int PE_start, int logPE_stride, int PE_size)
+{
+  shmemio_open_all_t *oa = proc.io.open_all;
+
+  for (size_t done = 0; done < len; done += SHMEMIO_OPEN_ALL_BUF) {
+    const size_t n = ((len - done) < SHMEMIO_OPEN_ALL_BUF) ? (len - done) : SHMEMIO_OPEN_ALL_BUF;
+
+    if (proc.rank == PE_start) {
+      memcpy(oa->src_data, buf + done, n);
+    }
+    shmem_broadcast64(oa->data, oa->src_data, (n + 7) / 8,
+		      0, PE_start, logPE_stride, PE_size, oa->bcast_sync[1]);
+    if ((proc.rank != PE_start) && (buf != NULL)) {
+      memcpy(buf + done, oa->data, n);
+    }
+    shmem_barrier(PE_start, logPE_stride, PE_size, oa->barrier_sync);
+  }
+}
+
+/*
+ * Write combining of small puts to file pes is off unless
+ * SHMEM_IO_WC_SIZE gives a buffer size. Puts bigger than
+ * SHMEM_IO_WC_MAX_PUT, a quarter of the buffer by default, go direct
+ */
+static inline void
+shmemio_init_wc(shmemio_wc_t *wc)
+{
+  memset(wc, 0, sizeof(shmemio_wc_t));
+
+  char *e = getenv("SHMEM_IO_WC_SIZE");
+  if ((e == NULL) || (shmemu_parse_size(e, &wc->size) != 0)) {
+    wc->size = 0;
+    return;
+  }
+
+  wc->max_put = wc->size / 4;
+  e = getenv("SHMEM_IO_WC_MAX_PUT");
+  if ((e != NULL) && (shmemu_parse_size(e, &wc->max_put) != 0)) {
+    shmemio_log(warn, "Ignoring bad SHMEM_IO_WC_MAX_PUT \"%s\"\n", e);
+    wc->max_put = wc->size / 4;
+  }
+  if (wc->max_put > wc->size) {
+    wc->max_put = wc->size;
+  }
+
+  shmemio_log(info, "Write combining on, %lu byte buffers, puts up to %lu bytes\n",
+	      (long unsigned)wc->size, (long unsigned)wc->max_put);
+}
+
+/*
+ * A stat this pe got may be reused for SHMEM_IO_STAT_LEASE microseconds,
+ * unless this pe resizes the file. Changes made by others show up when
+ * the lease runs out. Off by default
+ */
+static inline void
+shmemio_init_stat_lease()
+{
+  proc.io.stat_lease = 0;
+
+  char *e = getenv("SHMEM_IO_STAT_LEASE");
+  if (e != NULL) {
+    const long usec = atol(e);
+    proc.io.stat_lease = (usec > 0) ? ((uint64_t)usec * 1000) : 0;
+  }
+}
+
+/*
+ * Free the write combine buffers of a context
+ */
+void
+shmemio_wc_release(shmemc_context_h ch)
+{
+  for (int idx = 0; idx < ch->io_nwc; idx++) {
+    free(ch->io_wc[idx].data);
+  }
+  free(ch->io_wc);
+  ch->io_wc = NULL;
+  ch->io_nwc = 0;
+}
+
+static inline void
+shmemio_finalize_wc()
+{
+  shmemio_wc_release((shmemc_context_h)SHMEM_CTX_DEFAULT);
+  for (size_t idx = 0; idx < proc.comms.nctxts; idx++) {
+    if (proc.comms.ctxts[idx] != NULL) {
+      shmemio_wc_release(proc.comms.ctxts[idx]);
+    }
+  }
+}
+
+/*
+ * Get the write combine buffer of a context for a file pe, growing the
+ * context's buffer table as new fpes are used
+ */
+shmemio_wc_buf_t *
+shmemio_wc_get_buf(shmemc_context_h ch, int fpe_idx)
+{
+  if (fpe_idx >= ch->io_nwc) {
+    const int nbufs = (fpe_idx < proc.io.nfpes) ? proc.io.nfpes : (fpe_idx + 1);
+    shmemio_wc_buf_t *bufs = realloc(ch->io_wc, nbufs * sizeof(shmemio_wc_buf_t));
+    shmemio_log_ret_if(error, NULL, bufs == NULL,
+		       "Failed to grow write combine buffers to %d\n", nbufs);
+
+    memset(&bufs[ch->io_nwc], 0, (nbufs - ch->io_nwc) * sizeof(shmemio_wc_buf_t));
+    ch->io_wc = bufs;
+    ch->io_nwc = nbufs;
+  }
+
+  shmemio_wc_buf_t *buf = &(ch->io_wc[fpe_idx]);
+  if (buf->data == NULL) {
+    buf->data = malloc(proc.io.wc.size);
+    shmemio_log_ret_if(error, NULL, buf->data == NULL,
+		       "Failed to allocate write combine buffer for fpe %d\n", fpe_idx);
+  }
+  return buf;
+}
 
 /*
  * Initialize shmem process to be a client for shmemio API
@@ -32,6 +204,13 @@ shmemio_init_client()
   proc.io.nfspaces = 0;
   proc.io.fspaces = NULL;
 
+  shmemio_init_wc(&proc.io.wc);
+  shmemio_init_stat_lease();
+  shmemio_cache_init();
+  proc.io.nprefetch_fps = 0;
+  shmemio_init_open_all();
+  shmemio_embed_init();
+
 #ifdef ENABLE_DEBUG
   proc.io.fp_active_list = NULL;
   shmemio_set_log_level(warn);
@@ -100,11 +279,17 @@ shmemio_get_new_fp() {
  */
 static inline void
 shmemio_fp_release(shmemio_fp_t *fp) {
+
+  if (fp->cached) {
+    shmemio_cache_remove_fp(fp);
+  }
+  shmemio_prefetch_fp_release(fp);
   
 #ifdef ENABLE_DEBUG
   shmemio_fp_active_list_remove(fp);
 #endif
 
+  free(fp->extents);
   free(fp);
 }
 
@@ -130,6 +315,10 @@ shmemio_finalize_client()
     free(proc.io.fpes);
   proc.io.nfpes = 0;
 
+  shmemio_finalize_wc();
+  shmemio_cache_finalize();
+  shmemio_embed_finalize();
+
 #ifdef ENABLE_DEBUG
   while(proc.io.fp_active_list != NULL) {
     shmemio_fp_t *fp = proc.io.fp_active_list;
@@ -176,6 +365,22 @@ fp_to_fspace(const shmem_fp_t *fp)
   return &(proc.io.fspaces[((shmemio_fp_t*)fp)->fspace]);
 }
 
+/*
+ * Pes other than the root of a shmem_open_all are not openers of the
+ * file on the server, so only the root sends requests for it
+ */
+inline static int
+fp_coll_peer(const shmem_fp_t *fp)
+{
+  const int root = ((const shmemio_fp_t*)fp)->coll_root;
+  return ((root >= 0) && (root != proc.rank));
+}
+
+#define fp_server_check(_fp_)						\
+  shmemio_log_ret_if(error, shmemio_err_coll_root, fp_coll_peer(_fp_),	\
+		     "File was opened by pe %d with shmem_open_all, only it sends requests\n", \
+		     ((shmemio_fp_t*)(_fp_))->coll_root)
+
 /*
  * Initialize a file operation request object to send to fspace server
  */
@@ -188,6 +393,7 @@ init_fpreq(shmemio_req_t *req, shmem_fp_t *fp, int ioflags)
   shmemio_fp_req_t *fpreq = (shmemio_fp_req_t*)req->payload;
   
   fpreq->offset = fpio->offset;
+  fpreq->capacity = fpio->capacity;
   fpreq->size = fpio->size;
   fpreq->fkey = fpio->fkey;
   fpreq->ioflags = ioflags;
@@ -203,15 +409,41 @@ init_fpreq(shmemio_req_t *req, shmem_fp_t *fp, int ioflags)
 inline static int
 sendrecv_req(shmemio_req_t *req, shmemio_fspace_t *fio)
 {
-  int ret = shmemio_streamsend(fio->ch->w, fio->req_ep, req, sizeof(shmemio_req_t));
+  int ret = shmemio_fio_send(fio, req);
   shmemio_log_ret_if(error, -1, ret < 0,
 		     "Failed to send request type %d\n", req->type);
 
-  ret = shmemio_streamrecv(fio->ch->w, fio->req_ep, req, sizeof(shmemio_req_t));
+  ret = shmemio_fio_recv(fio, req);
   shmemio_log(trace, "Receive response to request type %d, status %d\n", req->type, req->status);
   
-  shmemio_log_ret_if(error, -1, ret != sizeof(shmemio_req_t),
+  shmemio_log_ret_if(error, -1, ret < 0,
 		     "Failed to recv response type %d\n", req->type);
+  return 0;
+}
+
+/*
+ * Complete this pe's puts on the default context and on every user
+ * context, pushing out their write combine buffers. Under
+ * SHMEM_THREAD_MULTIPLE private contexts of other threads are left to
+ * their owners, nothing is write combined then
+ */
+static void
+shmemio_quiet_all_ctxs()
+{
+  const threadwrap_thread_t me = threadwrap_thread_id();
+  
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  for (size_t c = 0; c < proc.comms.nctxts; c++) {
+    shmemc_context_h ch = proc.comms.ctxts[c];
+
+    if ( (ch == NULL) ||
+	 ( (proc.td.osh_tl == SHMEM_THREAD_MULTIPLE) && ch->attr.private &&
+	   !threadwrap_thread_equal(ch->creator_thread, me) ) ) {
+      continue;
+    }
+    shmemc_ctx_quiet((shmem_ctx_t)ch);
+  }
 }
 
 
@@ -238,13 +470,46 @@ client_fpe_to_remote_region(const shmemio_client_region_t *l_reg, int fpe)
 inline static shmemio_client_region_t *
 fspace_addr_to_client_region(const shmemio_fspace_t* fio, uint64_t addr)
 {
-  for (int idx = 0; idx < fio->nregions; idx++) {
-    if (in_fpe_region(addr, &(fio->l_regions[idx])))
-      return &(fio->l_regions[idx]);
+  int lo = 0;
+  int hi = fio->nsorted - 1;
+
+  while (lo <= hi) {
+    const int mid = (lo + hi) >> 1;
+    shmemio_client_region_t *l_reg = &(fio->l_regions[fio->rsorted[mid]]);
+    
+    if (addr < l_reg->l_base)
+      hi = mid - 1;
+    else if (addr >= l_reg->l_end)
+      lo = mid + 1;
+    else
+      return l_reg;
   }
   return NULL;
 }
 
+/*
+ * Same, trying first the region this context last translated in. Puts
+ * and gets mostly walk the same file
+ */
+inline static shmemio_client_region_t *
+ctx_addr_to_client_region(shmemc_context_h ch, const shmemio_fspace_t *fio, uint64_t addr)
+{
+  const int fspace = fio - proc.io.fspaces;
+  
+  if ((ch->io_fspace == fspace) && (ch->io_region < fio->nregions)) {
+    shmemio_client_region_t *l_reg = &(fio->l_regions[ch->io_region]);
+    if (in_fpe_region(addr, l_reg))
+      return l_reg;
+  }
+
+  shmemio_client_region_t *l_reg = fspace_addr_to_client_region(fio, addr);
+  if (l_reg != NULL) {
+    ch->io_fspace = fspace;
+    ch->io_region = l_reg - fio->l_regions;
+  }
+  return l_reg;
+}
+
 /*
  * * * * * Translation functions for put/get * * * * *
  */
@@ -262,14 +527,43 @@ shmemio_addr_accessible(const void *addr, int pe)
   shmemio_valid_check(fio);
 
   // Check if this address maps to an existing client region on the fspace
-  return (fspace_addr_to_client_region(fio, (uint64_t)addr) >= 0);
+  return (fspace_addr_to_client_region(fio, (uint64_t)addr) != NULL);
 }
 
 /*
- * Lookup rkey and raddr in fspaces. Called when translate fails for heaps.
+ * Lookup rkey and raddr of an address on the primary copy of client region l_reg
  */
-void
-secondary_remote_key_and_addr(uint64_t local_addr, int pe,
+static inline int
+primary_remote_key_and_addr(const shmemio_fspace_t *fio, const shmemio_client_region_t *l_reg,
+			    uint64_t local_addr, int pe, ucp_rkey_h *rkey_p, uint64_t *raddr_p)
+{
+  // Find the remote region access for the indicate file pe
+  shmemio_remote_region_t *r_reg =
+    client_fpe_to_remote_region(l_reg, pe_to_fpe_index(pe));
+
+  if (fio->lazy) {
+    int ret = shmemio_fill_remote_region((shmemio_fspace_t*)fio, pe_to_fpe_index(pe), r_reg);
+    shmemio_log_ret_if(error, -1, ret != 0, "cannot access fpe %d of region %p\n",
+		       pe_to_fpe_index(pe), (void*)l_reg);
+  }
+
+  // Calculate offset and remote addr from local region and remote access
+  const uint64_t my_offset = local_addr - l_reg->l_base;
+  const uint64_t remote_addr = my_offset + r_reg->r_base;
+
+  // Use the remote access key and the calculated address
+  *rkey_p = r_reg->rkey;
+  *raddr_p = remote_addr;
+  return 0;
+}
+
+/*
+ * Lookup rkey and raddr in fspaces for puts and atomics. Called when
+ * translate fails for heaps. Replicated regions are read-only, so
+ * return -1 for those and for addresses in no region
+ */
+int
+secondary_remote_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int pe,
 			      ucp_rkey_h *rkey_p, uint64_t *raddr_p)
 {
   shmemio_pe_range_check(pe);
@@ -282,21 +576,251 @@ secondary_remote_key_and_addr(uint64_t local_addr, int pe,
 
   // Find the local client region for this address on this fspace
   const shmemio_client_region_t * l_reg =
-    fspace_addr_to_client_region(fio, local_addr);
+    ctx_addr_to_client_region(ch, fio, local_addr);
 
-  shmemio_assert(l_reg != NULL, "cannot find region for addr %p\n", local_addr);
+  shmemio_log_ret_if(error, -1, l_reg == NULL,
+		     "cannot find region for addr %p\n", (void*)local_addr);
 
-  // Find the remote region access for the indicate file pe
-  const shmemio_remote_region_t *r_reg =
-    client_fpe_to_remote_region(l_reg, pe_to_fpe_index(pe));
+  // Replicas are only synced from the primary at load
+  shmemio_log_ret_if(error, -1, l_reg->nreplicas > 0,
+		     "Region of addr %p is replicated and read-only\n", (void*)local_addr);
+
+  return primary_remote_key_and_addr(fio, l_reg, local_addr, pe, rkey_p, raddr_p);
+}
+
+/*
+ * Pick which copy of a replicated region serves a get, 0 is the primary
+ */
+static inline int
+client_region_pick_replica(shmemio_client_region_t *l_reg)
+{
+  const int ncopies = l_reg->nreplicas + 1;
+  int cdx = 0;
+
+  if (l_reg->rep_policy & SHMEM_FOPEN_REPLICA_LOAD) {
+    // Copy this pe has sent the fewest gets to
+    unsigned long min_hits = __atomic_load_n(&(l_reg->rep_hits[0]), __ATOMIC_RELAXED);
+    for (int idx = 1; idx < ncopies; idx++) {
+      const unsigned long hits = __atomic_load_n(&(l_reg->rep_hits[idx]), __ATOMIC_RELAXED);
+      if (hits < min_hits) {
+	min_hits = hits;
+	cdx = idx;
+      }
+    }
+  }
+  else {
+    cdx = proc.rank % ncopies;
+  }
+
+  // Counts are only a balancing hint, but threads may share them
+  __atomic_add_fetch(&(l_reg->rep_hits[cdx]), 1, __ATOMIC_RELAXED);
+  return cdx;
+}
+
+/*
+ * Lookup rkey and raddr for a get in fspaces. Reads of a replicated
+ * region may be sent to a replica on another pe, so pe can change.
+ * Return -1 if address is in no region
+ */
+int
+secondary_remote_read_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int *pe_p,
+				   ucp_rkey_h *rkey_p, uint64_t *raddr_p)
+{
+  const int pe = *pe_p;
+  shmemio_pe_range_check(pe);
+  const shmemio_client_fpe_t *fpe = pe_to_fpe(pe);
+  shmemio_valid_check(fpe);
+  const shmemio_fspace_t *fio = fpe_to_fspace(fpe);
+  shmemio_valid_check(fio);
+
+  shmemio_client_region_t * l_reg =
+    ctx_addr_to_client_region(ch, fio, local_addr);
+
+  shmemio_log_ret_if(error, -1, l_reg == NULL,
+		     "cannot find region for addr %p\n", (void*)local_addr);
+
+  const int cdx = (l_reg->nreplicas > 0) ? client_region_pick_replica(l_reg) : 0;
+
+  if (cdx == 0) {
+    return primary_remote_key_and_addr(fio, l_reg, local_addr, pe, rkey_p, raddr_p);
+  }
+
+  // Same index into the replica fpe set as into the primary fpe set
+  const shmemio_client_region_t *rep = &(fio->l_regions[l_reg->replicas[cdx - 1]]);
+  const int rdx = (pe_to_fpe_index(pe) - l_reg->fpe_start) / l_reg->fpe_stride;
+  const int rfpe = rep->fpe_start + (rdx * rep->fpe_stride);
+  shmemio_remote_region_t *r_reg = &(rep->r_regions[rdx]);
+
+  if (fio->lazy) {
+    int ret = shmemio_fill_remote_region((shmemio_fspace_t*)fio, rfpe, r_reg);
+    shmemio_log_ret_if(error, -1, ret != 0, "cannot access replica fpe %d\n", rfpe);
+  }
 
-  // Calculate offset and remote addr from local region and remote access
   const uint64_t my_offset = local_addr - l_reg->l_base;
-  const uint64_t remote_addr = my_offset + r_reg->r_base;
 
-  // Use the remote access key and the calculated address
+  *pe_p = fpe_to_pe_index(rfpe);
   *rkey_p = r_reg->rkey;
-  *raddr_p = remote_addr;
+  *raddr_p = my_offset + r_reg->r_base;
+  return 0;
+}
+
+/*
+ * Direct pointer to an fspace address on a file pe, for shmem_ptr and
+ * shmem_fp_ptr. Fpes of a server embedded in this pe are in this address
+ * space, others only if ucx can map their rkey. NULL if neither
+ */
+void *
+shmemio_addr_ptr(shmemc_context_h ch, uint64_t local_addr, int pe)
+{
+  const int fdx = pe_to_fpe_index(pe);
+  if ((fdx < 0) || (fdx >= proc.io.nfpes) || !proc.io.fpes[fdx].valid) {
+    return NULL;
+  }
+
+  shmemio_client_fpe_t *fpe = &(proc.io.fpes[fdx]);
+  shmemio_client_region_t *l_reg = ctx_addr_to_client_region(ch, fpe->fspace, local_addr);
+  if (l_reg == NULL) {
+    return NULL;
+  }
+
+  const int rdx = (fdx - l_reg->fpe_start) / l_reg->fpe_stride;
+  if ((fdx < l_reg->fpe_start) || (rdx >= l_reg->fpe_size) ||
+      (((fdx - l_reg->fpe_start) % l_reg->fpe_stride) != 0)) {
+    return NULL;
+  }
+
+  shmemio_remote_region_t *r_reg = &(l_reg->r_regions[rdx]);
+  const uint64_t remote_addr = (local_addr - l_reg->l_base) + r_reg->r_base;
+
+  if (fpe->local < 0) {
+    fpe->local = shmemio_embed_is_local(fpe->server_addr, fpe->server_addr_len);
+  }
+  if (fpe->local) {
+    return (void*)remote_addr;
+  }
+
+#ifdef HAVE_UCP_RKEY_PTR
+  if ((r_reg->rkey == NULL) &&
+      (shmemio_fill_remote_region(&(proc.io.fspaces[fpe->fspace]), fdx, r_reg) != 0)) {
+    return NULL;
+  }
+
+  void *usable_addr = NULL;
+  if (ucp_rkey_ptr(r_reg->rkey, remote_addr, &usable_addr) == UCS_OK) {
+    return usable_addr;
+  }
+#endif  /* HAVE_UCP_RKEY_PTR */
+
+  return NULL;
+}
+
+/*
+ * A flush of the file finished, with the response in req
+ */
+static inline void
+fp_flush_done(shmem_fp_t *fp, shmemio_req_t *req)
+{
+  update_fp_status(req, (shmemio_fp_req_t*)req->payload, fp);
+  shmem_fp_invalidate(fp);
+
+  //The whole file is flushed, no need to remember persist ranges
+  if (req->status == shmemio_success) {
+    ((shmemio_fp_t*)fp)->npersist = 0;
+  }
+}
+
+/*
+ * Finish calls for non-blocking file requests, run when the response is
+ * taken by shmem_fio_test or shmem_fio_wait. fp is NULL if the file was
+ * closed while the request was in flight
+ */
+static int
+fio_update_finish(shmemio_fio_req_t *fr)
+{
+  if (fr->fp != NULL) {
+    update_fp_status(&(fr->req), (shmemio_fp_req_t*)fr->req.payload, (shmem_fp_t*)fr->fp);
+  }
+  return fr->req.status;
+}
+
+static int
+fio_flush_finish(shmemio_fio_req_t *fr)
+{
+  if (fr->fp != NULL) {
+    fp_flush_done((shmem_fp_t*)fr->fp, &(fr->req));
+  }
+  return fr->req.status;
+}
+
+static int
+fio_close_finish(shmemio_fio_req_t *fr)
+{
+  shmemio_fp_t *fp = fr->fp;
+  if (fp != NULL) {
+    shmemio_fio_detach_fp(&(proc.io.fspaces[fr->fspace]), fp);
+    shmemio_fp_release(fp);
+  }
+  return fr->req.status;
+}
+
+static int
+fio_open_finish(shmemio_fio_req_t *fr)
+{
+  int err = shmemio_success;
+  
+  if (shmemio_client_fopen_finish(&(proc.io.fspaces[fr->fspace]), fr->fp, &(fr->req), &err) != 0) {
+    shmemio_log(error, "File open failed\n");
+    shmemio_fp_release(fr->fp);
+    *(fr->fp_out) = NULL;
+    return err;
+  }
+
+  shmemio_log_fp(info, fr->fp, "open file");
+  *(fr->fp_out) = (shmem_fp_t*)fr->fp;
+  return shmemio_success;
+}
+
+/*
+ * Start a file request that has no data after it
+ */
+static inline int
+fio_start_fp(shmem_fp_t *fp, shmemio_req_t *req, shmemio_fio_finish_t finish, shmem_fio_t *handle)
+{
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+  *handle = shmemio_fio_start(fpio->fspace, req, NULL, 0, fpio, finish);
+  return (*handle == NULL) ? shmemio_err_send : shmemio_success;
+}
+
+/*
+ * Make a new file pointer object for an open
+ */
+static inline shmemio_fp_t *
+fp_open_init(shmem_fspace_t fspace, size_t fsize,
+	     int pe_start, int pe_stride, int pe_size, int unit_size)
+{
+  shmemio_fp_t *fp = shmemio_get_new_fp();
+  shmemio_assert(fp != NULL, "Unable to allocate new file pointer object\n");
+
+  // Init the file pointer with the input parameters
+  fp->fspace = fspace;
+  fp->addr = NULL;
+  fp->size = fsize;
+  fp->capacity = fsize;
+  fp->unit_size = unit_size;
+  fp->pe_start = pe_start;
+  fp->pe_stride = pe_stride;
+  fp->pe_size = pe_size;
+  fp->npersist = 0;
+  fp->cached = 0;
+  fp->coll_root = -1;
+  fp->nextents = 0;
+  fp->extents = NULL;
+  fp->stat_region = -1;
+  fp->stat_slot = -1;
+  fp->stat_lease = 0;
+  shmemio_prefetch_fp_init(fp);
+
+  return fp;
 }
 
 /*
@@ -343,6 +867,95 @@ shmem_fspace_t shmem_connect(shmem_fspace_conx_t *conx)
   return SHMEM_NULL_FSPACE;
 }
 
+/*
+ * Client API: Connect all pes of the active set to a remote fspace. Only
+ * the first pe of the set, the root, connects to the server. The other
+ * pes get the fpe addresses and regions from a broadcast, and make fpe
+ * endpoints and unpack rkeys on first access. They can put and get to
+ * files opened with shmem_open_all, but only the root sends requests
+ */
+shmem_fspace_t shmem_connect_all(shmem_fspace_conx_t *conx,
+				 int PE_start, int logPE_stride, int PE_size)
+{
+  shmemio_open_all_t *oa = proc.io.open_all;
+  char *buf = NULL;
+
+  shmemio_log(info, "shmem_connect_all to %s:%d from pe %d\n",
+	      conx->storage_server_name, conx->storage_server_port, PE_start);
+
+  shmem_fspace_t fid_ret = shmemio_get_new_fspace();
+  shmemio_fspace_t *fio = (fid_ret == SHMEM_NULL_FSPACE) ? NULL : &(proc.io.fspaces[fid_ret]);
+
+  //The broadcast does not write the root's copy, the root uses its source
+  shmemio_open_all_hdr_t *hdr = (proc.rank == PE_start) ? &(oa->src_hdr) : &(oa->hdr);
+
+  if (proc.rank == PE_start) {
+    size_t len = 0;
+    hdr->status = shmemio_err_unknown;
+
+    if ((fio != NULL) &&
+	(shmemio_connect_fspace(conx, fid_ret) == 0) &&
+	(shmemio_fill_fspace(fid_ret) == 0) &&
+	((buf = shmemio_client_pack_fspace(fio, &len)) != NULL)) {
+      hdr->status = shmemio_success;
+      //Number of fpes and regions in the pack
+      hdr->rstart = fio->nfpes;
+      hdr->rmax = fio->nregions;
+      hdr->len = len;
+    }
+  }
+
+  //Header first, so the other pes know how much follows
+  shmem_broadcast64(&(oa->hdr), &(oa->src_hdr), SHMEMIO_OPEN_ALL_HDR_NELEMS,
+		    0, PE_start, logPE_stride, PE_size, oa->bcast_sync[0]);
+  shmem_barrier(PE_start, logPE_stride, PE_size, oa->barrier_sync);
+
+  const int status = hdr->status;
+  const int nfpes = hdr->rstart;
+  const int nregions = hdr->rmax;
+  const size_t len = hdr->len;
+
+  if (status != shmemio_success) {
+    shmemio_log(error, "Pe %d failed to connect for all\n", PE_start);
+    goto err_fspace;
+  }
+
+  if (proc.rank != PE_start) {
+    buf = (char*)malloc(len);
+  }
+
+  //Every pe takes part in the broadcast, even one that cannot keep the data
+  coll_bcast_bytes(buf, len, PE_start, logPE_stride, PE_size);
+
+  if (proc.rank != PE_start) {
+    if ((buf == NULL) && (len > 0)) {
+      shmemio_log(error, "Failed to allocate %lu bytes for fspace\n", (long unsigned)len);
+      goto err_fspace;
+    }
+    if (fio == NULL) {
+      shmemio_log(error, "failed to init new fspace %d\n", fid_ret);
+      goto err_fspace;
+    }
+
+    fio->lazy = 1;
+    if ((shmemio_client_unpack_fspace(fio, fid_ret, nfpes, nregions, buf, len) != 0) ||
+	(shmemio_fill_fspace(fid_ret) != 0)) {
+      shmemio_log(error, "failed to build fspace %d from pe %d\n", fid_ret, PE_start);
+      goto err_fspace;
+    }
+  }
+
+  free(buf);
+  return fid_ret;
+
+ err_fspace:
+  free(buf);
+  if (fio != NULL) {
+    shmemio_release_fspace(fid_ret);
+  }
+  return SHMEM_NULL_FSPACE;
+}
+
 /*
  * Client API: Disconnect from a file space
  */
@@ -353,11 +966,25 @@ int shmem_disconnect(shmem_fspace_t fspace)
   shmemio_fspace_range_check(fspace);
   shmemio_fspace_t *fio = &proc.io.fspaces[fspace];
   shmemio_valid_check(fio);
+
+  //No buffered puts may be left for fpes of this fspace, on any context
+  if (proc.io.wc.size > 0) {
+    shmemio_quiet_all_ctxs();
+  }
+  
+  //Pes of shmem_connect_all other than the root have no server connection
+  if (fio->req_ep == NULL) {
+    shmemio_release_fspace(fspace);
+    return shmemio_success;
+  }
+
+  //Take the responses to requests still in flight before going
+  shmemio_fio_drain(fio);
   
   shmemio_req_t req;
   req.type = shmemio_disco_req;
 
-  int ret = shmemio_streamsend(fio->ch->w, fio->req_ep, &req, sizeof(shmemio_req_t));
+  int ret = shmemio_fio_send(fio, &req);
   shmemio_log_ret_if(error, -1, ret < 0, "Failed to send disconnect request\n");
   
   shmemio_release_fspace(fspace);
@@ -366,29 +993,93 @@ int shmem_disconnect(shmem_fspace_t fspace)
 }
 
 /*
- * Client API: Get statistics for this file
+ * Client API: Disconnect all pes of the active set from an fspace made
+ * with shmem_connect_all, the root once every pe is done with it
+ */
+int shmem_disconnect_all(shmem_fspace_t fspace, int PE_start, int logPE_stride, int PE_size)
+{
+  shmemio_quiet_all_ctxs();
+  shmem_barrier(PE_start, logPE_stride, PE_size, proc.io.open_all->barrier_sync);
+
+  return shmem_disconnect(fspace);
+}
+
+#define SHMEMIO_STAT_TRIES 16
+
+static inline void
+fp_set_stat(shmem_fp_t *fp, const shmemio_fp_stat_t *fstat)
+{
+  fp->size = fstat->size;
+  memcpy(&fp->ctime, &(fstat->ctime), sizeof(time_t));
+  memcpy(&fp->atime, &(fstat->atime), sizeof(time_t));
+  memcpy(&fp->mtime, &(fstat->mtime), sizeof(time_t));
+  memcpy(&fp->ftime, &(fstat->ftime), sizeof(time_t));
+  fp->capacity = fstat->capacity;
+}
+
+/*
+ * Get the stat the server publishes for the file in one get. Returns
+ * nonzero if it keeps changing under the get
+ */
+static inline int
+fp_get_stat_slot(shmemio_fp_t *fp)
+{
+  const shmemio_fspace_t *fio = &(proc.io.fspaces[fp->fspace]);
+  const shmemio_client_region_t *reg = &(fio->l_regions[fp->stat_region]);
+  const shmemio_stat_slot_t *src = ((const shmemio_stat_slot_t*)reg->l_base) + fp->stat_slot;
+  const int pe = fpe_to_pe_index(reg->fpe_start);
+  shmemio_stat_slot_t slot;
+
+  for (int tries = 0; tries < SHMEMIO_STAT_TRIES; tries++) {
+    shmemc_ctx_get(SHMEM_CTX_DEFAULT, &slot, src, sizeof(shmemio_stat_slot_t), pe);
+    if (slot.ver == slot.ver_end) {
+      fp_set_stat((shmem_fp_t*)fp, &(slot.stat));
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Client API: Get statistics for this file. Where the server publishes
+ * them, they are read with one get, or reused under a lease
  */
 int shmem_fp_stat(shmem_fp_t *fp)
 {
+  fp_server_check(fp);
+
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+  if (fpio->stat_slot >= 0) {
+    const uint64_t now = (proc.io.stat_lease > 0) ? shmemio_nsec() : 0;
+
+    if (now < fpio->stat_lease) {
+      return shmemio_success;
+    }
+    if (fp_get_stat_slot(fpio) == 0) {
+      fpio->stat_lease = (proc.io.stat_lease > 0) ? (now + proc.io.stat_lease) : 0;
+      shmemio_log_fp(trace, fpio, "fstat got");
+      return shmemio_success;
+    }
+  }
+
   shmemio_req_t req;
   shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, 0);
   req.type = shmemio_fp_stat_req;
   
   shmemio_fspace_t *fio = fp_to_fspace(fp);
   shmemio_fp_stat_t fstat;
+
+  //Stat reply is not a response, nothing else may be in flight
+  shmemio_fio_drain(fio);
   
-  int ret = shmemio_streamsend(fio->ch->w, fio->req_ep, &req, sizeof(shmemio_req_t));
+  int ret = shmemio_fio_send(fio, &req);
   shmemio_log_ret_if(error, -1, ret < 0, "Failed to send stat request\n");
 
   ret = shmemio_streamrecv(fio->ch->w, fio->req_ep, &fstat, sizeof(shmemio_fp_stat_t));
   shmemio_log_ret_if(error, -1, ret != sizeof(shmemio_fp_stat_t),
 		     "Failed to recv fstat\n")
 
-  fp->size = fstat.size;
-  memcpy(&fp->ctime, &(fstat.ctime), sizeof(time_t));
-  memcpy(&fp->atime, &(fstat.atime), sizeof(time_t));
-  memcpy(&fp->mtime, &(fstat.mtime), sizeof(time_t));
-  memcpy(&fp->ftime, &(fstat.ftime), sizeof(time_t));
+  fp_set_stat(fp, &fstat);
 
   shmemio_log_fp(info, ((shmemio_fp_t*)fp), "fstat returned");
   
@@ -400,6 +1091,8 @@ int shmem_fp_stat(shmem_fp_t *fp)
  */
 int shmem_fextend(shmem_fp_t *fp, size_t bytes)
 {
+  fp_server_check(fp);
+
   shmemio_req_t req;
   shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, 0);
   req.type = shmemio_fextend_req;
@@ -411,32 +1104,82 @@ int shmem_fextend(shmem_fp_t *fp, size_t bytes)
   return req.status;
 }
 
+/*
+ * Client API: Start extending this file, complete with shmem_fio_wait
+ */
+int shmem_fextend_nb(shmem_fp_t *fp, size_t bytes, shmem_fio_t *handle)
+{
+  *handle = NULL;
+  fp_server_check(fp);
+
+  shmemio_req_t req;
+  shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, 0);
+  req.type = shmemio_fextend_req;
+  fpreq->size = fp->size + bytes;
+
+  return fio_start_fp(fp, &req, fio_update_finish, handle);
+}
+
 /*
  * Client API: Flush this file to persistance
  */
 int shmem_fp_flush(shmem_fp_t *fp, int ioflags)
 {
+  fp_server_check(fp);
+
+  //Write combined puts on every context have to reach the file before
+  //it is flushed
+  if (proc.io.wc.size > 0) {
+    shmemio_quiet_all_ctxs();
+  }
+  
   shmemio_req_t req;
-  shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, ioflags);
+  init_fpreq(&req, fp, ioflags);
   req.type = shmemio_fp_flush_req;
 
   sendrecv_req(&req, fp_to_fspace(fp));
-  update_fp_status(&req, fpreq, fp);
+  fp_flush_done(fp, &req);
   
   return req.status;
 }
 
+/*
+ * Client API: Start a flush of this file. Puts to the file made before
+ * the call are flushed, complete with shmem_fio_wait
+ */
+int shmem_fp_flush_nb(shmem_fp_t *fp, int ioflags, shmem_fio_t *handle)
+{
+  *handle = NULL;
+  fp_server_check(fp);
+
+  //Write combined puts on every context have to reach the file before
+  //it is flushed
+  if (proc.io.wc.size > 0) {
+    shmemio_quiet_all_ctxs();
+  }
+  
+  shmemio_req_t req;
+  init_fpreq(&req, fp, ioflags);
+  req.type = shmemio_fp_flush_req;
+
+  return fio_start_fp(fp, &req, fio_flush_finish, handle);
+}
+
 /*
  * Client API: Truncate the file
  */
 int shmem_ftrunc(shmem_fp_t *fp, size_t bytes, int ioflags)
 {
+  fp_server_check(fp);
+
   shmemio_req_t req;
   shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, ioflags);
   req.type = shmemio_ftrunc_req;
   fpreq->size = bytes;
 
   sendrecv_req(&req, fp_to_fspace(fp));
+  update_fp_status(&req, fpreq, fp);
+  
   return req.status;
 }
 
@@ -446,17 +1189,518 @@ int shmem_ftrunc(shmem_fp_t *fp, size_t bytes, int ioflags)
 int shmem_close (shmem_fp_t *fp, int ioflags)
 {
   shmemio_log_fp(info, ((shmemio_fp_t*)fp), "close file");
+
+  //The file stays open on the server until the root closes it
+  if (fp_coll_peer(fp)) {
+    shmem_fp_invalidate(fp);
+    shmemio_prefetch_fp_release((shmemio_fp_t*)fp);
+    shmemio_fio_detach_fp(fp_to_fspace(fp), (shmemio_fp_t*)fp);
+    shmemio_fp_release((shmemio_fp_t*)fp);
+    return shmemio_success;
+  }
+
   shmemio_req_t req;
   shmemio_fp_req_t *fpreq = init_fpreq(&req, fp, ioflags);
   req.type = shmemio_fclose_req;
 
   sendrecv_req(&req, fp_to_fspace(fp));
   update_fp_status(&req, fpreq, fp);
+  shmemio_fio_detach_fp(fp_to_fspace(fp), (shmemio_fp_t*)fp);
   shmemio_fp_release((shmemio_fp_t*)fp);
   
   return req.status;
 }
 
+/*
+ * Client API: Start closing the file. The fp may not be used after the
+ * call, and is freed once the close completes with shmem_fio_wait
+ */
+int shmem_close_nb(shmem_fp_t *fp, int ioflags, shmem_fio_t *handle)
+{
+  if (fp_coll_peer(fp)) {
+    *handle = NULL;
+    return shmem_close(fp, ioflags);
+  }
+
+  shmemio_log_fp(info, ((shmemio_fp_t*)fp), "close file");
+  shmemio_req_t req;
+  init_fpreq(&req, fp, ioflags);
+  req.type = shmemio_fclose_req;
+
+  return fio_start_fp(fp, &req, fio_close_finish, handle);
+}
+
+
+/*
+ * Client API: Drop this pe's cached pages and prefetches of the file, so
+ * the next gets see puts made by other pes. Pages are dropped lazily by
+ * moving the file to a new epoch
+ */
+void shmem_fp_invalidate(shmem_fp_t *fp)
+{
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+  if (fpio->cached) {
+    shmemio_cache_new_epoch(fpio);
+  }
+  shmemio_prefetch_drop(fpio, 0, SIZE_MAX);
+}
+
+/*
+ * Client API: Make a named, read only snapshot of the file. The snapshot
+ * has this pe's puts to the file, and is opened by name with shmem_open
+ */
+int shmem_fsnapshot(shmem_fp_t *fp, const char *name)
+{
+  shmemio_log_ret_if(error, shmemio_err_invalid, (name == NULL) || (name[0] == '\0'),
+		     "Snapshot needs a name\n");
+  fp_server_check(fp);
+
+  shmemio_quiet_all_ctxs();
+  
+  shmemio_req_t req;
+  shmemio_fsnap_req_t *snreq = (shmemio_fsnap_req_t*)req.payload;
+  req.type = shmemio_fsnapshot_req;
+  req.status = shmemio_err_unknown;
+  snreq->fkey = fp->fkey;
+  snreq->name_len = strlen(name);
+
+  shmemio_fspace_t *fio = fp_to_fspace(fp);
+  
+  int ret = shmemio_fio_send(fio, &req);
+  shmemio_log_ret_if(error, shmemio_err_send, ret < 0, "Failed to send snapshot request\n");
+
+  ret = shmemio_streamsend(fio->ch->w, fio->req_ep, name, snreq->name_len);
+  shmemio_log_ret_if(error, shmemio_err_send, ret < 0, "Failed to send snapshot name\n");
+
+  ret = shmemio_fio_recv(fio, &req);
+  shmemio_log_ret_if(error, shmemio_err_recv, ret < 0,
+		     "Failed to recv snapshot response\n");
+  
+  return req.status;
+}
+
+/*
+ * Client API: Rebuild the stripe of the file on the pe at pe_index in its
+ * pe set, from the parity kept for files opened with SHMEM_FOPEN_PARITY.
+ * The stripe comes back as it was at the last flush or close, so call it
+ * before anything else is put to the file
+ */
+int shmem_fp_rebuild(shmem_fp_t *fp, int pe_index, int ioflags)
+{
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+
+  shmemio_log_ret_if(error, shmemio_err_no_parity, !(fpio->oflags & SHMEM_FOPEN_PARITY),
+		     "File not opened with parity\n");
+  shmemio_log_ret_if(error, shmemio_err_invalid, (pe_index < 0) || (pe_index >= fp->pe_size),
+		     "Rebuild pe index %d not in the file's %d pes\n", pe_index, fp->pe_size);
+  fp_server_check(fp);
+
+  shmemio_req_t req;
+  shmemio_rebuild_req_t *rbreq = (shmemio_rebuild_req_t*)req.payload;
+  req.type = shmemio_rebuild_req;
+  req.status = shmemio_err_unknown;
+  rbreq->fkey = fp->fkey;
+  rbreq->ioflags = ioflags;
+  rbreq->pe_index = pe_index;
+
+  sendrecv_req(&req, fp_to_fspace(fp));
+
+  if ((req.status == shmemio_success) && (fpio->oflags & SHMEM_FOPEN_CACHE)) {
+    shmem_fp_invalidate(fp);
+  }
+  return req.status;
+}
+
+/*
+ * Client API: Scan the file as an array of records of filt->rec_size
+ * bytes on the server, from record *start, and put up to max records
+ * whose field is within [filt->lo, filt->hi] to buf, or their indices as
+ * uint64_t with SHMEM_FILTER_INDEX. Only the matches cross the network.
+ * *start is moved past the records scanned, to the record count once the
+ * whole file is. This pe's puts to the file are completed first.
+ * Returns the number of matches or a negative error
+ */
+ssize_t shmem_fp_filter(shmem_fp_t *fp, const shmem_filter_t *filt, size_t *start,
+			void *buf, size_t max)
+{
+  shmemio_log_ret_if(error, shmemio_err_invalid,
+		     (filt == NULL) || (start == NULL) || ((buf == NULL) && (max > 0)),
+		     "Filter needs a filter, a start and a buffer\n");
+  fp_server_check(fp);
+
+  shmemio_fspace_t *fio = fp_to_fspace(fp);
+  const size_t out_size = (filt->flags & SHMEM_FILTER_INDEX) ? sizeof(uint64_t) : filt->rec_size;
+  size_t got = 0;
+
+  //The server scans what is in the file, so this pe's puts go out first
+  shmemio_quiet_all_ctxs();
+
+  //Matches are not a response, nothing else may be in flight
+  shmemio_fio_drain(fio);
+
+  do {
+    shmemio_req_t req;
+    shmemio_filter_req_t *freq = (shmemio_filter_req_t*)req.payload;
+    req.type = shmemio_filter_req;
+    req.status = shmemio_err_unknown;
+    freq->fkey = fp->fkey;
+    freq->rec_size = filt->rec_size;
+    freq->field_offset = filt->field_offset;
+    freq->type = filt->type;
+    freq->flags = filt->flags;
+    memcpy(&(freq->lo), &(filt->lo), sizeof(freq->lo));
+    memcpy(&(freq->hi), &(filt->hi), sizeof(freq->hi));
+    freq->start = *start;
+    freq->count = max - got;
+    freq->nrecs = 0;
+
+    int ret = sendrecv_req(&req, fio);
+    shmemio_log_ret_if(error, shmemio_err_recv, ret < 0, "Failed filter request\n");
+    if (req.status != shmemio_success) {
+      return req.status;
+    }
+
+    if (freq->count > 0) {
+      //A stream recv may complete with part of the matches
+      const size_t len = freq->count * out_size;
+      char *dst = (char*)buf + (got * out_size);
+      size_t recvd = 0;
+      while (recvd < len) {
+	ret = shmemio_streamrecv(fio->ch->w, fio->req_ep, dst + recvd, len - recvd);
+	shmemio_log_ret_if(error, shmemio_err_recv, ret <= 0,
+			   "Failed to recv %lu filter matches, got %lu of %lu bytes\n",
+			   (long unsigned)freq->count, (long unsigned)recvd, (long unsigned)len);
+	recvd += ret;
+      }
+      got += freq->count;
+    }
+
+    *start = freq->start;
+    if (*start >= freq->nrecs) {
+      break;
+    }
+  } while (got < max);
+
+  return got;
+}
+
+/*
+ * Start puts of len bytes at file offset foff, split over the file
+ * stripes. Completion is up to the caller
+ */
+static inline int
+fp_put_striped_nbi(shmem_fp_t *fp, size_t foff, const void *buf, size_t len)
+{
+  int ret = shmemio_client_sync_extents((shmemio_fp_t*)fp, foff + len);
+  if (ret != shmemio_success)
+    return ret;
+
+  size_t done = 0;
+  while (done < len) {
+    int pe;
+    void *addr;
+    size_t nbytes = fp_stripe_locate(fp, foff + done, &pe, &addr);
+    if (nbytes > (len - done))
+      nbytes = len - done;
+
+    shmemc_ctx_put_nbi(SHMEM_CTX_DEFAULT, addr, (const char*)buf + done, nbytes, pe);
+    done += nbytes;
+  }
+  return shmemio_success;
+}
+
+/*
+ * Start gets of len bytes from file offset foff, split over the file
+ * stripes. Completion is up to the caller
+ */
+static inline int
+fp_get_striped_nbi(shmem_fp_t *fp, size_t foff, void *buf, size_t len)
+{
+  int ret = shmemio_client_sync_extents((shmemio_fp_t*)fp, foff + len);
+  if (ret != shmemio_success)
+    return ret;
+
+  size_t done = 0;
+  while (done < len) {
+    int pe;
+    void *addr;
+    size_t nbytes = fp_stripe_locate(fp, foff + done, &pe, &addr);
+    if (nbytes > (len - done))
+      nbytes = len - done;
+
+    shmemc_ctx_get_nbi(SHMEM_CTX_DEFAULT, (char*)buf + done, addr, nbytes, pe);
+    done += nbytes;
+  }
+  return shmemio_success;
+}
+
+/*
+ * Bytes of a read at offset that are inside the file
+ */
+static inline size_t
+fp_read_len(const shmem_fp_t *fp, size_t offset, size_t len)
+{
+  if (offset >= fp->size)
+    return 0;
+  return (len > (fp->size - offset)) ? (fp->size - offset) : len;
+}
+
+/*
+ * Client API: Start a write of len bytes at offset in the file. Stripes
+ * on every pe of the file are written at once. Complete with shmem_quiet
+ */
+int shmem_fp_write_nbi(shmem_fp_t *fp, size_t offset, const void *buf, size_t len)
+{
+  //Written so offset + len can not wrap
+  shmemio_log_ret_if(error, shmemio_err_invalid,
+		     (len > fp->size) || (offset > (fp->size - len)),
+		     "Write of %lu bytes at %lu is past end of file\n",
+		     (long unsigned)len, (long unsigned)offset);
+
+  return fp_put_striped_nbi(fp, offset, buf, len);
+}
+
+/*
+ * Client API: Start a read of up to len bytes at offset in the file,
+ * stopping at the end of file like shmem_fp_read. Stripes on every pe of
+ * the file are read at once. Returns the bytes that will be read once
+ * complete with shmem_quiet
+ */
+ssize_t shmem_fp_read_nbi(shmem_fp_t *fp, size_t offset, void *buf, size_t len)
+{
+  len = fp_read_len(fp, offset, len);
+
+  int ret = fp_get_striped_nbi(fp, offset, buf, len);
+  if (ret != shmemio_success)
+    return ret;
+
+  return (ssize_t)len;
+}
+
+/*
+ * Client API: Write len bytes at offset in the file. Returns the bytes
+ * written, or a negative error
+ */
+ssize_t shmem_fp_write(shmem_fp_t *fp, size_t offset, const void *buf, size_t len)
+{
+  int ret = shmem_fp_write_nbi(fp, offset, buf, len);
+  if (ret != shmemio_success)
+    return ret;
+
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  return (ssize_t)len;
+}
+
+/*
+ * Client API: Return a local pointer to the file data at offset, for
+ * plain loads and stores, or NULL if the data can only be reached with
+ * puts and gets. If len is not NULL it is set to the bytes reachable
+ * from the pointer, up to the end of the stripe unit. Stores through the
+ * pointer are not in write combining or the read cache of other pes
+ */
+void *shmem_fp_ptr(shmem_fp_t *fp, size_t offset, size_t *len)
+{
+  shmemio_log_ret_if(error, NULL, offset >= fp->size,
+		     "Pointer at %lu is past end of file\n", (long unsigned)offset);
+
+  if (shmemio_client_sync_extents((shmemio_fp_t*)fp, offset + 1) != shmemio_success) {
+    return NULL;
+  }
+
+  int pe;
+  void *addr;
+  size_t nbytes = fp_stripe_locate(fp, offset, &pe, &addr);
+
+  void *ptr = shmemio_addr_ptr((shmemc_context_h)SHMEM_CTX_DEFAULT, (uint64_t)addr, pe);
+
+  if (len != NULL) {
+    if (nbytes > (fp->size - offset))
+      nbytes = fp->size - offset;
+    *len = (ptr == NULL) ? 0 : nbytes;
+  }
+  return ptr;
+}
+
+/*
+ * Client API: Read up to len bytes at offset in the file, stopping at the
+ * end of file. Returns the bytes read, or a negative error
+ */
+ssize_t shmem_fp_read(shmem_fp_t *fp, size_t offset, void *buf, size_t len)
+{
+  len = fp_read_len(fp, offset, len);
+  if (len == 0)
+    return 0;
+
+  if (shmemio_prefetch_read((shmemio_fp_t*)fp, offset, buf, len))
+    return (ssize_t)len;
+
+  ssize_t ret = shmem_fp_read_nbi(fp, offset, buf, len);
+  if (ret > 0)
+    shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  return ret;
+}
+
+/*
+ * Client API: Append to a file opened with SHMEM_FOPEN_APPEND_LOG. Space
+ * is reserved with a compare-and-swap on the tail counter in the file
+ * header, so many pes can append at once without locks. Returns the
+ * offset of the new record in the log, or a negative error
+ */
+ssize_t shmem_fp_append(shmem_fp_t *fp, const void *buf, size_t len)
+{
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+
+  shmemio_log_ret_if(error, shmemio_err_invalid, !(fpio->oflags & SHMEM_FOPEN_APPEND_LOG),
+		     "File not opened as an append log\n");
+
+  const size_t hdr = fp_log_header_size(fp);
+  uint64_t tail = shmemc_ctx_fetch64(SHMEM_CTX_DEFAULT, fp->addr, fp->pe_start);
+
+  //Only move the tail once the log can hold the record, so a failed
+  //extend leaves no hole in the log
+  for (;;) {
+    const size_t end = hdr + tail + len;
+
+    if (end > fp->size) {
+      //Past the end of the file as we know it. Server grows logs in large
+      //steps, or tells us someone else already did
+      int ret = shmem_fextend(fp, end - fp->size);
+      shmemio_log_ret_if(error, ret, ret != shmemio_success,
+			 "Failed to grow log for append at %lu\n", (long unsigned)tail);
+      shmemio_log_ret_if(error, shmemio_err_resize, end > fp->size,
+			 "Log only grew to %lu of %lu bytes\n",
+			 (long unsigned)fp->size, (long unsigned)end);
+    }
+
+    const uint64_t seen = shmemc_ctx_cswap64(SHMEM_CTX_DEFAULT, fp->addr,
+					     tail, tail + len, fp->pe_start);
+    if (seen == tail)
+      break;
+
+    //Another pe appended first, try again after its record
+    tail = seen;
+  }
+
+  int ret = fp_put_striped_nbi(fp, hdr + tail, buf, len);
+  shmemio_log_ret_if(error, ret, ret != shmemio_success,
+		     "Failed to put log record at %lu\n", (long unsigned)tail);
+
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  return (ssize_t)tail;
+}
+
+/*
+ * Send the pending persist ranges of the file to the server, which
+ * flushes just those bytes. Puts must be complete before this is called
+ */
+static inline int
+fp_send_persist_ranges(shmemio_fp_t *fpio)
+{
+  if (fpio->npersist == 0) {
+    return shmemio_success;
+  }
+  fp_server_check((shmem_fp_t*)fpio);
+  
+  shmemio_req_t req;
+  shmemio_range_flush_req_t *rfreq = (shmemio_range_flush_req_t*)req.payload;
+  req.type = shmemio_range_flush_req;
+  req.status = shmemio_err_unknown;
+  rfreq->fkey = fpio->fkey;
+  rfreq->ioflags = 0;
+  rfreq->nranges = fpio->npersist;
+  memcpy(rfreq->ranges, fpio->persist, fpio->npersist * sizeof(shmemio_range_t));
+
+  sendrecv_req(&req, fp_to_fspace((shmem_fp_t*)fpio));
+
+  if (req.status == shmemio_success) {
+    fpio->npersist = 0;
+  }
+  return req.status;
+}
+
+/*
+ * Remember a range to make persistent, merging it with the last range
+ * when they touch. Returns nonzero if the range did not fit
+ */
+static inline int
+fp_add_persist_range(shmemio_fp_t *fpio, size_t offset, size_t len)
+{
+  if (fpio->npersist > 0) {
+    shmemio_range_t *last = &(fpio->persist[fpio->npersist - 1]);
+    if ((offset <= last->offset + last->len) && (last->offset <= offset + len)) {
+      const uint64_t end = last->offset + last->len;
+      if (offset < last->offset) {
+	last->offset = offset;
+      }
+      last->len = ((offset + len > end) ? (offset + len) : end) - last->offset;
+      return 0;
+    }
+  }
+  
+  if (fpio->npersist == SHMEMIO_FLUSH_NRANGES) {
+    return 1;
+  }
+  
+  fpio->persist[fpio->npersist].offset = offset;
+  fpio->persist[fpio->npersist].len = len;
+  fpio->npersist++;
+  return 0;
+}
+
+/*
+ * Client API: Put len bytes at offset in the file, and return once they
+ * are persistent on the server. UCX has no remote persistent flush, so
+ * the put is completed with a quiet and then only the written bytes are
+ * flushed by the server, not the whole file
+ */
+int shmem_fp_put_persist(shmem_fp_t *fp, size_t offset, const void *src, size_t len)
+{
+  int ret = shmem_fp_put_persist_nbi(fp, offset, src, len);
+  if (ret != shmemio_success) {
+    return ret;
+  }
+  return shmem_fp_persist_quiet(fp);
+}
+
+/*
+ * Client API: Start a put of len bytes at offset in the file. The bytes
+ * are persistent once shmem_fp_persist_quiet returns, and ranges from
+ * many calls are flushed together with one request
+ */
+int shmem_fp_put_persist_nbi(shmem_fp_t *fp, size_t offset, const void *src, size_t len)
+{
+  shmemio_fp_t *fpio = (shmemio_fp_t*)fp;
+
+  shmemio_log_ret_if(error, shmemio_err_invalid, (offset + len) > fp->size,
+		     "Persistent put of %lu bytes at %lu is past end of file\n",
+		     (long unsigned)len, (long unsigned)offset);
+
+  int ret = fp_put_striped_nbi(fp, offset, src, len);
+  if (ret != shmemio_success) {
+    return ret;
+  }
+
+  if (fp_add_persist_range(fpio, offset, len)) {
+    //No room to batch more ranges. Complete what we have, this put too
+    ret = shmem_fp_persist_quiet(fp);
+    if (ret != shmemio_success) {
+      return ret;
+    }
+    fp_add_persist_range(fpio, offset, len);
+  }
+  
+  return shmemio_success;
+}
+
+/*
+ * Client API: Complete all outstanding persistent puts to the file
+ */
+int shmem_fp_persist_quiet(shmem_fp_t *fp)
+{
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  return fp_send_persist_ranges((shmemio_fp_t*)fp);
+}
 
 /*
  * Client API: Get statistics for this file space
@@ -470,10 +1714,13 @@ int shmem_fspace_stat(shmem_fspace_t fspace, shmem_fspace_stat_t *stat)
     return shmemio_err_invalid;
   }
   
+  //Stat reply is not a response, nothing else may be in flight
+  shmemio_fio_drain(fio);
+  
   shmemio_req_t req;
   req.type = shmemio_fspace_stat_req;
 
-  int ret = shmemio_streamsend(fio->ch->w, fio->req_ep, &req, sizeof(shmemio_req_t));
+  int ret = shmemio_fio_send(fio, &req);
   shmemio_log_ret_if(error, shmemio_err_send, ret < 0, "Failed to send stat request\n");
 
   ret = shmemio_streamrecv(fio->ch->w, fio->req_ep, stat, sizeof(shmem_fspace_stat_t));
@@ -504,30 +1751,51 @@ void shmem_fspace_flush(shmem_fspace_t fspace, int ioflags)
   sendrecv_req(&req, fio);
 }
 
+/*
+ * Client API: Start a flush of the entire file space
+ */
+int shmem_fspace_flush_nb(shmem_fspace_t fspace, int ioflags, shmem_fio_t *handle)
+{
+  shmemio_fspace_range_check(fspace);
+  
+  shmemio_req_t req;
+  req.type = shmemio_fspace_flush_req;
+  req.status = shmemio_err_unknown;
+  ((int*)req.payload)[0] = ioflags;
+
+  *handle = shmemio_fio_start(fspace, &req, NULL, 0, NULL, NULL);
+  return (*handle == NULL) ? shmemio_err_send : shmemio_success;
+}
+
 
 /*
  * Client API: Open a file
  */
 shmem_fp_t *shmem_open(shmem_fspace_t fspace, const char *file, size_t fsize,
 		       int pe_start, int pe_stride, int pe_size, int unit_size, int *err)
+{
+  return shmem_open_attr(fspace, file, fsize, pe_start, pe_stride, pe_size, unit_size,
+			 NULL, err);
+}
+
+/*
+ * Client API: Open a file with extra open attributes. With
+ * SHMEM_FOPEN_REPLICATE the server keeps read-only replicas of the file
+ * on other pes, and gets are spread over them. Puts still go to the
+ * original pes, and replicas are refreshed when the file is flushed.
+ */
+shmem_fp_t *shmem_open_attr(shmem_fspace_t fspace, const char *file, size_t fsize,
+			    int pe_start, int pe_stride, int pe_size, int unit_size,
+			    const shmem_fopen_attr_t *attr, int *err)
 {
   shmemio_fspace_range_check(fspace);
   shmemio_fspace_t *fio = &(proc.io.fspaces[fspace]);
   
-  shmemio_fp_t *fp = shmemio_get_new_fp();
-  shmemio_assert(fp != NULL, "Unable to allocate new file pointer object\n");
-
-  // Init the file pointer with the input parameters
-  fp->fspace = fspace;
-  fp->addr = NULL;
-  fp->size = fsize;
-  fp->unit_size = unit_size;
-  fp->pe_start = pe_start;
-  fp->pe_stride = pe_stride;
-  fp->pe_size = pe_size;
+  shmemio_fp_t *fp = fp_open_init(fspace, fsize, pe_start, pe_stride, pe_size, unit_size);
 
   // Call the internal client file open
-  if (shmemio_client_fopen(fio, file, fp, err) != 0) {
+  shmemio_req_t req;
+  if (shmemio_client_fopen(fio, file, fp, attr, &req, err) != 0) {
     shmemio_log(error, "File open failed\n");
     goto err_fp;
   }
@@ -542,6 +1810,138 @@ shmem_fp_t *shmem_open(shmem_fspace_t fspace, const char *file, size_t fsize,
   return NULL;
 }
 
+/*
+ * Client API: Open a file for all pes of the active set. Only the first
+ * pe of the set, the root, sends the open to the server. The other pes
+ * get the file from a broadcast, and may use it for puts and gets, but
+ * requests for the file (flush, stat, resize...) must come from the root
+ */
+shmem_fp_t *shmem_open_all(shmem_fspace_t fspace, const char *file, size_t fsize,
+			   int pe_start, int pe_stride, int pe_size, int unit_size,
+			   int PE_start, int logPE_stride, int PE_size, int *err)
+{
+  shmemio_fspace_range_check(fspace);
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fspace]);
+  shmemio_open_all_t *oa = proc.io.open_all;
+
+  shmemio_fp_t *fp = fp_open_init(fspace, fsize, pe_start, pe_stride, pe_size, unit_size);
+  fp->coll_root = PE_start;
+
+  //The broadcast does not write the root's copy, the root uses its source
+  shmemio_open_all_hdr_t *hdr = (proc.rank == PE_start) ? &(oa->src_hdr) : &(oa->hdr);
+  int status;
+
+  if (proc.rank == PE_start) {
+    const int nold = fio->nregions;
+    status = shmemio_success;
+
+    if (shmemio_client_fopen(fio, file, fp, NULL, &(hdr->req), &status) != 0) {
+      hdr->status = (status != shmemio_success) ? status : shmemio_err_unknown;
+    }
+    else {
+      hdr->status = shmemio_success;
+    }
+
+    //Regions this open added, for pes that have the same ones as the root
+    const ssize_t len = shmemio_client_pack_regions(fio, nold, fio->nregions,
+						    (char*)oa->src_data, SHMEMIO_OPEN_ALL_BUF);
+    hdr->rstart = nold;
+    hdr->rmax = (len < 0) ? nold : fio->nregions;
+    hdr->len = (len < 0) ? 0 : len;
+    shmemio_log_if(info, len < 0, "Regions %d:%d do not fit the open broadcast\n",
+		   nold, fio->nregions - 1);
+  }
+
+  shmem_broadcast64(&(oa->hdr), &(oa->src_hdr), SHMEMIO_OPEN_ALL_HDR_NELEMS,
+		    0, PE_start, logPE_stride, PE_size, oa->bcast_sync[0]);
+
+  if ((hdr->status == shmemio_success) && (hdr->len > 0)) {
+    shmem_broadcast64(oa->data, oa->src_data, (hdr->len + 7) / 8,
+		      0, PE_start, logPE_stride, PE_size, oa->bcast_sync[1]);
+  }
+
+  status = hdr->status;
+
+  if ((proc.rank != PE_start) && (status == shmemio_success)) {
+    shmemio_req_t req;
+    memcpy(&req, &(hdr->req), sizeof(shmemio_req_t));
+
+    //Regions not in the broadcast are asked from the server by fopen_finish
+    if ((shmemio_client_unpack_regions(fio, hdr->rstart, hdr->rmax, (char*)oa->data, hdr->len) != 0) ||
+	(shmemio_client_fopen_finish(fio, fp, &req, err) != 0)) {
+      shmemio_log(error, "Failed to set up file opened by pe %d\n", PE_start);
+      status = shmemio_err_region_req;
+    }
+  }
+
+  //Nobody may start the next broadcast before all pes are done with this one
+  shmem_barrier(PE_start, logPE_stride, PE_size, oa->barrier_sync);
+
+  if (status != shmemio_success) {
+    shmemio_seterr(err, status);
+    shmemio_fp_release(fp);
+    return NULL;
+  }
+
+  shmemio_log_fp(info, fp, "open file for all");
+  return (shmem_fp_t*)fp;
+}
+
+/*
+ * Client API: Close a file opened with shmem_open_all, on all pes of the
+ * same active set. The root closes it on the server once every pe's puts
+ * to the file are complete
+ */
+int shmem_close_all(shmem_fp_t *fp, int ioflags, int PE_start, int logPE_stride, int PE_size)
+{
+  shmemio_quiet_all_ctxs();
+  shmem_barrier(PE_start, logPE_stride, PE_size, proc.io.open_all->barrier_sync);
+
+  return shmem_close(fp, ioflags);
+}
+
+/*
+ * Client API: Start opening a file, see shmem_open. *fp is set when the
+ * open completes with shmem_fio_wait, so must stay valid until then
+ */
+int shmem_open_nb(shmem_fspace_t fspace, const char *file, size_t fsize,
+		  int pe_start, int pe_stride, int pe_size, int unit_size,
+		  shmem_fp_t **fp, shmem_fio_t *handle)
+{
+  return shmem_open_attr_nb(fspace, file, fsize, pe_start, pe_stride, pe_size, unit_size,
+			    NULL, fp, handle);
+}
+
+/*
+ * Client API: Start opening a file with extra open attributes
+ */
+int shmem_open_attr_nb(shmem_fspace_t fspace, const char *file, size_t fsize,
+		       int pe_start, int pe_stride, int pe_size, int unit_size,
+		       const shmem_fopen_attr_t *attr, shmem_fp_t **fp, shmem_fio_t *handle)
+{
+  shmemio_fspace_range_check(fspace);
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fspace]);
+
+  *fp = NULL;
+  
+  shmemio_fp_t *fpio = fp_open_init(fspace, fsize, pe_start, pe_stride, pe_size, unit_size);
+
+  shmemio_req_t req;
+  shmemio_client_fopen_req(fio, file, fpio, attr, &req);
+  const int path_len = ((shmemio_fopen_req_t*)req.payload)->file_path_len;
+
+  shmemio_fio_req_t *fr = shmemio_fio_start(fspace, &req, file, path_len, fpio, fio_open_finish);
+  if (fr == NULL) {
+    shmemio_fp_release(fpio);
+    *handle = NULL;
+    return shmemio_err_send;
+  }
+
+  fr->fp_out = fp;
+  *handle = fr;
+  return shmemio_success;
+}
+
 /*
  * Client API: return a string for error number
  */
@@ -552,3 +1952,33 @@ void shmem_strerror(int errnum, char *strbuf)
   memcpy(strbuf, str, len); 
 }
 
+
+/*
+ * Client API: Get write combining statistics for this pe
+ */
+void shmem_wc_stat(shmem_wc_stat_t *stat)
+{
+  const shmemio_wc_t *wc = &proc.io.wc;
+
+  stat->buffer_size = wc->size;
+  stat->max_put = wc->max_put;
+  stat->puts = wc->nputs;
+  stat->combined = wc->ncombined;
+  stat->bypassed = wc->nbypass;
+  stat->writes = wc->nwrites;
+  stat->put_bytes = wc->put_bytes;
+}
+
+/*
+ * Client API: Zero the write combining statistics
+ */
+void shmem_wc_stat_reset(void)
+{
+  shmemio_wc_t *wc = &proc.io.wc;
+
+  wc->nputs = 0;
+  wc->ncombined = 0;
+  wc->nbypass = 0;
+  wc->nwrites = 0;
+  wc->put_bytes = 0;
+}
@@ -66,6 +66,13 @@ void shmemc_ctx_get_nbi(shmem_ctx_t ctx,
                         void *dest, const void *src,
                         size_t nbytes, int pe);
 
+#ifdef ENABLE_SHMEMIO
+void *shmemc_ctx_get_nbr(shmem_ctx_t ctx,
+                         void *dest, const void *src,
+                         size_t nbytes, int pe);
+int shmemc_ctx_request_test(shmem_ctx_t ctx, void *req);
+#endif  /* ENABLE_SHMEMIO */
+
 void shmemc_ctx_put_signal(shmem_ctx_t ctx,
                            void *dest, const void *src, size_t nbytes,
                            uint64_t *sig_target, uint64_t sig_val,
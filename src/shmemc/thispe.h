@@ -12,6 +12,8 @@
 typedef struct shmemio_fspace_s      shmemio_fspace_t;
 typedef struct shmemio_client_fpe_s  shmemio_client_fpe_t;
 typedef struct shmemio_fp_s          shmemio_fp_t;
+typedef struct shmemio_wc_buf_s      shmemio_wc_buf_t;
+typedef struct shmemio_cache_s       shmemio_cache_t;
 #endif
 
 #include "boolean.h"
@@ -96,6 +98,20 @@ typedef struct shmemc_team {
 
 
 #ifdef ENABLE_SHMEMIO
+/*
+ * Opt-in write combining of small puts to file pes. Each context keeps
+ * its own buffers, the counters are shared
+ */
+typedef struct shmemio_wc {
+  size_t size;                /* buffer bytes per fpe, 0 when off */
+  size_t max_put;             /* bigger puts are not buffered */
+  unsigned long nputs;        /* puts taken into a buffer */
+  unsigned long ncombined;    /* ... of which joined a buffered run */
+  unsigned long nbypass;      /* puts too big to buffer */
+  unsigned long nwrites;      /* puts issued to write out buffers */
+  size_t put_bytes;           /* bytes taken into buffers */
+} shmemio_wc_t;
+
 /*
  * PE can be a shmemio_client
  */
@@ -104,6 +120,12 @@ typedef struct shmemio_client {
   shmemio_client_fpe_t *fpes; /* file pes */
   int nfspaces;                      /* how many connected filespaces */
   shmemio_fspace_t *fspaces;         /* connected filespaces */
+  shmemio_wc_t wc;                   /* write combining, if enabled */
+  shmemio_cache_t *cache;            /* read page cache, NULL when off */
+  int nprefetch_fps;                 /* files with prefetches, puts check them */
+  struct shmemio_open_all_s *open_all; /* symmetric, for collective opens and connects */
+  struct shmemio_embed_s *embed;     /* fspace server this pe hosts, or NULL */
+  uint64_t stat_lease;               /* nsec a file stat is reused, 0 is never */
 #ifdef ENABLE_DEBUG
   shmemio_fp_t *fp_active_list;
 #endif
@@ -121,13 +121,20 @@ translate_address(uint64_t local_addr, size_t region, int pe)
 }
 
 /*
- * All ops here need to find remote keys and addresses
+ * All ops here need to find remote keys and addresses.  Return
+ * non-zero if the address can't be used for this op.
  */
-inline static void
-get_remote_key_and_addr(uint64_t local_addr, int pe,
+inline static int
+get_remote_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int pe,
                         ucp_rkey_h *rkey_p, uint64_t *raddr_p)
 {
 #ifdef ENABLE_SHMEMIO
+  /* file pes only have fspace memory, no need to search the heaps */
+  if (pe >= proc.nranks) {
+    return secondary_remote_key_and_addr(ch, local_addr, pe, rkey_p, raddr_p);
+    /* NOT REACHED */
+  }
+
   /* Move this lookup_region code here and add goto 
      to avoid extra test in path for get/put for non-fspace access
   */
@@ -139,10 +146,11 @@ get_remote_key_and_addr(uint64_t local_addr, int pe,
     }
   }
   /* Only reach here if we fail to find nonfspace region */
-  secondary_remote_key_and_addr(local_addr, pe, rkey_p, raddr_p);
-  return;
+  return secondary_remote_key_and_addr(ch, local_addr, pe, rkey_p, raddr_p);
 
 #else
+    NO_WARN_UNUSED(ch);
+
     const long r = lookup_region(local_addr, proc.rank);
     /* assert only happens when debug enabled. This test is not used in production code path */
     shmemu_assert(r >= 0, "can't find memory region for %p", local_addr);
@@ -151,14 +159,42 @@ get_remote_key_and_addr(uint64_t local_addr, int pe,
  remote_region_found:
     *rkey_p = lookup_rkey(r, pe);
     *raddr_p = translate_address(local_addr, r, pe);
+    return 0;
+}
+
+/*
+ * Gets can be served by a replica of a read-mostly fspace file, which
+ * may live on another PE
+ */
+inline static int
+get_remote_read_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int *pe_p,
+                             ucp_rkey_h *rkey_p, uint64_t *raddr_p)
+{
+#ifdef ENABLE_SHMEMIO
+    if (*pe_p >= proc.nranks) {
+        return secondary_remote_read_key_and_addr(ch, local_addr, pe_p,
+                                                  rkey_p, raddr_p);
+        /* NOT REACHED */
+    }
+#endif /* ENABLE_SHMEMIO */
+
+    return get_remote_key_and_addr(ch, local_addr, *pe_p, rkey_p, raddr_p);
 }
 
 /*
  * -- ordering -----------------------------------------------------------
  */
 
+#ifdef ENABLE_SHMEMIO
+static void wc_flush_all(shmemc_context_h ch);
+# define WC_FLUSH_ALL(_ch) wc_flush_all(_ch)
+#else
+# define WC_FLUSH_ALL(_ch)
+#endif /* ENABLE_SHMEMIO */
+
 /*
- * fence and quiet only do something on storable contexts
+ * fence and quiet only do something on storable contexts.  Write
+ * combined puts to file PEs go out first
  */
 
 #define SHMEMC_FENCE_QUIET(_op, _ucp_op)                            \
@@ -169,6 +205,7 @@ get_remote_key_and_addr(uint64_t local_addr, int pe,
             shmemc_context_h ch = (shmemc_context_h) ctx;           \
                                                                     \
             if (! ch->attr.nostore) {                               \
+                WC_FLUSH_ALL(ch);                                   \
                 const ucs_status_t s = ucp_worker_##_ucp_op(ch->w); \
                                                                     \
                 shmemu_assert(s == UCS_OK,                          \
@@ -249,6 +286,253 @@ check_wait_for_request(shmemc_context_h ch, void *req)
     }
 }
 
+#ifdef ENABLE_SHMEMIO
+
+/*
+ *  -- write combining for file PEs ---------------------------------------
+ */
+
+/*
+ * Buffers belong to a context, so a quiet only has to push out its own.
+ * Nothing is combined under SHMEM_THREAD_MULTIPLE, where a flush or
+ * disconnect could not reach the buffers of other threads' contexts
+ */
+inline static bool
+wc_usable(void)
+{
+    return (proc.io.wc.size > 0) &&
+        (proc.td.osh_tl != SHMEM_THREAD_MULTIPLE);
+}
+
+/*
+ * Write out the buffered run of context "ch" for file PE "pe" as one
+ * put.  Waits for local completion so the buffer can be reused straight
+ * away.  Returns true if anything was written
+ */
+static bool
+wc_flush_pe(shmemc_context_h ch, int pe)
+{
+    const int fdx = pe - proc.nranks;
+    shmemio_wc_buf_t *buf;
+    uint64_t r_dest;
+    ucp_rkey_h r_key;
+    ucs_status_t s;
+
+    if (fdx >= ch->io_nwc) {
+        return false;
+        /* NOT REACHED */
+    }
+
+    buf = &ch->io_wc[fdx];
+    if (buf->len == 0) {
+        return false;
+        /* NOT REACHED */
+    }
+
+    if (get_remote_key_and_addr(ch, buf->dest, pe, &r_key, &r_dest) != 0) {
+        buf->len = 0;
+        return false;
+        /* NOT REACHED */
+    }
+
+#ifdef HAVE_UCP_PUT_NB
+    s = check_wait_for_request(ch,
+                               ucp_put_nb(lookup_ucp_ep(ch, pe),
+                                          buf->data, buf->len,
+                                          r_dest, r_key,
+                                          noop_callback));
+#else
+    s = ucp_put(lookup_ucp_ep(ch, pe), buf->data, buf->len, r_dest, r_key);
+#endif /* HAVE_UCP_PUT_NB */
+
+    shmemu_assert(s == UCS_OK,
+                  "write combine flush failed (status: %s)",
+                  ucs_status_string(s));
+
+    __atomic_add_fetch(&proc.io.wc.nwrites, 1, __ATOMIC_RELAXED);
+    buf->len = 0;
+    return true;
+}
+
+static void
+wc_flush_all(shmemc_context_h ch)
+{
+    int i;
+
+    for (i = 0; i < ch->io_nwc; i += 1) {
+        (void) wc_flush_pe(ch, proc.nranks + i);
+    }
+}
+
+/*
+ * Try to take a put to file PE "pe" into its write combine buffer.
+ * Returns true if the put was buffered.  A put that can not join the
+ * buffered run pushes the run out first, so puts stay in order
+ */
+inline static bool
+wc_put(shmemc_context_h ch, void *dest, const void *src,
+       size_t nbytes, int pe)
+{
+    shmemio_wc_t *wc = &proc.io.wc;
+    const uint64_t d = (uint64_t) dest;
+    shmemio_wc_buf_t *buf;
+
+    if (! wc_usable()) {
+        return false;
+        /* NOT REACHED */
+    }
+
+    if (nbytes > wc->max_put) {
+        __atomic_add_fetch(&wc->nbypass, 1, __ATOMIC_RELAXED);
+        (void) wc_flush_pe(ch, pe);
+        return false;
+        /* NOT REACHED */
+    }
+
+    buf = shmemio_wc_get_buf(ch, pe - proc.nranks);
+    if (buf == NULL) {
+        return false;
+        /* NOT REACHED */
+    }
+
+    /* joins or overlaps the run, and still fits */
+    if ((buf->len > 0) &&
+        (d >= buf->dest) && (d <= buf->dest + buf->len) &&
+        (d + nbytes <= buf->dest + wc->size)) {
+        const size_t at = d - buf->dest;
+
+        memcpy(buf->data + at, src, nbytes);
+        if (at + nbytes > buf->len) {
+            buf->len = at + nbytes;
+        }
+        __atomic_add_fetch(&wc->ncombined, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        (void) wc_flush_pe(ch, pe);
+        buf->dest = d;
+        buf->len = nbytes;
+        memcpy(buf->data, src, nbytes);
+    }
+
+    __atomic_add_fetch(&wc->nputs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wc->put_bytes, nbytes, __ATOMIC_RELAXED);
+    return true;
+}
+
+/*
+ *  -- read cache for file PEs --------------------------------------------
+ */
+
+/*
+ * Serve a get from file PE "pe" out of the read cache, reading in pages
+ * that are missing or stale.  Returns the number of bytes served, which
+ * stops short where the get runs out of cached files
+ */
+static size_t
+cache_get(shmemc_context_h ch, void *dest, const void *src,
+          size_t nbytes, int pe)
+{
+    const uint64_t s = (uint64_t) src;
+    size_t done = 0;
+
+    shmemio_cache_lock();
+
+    while (done < nbytes) {
+        shmemio_cache_page_t *pg = shmemio_cache_page(s + done, pe);
+        size_t off, n;
+
+        if (pg == NULL) {
+            break;
+            /* NOT REACHED */
+        }
+
+        if (! pg->valid) {
+            int rpe = pe;
+            uint64_t r_src;
+            ucp_rkey_h r_key;
+            ucs_status_t st;
+
+            /* page has to have our own buffered puts */
+            if (wc_flush_pe(ch, pe)) {
+                ucp_worker_fence(ch->w);
+            }
+
+            if (get_remote_read_key_and_addr(ch, pg->addr, &rpe,
+                                             &r_key, &r_src) != 0) {
+                break;
+                /* NOT REACHED */
+            }
+#ifdef HAVE_UCP_GET_NB
+            st = check_wait_for_request(ch,
+                                        ucp_get_nb(lookup_ucp_ep(ch, rpe),
+                                                   pg->data, pg->len,
+                                                   r_src, r_key,
+                                                   noop_callback));
+#else
+            st = ucp_get(lookup_ucp_ep(ch, rpe),
+                         pg->data, pg->len, r_src, r_key);
+#endif /* HAVE_UCP_GET_NB */
+
+            if (st != UCS_OK) {
+                /* leave the rest to the normal get */
+                break;
+                /* NOT REACHED */
+            }
+            pg->valid = 1;
+        }
+
+        off = s + done - pg->addr;
+        n = pg->len - off;
+        if (n > nbytes - done) {
+            n = nbytes - done;
+        }
+        memcpy((char *) dest + done, pg->data + off, n);
+        done += n;
+    }
+
+    shmemio_cache_unlock();
+
+    return done;
+}
+
+/*
+ * Keep cached pages up to date with our own puts
+ */
+static void
+cache_put(const void *dest, const void *src, size_t nbytes, int pe)
+{
+    shmemio_cache_lock();
+    shmemio_cache_update((uint64_t) dest, src, nbytes, pe);
+    shmemio_cache_unlock();
+}
+
+#endif /* ENABLE_SHMEMIO */
+
+/*
+ * Atomics to a file PE must not pass puts to it still sitting in a
+ * write combine buffer
+ */
+inline static int
+get_remote_amo_key_and_addr(shmemc_context_h ch, uint64_t local_addr,
+                            int pe, ucp_rkey_h *rkey_p, uint64_t *raddr_p)
+{
+#ifdef ENABLE_SHMEMIO
+    if (pe >= proc.nranks) {
+        /* the atomic may change prefetched file data */
+        if (proc.io.nprefetch_fps > 0) {
+            shmemio_prefetch_put(local_addr, sizeof(uint64_t), pe);
+        }
+        if (wc_flush_pe(ch, pe)) {
+            ucp_worker_fence(ch->w);
+        }
+    }
+#else
+    NO_WARN_UNUSED(ch);
+#endif /* ENABLE_SHMEMIO */
+
+    return get_remote_key_and_addr(ch, local_addr, pe, rkey_p, raddr_p);
+}
+
 /*
  *  -- helpers for atomics -----------------------------------------------
  */
@@ -270,7 +554,10 @@ ucx_atomic_post_op(ucp_atomic_post_op_t uapo,
     ucp_rkey_h r_key;
     ucp_ep_h ep;
 
-    get_remote_key_and_addr(t, pe, &r_key, &r_t);
+    if (get_remote_amo_key_and_addr(ch, t, pe, &r_key, &r_t) != 0) {
+        return UCS_ERR_INVALID_ADDR;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
     return ucp_atomic_post(ep, uapo, v, vs, r_t, r_key);
@@ -290,7 +577,10 @@ ucx_atomic_fetch_op(ucp_atomic_fetch_op_t uafo,
     ucp_ep_h ep;
     ucs_status_ptr_t sp;
 
-    get_remote_key_and_addr(t, pe, &r_key, &r_t);
+    if (get_remote_amo_key_and_addr(ch, t, pe, &r_key, &r_t) != 0) {
+        return UCS_ERR_INVALID_ADDR;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
     sp = ucp_atomic_fetch_nb(ep, uafo, v, result, vs, r_t, r_key,
@@ -315,7 +605,10 @@ ucx_atomic_fetch_op(ucp_atomic_fetch_op_t uafo,
         ucp_rkey_h r_key;                                           \
         ucp_ep_h ep;                                                \
                                                                     \
-        get_remote_key_and_addr(t, pe, &r_key, &r_t);               \
+        if (get_remote_amo_key_and_addr(ch, t, pe,                  \
+                                        &r_key, &r_t) != 0) {       \
+            return ret;                                             \
+        }                                                           \
         ep = lookup_ucp_ep(ch, pe);                                 \
                                                                     \
         s = ucp_atomic_fadd##_size(ep, v, r_t, r_key, &ret);        \
@@ -341,7 +634,10 @@ HELPER_FADD(64)
         ucp_rkey_h r_key;                                       \
         ucp_ep_h ep;                                            \
                                                                 \
-        get_remote_key_and_addr(t, pe, &r_key, &r_t);           \
+        if (get_remote_amo_key_and_addr(ch, t, pe,              \
+                                        &r_key, &r_t) != 0) {   \
+            return;                                             \
+        }                                                       \
         ep = lookup_ucp_ep(ch, pe);                             \
                                                                 \
         s = ucp_atomic_add##_size(ep, v, r_t, r_key);           \
@@ -396,7 +692,10 @@ HELPER_INC(64)
         ucp_ep_h ep;                                            \
         ucs_status_t s;                                         \
                                                                 \
-        get_remote_key_and_addr(t, pe, &r_key, &r_t);           \
+        if (get_remote_amo_key_and_addr(ch, t, pe,              \
+                                        &r_key, &r_t) != 0) {   \
+            return ret;                                         \
+        }                                                       \
         ep = lookup_ucp_ep(ch, pe);                             \
                                                                 \
         s = ucp_atomic_swap##_size(ep, v, r_t, r_key, &ret);    \
@@ -423,7 +722,10 @@ HELPER_SWAP(64)
         ucp_ep_h ep;                                                    \
         ucs_status_t s;                                                 \
                                                                         \
-        get_remote_key_and_addr(t, pe, &r_key, &r_t);                   \
+        if (get_remote_amo_key_and_addr(ch, t, pe,                      \
+                                        &r_key, &r_t) != 0) {           \
+            return ret;                                                 \
+        }                                                               \
         ep = lookup_ucp_ep(ch, pe);                                     \
                                                                         \
         s = ucp_atomic_cswap##_size(ep, c, v, r_t, r_key, &ret);        \
@@ -520,7 +822,10 @@ HELPER_BITWISE_ATOMIC(XOR, xor, 64)
         ucp_rkey_h r_key;                                               \
         ucp_ep_h ep;                                                    \
                                                                         \
-        get_remote_key_and_addr(t, pe, &r_key, &r_t);                   \
+        if (get_remote_amo_key_and_addr(ch, t, pe,                      \
+                                        &r_key, &r_t) != 0) {           \
+            return ret;                                                 \
+        }                                                               \
         ep = lookup_ucp_ep(ch, pe);                                     \
                                                                         \
         do {                                                            \
@@ -612,14 +917,31 @@ shmemc_ctx_ptr(shmem_ctx_t ctx, const void *addr, int pe)
 {
     NO_WARN_UNUSED(ctx);
 
+#ifdef ENABLE_SHMEMIO
+    /* file pes only have fspace memory, which may be mapped locally */
+    if (pe >= proc.nranks) {
+        return shmemio_addr_ptr((shmemc_context_h) ctx, (uint64_t) addr, pe);
+        /* NOT REACHED */
+    }
+    /* not in a heap, translation would look in the fspaces */
+    if (lookup_region((uint64_t) addr, proc.rank) < 0) {
+        return NULL;
+        /* NOT REACHED */
+    }
+#endif /* ENABLE_SHMEMIO */
+
     /* check to see if UCX is new enough */
 #ifdef HAVE_UCP_RKEY_PTR
+    shmemc_context_h ch = (shmemc_context_h) ctx;
     uint64_t r_addr;            /* address on other PE */
     ucp_rkey_h r_key;            /* rkey for remote address */
     void *usable_addr = NULL;
     ucs_status_t s;
 
-    get_remote_key_and_addr((uint64_t) addr, pe, &r_key, &r_addr);
+    if (get_remote_key_and_addr(ch, (uint64_t) addr, pe, &r_key, &r_addr) != 0) {
+        return NULL;
+        /* NOT REACHED */
+    }
 
     s = ucp_rkey_ptr(r_key, r_addr, &usable_addr);
     if (s == UCS_OK) {
@@ -675,7 +997,25 @@ shmemc_ctx_put(shmem_ctx_t ctx,
 #endif /* HAVE_UCP_PUT_NB */
     ucs_status_t s;
 
-    get_remote_key_and_addr((uint64_t) dest, pe, &r_key, &r_dest);
+#ifdef ENABLE_SHMEMIO
+    if (pe >= proc.nranks) {
+        if (proc.io.cache != NULL) {
+            cache_put(dest, src, nbytes, pe);
+        }
+        if (proc.io.nprefetch_fps > 0) {
+            shmemio_prefetch_put((uint64_t) dest, nbytes, pe);
+        }
+        if (wc_put(ch, dest, src, nbytes, pe)) {
+            return;
+            /* NOT REACHED */
+        }
+    }
+#endif /* ENABLE_SHMEMIO */
+
+    if (get_remote_key_and_addr(ch, (uint64_t) dest, pe, &r_key, &r_dest) != 0) {
+        return;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
 #ifdef HAVE_UCP_PUT_NB
@@ -705,7 +1045,32 @@ shmemc_ctx_get(shmem_ctx_t ctx,
 #endif /* HAVE_UCP_GET_NB */
     ucs_status_t s;
 
-    get_remote_key_and_addr((uint64_t) src, pe, &r_key, &r_src);
+#ifdef ENABLE_SHMEMIO
+    if (pe >= proc.nranks) {
+        if (proc.io.cache != NULL) {
+            const size_t done = cache_get(ch, dest, src, nbytes, pe);
+
+            if (done == nbytes) {
+                return;
+                /* NOT REACHED */
+            }
+            /* rest of the get is not in a cached file */
+            dest = (char *) dest + done;
+            src = (const char *) src + done;
+            nbytes -= done;
+        }
+        /* see our own buffered puts */
+        if (wc_flush_pe(ch, pe)) {
+            ucp_worker_fence(ch->w);
+        }
+    }
+#endif /* ENABLE_SHMEMIO */
+
+    if (get_remote_read_key_and_addr(ch, (uint64_t) src, &pe,
+                                     &r_key, &r_src) != 0) {
+        return;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
 #ifdef HAVE_UCP_GET_NB
@@ -741,7 +1106,25 @@ shmemc_ctx_put_nbi(shmem_ctx_t ctx,
     ucp_ep_h ep;
     ucs_status_t s;
 
-    get_remote_key_and_addr((uint64_t) dest, pe, &r_key, &r_dest);
+#ifdef ENABLE_SHMEMIO
+    if (pe >= proc.nranks) {
+        if (proc.io.cache != NULL) {
+            cache_put(dest, src, nbytes, pe);
+        }
+        if (proc.io.nprefetch_fps > 0) {
+            shmemio_prefetch_put((uint64_t) dest, nbytes, pe);
+        }
+        if (wc_put(ch, dest, src, nbytes, pe)) {
+            return;
+            /* NOT REACHED */
+        }
+    }
+#endif /* ENABLE_SHMEMIO */
+
+    if (get_remote_key_and_addr(ch, (uint64_t) dest, pe, &r_key, &r_dest) != 0) {
+        return;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
     s = ucp_put_nbi(ep, src, nbytes, r_dest, r_key);
@@ -761,7 +1144,32 @@ shmemc_ctx_get_nbi(shmem_ctx_t ctx,
     ucp_ep_h ep;
     ucs_status_t s;
 
-    get_remote_key_and_addr((uint64_t) src, pe, &r_key, &r_src);
+#ifdef ENABLE_SHMEMIO
+    if (pe >= proc.nranks) {
+        if (proc.io.cache != NULL) {
+            const size_t done = cache_get(ch, dest, src, nbytes, pe);
+
+            if (done == nbytes) {
+                return;
+                /* NOT REACHED */
+            }
+            /* rest of the get is not in a cached file */
+            dest = (char *) dest + done;
+            src = (const char *) src + done;
+            nbytes -= done;
+        }
+        /* see our own buffered puts */
+        if (wc_flush_pe(ch, pe)) {
+            ucp_worker_fence(ch->w);
+        }
+    }
+#endif /* ENABLE_SHMEMIO */
+
+    if (get_remote_read_key_and_addr(ch, (uint64_t) src, &pe,
+                                     &r_key, &r_src) != 0) {
+        return;
+        /* NOT REACHED */
+    }
     ep = lookup_ucp_ep(ch, pe);
 
     s = ucp_get_nbi(ep, dest, nbytes, r_src, r_key);
@@ -770,6 +1178,93 @@ shmemc_ctx_get_nbi(shmem_ctx_t ctx,
                   ucs_status_string(s));
  }
 
+#ifdef ENABLE_SHMEMIO
+
+/*
+ * Non-blocking get that hands back its request, so single gets (e.g. a
+ * file prefetch) can be tested for completion without a quiet.  NULL
+ * means the get is already complete
+ */
+void *
+shmemc_ctx_get_nbr(shmem_ctx_t ctx,
+                   void *dest, const void *src,
+                   size_t nbytes, int pe)
+{
+    shmemc_context_h ch = (shmemc_context_h) ctx;
+
+    if (pe >= proc.nranks) {
+        if (proc.io.cache != NULL) {
+            const size_t done = cache_get(ch, dest, src, nbytes, pe);
+
+            if (done == nbytes) {
+                return NULL;
+                /* NOT REACHED */
+            }
+            dest = (char *) dest + done;
+            src = (const char *) src + done;
+            nbytes -= done;
+        }
+        if (wc_flush_pe(ch, pe)) {
+            ucp_worker_fence(ch->w);
+        }
+    }
+
+#ifdef HAVE_UCP_GET_NB
+    {
+        uint64_t r_src;
+        ucp_rkey_h r_key;
+        ucs_status_ptr_t sp;
+
+        if (get_remote_read_key_and_addr(ch, (uint64_t) src, &pe,
+                                         &r_key, &r_src) != 0) {
+            return NULL;
+            /* NOT REACHED */
+        }
+        sp = ucp_get_nb(lookup_ucp_ep(ch, pe), dest, nbytes, r_src, r_key,
+                        noop_callback);
+        shmemu_assert(! UCS_PTR_IS_ERR(sp),
+                      "non-blocking get failed (status: %s)",
+                      ucs_status_string(UCS_PTR_STATUS(sp)));
+        return sp;
+    }
+#else
+    shmemc_ctx_get(ctx, dest, src, nbytes, pe);
+    return NULL;
+#endif /* HAVE_UCP_GET_NB */
+}
+
+/*
+ * Make some progress, then return non-zero if the request from
+ * shmemc_ctx_get_nbr is complete.  Complete requests are freed
+ */
+int
+shmemc_ctx_request_test(shmem_ctx_t ctx, void *req)
+{
+    shmemc_context_h ch = (shmemc_context_h) ctx;
+    ucs_status_t s;
+
+    if (req == NULL) {
+        return 1;
+        /* NOT REACHED */
+    }
+
+    (void) ucp_worker_progress(ch->w);
+
+    s = UCX_REQUEST_CHECK(req);
+    if (s == UCS_INPROGRESS) {
+        return 0;
+        /* NOT REACHED */
+    }
+
+    shmemu_assert(s == UCS_OK,
+                  "non-blocking get failed (status: %s)",
+                  ucs_status_string(s));
+    ucp_request_free(req);
+    return 1;
+}
+
+#endif /* ENABLE_SHMEMIO */
+
 #define SHMEMC_PUTGET_SIGNAL(_op)                                       \
     void                                                                \
     shmemc_ctx_##_op##_signal(shmem_ctx_t ctx,                          \
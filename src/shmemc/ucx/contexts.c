@@ -8,6 +8,10 @@
 #include "shmemc.h"
 #include "shmemu.h"
 
+#ifdef ENABLE_SHMEMIO
+#include "shmemio.h"
+#endif /* ENABLE_SHMEMIO */
+
 #include <ucp/api/ucp.h>
 
 /*
@@ -26,6 +30,13 @@ shmemc_context_fill(long options, shmemc_context_h ch)
     ch->attr.private    = options & SHMEM_CTX_PRIVATE;
     ch->attr.nostore    = options & SHMEM_CTX_NOSTORE;
 
+#ifdef ENABLE_SHMEMIO
+    ch->io_nwc = 0;
+    ch->io_wc = NULL;
+    ch->io_fspace = -1;
+    ch->io_region = -1;
+#endif /* ENABLE_SHMEMIO */
+
     wkpm.field_mask  = UCP_WORKER_PARAM_FIELD_THREAD_MODE;
 
     if (ch->attr.serialized) {
@@ -56,6 +67,9 @@ shmemc_context_fill(long options, shmemc_context_h ch)
 void
 shmemc_context_cleanup(shmemc_context_h ch)
 {
+#ifdef ENABLE_SHMEMIO
+    shmemio_wc_release(ch);
+#endif /* ENABLE_SHMEMIO */
     ucp_worker_destroy(ch->w);
 }
 
@@ -78,6 +78,20 @@ typedef struct shmemc_context {
      */
     shmemc_context_attr_t attr;
 
+#ifdef ENABLE_SHMEMIO
+    /*
+     * write combine buffers of puts on this context, one per file pe
+     */
+    int io_nwc;
+    struct shmemio_wc_buf_s *io_wc;
+
+    /*
+     * fspace region the last file pe address translated in
+     */
+    int io_fspace;
+    int io_region;
+#endif /* ENABLE_SHMEMIO */
+
     /*
      * possibly other things
      */
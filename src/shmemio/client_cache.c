@@ -0,0 +1,429 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "shmemu.h"
+#include "shmemc.h"
+#include "shmem.h"
+
+#include "shmemio.h"
+#include "shmemio_client.h"
+#include "shmemio_client_stripe.h"
+
+#include "shmemio_test_util.h"
+
+#ifdef ENABLE_THREADS
+#include "threading.h"
+#endif /* ENABLE_THREADS */
+
+/*
+ * Client read cache. Gets from files opened with SHMEM_FOPEN_CACHE are
+ * served from whole pages read in once from the fpe. The per pe memory
+ * budget is SHMEM_IO_CACHE_SIZE, and pages are SHMEM_IO_CACHE_PAGE bytes.
+ * Pages are dropped least recently used first when the budget is used up.
+ *
+ * Pages are not kept coherent with puts from other pes. Each open file
+ * has an epoch, moved on by flush, shmem_fp_invalidate, or the file
+ * moving or changing size, and a page read in an older epoch is read
+ * again on next use. Epochs are never reused, so pages left over from a
+ * closed file never match a file opened later at the same address
+ *
+ * The cache is shared by all contexts. Under SHMEM_THREAD_MULTIPLE it is
+ * guarded by its own lock, held from looking up a page until done with it
+ */
+
+#define SHMEMIO_CACHE_DEFAULT_PAGE 4096
+
+#ifdef ENABLE_THREADS
+static threadwrap_mutex_t cache_mutex = THREADWRAP_MUTEX_INITIALIZER;
+#endif /* ENABLE_THREADS */
+
+void
+shmemio_cache_lock()
+{
+#ifdef ENABLE_THREADS
+  if (proc.td.osh_tl == SHMEM_THREAD_MULTIPLE)
+    threadwrap_mutex_lock(&cache_mutex);
+#endif /* ENABLE_THREADS */
+}
+
+void
+shmemio_cache_unlock()
+{
+#ifdef ENABLE_THREADS
+  if (proc.td.osh_tl == SHMEM_THREAD_MULTIPLE)
+    threadwrap_mutex_unlock(&cache_mutex);
+#endif /* ENABLE_THREADS */
+}
+
+/*
+ * Bytes of the file held on each pe of its pe set, from fp->addr. Only
+ * the first extent of an extent file is cached, gets from the others
+ * are not served from the cache
+ */
+static inline uint64_t
+cache_fp_pe_len(const shmemio_fp_t *fp)
+{
+  const size_t row = fp_stripe_row((const shmem_fp_t*)fp);
+  const uint64_t len = ((fp->size + row - 1) / row) * fp->unit_size;
+
+  if (fp->nextents > 0) {
+    const uint64_t elen = fp->extents[0].len / fp->pe_size;
+    return (elen < len) ? elen : len;
+  }
+  return len;
+}
+
+/*
+ * Cached files of the fspace pe belongs to
+ */
+static inline shmemio_fp_t *
+cache_pe_fps(int pe)
+{
+  const int fdx = pe_to_fpe_index(pe);
+  if ((fdx < 0) || (fdx >= proc.io.nfpes))
+    return NULL;
+
+  return proc.io.fspaces[proc.io.fpes[fdx].fspace].cached_fps;
+}
+
+/*
+ * Find the cached file holding this address on pe, and the end of the
+ * file on that pe
+ */
+static inline shmemio_fp_t *
+cache_addr_to_fp(uint64_t addr, int pe, uint64_t *fend)
+{
+  for (shmemio_fp_t *fp = cache_pe_fps(pe); fp != NULL; fp = fp->next_cached) {
+    if (!fp_stripe_has_pe((const shmem_fp_t*)fp, pe))
+      continue;
+
+    const uint64_t base = (uint64_t)fp->addr;
+    const uint64_t end = base + cache_fp_pe_len(fp);
+    if ((base <= addr) && (addr < end)) {
+      *fend = end;
+      return fp;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Pages are aligned from the start of their file
+ */
+static inline uint64_t
+cache_page_addr(const shmemio_cache_t *cache, const shmemio_fp_t *fp, uint64_t addr)
+{
+  const uint64_t base = (uint64_t)fp->addr;
+  return base + ((addr - base) & ~((uint64_t)cache->page_size - 1));
+}
+
+static inline void
+cache_lru_remove(shmemio_cache_t *cache, shmemio_cache_page_t *pg)
+{
+  if (pg->lru_prev != NULL)
+    pg->lru_prev->lru_next = pg->lru_next;
+  else
+    cache->lru_head = pg->lru_next;
+
+  if (pg->lru_next != NULL)
+    pg->lru_next->lru_prev = pg->lru_prev;
+  else
+    cache->lru_tail = pg->lru_prev;
+
+  pg->lru_prev = NULL;
+  pg->lru_next = NULL;
+}
+
+static inline void
+cache_lru_push(shmemio_cache_t *cache, shmemio_cache_page_t *pg)
+{
+  pg->lru_prev = NULL;
+  pg->lru_next = cache->lru_head;
+  if (cache->lru_head != NULL)
+    cache->lru_head->lru_prev = pg;
+  else
+    cache->lru_tail = pg;
+  cache->lru_head = pg;
+}
+
+/*
+ * Find the page for this address and pe, or NULL
+ */
+static inline shmemio_cache_page_t *
+cache_find(shmemio_cache_t *cache, uint64_t paddr, int pe)
+{
+  khiter_t k = kh_get(ptr2ptr, cache->pages, paddr);
+  if (k == kh_end(cache->pages))
+    return NULL;
+
+  for (shmemio_cache_page_t *pg = kh_val(cache->pages, k); pg != NULL; pg = pg->next_pe) {
+    if (pg->pe == pe)
+      return pg;
+  }
+  return NULL;
+}
+
+/*
+ * Take a page out of the address table
+ */
+static inline void
+cache_unhash(shmemio_cache_t *cache, shmemio_cache_page_t *pg)
+{
+  khiter_t k = kh_get(ptr2ptr, cache->pages, pg->addr);
+  shmemio_assert(k != kh_end(cache->pages), "cached page %lx not in table\n",
+		 (long unsigned)pg->addr);
+
+  shmemio_cache_page_t **pp = (shmemio_cache_page_t**)&kh_val(cache->pages, k);
+  while (*pp != pg)
+    pp = &((*pp)->next_pe);
+  *pp = pg->next_pe;
+
+  if (kh_val(cache->pages, k) == NULL)
+    kh_del(ptr2ptr, cache->pages, k);
+  pg->next_pe = NULL;
+}
+
+static inline void
+cache_hash(shmemio_cache_t *cache, shmemio_cache_page_t *pg)
+{
+  int absent;
+  khiter_t k = kh_put(ptr2ptr, cache->pages, pg->addr, &absent);
+  pg->next_pe = absent ? NULL : (shmemio_cache_page_t*)kh_val(cache->pages, k);
+  kh_val(cache->pages, k) = (void*)pg;
+}
+
+/*
+ * Get a page object to fill, a new one while under budget, or else the
+ * least recently used one
+ */
+static inline shmemio_cache_page_t *
+cache_new_page(shmemio_cache_t *cache)
+{
+  shmemio_cache_page_t *pg;
+
+  if (cache->npages < cache->max_pages) {
+    pg = (shmemio_cache_page_t*)malloc(sizeof(shmemio_cache_page_t));
+    shmemio_log_ret_if(error, NULL, pg == NULL, "Failed to allocate cache page\n");
+    pg->data = (char*)malloc(cache->page_size);
+    if (pg->data == NULL) {
+      shmemio_log(error, "Failed to allocate %lu bytes of cache page data\n",
+		  (long unsigned)cache->page_size);
+      free(pg);
+      return NULL;
+    }
+    pg->lru_prev = NULL;
+    pg->lru_next = NULL;
+    pg->next_pe = NULL;
+    cache->npages++;
+    return pg;
+  }
+
+  pg = cache->lru_tail;
+  if (pg == NULL)
+    return NULL;
+
+  cache_lru_remove(cache, pg);
+  cache_unhash(cache, pg);
+  cache->evictions++;
+  return pg;
+}
+
+/*
+ * Set up the cache if SHMEM_IO_CACHE_SIZE gives a budget
+ */
+void
+shmemio_cache_init()
+{
+  size_t budget, page_size = SHMEMIO_CACHE_DEFAULT_PAGE;
+
+  proc.io.cache = NULL;
+
+  char *e = getenv("SHMEM_IO_CACHE_SIZE");
+  if ((e == NULL) || (shmemu_parse_size(e, &budget) != 0) || (budget == 0))
+    return;
+
+  e = getenv("SHMEM_IO_CACHE_PAGE");
+  if ((e != NULL) &&
+      ((shmemu_parse_size(e, &page_size) != 0) ||
+       (page_size == 0) || ((page_size & (page_size - 1)) != 0))) {
+    shmemio_log(warn, "Cache page size \"%s\" is not a power of 2, using %d\n",
+		e, SHMEMIO_CACHE_DEFAULT_PAGE);
+    page_size = SHMEMIO_CACHE_DEFAULT_PAGE;
+  }
+
+  if (budget < page_size) {
+    shmemio_log(warn, "Cache budget %lu smaller than a page, cache is off\n",
+		(long unsigned)budget);
+    return;
+  }
+
+  shmemio_cache_t *cache = (shmemio_cache_t*)malloc(sizeof(shmemio_cache_t));
+  shmemio_assert(cache != NULL, "Failed to allocate client read cache");
+
+  cache->page_size = page_size;
+  cache->npages = 0;
+  cache->max_pages = budget / page_size;
+  cache->pages = kh_init(ptr2ptr);
+  cache->lru_head = NULL;
+  cache->lru_tail = NULL;
+  cache->epoch = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->evictions = 0;
+
+  proc.io.cache = cache;
+
+  shmemio_log(info, "Client read cache on, %lu pages of %lu bytes\n",
+	      (long unsigned)cache->max_pages, (long unsigned)page_size);
+}
+
+void
+shmemio_cache_finalize()
+{
+  shmemio_cache_t *cache = proc.io.cache;
+  if (cache == NULL)
+    return;
+
+  shmemio_log(info, "Client read cache %lu hits, %lu misses, %lu evictions\n",
+	      cache->hits, cache->misses, cache->evictions);
+
+  shmemio_cache_page_t *pg = cache->lru_head;
+  while (pg != NULL) {
+    shmemio_cache_page_t *next = pg->lru_next;
+    free(pg->data);
+    free(pg);
+    pg = next;
+  }
+
+  kh_destroy(ptr2ptr, cache->pages);
+  free(cache);
+  proc.io.cache = NULL;
+}
+
+/*
+ * Gets from this file go through the cache from now on
+ */
+void
+shmemio_cache_add_fp(shmemio_fspace_t *fio, shmemio_fp_t *fp)
+{
+  shmemio_cache_lock();
+  fp->cached = 1;
+  fp->cache_epoch = ++(proc.io.cache->epoch);
+  fp->next_cached = fio->cached_fps;
+  fio->cached_fps = fp;
+  shmemio_cache_unlock();
+}
+
+/*
+ * Stop caching a file that is being closed. Its pages are left to age
+ * out of the cache
+ */
+void
+shmemio_cache_remove_fp(shmemio_fp_t *fp)
+{
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fp->fspace]);
+
+  shmemio_cache_lock();
+  shmemio_fp_t **pp = &(fio->cached_fps);
+  while ((*pp != NULL) && (*pp != fp))
+    pp = &((*pp)->next_cached);
+  if (*pp != NULL)
+    *pp = fp->next_cached;
+  fp->cached = 0;
+  shmemio_cache_unlock();
+}
+
+/*
+ * Make pages read so far for this file stale
+ */
+void
+shmemio_cache_new_epoch(shmemio_fp_t *fp)
+{
+  shmemio_cache_lock();
+  fp->cache_epoch = ++(proc.io.cache->epoch);
+  shmemio_cache_unlock();
+}
+
+/*
+ * Get the cache page holding addr on pe, or NULL if the address is not
+ * in a cached file. The page is not valid if it has to be read in,
+ * the caller reads it and marks it valid. The caller holds the cache
+ * lock while it uses the page
+ */
+shmemio_cache_page_t *
+shmemio_cache_page(uint64_t addr, int pe)
+{
+  shmemio_cache_t *cache = proc.io.cache;
+  uint64_t fend;
+  shmemio_fp_t *fp = cache_addr_to_fp(addr, pe, &fend);
+
+  if (fp == NULL)
+    return NULL;
+
+  const uint64_t paddr = cache_page_addr(cache, fp, addr);
+  shmemio_cache_page_t *pg = cache_find(cache, paddr, pe);
+
+  if (pg != NULL) {
+    cache_lru_remove(cache, pg);
+    cache_lru_push(cache, pg);
+
+    if (pg->valid && (pg->epoch == fp->cache_epoch)) {
+      cache->hits++;
+      return pg;
+    }
+  }
+  else {
+    pg = cache_new_page(cache);
+    if (pg == NULL)
+      return NULL;
+
+    pg->addr = paddr;
+    pg->pe = pe;
+    cache_hash(cache, pg);
+    cache_lru_push(cache, pg);
+  }
+
+  //Page has to be read in, but not past the end of the file
+  pg->len = (((paddr + cache->page_size) > fend) ?
+	     (fend - paddr) : cache->page_size);
+  pg->valid = 0;
+  pg->epoch = fp->cache_epoch;
+  cache->misses++;
+  return pg;
+}
+
+/*
+ * Keep pages this pe has cached up to date with its own puts, in every
+ * cached file the put lands in. The caller holds the cache lock
+ */
+void
+shmemio_cache_update(uint64_t addr, const void *src, size_t nbytes, int pe)
+{
+  shmemio_cache_t *cache = proc.io.cache;
+  const uint64_t pend = addr + nbytes;
+
+  for (shmemio_fp_t *fp = cache_pe_fps(pe); fp != NULL; fp = fp->next_cached) {
+    if (!fp_stripe_has_pe((const shmem_fp_t*)fp, pe))
+      continue;
+
+    const uint64_t base = (uint64_t)fp->addr;
+    const uint64_t fend = base + cache_fp_pe_len(fp);
+    const uint64_t start = (addr > base) ? addr : base;
+    const uint64_t end = (pend < fend) ? pend : fend;
+
+    for (uint64_t paddr = cache_page_addr(cache, fp, start); paddr < end; paddr += cache->page_size) {
+      shmemio_cache_page_t *pg = cache_find(cache, paddr, pe);
+      if ((pg == NULL) || !pg->valid || (pg->epoch != fp->cache_epoch))
+	continue;
+
+      const uint64_t lo = (start > paddr) ? start : paddr;
+      const uint64_t hi = (end < (paddr + pg->len)) ? end : (paddr + pg->len);
+      if (hi > lo)
+	memcpy(pg->data + (lo - paddr), (const char*)src + (lo - addr), hi - lo);
+    }
+  }
+}
@@ -102,14 +102,14 @@ shmemio_recv_r_region(ucp_worker_h worker, ucp_ep_h ep, shmemio_remote_region_t
 static inline int
 shmemio_recv_region(ucp_worker_h worker, ucp_ep_h ep, shmemio_client_region_t *reg)
 {
-  int ibuf[4];
-  size_t ibuf_size = sizeof(int) * 4;
+  int ibuf[5];
+  size_t ibuf_size = sizeof(int) * 5;
   int ret;
 
   ret = shmemio_streamrecv(worker, ep, ibuf, ibuf_size);
   shmemio_log_ret_if(error, -1, (ret != ibuf_size), "failed to recv region value fields\n");
 
-  ret = client_region_recv_init(reg, ibuf[0], ibuf[1], ibuf[2], ibuf[3]);
+  ret = client_region_recv_init(reg, ibuf[0], ibuf[1], ibuf[2], ibuf[3], ibuf[4]);
   shmemio_log_ret_if(error, -1, (ret != 0), "client region recv init fail\n");
   
   for (int idx = 0; idx < reg->fpe_size; idx++) {
@@ -237,6 +237,9 @@ shmemio_connect_fspace(shmem_fspace_conx_t *conx, int fid)
 static inline int
 shmemio_req_regions(shmemio_fspace_t *fio, int new_nregions)
 {
+  shmemio_log_ret_if(error, -1, fio->req_ep == NULL,
+		     "No server connection on this pe to request regions\n");
+
   int nnew = new_nregions - fio->nregions;
   shmemio_assert(nnew > 0, "Cannot reduce number of regions from %d to %d\n", fio->nregions, new_nregions);
 
@@ -260,14 +263,16 @@ shmemio_req_regions(shmemio_fspace_t *fio, int new_nregions)
   return 0;
 }
 
-int
-shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp, int *err)
+/*
+ * Fill an fopen request for the file with the fp parameters
+ */
+void
+shmemio_client_fopen_req(shmemio_fspace_t *fio, const char *file, const shmemio_fp_t *fp,
+			 const shmem_fopen_attr_t *attr, shmemio_req_t *req)
 {
-  int ret;
-  shmemio_req_t req;
-  shmemio_fopen_req_t *foreq = (shmemio_fopen_req_t*)req.payload;
+  shmemio_fopen_req_t *foreq = (shmemio_fopen_req_t*)req->payload;
 
-  req.type = shmemio_fopen_req;
+  req->type = shmemio_fopen_req;
 
   foreq->fsize        = fp->size;
   foreq->sfpe_start   = ( (fp->pe_start < 0) ?
@@ -278,6 +283,17 @@ shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp,
 
   foreq->unit_size = fp->unit_size;
 
+  foreq->flags     = (attr == NULL) ? 0 : attr->flags;
+  foreq->nreplicas = ( ((attr == NULL) || !(attr->flags & SHMEM_FOPEN_REPLICATE)) ?
+		       0 : attr->nreplicas );
+
+  foreq->capacity = ( ((attr != NULL) && (attr->flags & SHMEM_FOPEN_RESERVE)) ?
+		      attr->reserve : 0 );
+
+  //Set by the server if it publishes the stat
+  foreq->stat_region = -1;
+  foreq->stat_slot   = -1;
+
   if (file == NULL) {
     foreq->file_path_len = 0;
   }
@@ -285,33 +301,41 @@ shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp,
     foreq->file_path_len = strlen(file);
   }
   
-  req.status = shmemio_err_unknown;
+  req->status = shmemio_err_unknown;
 
   shmemio_log(info, "Sending request to open file %s (len=%d), size %lu, unit_size %d on pe [%d +%d] by %d\n",
 	      file, foreq->file_path_len, foreq->fsize, foreq->unit_size,
 	      foreq->sfpe_start, foreq->sfpe_size, foreq->sfpe_stride);
+}
 
-  ret = shmemio_streamsend(fio->ch->w, fio->req_ep, &req, sizeof(shmemio_req_t));
-  shmemio_log_ret_if(error, -1, ret < 0, "Failed to send fopen request\n");
-
-  if (foreq->file_path_len != 0) {
-    ret = shmemio_streamsend(fio->ch->w, fio->req_ep, file, foreq->file_path_len);
-    shmemio_log_ret_if(error, -1, ret < 0, "Failed to send file path\n");
-  }
-  
-  ret = shmemio_streamrecv(fio->ch->w, fio->req_ep, &req, sizeof(shmemio_req_t));
-  shmemio_log_ret_if(error, -1, ret != sizeof(shmemio_req_t), "Failed to recv fopen response\n");
+/*
+ * Set up the fp from the server response to its fopen request
+ */
+int
+shmemio_client_fopen_finish(shmemio_fspace_t *fio, shmemio_fp_t *fp,
+			    shmemio_req_t *req, int *err)
+{
+  int ret;
+  shmemio_fopen_req_t *foreq = (shmemio_fopen_req_t*)req->payload;
 
-  if (req.status != shmemio_success) {
+  if (req->status != shmemio_success) {
     shmemio_log(error, "Server failed to open file\n");
-    shmemio_seterr(err, req.status);
+    shmemio_seterr(err, req->status);
     return -1;
   }
   
-  if (foreq->l_region >= fio->nregions) {
+  //Replica regions are made right after the file region
+  int max_region = foreq->l_region + foreq->nreplicas;
+  if (foreq->stat_region > max_region) {
+    max_region = foreq->stat_region;
+  }
+  
+  if (max_region >= fio->nregions) {
     shmemio_log(info, "fopen results in region id %d, I only have up to %d. Requesting that region\n",
-		foreq->l_region, fio->nregions - 1);
-    ret = shmemio_req_regions(fio, foreq->l_region + 1);
+		max_region, fio->nregions - 1);
+    //Region data is not a response, nothing else may be in flight
+    shmemio_fio_drain(fio);
+    ret = shmemio_req_regions(fio, max_region + 1);
     if ( ret < 0 ) {
       shmemio_log(error, "Failed to request required regions for fopen\n");
       shmemio_seterr(err, shmemio_err_region_req);
@@ -324,11 +348,362 @@ shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp,
   fp->pe_size    = foreq->sfpe_size;
   fp->unit_size  = foreq->unit_size;
   fp->size       = foreq->fsize;
+  fp->capacity   = foreq->capacity;
   
   fp->l_region   = foreq->l_region;
   fp->offset     = foreq->offset;
   fp->addr       = (void*)(fio->l_regions[fp->l_region].l_base + fp->offset);
   fp->fkey       = foreq->fkey;
+  fp->oflags     = foreq->flags;
+
+  fp->stat_region = foreq->stat_region;
+  fp->stat_slot   = foreq->stat_slot;
+  fp->stat_lease  = 0;
+
+  //Gets from the file go through the read cache, if this pe has one
+  if ((proc.io.cache != NULL) && (foreq->flags & SHMEM_FOPEN_CACHE)) {
+    shmemio_cache_add_fp(fio, fp);
+  }
+
+  if (foreq->nreplicas > 0) {
+    ret = client_region_link_replicas(fio, fp->l_region, foreq->flags & SHMEM_FOPEN_REPLICA_LOAD);
+    shmemio_log_if(warn, ret != foreq->nreplicas,
+		   "Server made %d replicas, linked %d\n", foreq->nreplicas, ret);
+  }
+
+  if (foreq->flags & SHMEM_FOPEN_EXTENTS) {
+    ret = shmemio_client_fetch_extents(fio, fp);
+    if (ret != shmemio_success) {
+      shmemio_log(error, "Failed to get extents of file\n");
+      shmemio_seterr(err, ret);
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+/*
+ * Get the extents of an extent file this client does not know yet, and
+ * any regions they were put on. Extents are never moved or dropped, so
+ * only new ones are asked for
+ */
+int
+shmemio_client_fetch_extents(shmemio_fspace_t *fio, shmemio_fp_t *fp)
+{
+  const size_t row = (size_t)fp->unit_size * fp->pe_size;
+  int total;
+
+  do {
+    shmemio_req_t req;
+    shmemio_extents_req_t *exreq = (shmemio_extents_req_t*)req.payload;
+    req.type = shmemio_extents_req;
+    req.status = shmemio_err_unknown;
+    exreq->fkey = fp->fkey;
+    exreq->first = fp->nextents;
+
+    int ret = shmemio_fio_send(fio, &req);
+    shmemio_log_ret_if(error, shmemio_err_send, ret < 0, "Failed to send extents request\n");
+
+    ret = shmemio_fio_recv(fio, &req);
+    shmemio_log_ret_if(error, shmemio_err_recv, ret < 0, "Failed to recv extents response\n");
+
+    if (req.status != shmemio_success) {
+      return req.status;
+    }
+
+    total = exreq->total;
+    if (exreq->count <= 0) {
+      break;
+    }
+
+    shmemio_client_extent_t *exts = realloc(fp->extents, sizeof(shmemio_client_extent_t) *
+					    (fp->nextents + exreq->count));
+    shmemio_log_ret_if(error, shmemio_err_nomem, exts == NULL, "Failed to grow extent table\n");
+    fp->extents = exts;
+
+    for (int idx = 0; idx < exreq->count; idx++) {
+      const shmemio_extent_t *ext = &(exreq->ext[idx]);
+
+      if (ext->region >= fio->nregions) {
+	//Region data is not a response, nothing else may be in flight
+	shmemio_fio_drain(fio);
+	ret = shmemio_req_regions(fio, ext->region + 1);
+	shmemio_log_ret_if(error, shmemio_err_region_req, ret < 0,
+			   "Failed to request region %d of extent\n", ext->region);
+      }
+
+      shmemio_client_extent_t *cext = &(fp->extents[fp->nextents++]);
+      cext->foff = ext->foff;
+      cext->len  = ext->rows * row;
+      cext->addr = (char*)(fio->l_regions[ext->region].l_base + ext->offset);
+    }
+  } while (fp->nextents < total);
+
+  shmemio_log(trace, "File %p has %d extents\n", fp, fp->nextents);
+  return shmemio_success;
+}
+
+/*
+ * Make sure the client knows the extents up to file offset end. Another
+ * pe may have grown the file
+ */
+int
+shmemio_client_sync_extents(shmemio_fp_t *fp, size_t end)
+{
+  if (fp->nextents == 0) {
+    return shmemio_success;
+  }
+
+  const shmemio_client_extent_t *last = &(fp->extents[fp->nextents - 1]);
+  if (end <= (last->foff + last->len)) {
+    return shmemio_success;
+  }
+  
+  int ret = shmemio_client_fetch_extents(&(proc.io.fspaces[fp->fspace]), fp);
+  if (ret != shmemio_success) {
+    return ret;
+  }
+
+  last = &(fp->extents[fp->nextents - 1]);
+  shmemio_log_ret_if(error, shmemio_err_invalid, end > (last->foff + last->len),
+		     "File offset %lu is past the last extent\n", (long unsigned)end);
+  return shmemio_success;
+}
+
+/*
+ * Open a file with one request to the server. The server response is
+ * left in req
+ */
+int
+shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp,
+		     const shmem_fopen_attr_t *attr, shmemio_req_t *req, int *err)
+{
+  int ret;
+  shmemio_fopen_req_t *foreq = (shmemio_fopen_req_t*)req->payload;
+
+  shmemio_client_fopen_req(fio, file, fp, attr, req);
+
+  ret = shmemio_fio_send(fio, req);
+  shmemio_log_ret_if(error, -1, ret < 0, "Failed to send fopen request\n");
+
+  if (foreq->file_path_len != 0) {
+    ret = shmemio_streamsend(fio->ch->w, fio->req_ep, file, foreq->file_path_len);
+    shmemio_log_ret_if(error, -1, ret < 0, "Failed to send file path\n");
+  }
+  
+  ret = shmemio_fio_recv(fio, req);
+  shmemio_log_ret_if(error, -1, ret < 0, "Failed to recv fopen response\n");
+
+  return shmemio_client_fopen_finish(fio, fp, req, err);
+}
+
+/*
+ * Pack regions [rstart, rmax) as the server sends them, to hand to other
+ * pes. Returns the bytes packed, or -1 if they do not fit in maxlen
+ */
+ssize_t
+shmemio_client_pack_regions(shmemio_fspace_t *fio, int rstart, int rmax, char *buf, size_t maxlen)
+{
+  size_t len = 0;
+
+  for (int idx = rstart; idx < rmax; idx++) {
+    const shmemio_client_region_t *reg = &(fio->l_regions[idx]);
+    const int ibuf[5] = { reg->fpe_start, reg->fpe_stride, reg->fpe_size,
+			  reg->unit_size, reg->replica_of };
+
+    if ((len + sizeof(ibuf)) > maxlen) {
+      return -1;
+    }
+    memcpy(buf + len, ibuf, sizeof(ibuf));
+    len += sizeof(ibuf);
+
+    for (int fdx = 0; fdx < reg->fpe_size; fdx++) {
+      const shmemio_remote_region_t *rreg = &(reg->r_regions[fdx]);
+      const size_t rbuf[4] = { rreg->r_base, rreg->r_end, rreg->len, rreg->rkey_len };
+
+      if ((len + sizeof(rbuf) + rreg->rkey_len) > maxlen) {
+	return -1;
+      }
+      memcpy(buf + len, rbuf, sizeof(rbuf));
+      len += sizeof(rbuf);
+      memcpy(buf + len, rreg->packed_rkey, rreg->rkey_len);
+      len += rreg->rkey_len;
+    }
+  }
+
+  return (ssize_t)len;
+}
+
+/*
+ * Read regions [rstart, rmax) packed by shmemio_client_pack_regions into
+ * the regions from nold on, which must be allocated. Returns the bytes
+ * read, or -1 if the pack is cut short
+ */
+static ssize_t
+client_parse_regions(shmemio_fspace_t *fio, int nold, int rstart, int rmax,
+		     const char *buf, size_t len)
+{
+  size_t pos = 0;
+  for (int idx = rstart; idx < rmax; idx++) {
+    int ibuf[5];
+    shmemio_log_ret_if(error, -1, pos + sizeof(ibuf) > len,
+		       "Packed regions cut short at region %d\n", idx);
+    memcpy(ibuf, buf + pos, sizeof(ibuf));
+    pos += sizeof(ibuf);
+
+    //This pe may already have the first regions of the pack
+    shmemio_client_region_t *reg = (idx < nold) ? NULL : &(fio->l_regions[idx]);
+    if (reg != NULL) {
+      client_region_recv_init(reg, ibuf[0], ibuf[1], ibuf[2], ibuf[3], ibuf[4]);
+    }
+
+    for (int fdx = 0; fdx < ibuf[2]; fdx++) {
+      size_t rbuf[4];
+      shmemio_log_ret_if(error, -1, pos + sizeof(rbuf) > len,
+			 "Packed regions cut short at region %d fpe %d\n", idx, fdx);
+      memcpy(rbuf, buf + pos, sizeof(rbuf));
+      pos += sizeof(rbuf);
+
+      shmemio_log_ret_if(error, -1, rbuf[3] > len - pos,
+			 "Packed rkey of region %d fpe %d cut short\n", idx, fdx);
+
+      if (reg != NULL) {
+	shmemio_remote_region_t *rreg = &(reg->r_regions[fdx]);
+	remote_region_recv_init(rreg, rbuf[0], rbuf[1], rbuf[2], rbuf[3]);
+	memcpy(rreg->packed_rkey, buf + pos, rreg->rkey_len);
+	if (fdx == 0) {
+	  reg->len = rreg->len;
+	}
+      }
+      pos += rbuf[3];
+    }
+  }
+
+  return pos;
+}
+
+/*
+ * Make sure this pe has regions up to rmax, using regions [rstart, rmax)
+ * packed by another pe. Regions before rstart this pe does not have yet,
+ * or regions that did not fit in the pack, are asked from the server
+ */
+int
+shmemio_client_unpack_regions(shmemio_fspace_t *fio, int rstart, int rmax,
+			      const char *buf, size_t len)
+{
+  const int nold = fio->nregions;
+  if (rmax <= nold) {
+    return 0;
+  }
+
+  if ((nold < rstart) || (rstart == rmax)) {
+    //Region data is not a response, nothing else may be in flight
+    shmemio_fio_drain(fio);
+    return shmemio_req_regions(fio, rmax);
+  }
+
+  int ret = fspace_extend_client_regions(fio, rmax - nold);
+  shmemio_log_ret_if(error, -1, ret < 0, "failed to allocate new regions in fspace\n");
+
+  ret = (client_parse_regions(fio, nold, rstart, rmax, buf, len) < 0) ? -1 : 0;
+  shmemio_log_ret_if(error, -1, ret < 0, "Failed to read packed regions\n");
+
+  ret = shmemio_fill_regions(fio, nold, rmax);
+  shmemio_log_ret_if(error, -1, ret < 0, "Failed to fill regions\n");
+
+  return 0;
+}
+
+/*
+ * Pack what a pe gets from the server on connect, the fpe worker
+ * addresses then all regions, to hand to other pes. The buffer is
+ * malloced, the caller frees it
+ */
+char *
+shmemio_client_pack_fspace(shmemio_fspace_t *fio, size_t *len)
+{
+  size_t maxlen = 0;
+
+  for (int idx = fio->fpe_start; idx < fio->fpe_end; idx++) {
+    maxlen += sizeof(size_t) + proc.io.fpes[idx].server_addr_len;
+  }
+  for (int idx = 0; idx < fio->nregions; idx++) {
+    const shmemio_client_region_t *reg = &(fio->l_regions[idx]);
+    maxlen += sizeof(int) * 5;
+    for (int fdx = 0; fdx < reg->fpe_size; fdx++) {
+      maxlen += (sizeof(size_t) * 4) + reg->r_regions[fdx].rkey_len;
+    }
+  }
+
+  char *buf = (char*)malloc(maxlen);
+  shmemio_log_ret_if(error, NULL, (buf == NULL) && (maxlen > 0),
+		     "Failed to allocate %lu bytes to pack fspace\n", (long unsigned)maxlen);
+
+  size_t pos = 0;
+  for (int idx = fio->fpe_start; idx < fio->fpe_end; idx++) {
+    const shmemio_client_fpe_t *fpe = &(proc.io.fpes[idx]);
+    memcpy(buf + pos, &(fpe->server_addr_len), sizeof(size_t));
+    pos += sizeof(size_t);
+    memcpy(buf + pos, fpe->server_addr, fpe->server_addr_len);
+    pos += fpe->server_addr_len;
+  }
+
+  const ssize_t rlen = shmemio_client_pack_regions(fio, 0, fio->nregions, buf + pos, maxlen - pos);
+  if (rlen < 0) {
+    shmemio_log(error, "Packed regions overflow the fspace pack\n");
+    free(buf);
+    return NULL;
+  }
+
+  *len = pos + rlen;
+  return buf;
+}
+
+/*
+ * Take the fspace another pe got on connect, packed by
+ * shmemio_client_pack_fspace, instead of a handshake with the server
+ */
+int
+shmemio_client_unpack_fspace(shmemio_fspace_t *fio, int fid, int nfpes, int nregions,
+			     const char *buf, size_t len)
+{
+  fio->nfpes = nfpes;
+
+  if (fpe_range_assign(fio, fid) != fio->nfpes) {
+    shmemio_log(error, "failed to assign fpe range to fspace\n");
+    return -1;
+  }
+
+  size_t pos = 0;
+  for (int idx = fio->fpe_start; idx < fio->fpe_end; idx++) {
+    shmemio_client_fpe_t *fpe = &(proc.io.fpes[idx]);
+    size_t addr_len;
+
+    shmemio_log_ret_if(error, -1, pos + sizeof(size_t) > len,
+		       "Packed fspace cut short at fpe %d\n", idx);
+    memcpy(&addr_len, buf + pos, sizeof(size_t));
+    pos += sizeof(size_t);
+    shmemio_log_ret_if(error, -1, addr_len > len - pos,
+		       "Packed address of fpe %d cut short\n", idx);
+
+    int ret = fpe_recv_init(fpe, addr_len);
+    shmemio_log_ret_if(error, -1, (ret != 0), "fpe recv init fail\n");
+    memcpy(fpe->server_addr, buf + pos, addr_len);
+    pos += addr_len;
+  }
+
+  if (nregions > 0) {
+    if (fspace_extend_client_regions(fio, nregions) < 0) {
+      shmemio_log(error, "failed to allocate new regions in fspace\n");
+      return -1;
+    }
+    if (client_parse_regions(fio, 0, 0, nregions, buf + pos, len - pos) < 0) {
+      shmemio_log(error, "failed to read packed regions of fspace\n");
+      return -1;
+    }
+  }
+
   return 0;
 }
 
@@ -340,7 +715,16 @@ update_fp_status(shmemio_req_t *req, shmemio_fp_req_t *fpreq, shmem_fp_t *infp)
     
     shmemio_fspace_t *fio = &(proc.io.fspaces[fp->fspace]);
 
+    //Cached pages of a file that moved or changed size are no good
+    if (fp->cached && ((fp->offset != fpreq->offset) || (fp->size != fpreq->size))) {
+      shmemio_cache_new_epoch(fp);
+    }
+
+    //This pe changed the file, a stat it kept is out of date
+    fp->stat_lease = 0;
+
     fp->size      = fpreq->size;
+    fp->capacity  = fpreq->capacity;
     fp->offset    = fpreq->offset;
     fp->addr      = (void*)(fio->l_regions[fp->l_region].l_base + fp->offset);
     fp->fkey      = fpreq->fkey;
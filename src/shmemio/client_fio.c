@@ -0,0 +1,285 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "shmemu.h"
+#include "shmemc.h"
+#include "shmem.h"
+
+#include "shmemio.h"
+#include "shmemio_client.h"
+
+#include "shmemio_test_util.h"
+#include "shmemio_stream_util.h"
+
+/*
+ * File management requests in flight. Every request to the server gets a
+ * sequence number, echoed back in its response. Responses can come back
+ * out of order, since blocked flush and close requests are only answered
+ * once the file unblocks, so each response is handed to the blocking
+ * caller or the non-blocking handle with its sequence number.
+ *
+ * Replies that are not a shmemio_req_t (stat and region data) must only
+ * be received once no request is in flight, see shmemio_fio_drain
+ */
+
+/*
+ * Hand the response just received to whoever waits on its seq
+ */
+static inline void
+fio_dispatch(shmemio_fspace_t *fio)
+{
+  const unsigned seq = fio->resp.seq;
+
+  shmemio_log(trace, "Receive response to request type %d, seq %u, status %d\n",
+	      fio->resp.type, seq, fio->resp.status);
+
+  if ((fio->wait_resp != NULL) && (fio->wait_seq == seq)) {
+    memcpy(fio->wait_resp, &(fio->resp), sizeof(shmemio_req_t));
+    fio->wait_resp = NULL;
+    return;
+  }
+
+  for (shmemio_fio_req_t *fr = fio->pending; fr != NULL; fr = fr->next) {
+    if (!fr->done && (fr->seq == seq)) {
+      memcpy(&(fr->req), &(fio->resp), sizeof(shmemio_req_t));
+      fr->done = 1;
+      return;
+    }
+  }
+
+  shmemio_log(warn, "Response type %d, seq %u matches no request\n", fio->resp.type, seq);
+}
+
+/*
+ * Make progress on the response stream. Only call with a response due
+ */
+static inline int
+fio_progress(shmemio_fspace_t *fio)
+{
+  if (fio->resp_posted == NULL) {
+    size_t len;
+    shmemio_streamreq_t *request = ucp_stream_recv_nb(fio->req_ep, &(fio->resp), 1,
+						      ucp_dt_make_contig(sizeof(shmemio_req_t)),
+						      stream_recv_cb, &len,
+						      UCP_STREAM_RECV_FLAG_WAITALL);
+    if (UCS_PTR_IS_ERR(request)) {
+      shmemio_log(error, "unable to recv UCX message (%s)\n",
+		  ucs_status_string(UCS_PTR_STATUS(request)));
+      return -1;
+    }
+    if (UCS_PTR_STATUS(request) == UCS_OK) {
+      //Response was already here
+      fio_dispatch(fio);
+      return 0;
+    }
+    fio->resp_posted = request;
+  }
+
+  ucp_worker_progress(fio->ch->w);
+
+  if (fio->resp_posted->complete != 0) {
+    /* This request may be reused so initialize it for next time */
+    fio->resp_posted->complete = 0;
+    ucp_request_free(fio->resp_posted);
+    fio->resp_posted = NULL;
+    fio_dispatch(fio);
+  }
+  return 0;
+}
+
+static inline void
+fio_unlink(shmemio_fspace_t *fio, shmemio_fio_req_t *fr)
+{
+  shmemio_fio_req_t **pp = &(fio->pending);
+  while ((*pp != NULL) && (*pp != fr))
+    pp = &((*pp)->next);
+  if (*pp != NULL)
+    *pp = fr->next;
+  fr->next = NULL;
+}
+
+/*
+ * Send a request, giving it the next sequence number
+ */
+int
+shmemio_fio_send(shmemio_fspace_t *fio, shmemio_req_t *req)
+{
+  shmemio_log_ret_if(error, -1, fio->req_ep == NULL,
+		     "Fspace has no server connection on this pe, request type %d must come from the pe that connected\n",
+		     req->type);
+
+  req->seq = fio->next_seq++;
+
+  int ret = shmemio_streamsend(fio->ch->w, fio->req_ep, req, sizeof(shmemio_req_t));
+  shmemio_log_ret_if(error, -1, ret < 0,
+		     "Failed to send request type %d\n", req->type);
+  return 0;
+}
+
+/*
+ * Wait for the response to a request sent with shmemio_fio_send. The
+ * response is written over the request
+ */
+int
+shmemio_fio_recv(shmemio_fspace_t *fio, shmemio_req_t *req)
+{
+  fio->wait_seq = req->seq;
+  fio->wait_resp = req;
+
+  while (fio->wait_resp != NULL) {
+    if (fio_progress(fio) < 0) {
+      fio->wait_resp = NULL;
+      shmemio_log(error, "Failed to recv response type %d\n", req->type);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Receive the responses to all non-blocking requests of the fspace. The
+ * handles stay pending until tested or waited on
+ */
+void
+shmemio_fio_drain(shmemio_fspace_t *fio)
+{
+  for (shmemio_fio_req_t *fr = fio->pending; fr != NULL; ) {
+    if (fr->done) {
+      fr = fr->next;
+      continue;
+    }
+    if (fio_progress(fio) < 0) {
+      fr->req.status = shmemio_err_recv;
+      fr->done = 1;
+    }
+    //Responses may come in any order, look again from the start
+    fr = fio->pending;
+  }
+}
+
+/*
+ * Send a request, and data_len bytes of data after it, without waiting
+ * for the response. The finish call runs once the response is taken,
+ * whatever its status, and returns the status of the request
+ */
+shmemio_fio_req_t *
+shmemio_fio_start(int fspace, const shmemio_req_t *req, const void *data, size_t data_len,
+		  shmemio_fp_t *fp, shmemio_fio_finish_t finish)
+{
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fspace]);
+
+  shmemio_fio_req_t *fr = (shmemio_fio_req_t*)malloc(sizeof(shmemio_fio_req_t));
+  shmemio_log_ret_if(error, NULL, fr == NULL, "Failed to allocate request handle\n");
+
+  memcpy(&(fr->req), req, sizeof(shmemio_req_t));
+  fr->fspace = fspace;
+  fr->done = 0;
+  fr->fp = fp;
+  fr->fp_out = NULL;
+  fr->finish = finish;
+
+  if (shmemio_fio_send(fio, &(fr->req)) < 0) {
+    free(fr);
+    return NULL;
+  }
+  fr->seq = fr->req.seq;
+
+  if ((data_len > 0) &&
+      (shmemio_streamsend(fio->ch->w, fio->req_ep, data, data_len) < 0)) {
+    shmemio_log(error, "Failed to send %lu bytes of request data\n", (long unsigned)data_len);
+    free(fr);
+    return NULL;
+  }
+
+  fr->next = fio->pending;
+  fio->pending = fr;
+  return fr;
+}
+
+/*
+ * The file is being closed. Pending requests on it still complete, but
+ * they no longer update it
+ */
+void
+shmemio_fio_detach_fp(shmemio_fspace_t *fio, const shmemio_fp_t *fp)
+{
+  for (shmemio_fio_req_t *fr = fio->pending; fr != NULL; fr = fr->next) {
+    if (fr->fp == fp)
+      fr->fp = NULL;
+  }
+}
+
+/*
+ * Client API: Test a file management request. Returns nonzero and the
+ * request status once it completed, and the handle is then freed
+ */
+int shmem_fio_test(shmem_fio_t *req, int *status)
+{
+  shmemio_fio_req_t *fr = *req;
+
+  if (fr == NULL) {
+    shmemio_seterr(status, shmemio_success);
+    return 1;
+  }
+
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fr->fspace]);
+
+  if (!fr->done && (fio_progress(fio) < 0)) {
+    fr->req.status = shmemio_err_recv;
+    fr->done = 1;
+  }
+
+  if (!fr->done)
+    return 0;
+
+  const int ret = (fr->finish != NULL) ? fr->finish(fr) : fr->req.status;
+
+  fio_unlink(fio, fr);
+  free(fr);
+  *req = NULL;
+
+  shmemio_seterr(status, ret);
+  return 1;
+}
+
+/*
+ * Client API: Wait for a file management request, return its status
+ */
+int shmem_fio_wait(shmem_fio_t *req)
+{
+  int status;
+  while (!shmem_fio_test(req, &status))
+    ;
+  return status;
+}
+
+/*
+ * Client API: Wait for n file management requests. Returns the first
+ * error, or success if they all succeeded
+ */
+int shmem_fio_waitall(int n, shmem_fio_t *reqs)
+{
+  int ret = shmemio_success;
+  int left = n;
+
+  while (left > 0) {
+    left = 0;
+    for (int idx = 0; idx < n; idx++) {
+      int status;
+      if (reqs[idx] == NULL)
+	continue;
+      if (shmem_fio_test(&(reqs[idx]), &status)) {
+	if ((ret == shmemio_success) && (status != shmemio_success))
+	  ret = status;
+      }
+      else {
+	left++;
+      }
+    }
+  }
+  return ret;
+}
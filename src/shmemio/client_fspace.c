@@ -17,6 +17,8 @@
 #include "shmemio_client_region.h"
 #include "shmemio_stream_util.h"
 
+#include "threading.h"
+
 /*
  * How many fspace objects to malloc at a time when none are available
  * Only need one fspace object per shmem_connect call, even if connecting to large number of fpes
@@ -36,6 +38,7 @@ fspace_reset(int fid)
   fio->valid = 0;
   
   fio->req_ep = NULL;
+  fio->lazy = 0;
   
   fio->nfpes = 0;
   fio->fpe_start = -1;
@@ -45,6 +48,17 @@ fspace_reset(int fid)
   fio->l_regions = NULL;
 
   fio->used_addrs = NULL;
+  fio->cached_fps = NULL;
+  fio->prefetch_fps = NULL;
+
+  fio->rsorted = NULL;
+  fio->nsorted = 0;
+
+  fio->next_seq = 0;
+  fio->pending = NULL;
+  fio->wait_seq = 0;
+  fio->wait_resp = NULL;
+  fio->resp_posted = NULL;
 }
 
 
@@ -65,6 +79,18 @@ shmemio_release_fspace(int fid)
   if (fio->used_addrs != NULL) {
     free(fio->used_addrs);
   }
+
+  if (fio->rsorted != NULL) {
+    free(fio->rsorted);
+  }
+
+  //Handles not waited on before disconnect are gone with the fspace
+  while (fio->pending != NULL) {
+    shmemio_fio_req_t *fr = fio->pending;
+    shmemio_log(warn, "Drop request type %d, seq %u never waited on\n", fr->req.type, fr->seq);
+    fio->pending = fr->next;
+    free(fr);
+  }
   
   fspace_reset(fid);
 }
@@ -152,7 +178,7 @@ shmemio_fill_fspace(int fid)
 {
   shmemio_fspace_t* fio = &proc.io.fspaces[fid];
 
-  for (int idx = fio->fpe_start; idx < fio->fpe_end; idx++) {
+  for (int idx = fio->fpe_start; (idx < fio->fpe_end) && !fio->lazy; idx++) {
     shmemio_log(trace, "Fspace %d fill fpe %d of [%d:%d]\n",
 		fid, idx, fio->fpe_start, fio->fpe_end);
   
@@ -176,4 +202,59 @@ shmemio_fill_fspace(int fid)
   return 0;
 }
 
+/*
+ * Lazy fills can come from any thread under SHMEM_THREAD_MULTIPLE. The
+ * rkey is published last, so a thread that sees it set can use it
+ * without the lock
+ */
+static threadwrap_mutex_t lazy_fill_mutex = THREADWRAP_MUTEX_INITIALIZER;
+
+/*
+ * On a lazy fspace, make the endpoint to the fpe if there is none yet
+ * and unpack the rkey of the remote region, unless already done
+ */
+int
+shmemio_fill_remote_region(shmemio_fspace_t *fio, int fpe, shmemio_remote_region_t *r_reg)
+{
+  if (__atomic_load_n(&(r_reg->rkey), __ATOMIC_ACQUIRE) != NULL) {
+    return 0;
+  }
+
+  const int locked = (proc.td.osh_tl == SHMEM_THREAD_MULTIPLE);
+  if (locked) {
+    threadwrap_mutex_lock(&lazy_fill_mutex);
+  }
+
+  shmemio_client_fpe_t *cfpe = &(proc.io.fpes[fpe]);
+  int ret = 0;
+
+  //Another thread may have filled it while this one waited
+  if (r_reg->rkey != NULL) {
+    goto out;
+  }
+
+  if (cfpe->server_ep == NULL) {
+    shmemio_log(trace, "Fill fpe %d on first access\n", fpe);
+    if (fpe_fill(cfpe, fio) != 0) {
+      shmemio_log(error, "failed to create fpe endpoints for fpe %d\n", fpe);
+      ret = -1;
+      goto out;
+    }
+    proc.comms.eps[fpe_to_pe_index(fpe)] = cfpe->server_ep;
+  }
+
+  //Unpack into a copy so the rkey is only seen once complete
+  shmemio_remote_region_t filled = *r_reg;
+  ret = remote_region_fill(fpe, &filled);
+  if (ret == 0) {
+    __atomic_store_n(&(r_reg->rkey), filled.rkey, __ATOMIC_RELEASE);
+  }
+
+ out:
+  if (locked) {
+    threadwrap_mutex_unlock(&lazy_fill_mutex);
+  }
+  return ret;
+}
+
 
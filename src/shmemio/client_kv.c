@@ -0,0 +1,845 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "shmemu.h"
+#include "shmemc.h"
+#include "shmem.h"
+
+#include "shmemio.h"
+#include "shmemio_client.h"
+#include "shmemio_client_stripe.h"
+
+#include "shmemio_test_util.h"
+
+/*
+ * Key-value store in an fspace file. The first stripe row holds a
+ * header, then come fixed size buckets, packed into stripe units so no
+ * bucket spans two pes. Buckets follow the file striping, so consecutive
+ * units of buckets are on consecutive pes of the file. Past the hashed
+ * buckets are overflow buckets, taken with a fetch-add on the header and
+ * linked from the last full bucket of a chain.
+ *
+ * A bucket is a next word, the overflow bucket + 1 or 0, then its slots.
+ * A slot is a state word, the key and the value. The state word holds the
+ * key hash tag, a version bumped on every change, and the slot state:
+ *
+ *   empty -> writing -> ready -> writing -> ready ... -> dead
+ *
+ * Writers take a slot with a remote compare-and-swap to writing, put the
+ * key and value, and set it ready after a fence. Slots fill in order and
+ * dead slots are only taken again by new keys, so a lookup stops at the
+ * first empty slot. Lookups get a whole bucket in one get to find the
+ * slot, then read it as a seqlock: fetch the state word, get the key and
+ * value, and fetch the state word again, starting over if it changed. A
+ * bucket get is not ordered within itself, so its copy of a slot is only
+ * a hint.
+ *
+ * Two pes inserting the same new key at once race for the same first
+ * free slot, and the loser finds the key there. A key deleted and put
+ * again while another pe puts it may still end up in two slots, and
+ * lookups then return the first.
+ */
+
+#define SHMEMIO_KV_MAGIC    0x53484b5631000001UL  /* "SHKV1" */
+#define SHMEMIO_KV_BUSY     0x53484b5631000000UL  /* being formatted */
+#define SHMEMIO_KV_ZERO_BUF (64 * 1024)
+
+#define KV_EMPTY   0
+#define KV_WRITING 1
+#define KV_READY   2
+#define KV_DEAD    3
+
+#define KV_TAG_SHIFT 16
+#define KV_VER_MASK  0x3FFF
+
+typedef struct shmemio_kv_hdr_s {
+  uint64_t magic;
+  uint64_t overflow_used;  // overflow buckets taken
+  uint64_t nbuckets;
+  uint64_t noverflow;
+  uint32_t slots;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint32_t pad;
+} shmemio_kv_hdr_t;
+
+enum {
+  kv_scan_hit,
+  kv_scan_miss,
+  kv_scan_busy,
+  kv_scan_next
+};
+
+/*
+ * FNV-1a, with a final mix so the bucket and tag bits are both good
+ */
+static inline uint64_t
+kv_hash(const void *key, int len)
+{
+  const unsigned char *p = (const unsigned char*)key;
+  uint64_t h = 0xcbf29ce484222325UL;
+
+  for (int idx = 0; idx < len; idx++) {
+    h ^= p[idx];
+    h *= 0x100000001b3UL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline uint64_t
+kv_tag(uint64_t hash)
+{
+  return hash >> KV_TAG_SHIFT;
+}
+
+static inline int
+kv_st(uint64_t state)
+{
+  return (int)(state & 3);
+}
+
+/*
+ * State word for a slot going to st, one version on from old
+ */
+static inline uint64_t
+kv_state(uint64_t tag, uint64_t old, int st)
+{
+  const uint64_t ver = ((old >> 2) + 1) & KV_VER_MASK;
+  return (tag << KV_TAG_SHIFT) | (ver << 2) | (uint64_t)st;
+}
+
+static inline size_t
+kv_round8(size_t len)
+{
+  return (len + 7) & ~((size_t)7);
+}
+
+static inline size_t
+kv_bucket_off(const shmemio_kv_t *kv, size_t b)
+{
+  const size_t unit = kv->fp->unit_size;
+  return kv->data_off + ((b / kv->per_unit) * unit) + ((b % kv->per_unit) * kv->bucket_size);
+}
+
+static inline size_t
+kv_slot_off(const shmemio_kv_t *kv, size_t b, int s)
+{
+  return kv_bucket_off(kv, b) + sizeof(uint64_t) + ((size_t)s * kv->slot_size);
+}
+
+static inline char *
+kv_slot(const shmemio_kv_t *kv, char *img, int s)
+{
+  return img + sizeof(uint64_t) + ((size_t)s * kv->slot_size);
+}
+
+static inline uint64_t
+kv_word(const char *p)
+{
+  uint64_t w;
+  memcpy(&w, p, sizeof(uint64_t));
+  return w;
+}
+
+/*
+ * Pe and address of a file offset. Buckets and words never span units
+ */
+static inline void *
+kv_locate(const shmemio_kv_t *kv, size_t foff, int *pe)
+{
+  void *addr;
+  fp_stripe_locate(kv->fp, foff, pe, &addr);
+  return addr;
+}
+
+static inline void
+kv_fetch_bucket(const shmemio_kv_t *kv, size_t b, char *img)
+{
+  int pe;
+  void *addr = kv_locate(kv, kv_bucket_off(kv, b), &pe);
+  shmemc_ctx_get(SHMEM_CTX_DEFAULT, img, addr, kv->bucket_size, pe);
+}
+
+static inline uint64_t
+kv_cswap(const shmemio_kv_t *kv, size_t foff, uint64_t cond, uint64_t value)
+{
+  int pe;
+  void *addr = kv_locate(kv, foff, &pe);
+  return shmemc_ctx_cswap64(SHMEM_CTX_DEFAULT, addr, cond, value, pe);
+}
+
+/*
+ * Put the key and value of a slot taken for writing, then make it ready
+ */
+static inline void
+kv_publish(const shmemio_kv_t *kv, size_t b, int s, uint64_t tag, uint64_t state,
+	   const void *key, const void *value)
+{
+  const size_t off = kv_slot_off(kv, b, s);
+  int pe;
+  char *addr = kv_locate(kv, off, &pe);
+
+  if (key != NULL) {
+    shmemc_ctx_put_nbi(SHMEM_CTX_DEFAULT, addr + sizeof(uint64_t), key, kv->key_size, pe);
+  }
+  if (kv->value_size > 0) {
+    shmemc_ctx_put_nbi(SHMEM_CTX_DEFAULT, addr + sizeof(uint64_t) + kv->key_size,
+		       value, kv->value_size, pe);
+  }
+  shmemc_ctx_fence(SHMEM_CTX_DEFAULT);
+  shmemc_ctx_set64(SHMEM_CTX_DEFAULT, addr, kv_state(tag, state, KV_READY), pe);
+}
+
+/*
+ * Look for the key in a bucket image. A hit or a busy slot sets slot
+ */
+static inline int
+kv_scan(const shmemio_kv_t *kv, char *img, const void *key, uint64_t tag, int *slot)
+{
+  for (int s = 0; s < kv->slots; s++) {
+    const char *sp = kv_slot(kv, img, s);
+    const uint64_t state = kv_word(sp);
+
+    switch (kv_st(state)) {
+    case KV_EMPTY:
+      return kv_scan_miss;
+    case KV_DEAD:
+      continue;
+    }
+    if ((state >> KV_TAG_SHIFT) != tag) {
+      continue;
+    }
+
+    *slot = s;
+    if (kv_st(state) == KV_WRITING) {
+      return kv_scan_busy;
+    }
+    if (memcmp(sp + sizeof(uint64_t), key, kv->key_size) == 0) {
+      return kv_scan_hit;
+    }
+  }
+  return (kv_word(img) == 0) ? kv_scan_miss : kv_scan_next;
+}
+
+/*
+ * Find the key, from bucket b on. img may hold bucket b already. With
+ * value set, copy the value out, else mark the slot dead
+ */
+static inline int
+kv_find(shmemio_kv_t *kv, const void *key, uint64_t hash, void *value, char *img, int del)
+{
+  const uint64_t tag = kv_tag(hash);
+  size_t b = hash % kv->nbuckets;
+  int have = (img != NULL);
+  int s;
+
+  if (img == NULL) {
+    img = kv->bbuf;
+  }
+
+  for (;;) {
+    if (!have) {
+      kv_fetch_bucket(kv, b, img);
+    }
+    have = 0;
+
+    switch (kv_scan(kv, img, key, tag, &s)) {
+    case kv_scan_miss:
+      return shmemio_err_not_found;
+    case kv_scan_busy:
+      //Writer is mid update, look again
+      continue;
+    case kv_scan_next:
+      b = kv_word(img) - 1;
+      continue;
+    }
+
+    //Hit in the image, read the slot itself. Any change starts over
+    //from the bucket, which is fetched again
+    int pe;
+    char *addr = kv_locate(kv, kv_slot_off(kv, b, s), &pe);
+    char *kvp = kv_slot(kv, img, s) + sizeof(uint64_t);
+
+    const uint64_t state = shmemc_ctx_fetch64(SHMEM_CTX_DEFAULT, addr, pe);
+    if ((kv_st(state) != KV_READY) || ((state >> KV_TAG_SHIFT) != tag)) {
+      continue;
+    }
+
+    shmemc_ctx_get(SHMEM_CTX_DEFAULT, kvp, addr + sizeof(uint64_t),
+		   kv->key_size + (del ? 0 : kv->value_size), pe);
+    if (memcmp(kvp, key, kv->key_size) != 0) {
+      continue;
+    }
+
+    //Only this state was read, so only it may be deleted
+    if (del) {
+      if (shmemc_ctx_cswap64(SHMEM_CTX_DEFAULT, addr, state, kv_state(tag, state, KV_DEAD), pe) == state) {
+	return shmemio_success;
+      }
+      continue;
+    }
+
+    if (shmemc_ctx_fetch64(SHMEM_CTX_DEFAULT, addr, pe) == state) {
+      memcpy(value, kvp + kv->key_size, kv->value_size);
+      return shmemio_success;
+    }
+  }
+}
+
+/*
+ * Take a new overflow bucket and link it after bucket b. Returns it, or
+ * -1 if none are left, or -2 if another pe linked one first. A bucket
+ * lost in that race stays unused
+ */
+static inline long
+kv_link_overflow(shmemio_kv_t *kv, size_t b)
+{
+  int pe;
+  void *addr = kv_locate(kv, offsetof(shmemio_kv_hdr_t, overflow_used), &pe);
+  const uint64_t idx = shmemc_ctx_fadd64(SHMEM_CTX_DEFAULT, addr, 1, pe);
+
+  if (idx >= kv->noverflow) {
+    return -1;
+  }
+
+  const size_t nb = kv->nbuckets + idx;
+  if (kv_cswap(kv, kv_bucket_off(kv, b), 0, nb + 1) != 0) {
+    return -2;
+  }
+  return (long)nb;
+}
+
+/*
+ * Insert or update the key, from its hashed bucket on. img may hold
+ * that bucket already. Puts are left to complete with a quiet
+ */
+static inline int
+kv_store(shmemio_kv_t *kv, const void *key, uint64_t hash, const void *value, char *img)
+{
+  const uint64_t tag = kv_tag(hash);
+  int have = (img != NULL);
+
+  if (img == NULL) {
+    img = kv->bbuf;
+  }
+
+ retry:
+  ;
+  size_t b = hash % kv->nbuckets;
+  long free_b = -1;
+  int free_s = 0;
+  uint64_t free_state = 0;
+
+  for (;;) {
+    if (!have) {
+      kv_fetch_bucket(kv, b, img);
+    }
+    have = 0;
+
+    int s;
+    for (s = 0; s < kv->slots; s++) {
+      const char *sp = kv_slot(kv, img, s);
+      const uint64_t state = kv_word(sp);
+      const int st = kv_st(state);
+
+      if ((st == KV_EMPTY) || (st == KV_DEAD)) {
+	if (free_b < 0) {
+	  free_b = b;
+	  free_s = s;
+	  free_state = state;
+	}
+	if (st == KV_EMPTY) {
+	  goto claim;
+	}
+	continue;
+      }
+      if ((state >> KV_TAG_SHIFT) != tag) {
+	continue;
+      }
+      if (st == KV_WRITING) {
+	shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+	goto retry;
+      }
+      if (memcmp(sp + sizeof(uint64_t), key, kv->key_size) != 0) {
+	continue;
+      }
+
+      //Update in place
+      const uint64_t wstate = kv_state(tag, state, KV_WRITING);
+      if (kv_cswap(kv, kv_slot_off(kv, b, s), state, wstate) != state) {
+	shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+	goto retry;
+      }
+      kv_publish(kv, b, s, tag, wstate, NULL, value);
+      return shmemio_success;
+    }
+
+    if (kv_word(img) == 0) {
+      break;
+    }
+    b = kv_word(img) - 1;
+  }
+
+  if (free_b < 0) {
+    const long nb = kv_link_overflow(kv, b);
+    if (nb == -1) {
+      shmemio_log(warn, "Key-value store has no overflow buckets left\n");
+      return shmemio_err_full;
+    }
+    if (nb < 0) {
+      goto retry;
+    }
+    free_b = nb;
+    free_s = 0;
+    free_state = 0;
+  }
+
+ claim:
+  ;
+  const uint64_t wstate = kv_state(tag, free_state, KV_WRITING);
+  if (kv_cswap(kv, kv_slot_off(kv, free_b, free_s), free_state, wstate) != free_state) {
+    shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+    goto retry;
+  }
+  kv_publish(kv, free_b, free_s, tag, wstate, key, value);
+  return shmemio_success;
+}
+
+/*
+ * Write zeros over the buckets and the header, with the header magic
+ * left saying the store is being formatted
+ */
+static inline int
+kv_format(shmemio_kv_t *kv, const shmemx_kv_attr_t *attr)
+{
+  shmem_fp_t *fp = kv->fp;
+  int pe;
+  void *magic = kv_locate(kv, 0, &pe);
+
+  shmemc_ctx_swap64(SHMEM_CTX_DEFAULT, magic, SHMEMIO_KV_BUSY, pe);
+
+  char *zero = calloc(1, SHMEMIO_KV_ZERO_BUF);
+  shmemio_log_ret_if(error, shmemio_err_nomem, zero == NULL, "Failed to allocate format buffer\n");
+
+  const size_t end = kv_bucket_off(kv, kv->nbuckets + kv->noverflow);
+  for (size_t off = kv->data_off; off < end; off += SHMEMIO_KV_ZERO_BUF) {
+    const size_t len = ((end - off) < SHMEMIO_KV_ZERO_BUF) ? (end - off) : SHMEMIO_KV_ZERO_BUF;
+    shmem_fp_write_nbi(fp, off, zero, len);
+  }
+
+  shmemio_kv_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic      = SHMEMIO_KV_BUSY;
+  hdr.nbuckets   = attr->nbuckets;
+  hdr.noverflow  = attr->noverflow;
+  hdr.slots      = attr->slots;
+  hdr.key_size   = attr->key_size;
+  hdr.value_size = attr->value_size;
+  shmem_fp_write_nbi(fp, 0, &hdr, sizeof(hdr));
+
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  free(zero);
+  shmemc_ctx_set64(SHMEM_CTX_DEFAULT, magic, SHMEMIO_KV_MAGIC, pe);
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  return shmemio_success;
+}
+
+/*
+ * Set the store geometry from its parameters and the file layout
+ */
+static inline int
+kv_geometry(shmemio_kv_t *kv, size_t nbuckets, size_t noverflow,
+	    int slots, int key_size, int value_size)
+{
+  const shmem_fp_t *fp = kv->fp;
+
+  kv->nbuckets    = nbuckets;
+  kv->noverflow   = noverflow;
+  kv->slots       = slots;
+  kv->key_size    = key_size;
+  kv->value_size  = value_size;
+  kv->slot_size   = kv_round8(sizeof(uint64_t) + key_size + value_size);
+  kv->bucket_size = sizeof(uint64_t) + ((size_t)slots * kv->slot_size);
+  kv->per_unit    = fp->unit_size / kv->bucket_size;
+  kv->data_off    = fp_stripe_row(fp);
+
+  shmemio_log_ret_if(error, shmemio_err_invalid,
+		     (kv->per_unit == 0) || (sizeof(shmemio_kv_hdr_t) > fp->unit_size),
+		     "Buckets of %lu bytes do not fit file units of %d bytes\n",
+		     (long unsigned)kv->bucket_size, fp->unit_size);
+  return shmemio_success;
+}
+
+/*
+ * File bytes for the store with the given geometry
+ */
+static inline size_t
+kv_file_size(const shmemio_kv_t *kv)
+{
+  return kv_bucket_off(kv, kv->nbuckets + kv->noverflow) + kv->fp->unit_size;
+}
+
+/*
+ * Client API: Open a key-value store kept in an fspace file. With
+ * attr->create the file is formatted as a new, empty store, else it must
+ * hold one, or be formatted by another pe right now. Pes that open a
+ * store another pe creates should wait for it, with a barrier. Give the
+ * same attr and file layout on every open, the file is sized from them
+ */
+shmemx_kv_t shmemx_kv_open(shmem_fspace_t fspace, const char *file,
+			   const shmemx_kv_attr_t *attr, int pe_start, int pe_stride,
+			   int pe_size, int unit_size, int *err)
+{
+  shmemio_seterr(err, shmemio_err_invalid);
+
+  shmemio_log_ret_if(error, NULL, (attr == NULL) || (attr->nbuckets == 0) || (attr->slots <= 0) ||
+		     (attr->key_size <= 0) || (attr->value_size < 0),
+		     "Bad key-value store attributes\n");
+
+  shmemio_kv_t *kv = (shmemio_kv_t*)calloc(1, sizeof(shmemio_kv_t));
+  shmemio_log_ret_if(error, NULL, kv == NULL, "Failed to allocate key-value store\n");
+
+  //Size the file up front when the layout is given, else extend it once open
+  size_t fsize = 1;
+  if ((pe_size > 0) && (unit_size > 0)) {
+    shmem_fp_t sizing;
+    memset(&sizing, 0, sizeof(sizing));
+    sizing.unit_size = unit_size;
+    sizing.pe_size = pe_size;
+    kv->fp = &sizing;
+    if (kv_geometry(kv, attr->nbuckets, attr->noverflow, attr->slots,
+		    attr->key_size, attr->value_size) != shmemio_success) {
+      goto err_kv;
+    }
+    fsize = kv_file_size(kv);
+  }
+
+  kv->fp = shmem_open(fspace, file, fsize, pe_start, pe_stride, pe_size, unit_size, err);
+  if (kv->fp == NULL) {
+    shmemio_log(error, "Failed to open key-value store file %s\n", file);
+    goto err_kv;
+  }
+
+  if (kv_geometry(kv, attr->nbuckets, attr->noverflow, attr->slots,
+		  attr->key_size, attr->value_size) != shmemio_success) {
+    shmemio_seterr(err, shmemio_err_invalid);
+    goto err_fp;
+  }
+
+  kv->bbuf = malloc(kv->bucket_size);
+  if (kv->bbuf == NULL) {
+    shmemio_seterr(err, shmemio_err_nomem);
+    goto err_fp;
+  }
+
+  fsize = kv_file_size(kv);
+  if (attr->create) {
+    //An existing file may be shorter than the store
+    if ((kv->fp->size < fsize) && (shmem_fextend(kv->fp, fsize - kv->fp->size) != shmemio_success)) {
+      shmemio_log(error, "Failed to extend key-value store file %s to %lu bytes\n",
+		  file, (long unsigned)fsize);
+      shmemio_seterr(err, shmemio_err_nomem);
+      goto err_fp;
+    }
+
+    const int ret = kv_format(kv, attr);
+    if (ret != shmemio_success) {
+      shmemio_seterr(err, ret);
+      goto err_fp;
+    }
+  }
+
+  int pe;
+  void *magic = kv_locate(kv, 0, &pe);
+  uint64_t m;
+  while ((m = shmemc_ctx_fetch64(SHMEM_CTX_DEFAULT, magic, pe)) == SHMEMIO_KV_BUSY)
+    ;
+
+  if ((m != SHMEMIO_KV_MAGIC) || (kv->fp->size < fsize)) {
+    shmemio_log(error, "File %s holds no key-value store\n", file);
+    shmemio_seterr(err, shmemio_err_invalid);
+    goto err_fp;
+  }
+
+  //The store keeps the geometry it was made with
+  shmemio_kv_hdr_t hdr;
+  shmemc_ctx_get(SHMEM_CTX_DEFAULT, &hdr, magic, sizeof(hdr), pe);
+  if ((hdr.nbuckets != kv->nbuckets) || (hdr.noverflow != kv->noverflow) ||
+      (hdr.slots != kv->slots) || (hdr.key_size != kv->key_size) ||
+      (hdr.value_size != kv->value_size)) {
+    shmemio_log(error, "Key-value store %s was made with other attributes\n", file);
+    shmemio_seterr(err, shmemio_err_invalid);
+    goto err_fp;
+  }
+
+  shmemio_log(info, "Opened key-value store %s, %lu buckets of %d slots, %lu overflow, "
+	      "%lu buckets per unit\n", file, (long unsigned)kv->nbuckets, kv->slots,
+	      (long unsigned)kv->noverflow, (long unsigned)kv->per_unit);
+  shmemio_seterr(err, shmemio_success);
+  return kv;
+
+ err_fp:
+  shmem_close(kv->fp, 0);
+ err_kv:
+  free(kv->bbuf);
+  free(kv);
+  return NULL;
+}
+
+/*
+ * Client API: Close a key-value store
+ */
+int shmemx_kv_close(shmemx_kv_t kv, int ioflags)
+{
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  const int ret = shmem_close(kv->fp, ioflags);
+  free(kv->bbuf);
+  free(kv);
+  return ret;
+}
+
+/*
+ * Client API: Flush a key-value store to persistence
+ */
+int shmemx_kv_flush(shmemx_kv_t kv, int ioflags)
+{
+  return shmem_fp_flush(kv->fp, ioflags);
+}
+
+/*
+ * Client API: Copy the value of key out to value. Returns
+ * shmemio_err_not_found if the store has no such key
+ */
+int shmemx_kv_get(shmemx_kv_t kv, const void *key, void *value)
+{
+  return kv_find(kv, key, kv_hash(key, kv->key_size), value, NULL, 0);
+}
+
+/*
+ * Client API: Insert key with value, or update its value. Complete on
+ * return
+ */
+int shmemx_kv_put(shmemx_kv_t kv, const void *key, const void *value)
+{
+  const int ret = kv_store(kv, key, kv_hash(key, kv->key_size), value, NULL);
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+  return ret;
+}
+
+/*
+ * Client API: Remove key from the store
+ */
+int shmemx_kv_delete(shmemx_kv_t kv, const void *key)
+{
+  return kv_find(kv, key, kv_hash(key, kv->key_size), NULL, NULL, 1);
+}
+
+/*
+ * Hash n keys, and order them by the pe of their bucket. Returns the
+ * order, or NULL
+ */
+static inline int *
+kv_batch_order(shmemio_kv_t *kv, int n, const char *keys, uint64_t *hashes)
+{
+  const shmem_fp_t *fp = kv->fp;
+  int *order = malloc(n * sizeof(int));
+  int *sdx = malloc(n * sizeof(int));
+  int *count = calloc(fp->pe_size + 1, sizeof(int));
+
+  if ((order == NULL) || (sdx == NULL) || (count == NULL)) {
+    free(order);
+    order = NULL;
+    goto done;
+  }
+
+  for (int idx = 0; idx < n; idx++) {
+    int pe;
+    hashes[idx] = kv_hash(keys + ((size_t)idx * kv->key_size), kv->key_size);
+    kv_locate(kv, kv_bucket_off(kv, hashes[idx] % kv->nbuckets), &pe);
+    sdx[idx] = (pe - fp->pe_start) / fp->pe_stride;
+    count[sdx[idx] + 1]++;
+  }
+  for (int idx = 0; idx < fp->pe_size; idx++) {
+    count[idx + 1] += count[idx];
+  }
+  for (int idx = 0; idx < n; idx++) {
+    order[count[sdx[idx]]++] = idx;
+  }
+
+ done:
+  free(sdx);
+  free(count);
+  return order;
+}
+
+/*
+ * Start gets of the hashed bucket of every key, one pe after another
+ */
+static inline void
+kv_batch_fetch(shmemio_kv_t *kv, int n, const int *order, const uint64_t *hashes, char *imgs)
+{
+  for (int idx = 0; idx < n; idx++) {
+    const int k = order[idx];
+    int pe;
+    void *addr = kv_locate(kv, kv_bucket_off(kv, hashes[k] % kv->nbuckets), &pe);
+    shmemc_ctx_get_nbi(SHMEM_CTX_DEFAULT, imgs + ((size_t)k * kv->bucket_size), addr,
+		       kv->bucket_size, pe);
+  }
+}
+
+/*
+ * Client API: Get the values of n keys, packed one after another in
+ * keys and values. Keys are grouped by the pe of their bucket, and the
+ * buckets of all keys are got at once. status, if not NULL, gets the
+ * result of each key. Returns the first error, or success
+ */
+int shmemx_kv_mget(shmemx_kv_t kv, int n, const void *keys, void *values, int *status)
+{
+  const char *kp = (const char*)keys;
+  char *vp = (char*)values;
+  int ret = shmemio_success;
+
+  if (n <= 0) {
+    return shmemio_success;
+  }
+
+  uint64_t *hashes = malloc(n * sizeof(uint64_t));
+  uint64_t *seen = malloc(2 * n * sizeof(uint64_t));
+  int *hit = malloc(n * sizeof(int));
+  char *imgs = malloc((size_t)n * kv->bucket_size);
+  int *order = (hashes != NULL) ? kv_batch_order(kv, n, kp, hashes) : NULL;
+
+  if ((seen == NULL) || (hit == NULL) || (imgs == NULL) || (order == NULL)) {
+    ret = shmemio_err_nomem;
+    goto done;
+  }
+
+  kv_batch_fetch(kv, n, order, hashes, imgs);
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  //Hits in the hashed bucket are read as a seqlock, all at once: their
+  //state words, then their keys and values, then the state words again
+  for (int idx = 0; idx < n; idx++) {
+    const int k = order[idx];
+    char *img = imgs + ((size_t)k * kv->bucket_size);
+    int s;
+
+    hit[k] = -1;
+    if (kv_scan(kv, img, kp + ((size_t)k * kv->key_size), kv_tag(hashes[k]), &s) == kv_scan_hit) {
+      int pe;
+      void *addr = kv_locate(kv, kv_slot_off(kv, hashes[k] % kv->nbuckets, s), &pe);
+      hit[k] = s;
+      shmemc_ctx_get_nbi(SHMEM_CTX_DEFAULT, &(seen[k]), addr, sizeof(uint64_t), pe);
+    }
+  }
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  for (int k = 0; k < n; k++) {
+    if ((hit[k] < 0) || (kv_st(seen[k]) != KV_READY) ||
+	((seen[k] >> KV_TAG_SHIFT) != kv_tag(hashes[k]))) {
+      hit[k] = -1;
+      continue;
+    }
+    int pe;
+    char *addr = kv_locate(kv, kv_slot_off(kv, hashes[k] % kv->nbuckets, hit[k]), &pe);
+    char *kvp = kv_slot(kv, imgs + ((size_t)k * kv->bucket_size), hit[k]) + sizeof(uint64_t);
+    shmemc_ctx_get_nbi(SHMEM_CTX_DEFAULT, kvp, addr + sizeof(uint64_t),
+		       kv->key_size + kv->value_size, pe);
+  }
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  for (int k = 0; k < n; k++) {
+    if (hit[k] >= 0) {
+      int pe;
+      void *addr = kv_locate(kv, kv_slot_off(kv, hashes[k] % kv->nbuckets, hit[k]), &pe);
+      shmemc_ctx_get_nbi(SHMEM_CTX_DEFAULT, &(seen[n + k]), addr, sizeof(uint64_t), pe);
+    }
+  }
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  for (int k = 0; k < n; k++) {
+    const char *key = kp + ((size_t)k * kv->key_size);
+    char *value = vp + ((size_t)k * kv->value_size);
+    char *img = imgs + ((size_t)k * kv->bucket_size);
+    const char *kvp = (hit[k] >= 0) ? (kv_slot(kv, img, hit[k]) + sizeof(uint64_t)) : NULL;
+    int r = shmemio_success;
+
+    if ((kvp != NULL) && (seen[k] == seen[n + k]) && (memcmp(kvp, key, kv->key_size) == 0)) {
+      memcpy(value, kvp + kv->key_size, kv->value_size);
+    }
+    else {
+      //Changed, busy or further down the chain
+      r = kv_find(kv, key, hashes[k], value, (hit[k] >= 0) ? NULL : img, 0);
+    }
+
+    shmemio_seterr(status ? &(status[k]) : NULL, r);
+    if ((ret == shmemio_success) && (r != shmemio_success)) {
+      ret = r;
+    }
+  }
+
+ done:
+  free(order);
+  free(imgs);
+  free(hit);
+  free(seen);
+  free(hashes);
+  return ret;
+}
+
+/*
+ * Client API: Insert or update n keys with their values, packed one
+ * after another in keys and values. Keys are grouped by the pe of their
+ * bucket, and the buckets of all keys are got at once before they are
+ * taken one by one. Complete on return. status, if not NULL, gets the
+ * result of each key. Returns the first error, or success
+ */
+int shmemx_kv_mput(shmemx_kv_t kv, int n, const void *keys, const void *values, int *status)
+{
+  const char *kp = (const char*)keys;
+  const char *vp = (const char*)values;
+  int ret = shmemio_success;
+
+  if (n <= 0) {
+    return shmemio_success;
+  }
+
+  uint64_t *hashes = malloc(n * sizeof(uint64_t));
+  char *imgs = malloc((size_t)n * kv->bucket_size);
+  int *order = (hashes != NULL) ? kv_batch_order(kv, n, kp, hashes) : NULL;
+
+  if ((imgs == NULL) || (order == NULL)) {
+    ret = shmemio_err_nomem;
+    goto done;
+  }
+
+  kv_batch_fetch(kv, n, order, hashes, imgs);
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+  //A stale bucket image only costs a failed compare-and-swap and a get
+  for (int idx = 0; idx < n; idx++) {
+    const int k = order[idx];
+    const int r = kv_store(kv, kp + ((size_t)k * kv->key_size), hashes[k],
+			   vp + ((size_t)k * kv->value_size),
+			   imgs + ((size_t)k * kv->bucket_size));
+
+    shmemio_seterr(status ? &(status[k]) : NULL, r);
+    if ((ret == shmemio_success) && (r != shmemio_success)) {
+      ret = r;
+    }
+  }
+  shmemc_ctx_quiet(SHMEM_CTX_DEFAULT);
+
+ done:
+  free(order);
+  free(imgs);
+  free(hashes);
+  return ret;
+}
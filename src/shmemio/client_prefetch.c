@@ -0,0 +1,449 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "shmemu.h"
+#include "shmemc.h"
+#include "shmem.h"
+
+#include "shmemio.h"
+#include "shmemio_client.h"
+#include "shmemio_client_stripe.h"
+
+#include "shmemio_test_util.h"
+
+/*
+ * File prefetch. A prefetch starts gets of every stripe of a file range
+ * into a local buffer, and can be tested or waited on by itself. While a
+ * prefetch is held, shmem_fp_read of a range inside it is served from
+ * the buffer. Reads of files opened with SHMEM_FOPEN_READAHEAD that walk
+ * the file with a fixed stride also start readahead prefetches of the
+ * next few reads.
+ *
+ * Files with prefetches are listed on their fspace, so any put from this
+ * pe to file memory, through the file API or not, can drop the
+ * prefetches it overwrites
+ */
+
+/*
+ * List the file on its fspace when it gets its first prefetch
+ */
+static inline void
+prefetch_fp_list(shmemio_fp_t *fp)
+{
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fp->fspace]);
+
+  fp->next_prefetch = fio->prefetch_fps;
+  fio->prefetch_fps = fp;
+  proc.io.nprefetch_fps++;
+}
+
+/*
+ * Take the file off its fspace list once it has no prefetches left
+ */
+static inline void
+prefetch_fp_unlist(shmemio_fp_t *fp)
+{
+  if (fp->prefetches != NULL)
+    return;
+
+  shmemio_fspace_t *fio = &(proc.io.fspaces[fp->fspace]);
+
+  shmemio_fp_t **pp = &(fio->prefetch_fps);
+  while ((*pp != NULL) && (*pp != fp))
+    pp = &((*pp)->next_prefetch);
+  if (*pp != NULL) {
+    *pp = fp->next_prefetch;
+    proc.io.nprefetch_fps--;
+  }
+  fp->next_prefetch = NULL;
+}
+
+static inline int
+prefetch_test(shmemio_prefetch_t *pf)
+{
+  int done = 1;
+  for (int idx = 0; idx < pf->nreqs; idx++) {
+    if (pf->reqs[idx] != NULL) {
+      if (shmemc_ctx_request_test(SHMEM_CTX_DEFAULT, pf->reqs[idx]))
+	pf->reqs[idx] = NULL;
+      else
+	done = 0;
+    }
+  }
+  return done;
+}
+
+static inline void
+prefetch_wait(shmemio_prefetch_t *pf)
+{
+  while (!prefetch_test(pf))
+    ;
+}
+
+static inline void
+prefetch_free(shmemio_prefetch_t *pf)
+{
+  prefetch_wait(pf);
+  if (pf->own_buf)
+    free(pf->buf);
+  free(pf->reqs);
+  free(pf);
+}
+
+/*
+ * Take a prefetch off its file list
+ */
+static inline void
+prefetch_unlink(shmemio_prefetch_t *pf)
+{
+  if (pf->fp == NULL)
+    return;
+
+  shmemio_fp_t *fp = pf->fp;
+  shmemio_prefetch_t **pp = &(fp->prefetches);
+  while ((*pp != NULL) && (*pp != pf))
+    pp = &((*pp)->next);
+  if (*pp != NULL)
+    *pp = pf->next;
+
+  pf->next = NULL;
+  pf->fp = NULL;
+  prefetch_fp_unlist(fp);
+}
+
+/*
+ * Start gets of the file range into buf, or a new buffer if buf is NULL
+ */
+static shmemio_prefetch_t *
+prefetch_start(shmemio_fp_t *fp, size_t offset, size_t len, void *buf, int readahead)
+{
+  shmem_fp_t *sfp = (shmem_fp_t*)fp;
+  const size_t unit = sfp->unit_size;
+
+  if (shmemio_client_sync_extents(fp, offset + len) != shmemio_success)
+    return NULL;
+
+  shmemio_prefetch_t *pf = (shmemio_prefetch_t*)malloc(sizeof(shmemio_prefetch_t));
+  shmemio_log_ret_if(error, NULL, pf == NULL, "Failed to allocate prefetch\n");
+
+  pf->own_buf = (buf == NULL);
+  pf->buf = pf->own_buf ? (char*)malloc(len) : (char*)buf;
+  pf->nreqs = ((offset % unit) + len + unit - 1) / unit;
+  pf->reqs = (void**)malloc(pf->nreqs * sizeof(void*));
+
+  if ((pf->buf == NULL) || (pf->reqs == NULL)) {
+    shmemio_log(error, "Failed to allocate prefetch of %lu bytes\n", (long unsigned)len);
+    if (pf->own_buf)
+      free(pf->buf);
+    free(pf->reqs);
+    free(pf);
+    return NULL;
+  }
+
+  pf->offset = offset;
+  pf->len = len;
+  pf->readahead = readahead;
+
+  size_t done = 0;
+  for (int idx = 0; idx < pf->nreqs; idx++) {
+    int pe;
+    void *addr;
+    size_t nbytes = fp_stripe_locate(sfp, offset + done, &pe, &addr);
+    if (nbytes > (len - done))
+      nbytes = len - done;
+
+    pf->reqs[idx] = shmemc_ctx_get_nbr(SHMEM_CTX_DEFAULT, pf->buf + done, addr, nbytes, pe);
+    done += nbytes;
+  }
+
+  if (fp->prefetches == NULL)
+    prefetch_fp_list(fp);
+
+  pf->fp = fp;
+  pf->next = fp->prefetches;
+  fp->prefetches = pf;
+
+  return pf;
+}
+
+static inline int
+prefetch_covers(const shmemio_prefetch_t *pf, size_t offset, size_t len)
+{
+  return ((pf->offset <= offset) && ((offset + len) <= (pf->offset + pf->len)));
+}
+
+/*
+ * Free the readahead prefetches of the file, not the ones the user holds
+ */
+static inline void
+prefetch_drop_readahead(shmemio_fp_t *fp)
+{
+  shmemio_prefetch_t **pp = &(fp->prefetches);
+  while (*pp != NULL) {
+    shmemio_prefetch_t *pf = *pp;
+    if (pf->readahead) {
+      *pp = pf->next;
+      prefetch_free(pf);
+    }
+    else {
+      pp = &(pf->next);
+    }
+  }
+  prefetch_fp_unlist(fp);
+}
+
+/*
+ * Watch the reads of a file. Once two reads in a row move by the same
+ * stride, keep the next SHMEMIO_READAHEAD_DEPTH reads in flight
+ */
+static inline void
+prefetch_readahead(shmemio_fp_t *fp, size_t offset, size_t len)
+{
+  if (fp->ra_offset == SHMEMIO_RA_NONE) {
+    fp->ra_offset = offset;
+    return;
+  }
+
+  const ssize_t stride = (ssize_t)offset - (ssize_t)fp->ra_offset;
+  fp->ra_offset = offset;
+
+  if ((stride == 0) || (stride != fp->ra_stride)) {
+    if (fp->ra_seq > 1)
+      prefetch_drop_readahead(fp);
+    fp->ra_stride = stride;
+    fp->ra_seq = 1;
+    return;
+  }
+
+  fp->ra_seq++;
+
+  for (int idx = 1; idx <= SHMEMIO_READAHEAD_DEPTH; idx++) {
+    const ssize_t next = (ssize_t)offset + (idx * stride);
+    if ((next < 0) || ((size_t)next + len) > fp->size)
+      break;
+
+    int have = 0;
+    for (shmemio_prefetch_t *pf = fp->prefetches; pf != NULL; pf = pf->next) {
+      if (prefetch_covers(pf, next, len)) {
+	have = 1;
+	break;
+      }
+    }
+
+    if (!have) {
+      shmemio_log(trace, "Readahead %lu bytes at %ld of fp %p\n", (long unsigned)len, (long)next, fp);
+      prefetch_start(fp, next, len, NULL, 1);
+    }
+  }
+}
+
+void
+shmemio_prefetch_fp_init(shmemio_fp_t *fp)
+{
+  fp->prefetches = NULL;
+  fp->next_prefetch = NULL;
+  fp->ra_offset = SHMEMIO_RA_NONE;
+  fp->ra_stride = 0;
+  fp->ra_seq = 0;
+}
+
+/*
+ * Serve a read from a prefetch that holds the whole range, waiting for
+ * it if needed. Returns nonzero if the read was served
+ */
+int
+shmemio_prefetch_read(shmemio_fp_t *fp, size_t offset, void *buf, size_t len)
+{
+  int served = 0;
+
+  for (shmemio_prefetch_t *pf = fp->prefetches; pf != NULL; pf = pf->next) {
+    if (prefetch_covers(pf, offset, len)) {
+      prefetch_wait(pf);
+      memcpy(buf, pf->buf + (offset - pf->offset), len);
+
+      if (pf->readahead) {
+	prefetch_unlink(pf);
+	prefetch_free(pf);
+      }
+      served = 1;
+      break;
+    }
+  }
+
+  if (fp->oflags & SHMEM_FOPEN_READAHEAD)
+    prefetch_readahead(fp, offset, len);
+  return served;
+}
+
+/*
+ * Stop serving reads from the prefetch. Handles the user holds stay
+ * valid until released
+ */
+static inline void
+prefetch_detach(shmemio_prefetch_t *pf)
+{
+  pf->next = NULL;
+  pf->fp = NULL;
+  if (pf->readahead)
+    prefetch_free(pf);
+}
+
+/*
+ * The file range is stale, stop serving reads from prefetches that
+ * overlap it
+ */
+void
+shmemio_prefetch_drop(shmemio_fp_t *fp, size_t offset, size_t len)
+{
+  shmemio_prefetch_t **pp = &(fp->prefetches);
+  while (*pp != NULL) {
+    shmemio_prefetch_t *pf = *pp;
+    if ((pf->offset < (offset + len)) && (offset < (pf->offset + pf->len))) {
+      *pp = pf->next;
+      prefetch_detach(pf);
+    }
+    else {
+      pp = &(pf->next);
+    }
+  }
+  prefetch_fp_unlist(fp);
+}
+
+/*
+ * Does a put of nbytes at addr land in the stripe rows the prefetch
+ * reads from. The rows of a range are contiguous on each pe within an
+ * extent, so a put next to the range in the same row drops the prefetch
+ * too
+ */
+static inline int
+prefetch_put_overlaps(const shmemio_prefetch_t *pf, uint64_t addr, size_t nbytes)
+{
+  const shmemio_fp_t *fp = pf->fp;
+  const size_t row = fp_stripe_row((const shmem_fp_t*)fp);
+  const size_t pend = pf->offset + pf->len;
+  size_t foff = pf->offset;
+
+  while (foff < pend) {
+    uint64_t base = (uint64_t)fp->addr;
+    size_t eoff = 0, end = pend;
+
+    if (fp->nextents > 0) {
+      const shmemio_client_extent_t *ext = fp_extent_find(fp, foff);
+      base = (uint64_t)ext->addr;
+      eoff = ext->foff;
+      if (ext->len < (pend - eoff))
+	end = eoff + ext->len;
+      if (end <= foff)
+	break;    //past the extents known, prefetch_start synced them
+    }
+
+    const uint64_t lo = base + (((foff - eoff) / row) * fp->unit_size);
+    const uint64_t hi = base + (((end - eoff + row - 1) / row) * fp->unit_size);
+    if ((addr < hi) && (lo < (addr + nbytes)))
+      return 1;
+
+    foff = end;
+  }
+  return 0;
+}
+
+/*
+ * This pe put to file memory on pe, drop the prefetches the put
+ * overwrites
+ */
+void
+shmemio_prefetch_put(uint64_t addr, size_t nbytes, int pe)
+{
+  const int fdx = pe_to_fpe_index(pe);
+  if ((fdx < 0) || (fdx >= proc.io.nfpes))
+    return;
+
+  shmemio_fspace_t *fio = &(proc.io.fspaces[proc.io.fpes[fdx].fspace]);
+
+  shmemio_fp_t *fp = fio->prefetch_fps;
+  while (fp != NULL) {
+    //Dropping the last prefetch takes the file off the list
+    shmemio_fp_t *next = fp->next_prefetch;
+
+    if (fp_stripe_has_pe((const shmem_fp_t*)fp, pe)) {
+      shmemio_prefetch_t **pp = &(fp->prefetches);
+      while (*pp != NULL) {
+	shmemio_prefetch_t *pf = *pp;
+	if (prefetch_put_overlaps(pf, addr, nbytes)) {
+	  *pp = pf->next;
+	  prefetch_detach(pf);
+	}
+	else {
+	  pp = &(pf->next);
+	}
+      }
+      prefetch_fp_unlist(fp);
+    }
+
+    fp = next;
+  }
+}
+
+/*
+ * File is closing, finish and detach all of its prefetches
+ */
+void
+shmemio_prefetch_fp_release(shmemio_fp_t *fp)
+{
+  shmemio_prefetch_drop(fp, 0, SIZE_MAX);
+}
+
+/*
+ * Client API: Start reading a file range into a library buffer
+ */
+int shmem_fp_prefetch(shmem_fp_t *fp, size_t offset, size_t len, shmem_prefetch_t *handle)
+{
+  return shmem_fp_prefetch_buf(fp, offset, len, NULL, handle);
+}
+
+/*
+ * Client API: Start reading a file range into buf, which must stay
+ * valid until the prefetch is released
+ */
+int shmem_fp_prefetch_buf(shmem_fp_t *fp, size_t offset, size_t len, void *buf,
+			  shmem_prefetch_t *handle)
+{
+  *handle = NULL;
+
+  shmemio_log_ret_if(error, shmemio_err_invalid, (len == 0) || ((offset + len) > fp->size),
+		     "Prefetch of %lu bytes at %lu is outside file\n",
+		     (long unsigned)len, (long unsigned)offset);
+
+  *handle = prefetch_start((shmemio_fp_t*)fp, offset, len, buf, 0);
+  return (*handle == NULL) ? shmemio_err_nomem : shmemio_success;
+}
+
+/*
+ * Client API: Return nonzero if the prefetch is complete
+ */
+int shmem_prefetch_test(shmem_prefetch_t handle)
+{
+  return prefetch_test(handle);
+}
+
+/*
+ * Client API: Wait for the prefetch and return the prefetched data
+ */
+void *shmem_prefetch_wait(shmem_prefetch_t handle)
+{
+  prefetch_wait(handle);
+  return handle->buf;
+}
+
+/*
+ * Client API: Done with a prefetch, reads are no longer served from it
+ */
+void shmem_prefetch_release(shmem_prefetch_t handle)
+{
+  prefetch_unlink(handle);
+  prefetch_free(handle);
+}
@@ -0,0 +1,1145 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+/*
+ * Node level fspace proxy. One proxy per node holds the only connection
+ * to the fspace server, and the pes of the node connect to the proxy
+ * instead of the server. Pes still reach fspace memory directly, the
+ * proxy only carries file management requests:
+ *
+ *  - the fspace description (fpe worker addresses and region keys) is
+ *    fetched from the server once, and handed to every pe from the proxy
+ *  - requests answered with a shmemio_req_t are forwarded with a proxy
+ *    sequence number, and the response is routed back to the pe
+ *  - requests answered with raw data (stats, regions, filter matches) are
+ *    served once no forwarded request is in flight, regions from the
+ *    proxy copy
+ *  - fspace stat requests waiting together share one stat, and fspace
+ *    flush requests that come while one is in flight share the next one
+ *
+ * Opens are not merged, the server counts openers of a file to know
+ * when blocking flush and close requests can complete
+ */
+
+#include "shmemio.h"
+#include "shmem/defs_shmemio.h"
+#include "shmemio_test_util.h"
+#include "shmemio_stream_util.h"
+
+#include <ucp/api/ucp.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  /* getopt */
+#include <ctype.h>   /* isprint */
+#include <signal.h>
+
+typedef enum {
+  proxy_running = 0,
+  proxy_halting = 1
+} proxy_status_t;
+
+/*
+ * Bytes of the fspace description as the server streams them
+ */
+typedef struct proxy_blob_s {
+  size_t len;
+  char *data;
+} proxy_blob_t;
+
+/*
+ * A pe connected to the proxy, and the files it has open
+ */
+typedef struct proxy_conn_s {
+  ucp_ep_h ep;
+  int nfkeys, maxfkeys;
+  uint64_t *fkeys;
+  struct proxy_conn_s *prev, *next;
+} proxy_conn_t;
+
+typedef struct proxy_waiter_s {
+  proxy_conn_t *conn;    //NULL once the pe has gone
+  unsigned seq;          //seq of the request on the pe connection
+  struct proxy_waiter_s *next;
+} proxy_waiter_t;
+
+/*
+ * A request forwarded to the server, and the pes waiting on its response
+ */
+typedef struct proxy_wait_s {
+  unsigned up_seq;
+  short type;
+  proxy_waiter_t *waiters;
+  struct proxy_wait_s *next;
+} proxy_wait_t;
+
+/*
+ * A raw data request held until nothing is in flight to the server
+ */
+typedef struct proxy_held_s {
+  proxy_conn_t *conn;
+  shmemio_req_t req;
+  struct proxy_held_s *next;
+} proxy_held_t;
+
+typedef struct proxy_s {
+  volatile proxy_status_t status;
+
+  ucp_context_h context;
+  ucp_worker_h worker;
+  ucp_listener_h listener;
+
+  const char *server_name;
+  uint16_t server_port;
+  uint16_t port;
+  int log_level;
+
+  ucp_ep_h up_ep;
+  unsigned next_seq;
+
+  int nfpes;
+  proxy_blob_t *fpes;
+  int nregions;
+  proxy_blob_t *regions;
+
+  proxy_conn_t *new_conns;
+  proxy_conn_t *conns;
+  int nconns;
+
+  proxy_wait_t *inflight;
+  int ninflight;
+  proxy_held_t *held, *held_tail;
+  proxy_waiter_t *flush_waiters;  //fspace flushes for after the one in flight
+
+  unsigned long pe_reqs;
+  unsigned long up_reqs;
+  unsigned long merged;
+  unsigned long local;
+} proxy_t;
+
+proxy_t px;
+
+static int parse_cmd(int argc, char * const argv[], proxy_t *px);
+
+void sig_handler(int signo)
+{
+  if ( (signo == SIGINT) || (signo == SIGUSR1) ) {
+    printf ("Fspace proxy: Halting proxy\n");
+
+    px.status = proxy_halting;
+    ucp_worker_signal(px.worker);
+  }
+}
+
+static void err_cb(void *arg, ucp_ep_h ep, ucs_status_t status)
+{
+  printf("error handling callback was invoked with status %d (%s)\n",
+	 status, ucs_status_string(status));
+}
+
+/*
+ * Receive exactly len bytes
+ */
+static int
+proxy_recv(proxy_t *px, ucp_ep_h ep, void *data, size_t len)
+{
+  size_t rlen = 0;
+  shmemio_streamreq_t *request = ucp_stream_recv_nb(ep, data, 1, ucp_dt_make_contig(len),
+						    stream_recv_cb, &rlen,
+						    UCP_STREAM_RECV_FLAG_WAITALL);
+  if (UCS_PTR_IS_ERR(request)) {
+    shmemio_log(error, "unable to recv UCX message (%s)\n",
+		ucs_status_string(UCS_PTR_STATUS(request)));
+    return -1;
+  }
+  if (UCS_PTR_STATUS(request) != UCS_OK)
+    rlen = shmemio_request_wait(px->worker, request);
+
+  return (rlen == len) ? 0 : -1;
+}
+
+static int
+proxy_blob_append(proxy_blob_t *blob, const void *data, size_t len)
+{
+  char *newdata = (char*)realloc(blob->data, blob->len + len);
+  shmemio_log_ret_if(error, -1, newdata == NULL, "Failed to grow fspace copy\n");
+
+  memcpy(newdata + blob->len, data, len);
+  blob->data = newdata;
+  blob->len += len;
+  return 0;
+}
+
+/*
+ * Receive len bytes from the server onto the blob
+ */
+static int
+proxy_recv_append(proxy_t *px, proxy_blob_t *blob, size_t len)
+{
+  char *buf = (char*)malloc(len);
+  shmemio_log_ret_if(error, -1, buf == NULL, "Failed to allocate %lu bytes\n", (long unsigned)len);
+
+  int ret = proxy_recv(px, px->up_ep, buf, len);
+  if (ret == 0)
+    ret = proxy_blob_append(blob, buf, len);
+
+  free(buf);
+  return ret;
+}
+
+/*
+ * Same layout as shmemio_send_sfpe
+ */
+static int
+proxy_recv_fpe(proxy_t *px, proxy_blob_t *blob)
+{
+  size_t addr_len;
+
+  int ret = proxy_recv(px, px->up_ep, &addr_len, sizeof(addr_len));
+  shmemio_log_ret_if(error, -1, ret < 0, "recv fpe server_addr_len\n");
+
+  proxy_blob_append(blob, &addr_len, sizeof(addr_len));
+  return proxy_recv_append(px, blob, addr_len);
+}
+
+/*
+ * Same layout as shmemio_send_region
+ */
+static int
+proxy_recv_region(proxy_t *px, proxy_blob_t *blob)
+{
+  int ibuf[5];
+
+  int ret = proxy_recv(px, px->up_ep, ibuf, sizeof(ibuf));
+  shmemio_log_ret_if(error, -1, ret < 0, "failed to recv region value fields\n");
+  proxy_blob_append(blob, ibuf, sizeof(ibuf));
+
+  for (int idx = 0; idx < ibuf[2]; idx++) {
+    size_t rbuf[4];
+    ret = proxy_recv(px, px->up_ep, rbuf, sizeof(rbuf));
+    shmemio_log_ret_if(error, -1, ret < 0, "failed to recv remote region size fields\n");
+    proxy_blob_append(blob, rbuf, sizeof(rbuf));
+
+    ret = proxy_recv_append(px, blob, rbuf[3]);
+    shmemio_log_ret_if(error, -1, ret < 0, "failed in recv sfpe rkey\n");
+  }
+
+  return 0;
+}
+
+/*
+ * Copy regions up to rmax from the server
+ */
+static int
+proxy_fetch_regions(proxy_t *px, int rmax)
+{
+  if (rmax <= px->nregions)
+    return 0;
+
+  proxy_blob_t *newregions = (proxy_blob_t*)realloc(px->regions, rmax * sizeof(proxy_blob_t));
+  shmemio_log_ret_if(error, -1, newregions == NULL, "Failed to grow region copy\n");
+  px->regions = newregions;
+
+  shmemio_req_t req;
+  req.type = shmemio_region_req;
+  req.status = shmemio_err_unknown;
+  req.seq = px->next_seq++;
+  ((int*)req.payload)[0] = px->nregions;
+  ((int*)req.payload)[1] = rmax;
+
+  int ret = shmemio_streamsend(px->worker, px->up_ep, &req, sizeof(shmemio_req_t));
+  shmemio_log_ret_if(error, -1, ret < 0, "Failed to send region request\n");
+  px->up_reqs++;
+
+  for (; px->nregions < rmax; px->nregions++) {
+    proxy_blob_t *blob = &(px->regions[px->nregions]);
+    blob->len = 0;
+    blob->data = NULL;
+    ret = proxy_recv_region(px, blob);
+    shmemio_log_ret_if(error, -1, ret < 0, "Failed to recv region %d\n", px->nregions);
+  }
+
+  shmemio_log(info, "Proxy holds %d regions\n", px->nregions);
+  return 0;
+}
+
+/*
+ * Connect to the server and copy the fspace description
+ */
+static int
+proxy_connect_server(proxy_t *px)
+{
+  ucp_ep_params_t ep_params;
+  struct sockaddr_in connect_addr;
+  shmemio_connreq_t connreq;
+
+  memset(&connect_addr, 0, sizeof(struct sockaddr_in));
+  connect_addr.sin_family      = AF_INET;
+  connect_addr.sin_addr.s_addr = inet_addr(px->server_name);
+  connect_addr.sin_port        = px->server_port;
+
+  ep_params.field_mask       = ( UCP_EP_PARAM_FIELD_FLAGS     |
+				 UCP_EP_PARAM_FIELD_SOCK_ADDR |
+				 UCP_EP_PARAM_FIELD_ERR_HANDLER |
+				 UCP_EP_PARAM_FIELD_USER_DATA );
+  ep_params.err_handler.cb   = err_cb;
+  ep_params.err_handler.arg  = NULL;
+  ep_params.user_data        = NULL;
+  ep_params.flags            = UCP_EP_PARAMS_FLAGS_CLIENT_SERVER;
+  ep_params.sockaddr.addr    = (struct sockaddr*)&connect_addr;
+  ep_params.sockaddr.addrlen = sizeof(connect_addr);
+
+  ucs_status_t status = ucp_ep_create(px->worker, &ep_params, &(px->up_ep));
+  if (status != UCS_OK) {
+    fprintf(stderr, "Failed to connect to %s:%u (%s)\n",
+	    px->server_name, (unsigned)px->server_port, ucs_status_string(status));
+    return -1;
+  }
+
+  test_send_recv_stream(px->worker, px->up_ep, 0);
+
+  int ret = proxy_recv(px, px->up_ep, &connreq, sizeof(shmemio_connreq_t));
+  shmemio_log_ret_if(error, -1, ret < 0, "failed to recv connection request data\n");
+
+  px->fpes = (proxy_blob_t*)calloc(connreq.nfpes, sizeof(proxy_blob_t));
+  px->regions = (proxy_blob_t*)calloc(connreq.nregions, sizeof(proxy_blob_t));
+  if ((px->fpes == NULL) || (px->regions == NULL)) {
+    connreq.nfpes = -1;
+    connreq.nregions = -1;
+  }
+
+  ret = shmemio_streamsend(px->worker, px->up_ep, &connreq, sizeof(shmemio_connreq_t));
+  shmemio_log_ret_if(error, -1, (ret < 0) || (connreq.nfpes < 0),
+		     "failed to ack connection to server\n");
+
+  for (int idx = 0; idx < connreq.nfpes; idx++) {
+    ret = proxy_recv_fpe(px, &(px->fpes[idx]));
+    shmemio_log_ret_if(error, -1, ret < 0, "Failed on recv of fpe %d\n", idx);
+    px->nfpes++;
+  }
+
+  for (int idx = 0; idx < connreq.nregions; idx++) {
+    ret = proxy_recv_region(px, &(px->regions[idx]));
+    shmemio_log_ret_if(error, -1, ret < 0, "Failed on recv of region %d\n", idx);
+    px->nregions++;
+  }
+
+  printf ("Fspace proxy: Connected to %s:%u with %d fpes and %d regions\n",
+	  px->server_name, (unsigned)px->server_port, px->nfpes, px->nregions);
+  return 0;
+}
+
+/*
+ * The listener callback, runs from worker progress
+ */
+static void
+proxy_conn_handle_cb(ucp_conn_request_h conn_request, void *arg)
+{
+  proxy_t *px = (proxy_t*)arg;
+  ucp_ep_params_t ep_params;
+
+  proxy_conn_t *conn = (proxy_conn_t*)calloc(1, sizeof(proxy_conn_t));
+  if (conn == NULL) {
+    fprintf(stderr, "Failed to allocate pe connection\n");
+    ucp_listener_reject(px->listener, conn_request);
+    return;
+  }
+
+  ep_params.field_mask      = UCP_EP_PARAM_FIELD_ERR_HANDLER |
+                              UCP_EP_PARAM_FIELD_CONN_REQUEST |
+                              UCP_EP_PARAM_FIELD_USER_DATA;
+  ep_params.conn_request    = conn_request;
+  ep_params.err_handler.cb  = err_cb;
+  ep_params.err_handler.arg = NULL;
+  ep_params.user_data       = conn;
+
+  ucs_status_t status = ucp_ep_create(px->worker, &ep_params, &(conn->ep));
+  if (status != UCS_OK) {
+    fprintf(stderr, "failed to create an endpoint on the proxy: (%s)\n",
+	    ucs_status_string(status));
+    free(conn);
+    return;
+  }
+
+  conn->next = px->new_conns;
+  px->new_conns = conn;
+}
+
+static int
+proxy_listen(proxy_t *px)
+{
+  struct sockaddr_in listen_addr;
+  ucp_listener_params_t params;
+
+  memset(&listen_addr, 0, sizeof(struct sockaddr_in));
+  listen_addr.sin_family      = AF_INET;
+  listen_addr.sin_addr.s_addr = INADDR_ANY;
+  listen_addr.sin_port        = px->port;
+
+  params.field_mask         = UCP_LISTENER_PARAM_FIELD_SOCK_ADDR |
+                              UCP_LISTENER_PARAM_FIELD_CONN_HANDLER;
+  params.sockaddr.addr      = (const struct sockaddr*)&listen_addr;
+  params.sockaddr.addrlen   = sizeof(listen_addr);
+  params.conn_handler.cb    = proxy_conn_handle_cb;
+  params.conn_handler.arg   = px;
+
+  ucs_status_t status = ucp_listener_create(px->worker, &params, &(px->listener));
+  if (status != UCS_OK) {
+    fprintf(stderr, "failed to create listener (%s)\n", ucs_status_string(status));
+    return -1;
+  }
+  return 0;
+}
+
+static inline int
+proxy_send_blobs(proxy_t *px, ucp_ep_h ep, proxy_blob_t *blobs, int start, int end)
+{
+  for (int idx = start; idx < end; idx++) {
+    int ret = shmemio_streamsend(px->worker, ep, blobs[idx].data, blobs[idx].len);
+    shmemio_log_ret_if(error, -1, ret < 0, "Failed to send fspace data %d\n", idx);
+  }
+  return 0;
+}
+
+/*
+ * Same as the server side of a connection, from the fspace copy
+ */
+static int
+proxy_accept(proxy_t *px, proxy_conn_t *conn)
+{
+  shmemio_connreq_t req;
+  req.nfpes = px->nfpes;
+  req.nregions = px->nregions;
+
+  test_send_recv_stream(px->worker, conn->ep, 1);
+
+  int ret = shmemio_streamsend(px->worker, conn->ep, &req, sizeof(shmemio_connreq_t));
+  shmemio_log_jmp_if(error, err_conn, ret < 0, "send connection info\n");
+
+  ret = proxy_recv(px, conn->ep, &req, sizeof(shmemio_connreq_t));
+  shmemio_log_jmp_if(error, err_conn, ret < 0, "recv connections ack from pe\n");
+
+  shmemio_log_jmp_if(error, err_conn,
+		     (req.nfpes <= 0) || (req.nfpes > px->nfpes) ||
+		     (req.nregions <= 0) || (req.nregions > px->nregions),
+		     "new connection rejected by pe\n");
+
+  ret = proxy_send_blobs(px, conn->ep, px->fpes, 0, req.nfpes);
+  shmemio_log_jmp_if(error, err_conn, ret < 0, "Send fpes failed\n");
+
+  ret = proxy_send_blobs(px, conn->ep, px->regions, 0, req.nregions);
+  shmemio_log_jmp_if(error, err_conn, ret < 0, "Send regions failed\n");
+
+  conn->prev = NULL;
+  conn->next = px->conns;
+  if (px->conns != NULL)
+    px->conns->prev = conn;
+  px->conns = conn;
+  px->nconns++;
+
+  shmemio_log(info, "Proxy now serves %d pes\n", px->nconns);
+  return 0;
+
+ err_conn:
+  shmemio_ep_force_close(px->worker, conn->ep);
+  free(conn);
+  return -1;
+}
+
+static void
+proxy_add_fkey(proxy_conn_t *conn, uint64_t fkey)
+{
+  if (conn->nfkeys == conn->maxfkeys) {
+    const int newmax = (conn->maxfkeys == 0) ? 8 : (2 * conn->maxfkeys);
+    uint64_t *newkeys = (uint64_t*)realloc(conn->fkeys, newmax * sizeof(uint64_t));
+    if (newkeys == NULL) {
+      shmemio_log(warn, "Failed to track fkey %lx, not closed if the pe goes\n",
+		  (long unsigned)fkey);
+      return;
+    }
+    conn->fkeys = newkeys;
+    conn->maxfkeys = newmax;
+  }
+  conn->fkeys[conn->nfkeys++] = fkey;
+}
+
+static void
+proxy_del_fkey(proxy_conn_t *conn, uint64_t fkey)
+{
+  for (int idx = 0; idx < conn->nfkeys; idx++) {
+    if (conn->fkeys[idx] == fkey) {
+      conn->fkeys[idx] = conn->fkeys[--conn->nfkeys];
+      return;
+    }
+  }
+}
+
+static proxy_waiter_t *
+proxy_new_waiter(proxy_conn_t *conn, unsigned seq, proxy_waiter_t *next)
+{
+  proxy_waiter_t *w = (proxy_waiter_t*)malloc(sizeof(proxy_waiter_t));
+  shmemio_log_ret_if(error, NULL, w == NULL, "Failed to allocate request waiter\n");
+  w->conn = conn;
+  w->seq = seq;
+  w->next = next;
+  return w;
+}
+
+/*
+ * Send a request to the server with a proxy seq, and data after it. The
+ * response goes back to the waiters, which may be none
+ */
+static int
+proxy_forward_waiters(proxy_t *px, proxy_waiter_t *waiters, shmemio_req_t *req,
+		      const void *data, size_t len)
+{
+  proxy_wait_t *wait = (proxy_wait_t*)malloc(sizeof(proxy_wait_t));
+  shmemio_log_ret_if(error, -1, wait == NULL, "Failed to allocate forwarded request\n");
+
+  wait->waiters = waiters;
+  wait->type = req->type;
+  wait->up_seq = px->next_seq++;
+  req->seq = wait->up_seq;
+
+  int ret = shmemio_streamsend(px->worker, px->up_ep, req, sizeof(shmemio_req_t));
+  if ((ret == 0) && (len > 0))
+    ret = shmemio_streamsend(px->worker, px->up_ep, data, len);
+
+  if (ret < 0) {
+    shmemio_log(error, "Failed to forward request type %d\n", req->type);
+    free(wait);
+    return -1;
+  }
+
+  wait->next = px->inflight;
+  px->inflight = wait;
+  px->ninflight++;
+  px->up_reqs++;
+  return 0;
+}
+
+/*
+ * Forward a request for one pe, or for nobody if conn is NULL
+ */
+static int
+proxy_forward(proxy_t *px, proxy_conn_t *conn, shmemio_req_t *req, const void *data, size_t len)
+{
+  proxy_waiter_t *w = NULL;
+  if (conn != NULL) {
+    w = proxy_new_waiter(conn, req->seq, NULL);
+    if (w == NULL)
+      return -1;
+  }
+
+  if (proxy_forward_waiters(px, w, req, data, len) < 0) {
+    free(w);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Answer a pe without going to the server
+ */
+static int
+proxy_respond(proxy_t *px, proxy_conn_t *conn, shmemio_req_t *req, int status)
+{
+  req->status = status;
+  return shmemio_streamsend(px->worker, conn->ep, req, sizeof(shmemio_req_t));
+}
+
+/*
+ * Close the files a pe left open, nobody waits on the responses
+ */
+static void
+proxy_close_orphans(proxy_t *px, proxy_conn_t *conn)
+{
+  for (int idx = 0; idx < conn->nfkeys; idx++) {
+    shmemio_req_t req;
+    shmemio_fp_req_t *fpreq = (shmemio_fp_req_t*)req.payload;
+    req.type = shmemio_fclose_req;
+    req.status = shmemio_err_unknown;
+    fpreq->fkey = conn->fkeys[idx];
+    fpreq->ioflags = 0;
+
+    shmemio_log(warn, "Close fkey %lx left open by pe at ep %p\n",
+		(long unsigned)fpreq->fkey, conn->ep);
+    proxy_forward(px, NULL, &req, NULL, 0);
+  }
+  conn->nfkeys = 0;
+}
+
+static void
+proxy_release_conn(proxy_t *px, proxy_conn_t *conn)
+{
+  proxy_close_orphans(px, conn);
+
+  for (proxy_wait_t *wait = px->inflight; wait != NULL; wait = wait->next) {
+    for (proxy_waiter_t *w = wait->waiters; w != NULL; w = w->next) {
+      if (w->conn == conn)
+	w->conn = NULL;
+    }
+  }
+
+  for (proxy_waiter_t *w = px->flush_waiters; w != NULL; w = w->next) {
+    if (w->conn == conn)
+      w->conn = NULL;
+  }
+
+  for (proxy_held_t *h = px->held; h != NULL; h = h->next) {
+    if (h->conn == conn)
+      h->conn = NULL;
+  }
+
+  if (conn->prev != NULL)
+    conn->prev->next = conn->next;
+  else
+    px->conns = conn->next;
+  if (conn->next != NULL)
+    conn->next->prev = conn->prev;
+  px->nconns--;
+
+  shmemio_ep_force_close(px->worker, conn->ep);
+  free(conn->fkeys);
+  free(conn);
+
+  shmemio_log(info, "Proxy now serves %d pes\n", px->nconns);
+}
+
+static int
+proxy_hold(proxy_t *px, proxy_conn_t *conn, shmemio_req_t *req)
+{
+  proxy_held_t *h = (proxy_held_t*)malloc(sizeof(proxy_held_t));
+  shmemio_log_ret_if(error, -1, h == NULL, "Failed to hold request\n");
+
+  h->conn = conn;
+  memcpy(&(h->req), req, sizeof(shmemio_req_t));
+  h->next = NULL;
+
+  if (px->held_tail != NULL)
+    px->held_tail->next = h;
+  else
+    px->held = h;
+  px->held_tail = h;
+  return 0;
+}
+
+/*
+ * Serve a raw data request. Nothing may be in flight to the server
+ */
+static int
+proxy_serve_raw(proxy_t *px, proxy_conn_t *conn, shmemio_req_t *req)
+{
+  int ret;
+
+  switch (req->type) {
+  case shmemio_region_req:
+    {
+      const int rstart = ((int*)req->payload)[0];
+      const int rmax = ((int*)req->payload)[1];
+      if (rmax > px->nregions)
+	ret = proxy_fetch_regions(px, rmax);
+      else {
+	px->local++;
+	ret = 0;
+      }
+      if ((ret == 0) && (conn != NULL))
+	ret = proxy_send_blobs(px, conn->ep, px->regions, rstart, rmax);
+      return ret;
+    }
+  case shmemio_fp_stat_req:
+    {
+      shmemio_fp_stat_t fpstat;
+      ret = shmemio_streamsend(px->worker, px->up_ep, req, sizeof(shmemio_req_t));
+      if (ret == 0)
+	ret = proxy_recv(px, px->up_ep, &fpstat, sizeof(shmemio_fp_stat_t));
+      px->up_reqs++;
+      if ((ret == 0) && (conn != NULL))
+	ret = shmemio_streamsend(px->worker, conn->ep, &fpstat, sizeof(shmemio_fp_stat_t));
+      return ret;
+    }
+  case shmemio_filter_req:
+    {
+      //The matches follow the response, pass both down
+      shmemio_filter_req_t *freq = (shmemio_filter_req_t*)req->payload;
+      const size_t out_size = (freq->flags & SHMEM_FILTER_INDEX) ? sizeof(uint64_t) : freq->rec_size;
+      shmemio_req_t resp;
+      char *data = NULL;
+      size_t len = 0;
+
+      ret = shmemio_streamsend(px->worker, px->up_ep, req, sizeof(shmemio_req_t));
+      if (ret == 0)
+	ret = proxy_recv(px, px->up_ep, &resp, sizeof(shmemio_req_t));
+      px->up_reqs++;
+      if (ret < 0)
+	return ret;
+
+      if (resp.status == shmemio_success) {
+	len = ((shmemio_filter_req_t*)resp.payload)->count * out_size;
+	data = (len > 0) ? (char*)malloc(len) : NULL;
+	if ((len > 0) && ((data == NULL) || (proxy_recv(px, px->up_ep, data, len) < 0))) {
+	  shmemio_log(error, "Failed to recv %lu bytes of filter matches\n", (long unsigned)len);
+	  free(data);
+	  return -1;
+	}
+      }
+
+      if (conn != NULL) {
+	ret = shmemio_streamsend(px->worker, conn->ep, &resp, sizeof(shmemio_req_t));
+	if ((ret == 0) && (len > 0))
+	  ret = shmemio_streamsend(px->worker, conn->ep, data, len);
+      }
+      free(data);
+      return ret;
+    }
+  case shmemio_fspace_stat_req:
+    {
+      //One stat answers every pe asking for it
+      shmem_fspace_stat_t fsstat;
+      ret = shmemio_streamsend(px->worker, px->up_ep, req, sizeof(shmemio_req_t));
+      if (ret == 0)
+	ret = proxy_recv(px, px->up_ep, &fsstat, sizeof(shmem_fspace_stat_t));
+      px->up_reqs++;
+      if (ret < 0)
+	return ret;
+
+      if (conn != NULL)
+	shmemio_streamsend(px->worker, conn->ep, &fsstat, sizeof(shmem_fspace_stat_t));
+
+      proxy_held_t **pp = &(px->held);
+      proxy_held_t *last = NULL;
+      while (*pp != NULL) {
+	proxy_held_t *h = *pp;
+	if (h->req.type == shmemio_fspace_stat_req) {
+	  if (h->conn != NULL)
+	    shmemio_streamsend(px->worker, h->conn->ep, &fsstat, sizeof(shmem_fspace_stat_t));
+	  px->merged++;
+	  *pp = h->next;
+	  free(h);
+	}
+	else {
+	  last = h;
+	  pp = &(h->next);
+	}
+      }
+      px->held_tail = last;
+      return 0;
+    }
+  default:
+    shmemio_log(error, "Request type %d is not a raw data request\n", req->type);
+    return -1;
+  }
+}
+
+/*
+ * Serve the held raw data requests, in the order they came
+ */
+static void
+proxy_run_held(proxy_t *px)
+{
+  while ((px->ninflight == 0) && (px->held != NULL)) {
+    proxy_held_t *h = px->held;
+    px->held = h->next;
+    if (px->held == NULL)
+      px->held_tail = NULL;
+
+    if (proxy_serve_raw(px, h->conn, &(h->req)) < 0)
+      shmemio_log(error, "Failed to serve held request type %d\n", h->req.type);
+    free(h);
+  }
+}
+
+/*
+ * Receive the data sent after a request, of len bytes
+ */
+static char *
+proxy_recv_data(proxy_t *px, proxy_conn_t *conn, size_t len)
+{
+  char *data = (char*)malloc(len + 1);
+  shmemio_log_ret_if(error, NULL, data == NULL, "Failed to allocate %lu bytes\n", (long unsigned)len);
+
+  if ((len > 0) && (proxy_recv(px, conn->ep, data, len) < 0)) {
+    shmemio_log(error, "Failed to recv %lu bytes of request data\n", (long unsigned)len);
+    free(data);
+    return NULL;
+  }
+  return data;
+}
+
+static int
+proxy_pe_request(proxy_t *px, proxy_conn_t *conn)
+{
+  shmemio_req_t req;
+  int ret = proxy_recv(px, conn->ep, &req, sizeof(shmemio_req_t));
+  shmemio_log_ret_if(error, -1, ret < 0, "fail on recv new request from pe\n");
+
+  px->pe_reqs++;
+  shmemio_log(trace, "Got request type %d [%s] seq %u from pe at ep %p\n",
+	      req.type, shmemio_rt2str(req.type), req.seq, conn->ep);
+
+  switch (req.type) {
+  case shmemio_disco_req:
+    proxy_release_conn(px, conn);
+    return 0;
+  case shmemio_region_req:
+    if ((((int*)req.payload)[1] > px->nregions) && (px->ninflight > 0))
+      return proxy_hold(px, conn, &req);
+    return proxy_serve_raw(px, conn, &req);
+  case shmemio_fp_stat_req:
+  case shmemio_fspace_stat_req:
+  case shmemio_filter_req:
+    if (px->ninflight > 0)
+      return proxy_hold(px, conn, &req);
+    return proxy_serve_raw(px, conn, &req);
+  case shmemio_fopen_req:
+  case shmemio_fsnapshot_req:
+    {
+      const size_t len = ((req.type == shmemio_fopen_req) ?
+			  ((shmemio_fopen_req_t*)req.payload)->file_path_len :
+			  ((shmemio_fsnap_req_t*)req.payload)->name_len);
+      char *data = proxy_recv_data(px, conn, len);
+      if (data == NULL)
+	return proxy_respond(px, conn, &req, shmemio_err_recv);
+
+      ret = proxy_forward(px, conn, &req, data, len);
+      free(data);
+      if (ret < 0)
+	return proxy_respond(px, conn, &req, shmemio_err_send);
+      return 0;
+    }
+  case shmemio_fspace_flush_req:
+    for (proxy_wait_t *wait = px->inflight; wait != NULL; wait = wait->next) {
+      if (wait->type == shmemio_fspace_flush_req) {
+	//The flush in flight may have started before this pe's puts landed,
+	//wait for it and send one more flush for all that came meanwhile
+	proxy_waiter_t *w = proxy_new_waiter(conn, req.seq, px->flush_waiters);
+	if (w == NULL)
+	  break;
+	if (px->flush_waiters != NULL)
+	  px->merged++;
+	px->flush_waiters = w;
+	return 0;
+      }
+    }
+    break;
+  case shmemio_fclose_req:
+    proxy_del_fkey(conn, ((shmemio_fp_req_t*)req.payload)->fkey);
+    break;
+  case shmemio_fp_flush_req:
+  case shmemio_ftrunc_req:
+  case shmemio_fextend_req:
+  case shmemio_range_flush_req:
+  case shmemio_extents_req:
+  case shmemio_rebuild_req:
+    break;
+  default:
+    shmemio_log(error, "Unhandled type %d recv by proxy\n", req.type);
+    return -1;
+  }
+
+  if (proxy_forward(px, conn, &req, NULL, 0) < 0)
+    return proxy_respond(px, conn, &req, shmemio_err_send);
+  return 0;
+}
+
+/*
+ * Route a server response back to the pes waiting on it
+ */
+static int
+proxy_up_response(proxy_t *px)
+{
+  shmemio_req_t resp;
+  int ret = proxy_recv(px, px->up_ep, &resp, sizeof(shmemio_req_t));
+  shmemio_log_ret_if(error, -1, ret < 0, "fail on recv response from server\n");
+
+  proxy_wait_t **pp = &(px->inflight);
+  while ((*pp != NULL) && ((*pp)->up_seq != resp.seq))
+    pp = &((*pp)->next);
+
+  if (*pp == NULL) {
+    shmemio_log(warn, "Response type %d, seq %u matches no request\n", resp.type, resp.seq);
+    return -1;
+  }
+
+  proxy_wait_t *wait = *pp;
+  *pp = wait->next;
+  px->ninflight--;
+
+  while (wait->waiters != NULL) {
+    proxy_waiter_t *w = wait->waiters;
+    wait->waiters = w->next;
+
+    if (w->conn != NULL) {
+      if ((resp.type == shmemio_fopen_req) && (resp.status == shmemio_success))
+	proxy_add_fkey(w->conn, ((shmemio_fopen_req_t*)resp.payload)->fkey);
+
+      resp.seq = w->seq;
+      shmemio_streamsend(px->worker, w->conn->ep, &resp, sizeof(shmemio_req_t));
+    }
+    else if ((resp.type == shmemio_fopen_req) && (resp.status == shmemio_success)) {
+      //The pe went before its open completed
+      proxy_conn_t orphan;
+      memset(&orphan, 0, sizeof(orphan));
+      proxy_add_fkey(&orphan, ((shmemio_fopen_req_t*)resp.payload)->fkey);
+      proxy_close_orphans(px, &orphan);
+      free(orphan.fkeys);
+    }
+    free(w);
+  }
+
+  if ((wait->type == shmemio_fspace_flush_req) && (px->flush_waiters != NULL)) {
+    shmemio_req_t req;
+    req.type = shmemio_fspace_flush_req;
+    req.status = shmemio_err_unknown;
+
+    if (proxy_forward_waiters(px, px->flush_waiters, &req, NULL, 0) == 0) {
+      px->flush_waiters = NULL;
+    }
+    else {
+      while (px->flush_waiters != NULL) {
+	proxy_waiter_t *w = px->flush_waiters;
+	px->flush_waiters = w->next;
+	if (w->conn != NULL) {
+	  req.seq = w->seq;
+	  proxy_respond(px, w->conn, &req, shmemio_err_send);
+	}
+	free(w);
+      }
+    }
+  }
+  free(wait);
+
+  proxy_run_held(px);
+  return 0;
+}
+
+static int
+proxy_loop(proxy_t *px)
+{
+  static const size_t max_eps = 10;
+  ucp_stream_poll_ep_t poll_eps[max_eps];
+
+  while (px->status == proxy_running) {
+    while (ucp_worker_progress(px->worker) != 0)
+      ;
+
+    while (px->new_conns != NULL) {
+      proxy_conn_t *conn = px->new_conns;
+      px->new_conns = conn->next;
+      if (proxy_accept(px, conn) != 0)
+	shmemio_log(error, "New pe connection handshake failed\n");
+    }
+
+    ssize_t count = ucp_stream_worker_poll(px->worker, poll_eps, max_eps, 0);
+    for (int idx = 0; idx < count; idx++) {
+      if (poll_eps[idx].ep == px->up_ep)
+	proxy_up_response(px);
+      else
+	proxy_pe_request(px, (proxy_conn_t*)poll_eps[idx].user_data);
+    }
+  }
+
+  return 0;
+}
+
+static void
+proxy_shutdown(proxy_t *px)
+{
+  while (px->new_conns != NULL) {
+    proxy_conn_t *conn = px->new_conns;
+    px->new_conns = conn->next;
+    shmemio_ep_force_close(px->worker, conn->ep);
+    free(conn);
+  }
+
+  while (px->conns != NULL)
+    proxy_release_conn(px, px->conns);
+
+  //Let the orphan closes reach the server before going
+  while (px->ninflight > 0) {
+    while (ucp_worker_progress(px->worker) != 0)
+      ;
+    ucp_stream_poll_ep_t poll_ep;
+    if ((ucp_stream_worker_poll(px->worker, &poll_ep, 1, 0) > 0) &&
+	(proxy_up_response(px) < 0))
+      break;
+  }
+
+  if (px->up_ep != NULL) {
+    shmemio_req_t req;
+    req.type = shmemio_disco_req;
+    req.seq = px->next_seq++;
+    shmemio_streamsend(px->worker, px->up_ep, &req, sizeof(shmemio_req_t));
+    shmemio_ep_force_close(px->worker, px->up_ep);
+  }
+
+  if (px->listener != NULL)
+    ucp_listener_destroy(px->listener);
+
+  for (int idx = 0; idx < px->nfpes; idx++)
+    free(px->fpes[idx].data);
+  for (int idx = 0; idx < px->nregions; idx++)
+    free(px->regions[idx].data);
+  free(px->fpes);
+  free(px->regions);
+
+  printf ("Fspace proxy: %lu pe requests, %lu server requests, %lu merged, %lu served locally\n",
+	  px->pe_reqs, px->up_reqs, px->merged, px->local);
+}
+
+/*
+ * Init ucx with one worker
+ */
+static int
+proxy_init(proxy_t *px)
+{
+  ucp_params_t ucp_params;
+  ucp_worker_params_t worker_params;
+  ucp_config_t *config;
+  ucs_status_t status;
+
+  memset(&ucp_params, 0, sizeof(ucp_params));
+  memset(&worker_params, 0, sizeof(worker_params));
+
+  status = ucp_config_read(NULL, NULL, &config);
+  if (status != UCS_OK) {
+    fprintf(stderr, "Failed to ucp_config_read\n");
+    return -1;
+  }
+
+  ucp_params.field_mask   = ( UCP_PARAM_FIELD_FEATURES     |
+                              UCP_PARAM_FIELD_REQUEST_SIZE |
+                              UCP_PARAM_FIELD_REQUEST_INIT );
+  ucp_params.features     = (UCP_FEATURE_STREAM | UCP_FEATURE_WAKEUP);
+  ucp_params.request_size = sizeof(shmemio_streamreq_t);
+  ucp_params.request_init = shmemio_request_init;
+
+  status = ucp_init(&ucp_params, config, &px->context);
+  ucp_config_release(config);
+  if (status != UCS_OK) {
+    fprintf(stderr, "Failed to ucp_init\n");
+    return -1;
+  }
+
+  worker_params.field_mask  = UCP_WORKER_PARAM_FIELD_THREAD_MODE;
+  worker_params.thread_mode = UCS_THREAD_MODE_SINGLE;
+
+  status = ucp_worker_create(px->context, &worker_params, &px->worker);
+  if (status != UCS_OK) {
+    fprintf(stderr, "Failed to ucp_worker_create\n");
+    ucp_cleanup(px->context);
+    return -1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  memset(&px, 0, sizeof(proxy_t));
+
+  if (parse_cmd(argc, argv, &px) != 0)
+    return -1;
+
+  switch (px.log_level) {
+  case 0:
+    shmemio_set_log_level(warn);
+    break;
+  case 1:
+    shmemio_set_log_level(info);
+    break;
+  case 2:
+    shmemio_set_log_level(trace);
+    break;
+  }
+
+  if (proxy_init(&px) != 0)
+    return -1;
+
+  signal(SIGINT, sig_handler);
+  signal(SIGUSR1, sig_handler);
+
+  int ret = -1;
+  if (proxy_connect_server(&px) != 0) {
+    fprintf(stderr, "Failed to connect to fspace server\n");
+    goto shutdown;
+  }
+
+  if (proxy_listen(&px) != 0)
+    goto shutdown;
+
+  printf ("Fspace proxy: Serving pes on port %u...\n", (unsigned)px.port);
+  ret = proxy_loop(&px);
+
+ shutdown:
+  proxy_shutdown(&px);
+  ucp_worker_destroy(px.worker);
+  ucp_cleanup(px.context);
+  return ret;
+}
+
+const char cmd_optstr[] = "hp:P:s:vV";
+
+int parse_cmd(int argc, char * const argv[], proxy_t *px)
+{
+  int c = 0;
+  opterr = 0;
+
+  // Set defaults
+  px->server_name = "127.0.0.1";
+  px->server_port = 13337;
+  px->port = 13338;
+  px->log_level = 0;
+
+  while ((c = getopt(argc, argv, cmd_optstr)) != -1) {
+    switch (c) {
+    case 'p':
+      px->port = atoi(optarg);
+      if (px->port <= 0) {
+	fprintf(stderr, "Wrong proxy port number %d\n", px->port);
+	return -1;
+      }
+      break;
+    case 'P':
+      px->server_port = atoi(optarg);
+      if (px->server_port <= 0) {
+	fprintf(stderr, "Wrong server port number %d\n", px->server_port);
+	return -1;
+      }
+      break;
+    case 's':
+      px->server_name = optarg;
+      break;
+    case 'v':
+      px->log_level = 1;
+      break;
+    case 'V':
+      px->log_level = 2;
+      break;
+    case '?':
+      if (isprint (optopt)) {
+	fprintf(stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+      } else {
+	fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+      }
+    case 'h':
+    default:
+      fprintf(stderr, "Usage: fspace_proxy [parameters]\n");
+      fprintf(stderr, "\nParameters for the Fspace node proxy are:\n");
+      fprintf(stderr, "  -s addr Set fspace server address (default:127.0.0.1)\n");
+      fprintf(stderr, "  -P port Set fspace server port (default:13337)\n");
+      fprintf(stderr, "  -p port Set proxy listen port for pes of this node (default:13338)\n");
+      fprintf(stderr, "  -v set to verbose (only in debug mode, sets log level=info)\n");
+      fprintf(stderr, "  -V set to very verbose (only in debug mode, sets log level=trace)\n");
+      fprintf(stderr, "\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
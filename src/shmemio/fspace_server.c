@@ -85,6 +85,10 @@ typedef struct local_state_s {
   size_t            sys_pagesize;
   size_t            region_size;
   size_t            default_unit;
+  int               compact_interval;
+  double            sched_rate;
+  int               crc;
+  int               lz;
 
   shmemio_server_t  server;
 
@@ -608,6 +612,10 @@ int run_server_main()
     fprintf(stderr, "Failed to init shmemio server\n");
     goto err_shutdown;
   }
+  loc.server.compact_interval = loc.compact_interval;
+  loc.server.sched_rate = loc.sched_rate;
+  loc.server.crc = loc.crc;
+  loc.server.lz = loc.lz;
 
   if (test_server_make_threads(&loc) != 0) {
     printf ("Failed to create threads\n");
@@ -661,9 +669,9 @@ int main(int argc, char **argv)
 }
 
 #ifdef ENABLE_MUTIPLE_WORKERS
-const char cmd_optstr[] = "dn:p:w:s:hvV";
+const char cmd_optstr[] = "c:dkn:p:r:w:s:hvVz";
 #else
-const char cmd_optstr[] = "dn:p:s:hvV";
+const char cmd_optstr[] = "c:dkn:p:r:s:hvVz";
 #endif
   
 int parse_cmd(int argc, char * const argv[], local_state_t *loc)
@@ -677,14 +685,28 @@ int parse_cmd(int argc, char * const argv[], local_state_t *loc)
   loc->nworkers = 1;
   loc->nsfpes = 1;
   loc->log_level = 0;
+  loc->compact_interval = SHMEMIO_COMPACT_INTERVAL;
+  loc->sched_rate = 0;
+  loc->crc = 0;
+  loc->lz = 0;
 
   loc->daemonize = 0;
   
   while ((c = getopt(argc, argv, cmd_optstr)) != -1) {
     switch (c) {
+    case 'c':
+      loc->compact_interval = atoi(optarg);
+      if (loc->compact_interval < 0) {
+	fprintf(stderr, "Invalid compaction interval %d\n", loc->compact_interval);
+	return UCS_ERR_UNSUPPORTED;
+      }
+      break;
     case 'd':
       loc->daemonize = 1;
       break;
+    case 'k':
+      loc->crc = 1;
+      break;
     case 'p':
       loc->port = atoi(optarg);
       if (loc->port <= 0) {
@@ -692,12 +714,22 @@ int parse_cmd(int argc, char * const argv[], local_state_t *loc)
 	return UCS_ERR_UNSUPPORTED;
       }
       break;
+    case 'r':
+      loc->sched_rate = atof(optarg);
+      if (loc->sched_rate < 0) {
+	fprintf(stderr, "Invalid request rate limit %s\n", optarg);
+	return UCS_ERR_UNSUPPORTED;
+      }
+      break;
     case 'v':
       loc->log_level = 1;
       break;
     case 'V':
       loc->log_level = 2;
       break;
+    case 'z':
+      loc->lz = 1;
+      break;
 #ifdef ENABLE_MUTIPLE_WORKERS
     case 'w':
       loc->nworkers = atoi(optarg);
@@ -731,11 +763,16 @@ int parse_cmd(int argc, char * const argv[], local_state_t *loc)
     default:
       fprintf(stderr, "Usage: fspace_server [parameters]\n");
       fprintf(stderr, "\nParameters for the Fspace test server are:\n");
+      fprintf(stderr, "  -c secs Seconds between compactions of closed files, 0 is off (default:%d)\n",
+	      SHMEMIO_COMPACT_INTERVAL);
       fprintf(stderr, "  -d daemonize the server (default: run interactive)\n");
+      fprintf(stderr, "  -k keep CRC32C checksums of backing files, check them on load (default: off)\n");
       fprintf(stderr, "  -n nsfpes Set number of psuedo-fpes. (default:1)\n");
       fprintf(stderr, "  -p port Set server listen port (default:13337)\n");
+      fprintf(stderr, "  -r rate Requests per second served to each client, 0 is no limit (default:0)\n");
       fprintf(stderr, "  -v set to verbose (only in debug mode, sets log level=info)\n");
       fprintf(stderr, "  -V set to very verbose (only in debug mode, sets log level=trace)\n");
+      fprintf(stderr, "  -z compress files written back to backing files (default: off)\n");
 #ifdef ENABLE_MULTIPLE_WORKERS
       fprintf(stderr, "  -w nworkers Set number of workers. (default:1)\n");
 #endif
@@ -10,6 +10,9 @@
 #include "shmemio_stream_util.h"
 
 
+shmemio_static_assert( (shmemio_nclasses == SHMEM_FSPACE_NCLASSES),
+		       "Server request classes do not match fspace stat classes" );
+
 static inline shmemio_fp_req_t*
 get_fpreq(shmemio_req_t* req) {
   return (shmemio_fp_req_t*)req->payload;
@@ -23,6 +26,7 @@ shmemio_fill_stats(shmemio_sfile_t *sfile, shmemio_fp_stat_t* fstat)
   memcpy(&fstat->atime, &sfile->atime, sizeof(time_t));
   memcpy(&fstat->mtime, &sfile->mtime, sizeof(time_t));
   memcpy(&fstat->ftime, &sfile->ftime, sizeof(time_t));
+  fstat->capacity = sfile->capacity;
 }
 
 static inline shmemio_conn_t*
@@ -43,6 +47,8 @@ shmemio_create_new_conn(shmemio_server_t *srvr, ucp_ep_h ep)
   newconn->ep = ep;
 
   newconn->open_sfiles = NULL;
+
+  shmemio_sched_conn_init(srvr, newconn);
   
   shmemio_mutex_lock(&(srvr->req_conn_ls_lock));
   if (srvr->req_conns != NULL) {
@@ -144,6 +150,7 @@ shmemio_release_client_conn(shmemio_server_t *srvr, shmemio_conn_t *in_conn)
   if (conn->ep != NULL) {
     shmemio_kill_connection(srvr, conn);
   }
+  shmemio_sched_conn_release(srvr, conn);
 
   free(conn);
 }
@@ -308,14 +315,15 @@ static inline int
 shmemio_send_region(ucp_worker_h worker, ucp_ep_h ep, shmemio_server_region_t *reg)
 {
   int ret;
-  int ibuf[4];
-  size_t ibufsize = sizeof(int) * 4;
-  //client_region_recv_init(reg, ibuf[0], ibuf[1], ibuf[2], ibuf[3]); -> fpe_start, fpe_stride, fpe_size, unit_size
+  int ibuf[5];
+  size_t ibufsize = sizeof(int) * 5;
+  //client_region_recv_init(reg, ibuf[0], ibuf[1], ibuf[2], ibuf[3], ibuf[4]); -> fpe_start, fpe_stride, fpe_size, unit_size, replica_of
 
   ibuf[0] = reg->sfpe_start;
   ibuf[1] = reg->sfpe_stride;
   ibuf[2] = reg->sfpe_size;
   ibuf[3] = reg->unit_size;
+  ibuf[4] = reg->replica_of;
   
   ret = shmemio_streamsend(worker, ep, ibuf, ibufsize);
   shmemio_log_ret_if(error, -1, (ret < 0), "failed to send sfpe int fields\n");
@@ -410,38 +418,64 @@ shmemio_fspace_stat(shmemio_server_t *srvr, shmem_fspace_stat_t *fsstat)
 
   size_t bused = 0;
   size_t bfree = 0;
+  size_t bhole = 0;
+  int nempty = 0;
   mallinfo_t mi;
   for (int idx = 0; idx < srvr->nregions; idx++) {
     shmemio_region_mallinfo(&mi, &(srvr->regions[idx]));
     bused += mi.uordblks + mi.hblkhd;
     bfree += mi.fordblks;
+
+    //Free space past the last file in a region is one block, the rest is holes
+    bhole += mi.fordblks - mi.keepcost;
+    if ((srvr->regions[idx].mem_space != NULL) && !srvr->regions[idx].read_only &&
+	(srvr->regions[idx].nallocs == 0)) {
+      nempty++;
+    }
   }
   fsstat->used_size = bused;
   fsstat->free_size = bfree;
+  fsstat->hole_size = bhole;
+  fsstat->empty_regions = nempty;
+  fsstat->compact_moves = srvr->compact_moves;
+
+  for (int cls = 0; cls < shmemio_nclasses; cls++) {
+    const shmemio_sched_stat_t *st = &(srvr->sched_stats[cls]);
+    fsstat->nreqs[cls] = st->nreqs;
+    fsstat->lat_p50[cls] = shmemio_sched_percentile(st, 50);
+    fsstat->lat_p99[cls] = shmemio_sched_percentile(st, 99);
+    fsstat->lat_max[cls] = st->max_usec;
+  }
+
+  fsstat->crc_failures = srvr->crc_failures;
+  fsstat->crc_mbps = (srvr->crc_nsec > 0) ? ((srvr->crc_bytes * 1000) / srvr->crc_nsec) : 0;
+  fsstat->lz_ratio_x100 = ( (srvr->lz_out_bytes > 0) ?
+			    ((srvr->lz_in_bytes * 100) / srvr->lz_out_bytes) : 0 );
+  fsstat->lz_mbps = (srvr->lz_nsec > 0) ? ((srvr->lz_in_bytes * 1000) / srvr->lz_nsec) : 0;
+  fsstat->parity_mbps = ( (srvr->parity_nsec > 0) ?
+			  ((srvr->parity_bytes * 1000) / srvr->parity_nsec) : 0 );
+  fsstat->parity_overhead_pct = ( (srvr->parity_flush_nsec > 0) ?
+				  ((srvr->parity_nsec * 100) / srvr->parity_flush_nsec) : 0 );
+  fsstat->filter_mbps = ( (srvr->filter_nsec > 0) ?
+			  ((srvr->filter_scan_bytes * 1000) / srvr->filter_nsec) : 0 );
+  fsstat->filter_sent_pct = ( (srvr->filter_scan_bytes > 0) ?
+			      ((srvr->filter_sent_bytes * 100) / srvr->filter_scan_bytes) : 0 );
 }
 
 static inline int
-shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep)
+shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep, shmemio_req_t *req)
 {
-  //shmemio_log(trace, "Handle request from ep %p\n", ep);
-  
   int ret;
-  shmemio_req_t req;
-  ret = shmemio_streamrecv(srvr->worker, ep, &req, sizeof(shmemio_req_t));
-  shmemio_log_ret_if(error, -1, ret < 0, "fail on recv new shmemio server request\n");
-  
-  shmemio_log(trace, "Got new request type %d [%s] from shmemio client at ep %p...\n",
-	      req.type, shmemio_rt2str(req.type), ep);
 
-  switch(req.type) {
+  switch(req->type) {
   case shmemio_fopen_req:
     {
-      shmemio_server_fopen(srvr, ep, (shmemio_fopen_req_t*)req.payload, &(req.status));
-      return shmemio_send_response(srvr, ep, &req, req.status);
+      shmemio_server_fopen(srvr, ep, (shmemio_fopen_req_t*)req->payload, &(req->status));
+      return shmemio_send_response(srvr, ep, req, req->status);
     }
   case shmemio_region_req:
     {
-      ret = shmemio_send_regions(srvr, ep, ((int*)req.payload)[0], ((int*)req.payload)[1]);
+      ret = shmemio_send_regions(srvr, ep, ((int*)req->payload)[0], ((int*)req->payload)[1]);
       shmemio_log_ret_if(error, -1, ret < 0, "Failed to send regions\n");
       return ret;
     }
@@ -460,32 +494,33 @@ shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep)
   case shmemio_fclose_req:
   case shmemio_ftrunc_req:
     {
-      shmemio_fp_req_t *fpreq = get_fpreq(&req);
+      shmemio_fp_req_t *fpreq = get_fpreq(req);
       shmemio_do_error(shmemio_check_fkey_ep(fpreq->fkey, ep));
       
-      shmemio_try_blocking_file_act(srvr, req.type,
-				    fpreq, &(req.status));
+      shmemio_try_blocking_file_act(srvr, req->type,
+				    fpreq, &(req->status));
 
-      if (req.status != shmemio_action_blocked) {
+      if (req->status != shmemio_action_blocked) {
 	//action did not block
-	return shmemio_send_response(srvr, ep, &req, req.status);
+	return shmemio_send_response(srvr, ep, req, req->status);
       }
-      //action blocked. No response until complete.
+      //action blocked. No response until complete, answered with this seq
+      ((shmemio_sfile_ls_t*)fpreq->fkey)->waitseq = req->seq;
       return 0;
     }
   case shmemio_fextend_req:
     {
-      shmemio_fp_req_t *fpreq = get_fpreq(&req);
+      shmemio_fp_req_t *fpreq = get_fpreq(req);
       shmemio_do_error(shmemio_check_fkey_ep(fpreq->fkey, ep));
       
-      shmemio_try_nonblock_file_act(srvr, req.type,
-				    fpreq, &(req.status));
+      shmemio_try_nonblock_file_act(srvr, req->type,
+				    fpreq, &(req->status));
       
-      return shmemio_send_response(srvr, ep, &req, req.status);
+      return shmemio_send_response(srvr, ep, req, req->status);
     }
   case shmemio_fp_stat_req:
     {
-      shmemio_fp_req_t *fpreq = get_fpreq(&req);
+      shmemio_fp_req_t *fpreq = get_fpreq(req);
       shmemio_do_error(shmemio_check_fkey_ep(fpreq->fkey, ep));
 
       shmemio_fp_stat_t fpstat;
@@ -495,10 +530,50 @@ shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep)
       shmemio_streamsend(srvr->worker, ep, &fpstat, sizeof(shmemio_fp_stat_t));
       return 0;
     }
+  case shmemio_fsnapshot_req:
+    {
+      shmemio_fsnap_req_t *snreq = (shmemio_fsnap_req_t*)req->payload;
+      shmemio_do_error(shmemio_check_fkey_ep(snreq->fkey, ep));
+
+      shmemio_server_fsnapshot(srvr, ep, snreq, &(req->status));
+      return shmemio_send_response(srvr, ep, req, req->status);
+    }
+  case shmemio_range_flush_req:
+    {
+      shmemio_range_flush_req_t *rfreq = (shmemio_range_flush_req_t*)req->payload;
+      shmemio_do_error(shmemio_check_fkey_ep(rfreq->fkey, ep));
+
+      shmemio_server_range_flush(srvr, rfreq, &(req->status));
+      return shmemio_send_response(srvr, ep, req, req->status);
+    }
+  case shmemio_extents_req:
+    {
+      shmemio_extents_req_t *exreq = (shmemio_extents_req_t*)req->payload;
+      shmemio_do_error(shmemio_check_fkey_ep(exreq->fkey, ep));
+
+      shmemio_server_extents(srvr, exreq, &(req->status));
+      return shmemio_send_response(srvr, ep, req, req->status);
+    }
+  case shmemio_rebuild_req:
+    {
+      shmemio_rebuild_req_t *rbreq = (shmemio_rebuild_req_t*)req->payload;
+      shmemio_do_error(shmemio_check_fkey_ep(rbreq->fkey, ep));
+
+      shmemio_sfile_t *sfile = ((shmemio_sfile_ls_t*)rbreq->fkey)->sfile;
+      req->status = shmemio_parity_rebuild(srvr, sfile, rbreq->pe_index, rbreq->ioflags);
+      return shmemio_send_response(srvr, ep, req, req->status);
+    }
+  case shmemio_filter_req:
+    {
+      shmemio_filter_req_t *freq = (shmemio_filter_req_t*)req->payload;
+      shmemio_do_error(shmemio_check_fkey_ep(freq->fkey, ep));
+
+      return shmemio_server_filter(srvr, ep, req);
+    }
   case shmemio_fspace_flush_req:
     {
       shmemio_flush_fspace(srvr, 0);
-      return shmemio_send_response(srvr, ep, &req, shmemio_success);
+      return shmemio_send_response(srvr, ep, req, shmemio_success);
     }
   case shmemio_fspace_stat_req:
     {
@@ -508,7 +583,7 @@ shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep)
       return 0;
     }
   default:
-    shmemio_log(error, "Unhandled type %d recv by server\n", req.type);
+    shmemio_log(error, "Unhandled type %d recv by server\n", req->type);
     return -1;
   }
 
@@ -516,6 +591,34 @@ shmemio_handle_request(shmemio_server_t *srvr, ucp_ep_h ep)
 }
 
 
+/*
+ * Handle the request the scheduler picked, then post the recv of the
+ * next request of the connection
+ */
+static inline void
+shmemio_serve_request(shmemio_server_t *srvr, shmemio_conn_t *conn)
+{
+  if (conn->pending < 0) {
+    shmemio_log(warn, "Lost request stream of connection %p, release it\n", conn);
+    shmemio_release_client_conn(srvr, conn);
+    return;
+  }
+
+  shmemio_req_t req;
+  memcpy(&req, &(conn->req), sizeof(shmemio_req_t));
+  const uint64_t arrival = conn->arrival;
+  conn->pending = 0;
+
+  shmemio_handle_request(srvr, conn->ep, &req);
+  shmemio_sched_done(srvr, req.type, arrival);
+
+  //A disconnect released the connection
+  if (req.type != shmemio_disco_req) {
+    shmemio_sched_post(srvr, conn);
+  }
+}
+
+
 static inline int
 shmemio_handshake(shmemio_server_t *srvr, shmemio_conn_t *newconn)
 {
@@ -556,9 +659,6 @@ int
 shmemio_connectloop(shmemio_server_t *srvr)
 {
   int ret;
-  size_t len;
-  static const size_t max_eps = 10;
-  ucp_stream_poll_ep_t poll_eps[max_eps];
   
   while (srvr->status == shmemio_server_listen) {
     wait_next_conn:
@@ -573,20 +673,16 @@ shmemio_connectloop(shmemio_server_t *srvr)
       if (srvr->status != shmemio_server_listen)
 	goto killall_newconns;
 
-      //shmemio_log(trace, "Polling server worker\n");
-      ssize_t count = ucp_stream_worker_poll(srvr->worker, poll_eps, max_eps, 0);
-      
-      while (count > 0) {
-	shmemio_log(trace, "Received requests from %d eps\n", count);
-      
-	for (int idx = 0; idx < count; idx++) {
-	  shmemio_handle_request(srvr, poll_eps[idx].ep);
-	}
+      shmemio_conn_t *conn = shmemio_sched_next(srvr);
+      while (conn != NULL) {
+	shmemio_serve_request(srvr, conn);
 	while (ucp_worker_progress(srvr->worker) != 0);
-	
-	count = ucp_stream_worker_poll(srvr->worker, poll_eps, max_eps, 0);
+
+	conn = shmemio_sched_next(srvr);
       }
 
+      shmemio_compact_idle(srvr);
+
       //Currently busted on bluefield, never returns, emulated atomics problem?
       //shmemio_log(trace, "Enter server worker wait\n");
       //ucs_status_t status = ucp_worker_wait(srvr->worker);
@@ -606,6 +702,9 @@ shmemio_connectloop(shmemio_server_t *srvr)
     shmemio_log_jmp_if(error, wait_next_conn, ret != 0, "Send fspace failed\n");
       
     (*(srvr->conn_cb_f))(srvr, newconn, srvr->conn_cb_args);
+
+    ret = shmemio_sched_post(srvr, newconn);
+    shmemio_log_if(error, ret != 0, "Failed to post request recv of new connection\n");
     
   } // end while server is running
   
@@ -0,0 +1,328 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+
+#include <sys/stat.h>
+
+/*
+ * CRC32C checksums of files written back to and loaded from their
+ * backing files. With srvr->crc set, write-back stores the checksum of
+ * every unit, in file order, in a side file named after the backing file
+ * with a ".crc" suffix. A load checks each unit it reads against it. The
+ * side file records the backing file size and mtime, so a backing file
+ * changed by something other than the server is loaded unchecked.
+ *
+ * Checksums use the crc32 instructions where the cpu has them, ARMv8 CRC
+ * or SSE4.2, and a table otherwise
+ */
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define SHMEMIO_CRC_ARM
+#elif defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define SHMEMIO_CRC_X86
+#endif
+
+#define SHMEMIO_CRC_POLY  0x82F63B78  /* reflected Castagnoli */
+#define SHMEMIO_CRC_MAGIC "SHIOCRC1"
+
+typedef struct shmemio_crc_hdr_s {
+  char magic[8];
+  uint32_t unit_size;
+  uint32_t pad;
+  uint64_t size;       // of the backing file when written
+  int64_t mtime_sec;   // of the backing file when written
+  int64_t mtime_nsec;
+  uint64_t nunits;
+} shmemio_crc_hdr_t;
+
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const unsigned char *p, size_t len);
+
+static uint32_t crc_table[256];
+
+static uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+  while (len-- > 0) {
+    crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef SHMEMIO_CRC_ARM
+__attribute__((target("+crc")))
+static uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+  while (len >= sizeof(uint64_t)) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    crc = __crc32cd(crc, v);
+    p += sizeof(uint64_t);
+    len -= sizeof(uint64_t);
+  }
+  while (len-- > 0) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+
+static inline int
+crc32c_hw_ok()
+{
+  return ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0);
+}
+#endif
+
+#ifdef SHMEMIO_CRC_X86
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+  uint64_t c = crc;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    c = _mm_crc32_u64(c, v);
+    p += sizeof(uint64_t);
+    len -= sizeof(uint64_t);
+  }
+  crc = (uint32_t)c;
+  while (len-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+
+static inline int
+crc32c_hw_ok()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+static crc32c_fn_t crc32c_fn = NULL;
+
+static void
+crc32c_select()
+{
+  for (uint32_t idx = 0; idx < 256; idx++) {
+    uint32_t c = idx;
+    for (int bit = 0; bit < 8; bit++) {
+      c = (c & 1) ? ((c >> 1) ^ SHMEMIO_CRC_POLY) : (c >> 1);
+    }
+    crc_table[idx] = c;
+  }
+
+  crc32c_fn = crc32c_sw;
+#if defined(SHMEMIO_CRC_ARM) || defined(SHMEMIO_CRC_X86)
+  if (crc32c_hw_ok()) {
+    crc32c_fn = crc32c_hw;
+  }
+#endif
+  shmemio_log(info, "CRC32C checksums use %s\n",
+	      (crc32c_fn == crc32c_sw) ? "lookup table" : "crc32 instructions");
+}
+
+/*
+ * CRC32C of len bytes, continuing from crc. Start with crc 0
+ */
+uint32_t
+shmemio_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+  if (crc32c_fn == NULL) {
+    crc32c_select();
+  }
+  return ~crc32c_fn(~crc, (const unsigned char*)buf, len);
+}
+
+static inline char *
+crc_side_path(const char *path)
+{
+  char *side = malloc(strlen(path) + sizeof(".crc"));
+  if (side != NULL) {
+    sprintf(side, "%s.crc", path);
+  }
+  return side;
+}
+
+/*
+ * Load the checksums of the backing file, if they still describe it
+ */
+static inline void
+crc_load_side(shmemio_crc_file_t *cf, const char *path, FILE *fp, int unit_size)
+{
+  struct stat st;
+  shmemio_crc_hdr_t hdr;
+
+  if (fstat(fileno(fp), &st) != 0) {
+    return;
+  }
+
+  char *side = crc_side_path(path);
+  FILE *sfp = (side != NULL) ? fopen(side, "r") : NULL;
+  if (sfp == NULL) {
+    shmemio_log(info, "No checksums for backing file %s, load it unchecked\n", path);
+    free(side);
+    return;
+  }
+
+  if ((fread(&hdr, sizeof(hdr), 1, sfp) != 1) ||
+      (memcmp(hdr.magic, SHMEMIO_CRC_MAGIC, sizeof(hdr.magic)) != 0)) {
+    shmemio_log(warn, "Bad checksum file %s, load %s unchecked\n", side, path);
+    goto done;
+  }
+
+  if ((hdr.unit_size != unit_size) || (hdr.size != st.st_size) ||
+      (hdr.mtime_sec != st.st_mtim.tv_sec) || (hdr.mtime_nsec != st.st_mtim.tv_nsec)) {
+    shmemio_log(warn, "Checksum file %s is older than %s or for another unit size, load it unchecked\n",
+		side, path);
+    goto done;
+  }
+
+  cf->crcs = (uint32_t*)malloc(hdr.nunits * sizeof(uint32_t));
+  if ((cf->crcs == NULL) ||
+      (fread(cf->crcs, sizeof(uint32_t), hdr.nunits, sfp) != hdr.nunits)) {
+    shmemio_log(warn, "Failed to read checksum file %s, load %s unchecked\n", side, path);
+    free(cf->crcs);
+    cf->crcs = NULL;
+    goto done;
+  }
+
+  cf->maxunits = hdr.nunits;
+  cf->verify = 1;
+
+ done:
+  fclose(sfp);
+  free(side);
+}
+
+/*
+ * Start checksums of a backing file read or write of units of unit_size
+ */
+void
+shmemio_crc_begin(shmemio_server_t *srvr, shmemio_crc_file_t *cf,
+		  const char *path, FILE *fp, int unit_size, int do_write)
+{
+  memset(cf, 0, sizeof(shmemio_crc_file_t));
+  cf->on = srvr->crc;
+  cf->unit_size = unit_size;
+
+  if (cf->on && !do_write) {
+    crc_load_side(cf, path, fp, unit_size);
+    cf->on = cf->verify;
+  }
+}
+
+/*
+ * Checksum the next unit of the file, which was just written from or
+ * read into addr. Returns nonzero if a read unit fails its check
+ */
+int
+shmemio_crc_unit(shmemio_crc_file_t *cf, const void *addr, size_t len)
+{
+  if (!cf->on || (len == 0)) {
+    return 0;
+  }
+
+  const uint64_t start = shmemio_nsec();
+  const uint32_t crc = shmemio_crc32c(0, addr, len);
+  cf->nsec += shmemio_nsec() - start;
+  cf->bytes += len;
+
+  if (cf->verify) {
+    const int bad = ((cf->nunits >= cf->maxunits) || (cf->crcs[cf->nunits] != crc));
+    if (bad) {
+      shmemio_log(error, "Checksum of unit %lu does not match, 0x%08x not 0x%08x\n",
+		  (long unsigned)cf->nunits, crc,
+		  (cf->nunits < cf->maxunits) ? cf->crcs[cf->nunits] : 0);
+      cf->bad++;
+    }
+    cf->nunits++;
+    return bad;
+  }
+
+  if (cf->nunits == cf->maxunits) {
+    const size_t maxunits = (cf->maxunits > 0) ? (2 * cf->maxunits) : 1024;
+    uint32_t *crcs = (uint32_t*)realloc(cf->crcs, maxunits * sizeof(uint32_t));
+    if (crcs == NULL) {
+      shmemio_log(error, "Failed to grow checksums to %lu units, none kept\n", (long unsigned)maxunits);
+      cf->on = 0;
+      return 0;
+    }
+    cf->crcs = crcs;
+    cf->maxunits = maxunits;
+  }
+  cf->crcs[cf->nunits++] = crc;
+  return 0;
+}
+
+/*
+ * Finish the checksums of a backing file read or write. A write stores
+ * them beside the file, which must be flushed. Returns
+ * shmemio_err_checksum if a read unit failed its check
+ */
+int
+shmemio_crc_end(shmemio_server_t *srvr, shmemio_crc_file_t *cf,
+		const char *path, FILE *fp, int do_write)
+{
+  int ret = shmemio_success;
+
+  if (!cf->on) {
+    free(cf->crcs);
+    return ret;
+  }
+
+  if (do_write) {
+    struct stat st;
+    shmemio_crc_hdr_t hdr;
+    char *side = crc_side_path(path);
+    FILE *sfp = NULL;
+
+    memset(&hdr, 0, sizeof(hdr));
+    if ((side != NULL) && (fstat(fileno(fp), &st) == 0)) {
+      memcpy(hdr.magic, SHMEMIO_CRC_MAGIC, sizeof(hdr.magic));
+      hdr.unit_size  = cf->unit_size;
+      hdr.size       = st.st_size;
+      hdr.mtime_sec  = st.st_mtim.tv_sec;
+      hdr.mtime_nsec = st.st_mtim.tv_nsec;
+      hdr.nunits     = cf->nunits;
+      sfp = fopen(side, "w");
+    }
+
+    if ((sfp == NULL) ||
+	(fwrite(&hdr, sizeof(hdr), 1, sfp) != 1) ||
+	(fwrite(cf->crcs, sizeof(uint32_t), cf->nunits, sfp) != cf->nunits)) {
+      shmemio_log(warn, "Failed to write checksums of %s\n", path);
+    }
+    if (sfp != NULL) {
+      fclose(sfp);
+    }
+    free(side);
+  }
+  else if (cf->bad > 0) {
+    shmemio_log(error, "Backing file %s failed checksums, %lu of %lu units bad\n",
+		path, (long unsigned)cf->bad, (long unsigned)cf->maxunits);
+    srvr->crc_failures++;
+    ret = shmemio_err_checksum;
+  }
+
+  srvr->crc_bytes += cf->bytes;
+  srvr->crc_nsec  += cf->nsec;
+
+  shmemio_log(info, "Checksummed %lu bytes of %s at %.1f MB/s\n",
+	      (long unsigned)cf->bytes, path,
+	      (cf->nsec > 0) ? ((double)cf->bytes * 1e3 / cf->nsec) : 0.0);
+
+  free(cf->crcs);
+  cf->crcs = NULL;
+  return ret;
+}
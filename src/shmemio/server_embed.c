@@ -0,0 +1,259 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "shmemu.h"
+#include "shmemc.h"
+#include "shmem.h"
+
+#include "shmemio.h"
+#include "shmemio_test_util.h"
+
+#include <pthread.h>
+#include <stdlib.h>    /* getenv, atoi */
+
+/*
+ * Embedded fspace server. With SHMEM_IO_SERVER_PE set, that pe runs an
+ * fspace server in a service thread, on its own ucp context and worker,
+ * so a node can host its own fspace without a standalone fspace_server.
+ * Pes connect to it with shmem_connect as to any server, on port
+ * SHMEM_IO_SERVER_PORT. Ucx picks shared memory transports for the fpe
+ * worker addresses of pes on the same node, so their puts and gets to
+ * files never go through the network stack.
+ *
+ * Other settings, same as the fspace_server options:
+ *   SHMEM_IO_SERVER_NFPES   number of fpes (default 1)
+ *   SHMEM_IO_SERVER_REGION  default region size, multiple of 64K
+ *   SHMEM_IO_SERVER_RATE    requests per second served to each pe, 0 is
+ *                           no limit (default 0)
+ *   SHMEM_IO_SERVER_CRC     1 to keep checksums of backing files (default 0)
+ *   SHMEM_IO_SERVER_LZ      1 to compress backing files (default 0)
+ */
+
+#define SHMEMIO_EMBED_PORT     13337
+#define SHMEMIO_EMBED_PAGESIZE 65536
+#define SHMEMIO_EMBED_UNIT     1024
+
+typedef struct shmemio_embed_s {
+  ucp_context_h context;
+  ucp_worker_h worker;
+  pthread_t pth;
+  shmemio_server_t server;
+} shmemio_embed_t;
+
+static void
+embed_connect_cb(shmemio_server_t *srvr, shmemio_conn_t *newconn, void *args)
+{
+  shmemio_log(info, "Embedded server got connection ep %p with %d fpes and %d regions\n",
+	      newconn->ep, newconn->nfpes, newconn->nregions);
+}
+
+static void *
+embed_thread(void *arg)
+{
+  shmemio_embed_t *embed = (shmemio_embed_t*)arg;
+
+  shmemio_connectloop(&(embed->server));
+  return NULL;
+}
+
+static int
+embed_ucx_init(shmemio_embed_t *embed)
+{
+  ucp_params_t ucp_params;
+  ucp_worker_params_t worker_params;
+  ucp_config_t *config;
+
+  ucs_status_t s = ucp_config_read(NULL, NULL, &config);
+  shmemio_log_ret_if(error, -1, s != UCS_OK, "Embedded server ucp_config_read failed\n");
+
+  memset(&ucp_params, 0, sizeof(ucp_params));
+  ucp_params.field_mask   = ( UCP_PARAM_FIELD_FEATURES     |
+			      UCP_PARAM_FIELD_REQUEST_SIZE |
+			      UCP_PARAM_FIELD_REQUEST_INIT );
+  ucp_params.features     = (UCP_FEATURE_STREAM   |
+			     UCP_FEATURE_WAKEUP   |
+			     UCP_FEATURE_RMA      |
+			     UCP_FEATURE_AMO32    |
+			     UCP_FEATURE_AMO64 );
+  ucp_params.request_size = sizeof(shmemio_streamreq_t);
+  ucp_params.request_init = shmemio_request_init;
+
+  s = ucp_init(&ucp_params, config, &(embed->context));
+  ucp_config_release(config);
+  shmemio_log_ret_if(error, -1, s != UCS_OK, "Embedded server ucp_init failed\n");
+
+  //Only the service thread progresses it, the pe thread only signals it
+  memset(&worker_params, 0, sizeof(worker_params));
+  worker_params.field_mask  = UCP_WORKER_PARAM_FIELD_THREAD_MODE;
+  worker_params.thread_mode = UCS_THREAD_MODE_SERIALIZED;
+
+  s = ucp_worker_create(embed->context, &worker_params, &(embed->worker));
+  if (s != UCS_OK) {
+    shmemio_log(error, "Embedded server ucp_worker_create failed\n");
+    ucp_cleanup(embed->context);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+embed_ucx_finalize(shmemio_embed_t *embed)
+{
+  ucp_worker_destroy(embed->worker);
+  ucp_cleanup(embed->context);
+}
+
+/*
+ * Start the server and its service thread on this pe
+ */
+static int
+embed_start(shmemio_embed_t *embed)
+{
+  uint16_t port = SHMEMIO_EMBED_PORT;
+  int nsfpes = 1;
+  size_t region_size = 2 * SHMEMIO_EMBED_PAGESIZE;
+
+  char *e = getenv("SHMEM_IO_SERVER_PORT");
+  if (e != NULL) {
+    port = atoi(e);
+  }
+  e = getenv("SHMEM_IO_SERVER_NFPES");
+  if (e != NULL) {
+    nsfpes = atoi(e);
+  }
+  e = getenv("SHMEM_IO_SERVER_REGION");
+  if ((e != NULL) && (shmemu_parse_size(e, &region_size) != 0)) {
+    shmemio_log(warn, "Cannot parse embedded server region size \"%s\"\n", e);
+    region_size = 2 * SHMEMIO_EMBED_PAGESIZE;
+  }
+
+  shmemio_log_ret_if(error, -1, (port == 0) || (nsfpes <= 0) ||
+		     ((region_size % SHMEMIO_EMBED_PAGESIZE) != 0),
+		     "Bad embedded server settings, port %u, %d fpes, region size %lu\n",
+		     (unsigned)port, nsfpes, (long unsigned)region_size);
+
+  if (embed_ucx_init(embed) != 0) {
+    return -1;
+  }
+
+  if (shmemio_init_server(&(embed->server), embed->context, embed->worker, nsfpes,
+			  &embed_connect_cb, NULL, port, SHMEMIO_EMBED_PAGESIZE,
+			  region_size, SHMEMIO_EMBED_UNIT) != 0) {
+    shmemio_log(error, "Failed to init embedded server\n");
+    goto err_ucx;
+  }
+
+  e = getenv("SHMEM_IO_SERVER_RATE");
+  if (e != NULL) {
+    embed->server.sched_rate = atof(e);
+  }
+  e = getenv("SHMEM_IO_SERVER_CRC");
+  if (e != NULL) {
+    embed->server.crc = atoi(e);
+  }
+  e = getenv("SHMEM_IO_SERVER_LZ");
+  if (e != NULL) {
+    embed->server.lz = atoi(e);
+  }
+
+  if (shmemio_listen(&(embed->server)) != 0) {
+    shmemio_log(error, "Embedded server failed to listen on port %u\n", (unsigned)port);
+    goto err_server;
+  }
+
+  if (pthread_create(&(embed->pth), NULL, embed_thread, embed) != 0) {
+    shmemio_log(error, "Failed to start embedded server thread\n");
+    goto err_server;
+  }
+
+  shmemio_log(info, "Embedded server on pe %d listening on port %u with %d fpes\n",
+	      proc.rank, (unsigned)port, nsfpes);
+  return 0;
+
+ err_server:
+  shmemio_finalize_server(&(embed->server));
+ err_ucx:
+  embed_ucx_finalize(embed);
+  return -1;
+}
+
+/*
+ * Start the embedded server if this is the pe chosen to host it. Every
+ * pe waits here until it listens, so they can connect to it right away
+ */
+void
+shmemio_embed_init()
+{
+  proc.io.embed = NULL;
+
+  char *e = getenv("SHMEM_IO_SERVER_PE");
+  if (e == NULL) {
+    return;
+  }
+
+  const int host = atoi(e);
+  if ((host < 0) || (host >= proc.nranks)) {
+    shmemio_log(warn, "SHMEM_IO_SERVER_PE %d is not a pe, no embedded server\n", host);
+    return;
+  }
+
+  if (proc.rank == host) {
+    shmemio_embed_t *embed = (shmemio_embed_t*)malloc(sizeof(shmemio_embed_t));
+    shmemio_assert(embed != NULL, "Failed to allocate embedded server\n");
+
+    if (embed_start(embed) == 0) {
+      proc.io.embed = embed;
+    }
+    else {
+      free(embed);
+    }
+  }
+
+  shmem_barrier_all();
+}
+
+/*
+ * Return nonzero if the fpe worker address is the worker of the server
+ * this pe hosts. Its region memory is then in this address space
+ */
+int
+shmemio_embed_is_local(const ucp_address_t *addr, size_t addr_len)
+{
+  const shmemio_embed_t *embed = proc.io.embed;
+  if ((embed == NULL) || (embed->server.nsfpes < 1)) {
+    return 0;
+  }
+
+  //All fpes of the server share its one worker
+  const shmemio_server_fpe_t *sfpe = &(embed->server.sfpes[0]);
+  return ((sfpe->worker_addr_len == addr_len) &&
+	  (memcmp(sfpe->worker_addr, addr, addr_len) == 0));
+}
+
+/*
+ * Halt the service thread and release the server. Runs after the
+ * finalize barrier, so no pe uses the files any more
+ */
+void
+shmemio_embed_finalize()
+{
+  shmemio_embed_t *embed = proc.io.embed;
+  if (embed == NULL) {
+    return;
+  }
+
+  embed->server.status = shmemio_server_halting;
+  ucp_worker_signal(embed->worker);
+  pthread_join(embed->pth, NULL);
+
+  shmemio_finalize_server(&(embed->server));
+  embed_ucx_finalize(embed);
+
+  free(embed);
+  proc.io.embed = NULL;
+}
@@ -0,0 +1,270 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmem/defs_shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+#include "shmemio_stream_util.h"
+
+/*
+ * Filter requests. The file is taken as an array of fixed size records,
+ * and the server sends back only the records, or the indices of records,
+ * whose field is within the bounds. Records are tested a block at a time
+ * with branch free loops the compiler can vectorize, then the hits are
+ * copied out. One request scans at most SHMEMIO_FILTER_MAX_SCAN records
+ * and sends at most SHMEMIO_FILTER_MAX_BYTES, so a long scan does not
+ * hold up other clients; the client asks again from where it stopped.
+ */
+
+#define SHMEMIO_FILTER_BLOCK     1024
+#define SHMEMIO_FILTER_MAX_SCAN  (16UL * 1024 * 1024)
+#define SHMEMIO_FILTER_MAX_BYTES (4UL * 1024 * 1024)
+
+/*
+ * hit[idx] is 1 if the field of record idx is in [lo, hi]. The fields
+ * are gathered first so the compare runs over a packed array. Fields are
+ * widened to the type of the bounds, so narrow bounds need no clamping
+ */
+#define SHMEMIO_FILTER_MATCH(_name, _ftype, _btype)			\
+  static void								\
+  _name(const char *base, size_t n, size_t rec_size, size_t field_offset, \
+	_btype lo, _btype hi, uint8_t *hit)				\
+  {									\
+    const char *field = base + field_offset;				\
+    _ftype v[SHMEMIO_FILTER_BLOCK];					\
+    for (size_t idx = 0; idx < n; idx++) {				\
+      memcpy(&v[idx], field + (idx * rec_size), sizeof(_ftype));	\
+    }									\
+    for (size_t idx = 0; idx < n; idx++) {				\
+      hit[idx] = ((_btype)v[idx] >= lo) & ((_btype)v[idx] <= hi);	\
+    }									\
+  }
+
+SHMEMIO_FILTER_MATCH(filter_match_int32,  int32_t,  int64_t)
+SHMEMIO_FILTER_MATCH(filter_match_int64,  int64_t,  int64_t)
+SHMEMIO_FILTER_MATCH(filter_match_uint32, uint32_t, uint64_t)
+SHMEMIO_FILTER_MATCH(filter_match_uint64, uint64_t, uint64_t)
+SHMEMIO_FILTER_MATCH(filter_match_float,  float,    double)
+SHMEMIO_FILTER_MATCH(filter_match_double, double,   double)
+
+static inline size_t
+filter_field_size(int type)
+{
+  switch (type) {
+  case SHMEM_FILTER_INT32:
+  case SHMEM_FILTER_UINT32:
+  case SHMEM_FILTER_FLOAT:
+    return 4;
+  case SHMEM_FILTER_INT64:
+  case SHMEM_FILTER_UINT64:
+  case SHMEM_FILTER_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+static inline void
+filter_match(const shmemio_filter_req_t *freq, const char *base, size_t n, uint8_t *hit)
+{
+  int64_t ilo, ihi;
+  double dlo, dhi;
+
+  switch (freq->type) {
+  case SHMEM_FILTER_INT32:
+  case SHMEM_FILTER_INT64:
+    memcpy(&ilo, &(freq->lo), sizeof(ilo));
+    memcpy(&ihi, &(freq->hi), sizeof(ihi));
+    if (freq->type == SHMEM_FILTER_INT32) {
+      filter_match_int32(base, n, freq->rec_size, freq->field_offset, ilo, ihi, hit);
+    }
+    else {
+      filter_match_int64(base, n, freq->rec_size, freq->field_offset, ilo, ihi, hit);
+    }
+    break;
+  case SHMEM_FILTER_UINT32:
+    filter_match_uint32(base, n, freq->rec_size, freq->field_offset, freq->lo, freq->hi, hit);
+    break;
+  case SHMEM_FILTER_UINT64:
+    filter_match_uint64(base, n, freq->rec_size, freq->field_offset, freq->lo, freq->hi, hit);
+    break;
+  case SHMEM_FILTER_FLOAT:
+  case SHMEM_FILTER_DOUBLE:
+    memcpy(&dlo, &(freq->lo), sizeof(dlo));
+    memcpy(&dhi, &(freq->hi), sizeof(dhi));
+    if (freq->type == SHMEM_FILTER_FLOAT) {
+      filter_match_float(base, n, freq->rec_size, freq->field_offset, dlo, dhi, hit);
+    }
+    else {
+      filter_match_double(base, n, freq->rec_size, freq->field_offset, dlo, dhi, hit);
+    }
+    break;
+  }
+}
+
+/*
+ * Address of file offset foff on the server, and in *len the bytes from
+ * there to the end of its stripe unit
+ */
+static inline char *
+filter_locate(shmemio_server_t *srvr, const shmemio_sfile_t *sfile, size_t foff, size_t *len)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  size_t base = sfile->offset;
+
+  if (sfile->nextents > 0) {
+    int edx = sfile->nextents - 1;
+    while ((edx > 0) && (sfile->extents[edx].foff > foff)) {
+      edx--;
+    }
+    reg = &(srvr->regions[sfile->extents[edx].region]);
+    base = sfile->extents[edx].offset;
+    foff -= sfile->extents[edx].foff;
+  }
+
+  const size_t unit = foff / reg->unit_size;
+  const size_t uoff = foff % reg->unit_size;
+  const size_t row  = unit / reg->sfpe_size;
+  const int sfpe    = unit % reg->sfpe_size;
+
+  *len = reg->unit_size - uoff;
+  return (char*)(reg->sfpe_mems[sfpe].base + base + (row * reg->unit_size) + uoff);
+}
+
+/*
+ * Copy rec_size bytes at file offset foff to buf, for records that cross
+ * the end of a stripe unit
+ */
+static inline void
+filter_gather(shmemio_server_t *srvr, const shmemio_sfile_t *sfile, size_t foff,
+	      char *buf, size_t rec_size)
+{
+  size_t done = 0;
+  while (done < rec_size) {
+    size_t len;
+    const char *addr = filter_locate(srvr, sfile, foff + done, &len);
+    if (len > (rec_size - done)) {
+      len = rec_size - done;
+    }
+    memcpy(buf + done, addr, len);
+    done += len;
+  }
+}
+
+/*
+ * Scan the file from record freq->start and send the response, then the
+ * matches. The response says how many matches follow and where the scan
+ * stopped
+ */
+int
+shmemio_server_filter(shmemio_server_t *srvr, ucp_ep_h ep, shmemio_req_t *req)
+{
+  shmemio_filter_req_t *freq = (shmemio_filter_req_t*)req->payload;
+  shmemio_sfile_t *sfile = ((shmemio_sfile_ls_t*)freq->fkey)->sfile;
+
+  const size_t fsize = filter_field_size(freq->type);
+  if ((freq->rec_size == 0) || (fsize == 0) ||
+      (freq->field_offset > freq->rec_size) || (fsize > (freq->rec_size - freq->field_offset))) {
+    shmemio_log(error, "Filter of file %s with record size %lu, field at %lu of type %d\n",
+		sfile->sfile_key, (long unsigned)freq->rec_size,
+		(long unsigned)freq->field_offset, freq->type);
+    freq->count = 0;
+    return shmemio_send_response(srvr, ep, req, shmemio_err_invalid);
+  }
+
+  const uint64_t start = shmemio_nsec();
+  const size_t rec_size = freq->rec_size;
+  const size_t out_size = (freq->flags & SHMEM_FILTER_INDEX) ? sizeof(uint64_t) : rec_size;
+  const size_t nrecs = sfile->size / rec_size;
+
+  size_t max = SHMEMIO_FILTER_MAX_BYTES / out_size;
+  if (max == 0) {
+    max = 1;
+  }
+  if (max > freq->count) {
+    max = freq->count;
+  }
+
+  size_t end = nrecs;
+  if ((freq->start < nrecs) && ((nrecs - freq->start) > SHMEMIO_FILTER_MAX_SCAN)) {
+    end = freq->start + SHMEMIO_FILTER_MAX_SCAN;
+  }
+
+  char *out = (max > 0) ? malloc(max * out_size) : NULL;
+  char *tmp = malloc(rec_size);
+  if (((max > 0) && (out == NULL)) || (tmp == NULL)) {
+    shmemio_log(error, "Failed to allocate %lu bytes of filter output\n",
+		(long unsigned)(max * out_size));
+    free(out);
+    free(tmp);
+    freq->count = 0;
+    return shmemio_send_response(srvr, ep, req, shmemio_err_nomem);
+  }
+
+  uint8_t hit[SHMEMIO_FILTER_BLOCK];
+  size_t rdx = freq->start;
+  size_t nout = 0;
+
+  while ((rdx < end) && (nout < max)) {
+    const size_t foff = rdx * rec_size;
+    size_t len;
+    const char *base = filter_locate(srvr, sfile, foff, &len);
+
+    //Whole records to the end of the unit, as many as may still match
+    size_t n = len / rec_size;
+    if (n > (end - rdx)) {
+      n = end - rdx;
+    }
+    if (n > SHMEMIO_FILTER_BLOCK) {
+      n = SHMEMIO_FILTER_BLOCK;
+    }
+
+    if (n == 0) {
+      //The record crosses into the next unit
+      filter_gather(srvr, sfile, foff, tmp, rec_size);
+      base = tmp;
+      n = 1;
+    }
+
+    filter_match(freq, base, n, hit);
+
+    size_t idx = 0;
+    for (; (idx < n) && (nout < max); idx++) {
+      if (hit[idx]) {
+	if (freq->flags & SHMEM_FILTER_INDEX) {
+	  const uint64_t rec = rdx + idx;
+	  memcpy(out + (nout * out_size), &rec, sizeof(rec));
+	}
+	else {
+	  memcpy(out + (nout * out_size), base + (idx * rec_size), rec_size);
+	}
+	nout++;
+      }
+    }
+    rdx += idx;
+  }
+
+  srvr->filter_nsec += shmemio_nsec() - start;
+  srvr->filter_scan_bytes += (rdx - freq->start) * rec_size;
+  srvr->filter_sent_bytes += nout * out_size;
+
+  shmemio_log(trace, "Filter of file %s, records %lu to %lu of %lu, %lu matches\n",
+	      sfile->sfile_key, (long unsigned)freq->start, (long unsigned)rdx,
+	      (long unsigned)nrecs, (long unsigned)nout);
+
+  freq->start = (rdx > freq->start) ? rdx : freq->start;
+  freq->count = nout;
+  freq->nrecs = nrecs;
+
+  int ret = shmemio_send_response(srvr, ep, req, shmemio_success);
+  if ((ret == 0) && (nout > 0)) {
+    ret = shmemio_streamsend(srvr->worker, ep, out, nout * out_size);
+    shmemio_log_if(error, ret < 0, "Failed to send %lu filter matches\n", (long unsigned)nout);
+  }
+
+  free(out);
+  free(tmp);
+  return ret;
+}
@@ -31,76 +31,268 @@ shmemio_unpack_data(int req_type, shmemio_sfile_t *sfile, shmemio_fp_req_t *fpre
   }
 }
 
+//Append logs get regions with room to grow by this factor
+#define SHMEMIO_LOG_HEADROOM 8
+
+//Most bytes reserved past the size of a file at each extend
+#define SHMEMIO_GROW_MAX (1UL << 30)
+
+/*
+ * Bytes each sfpe holds for a file of the given size striped in units
+ */
+static inline size_t
+shmemio_size_per_sfpe(const shmemio_server_region_t *reg, size_t size)
+{
+  const size_t row = (size_t)reg->unit_size * reg->sfpe_size;
+  return ((size + row - 1) / row) * reg->unit_size;
+}
+
+/*
+ * Bytes to reserve for a file extended to want. Files grow by half again,
+ * at most SHMEMIO_GROW_MAX at a time, and logs double, so writers that
+ * extend in small steps rarely need a realloc
+ */
+static inline size_t
+shmemio_grow_target(const shmemio_sfile_t *sfile, size_t want)
+{
+  size_t extra = sfile->size;
+  if (!sfile->append_log) {
+    extra = (sfile->size / 2 < SHMEMIO_GROW_MAX) ? (sfile->size / 2) : SHMEMIO_GROW_MAX;
+  }
+  return (want > (sfile->size + extra)) ? want : (sfile->size + extra);
+}
+
+/*
+ * File bytes the extents of an extent file can hold
+ */
+static inline size_t
+shmemio_extents_capacity(const shmemio_server_t *srvr, const shmemio_sfile_t *sfile)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  const shmemio_extent_t *last = &(sfile->extents[sfile->nextents - 1]);
+  return last->foff + ((size_t)last->rows * reg->unit_size * reg->sfpe_size);
+}
+
+/*
+ * Add an extent of at least len bytes to the end of an extent file. The
+ * extent goes on the region of the last extent if it fits, or else on a
+ * new region with the same layout as the file
+ */
+static inline int
+shmemio_extent_append(shmemio_server_t *srvr, shmemio_sfile_t *sfile, size_t len)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  const size_t per_sfpe = shmemio_size_per_sfpe(reg, len);
+  const size_t foff = shmemio_extents_capacity(srvr, sfile);
+  int rdx = sfile->extents[sfile->nextents - 1].region;
+  size_t offset;
+
+  shmemio_extent_t *ext = realloc(sfile->extents, sizeof(shmemio_extent_t) * (sfile->nextents + 1));
+  shmemio_log_ret_if(error, -1, ext == NULL, "Failed to grow extent table of %s\n", sfile->sfile_key);
+  sfile->extents = ext;
+
+  if (shmemio_region_malloc(&(srvr->regions[rdx]), per_sfpe, &offset) != 0) {
+    const size_t keylen = strlen(sfile->sfile_key) + 24;
+    char *ext_key = malloc(keylen);
+    shmemio_assert(ext_key != NULL, "malloc error for extent region key\n");
+    snprintf(ext_key, keylen, "%s.extent-%d", sfile->sfile_key, sfile->nextents);
+
+    const size_t min_len = ((per_sfpe / srvr->sys_pagesize) + 1) * srvr->sys_pagesize;
+    rdx = shmemio_new_server_region(srvr, ext_key,
+				    (srvr->default_len > min_len) ? srvr->default_len : min_len,
+				    reg->unit_size, reg->sfpe_start, reg->sfpe_stride, reg->sfpe_size);
+    free(ext_key);
+    shmemio_log_ret_if(error, -1, rdx < 0, "Failed to make region for extent of %s\n",
+		       sfile->sfile_key);
+
+    shmemio_log_ret_if(error, -1, shmemio_region_malloc(&(srvr->regions[rdx]), per_sfpe, &offset) != 0,
+		       "Failed to allocate extent on new region %d\n", rdx);
+  }
+
+  //New regions may have moved the region array
+  reg = &(srvr->regions[sfile->region_id]);
+
+  ext = &(sfile->extents[sfile->nextents++]);
+  ext->foff = foff;
+  ext->offset = offset;
+  ext->region = rdx;
+  ext->rows = per_sfpe / reg->unit_size;
+
+  shmemio_log(info, "File %s extent %d: %lu bytes at file offset %lu, region %d offset %lx\n",
+	      sfile->sfile_key, sfile->nextents - 1, (long unsigned)(per_sfpe * reg->sfpe_size),
+	      (long unsigned)foff, rdx, (long unsigned)offset);
+  return 0;
+}
+
+/*
+ * Resize an extent file. Growing only adds extents, so data never moves
+ * and it works with the file shared. Shrinking keeps the extents
+ */
+static inline int
+shmemio_extent_resize(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
+		      shmemio_fp_req_t *fpreq, int extend_only)
+{
+  if ((fpreq->size < sfile->size) && (sfile->open_count > 1)) {
+    return shmemio_err_shared_resize;
+  }
+
+  size_t new_size = fpreq->size;
+  const size_t cap = shmemio_extents_capacity(srvr, sfile);
+
+  if (new_size > cap) {
+    size_t len = new_size - cap;
+
+    //Extends reserve ahead, so the next ones rarely have to add extents
+    if (extend_only && ((shmemio_grow_target(sfile, new_size) - cap) > len)) {
+      len = shmemio_grow_target(sfile, new_size) - cap;
+    }
+    if (shmemio_extent_append(srvr, sfile, len) != 0) {
+      return shmemio_err_resize;
+    }
+    if (sfile->append_log && extend_only) {
+      new_size = shmemio_extents_capacity(srvr, sfile);
+    }
+  }
+
+  sfile->size = new_size;
+  sfile->capacity = shmemio_extents_capacity(srvr, sfile);
+  fpreq->size = new_size;
+  fpreq->capacity = sfile->capacity;
+  time(&sfile->mtime);
+  shmemio_stat_publish(srvr, sfile);
+  return shmemio_success;
+}
+
 static inline int
 shmemio_do_ftrunc(shmemio_server_t *srvr, shmemio_fp_req_t *fpreq, int extend_only)
 {
   shmemio_sfile_ls_t *snode = (shmemio_sfile_ls_t *)fpreq->fkey;
   shmemio_sfile_t *sfile = snode->sfile;
+  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+
+  if (sfile->read_only) {
+    return shmemio_err_readonly;
+  }
 
   if (extend_only && (fpreq->size < sfile->size)) {
+    //Already grown by someone else
+    fpreq->size = sfile->size;
     goto ftrunc_success;
   }
 
+  if (sfile->nextents > 0) {
+    return shmemio_extent_resize(srvr, sfile, fpreq, extend_only);
+  }
+
+  //Replicas are sized and placed to match the file, so no resizing
+  if (srvr->regions[sfile->region_id].nreplicas > 0) {
+    return shmemio_err_replicated;
+  }
+
   if ((fpreq->size < sfile->size) && (sfile->open_count > 1)) {
     return shmemio_err_shared_resize;
   }
 
   size_t new_offset = sfile->offset;
-  if (shmemio_region_realloc_in_place( &(srvr->regions[sfile->region_id]),
-				       fpreq->size,
-				       &new_offset ) == 0) {
+  const size_t exact = shmemio_size_per_sfpe(reg, fpreq->size);
+
+  //Growth into space reserved before is only a new size
+  if (!sfile->append_log && (fpreq->size >= sfile->size) && (fpreq->size <= sfile->capacity)) {
     sfile->size = fpreq->size;
     goto ftrunc_success;
   }
 
+  //Logs grow in large steps so appenders rarely have to ask
+  if (sfile->append_log && extend_only && (fpreq->size < 2 * sfile->size)) {
+    if (shmemio_region_realloc_in_place( reg,
+					 shmemio_size_per_sfpe(reg, 2 * sfile->size),
+					 &new_offset ) == 0) {
+      sfile->capacity = shmemio_size_per_sfpe(reg, 2 * sfile->size) * reg->sfpe_size;
+      sfile->size = 2 * sfile->size;
+      fpreq->size = sfile->size;
+      goto ftrunc_success;
+    }
+  }
+
+  //Other files reserve ahead on extends
+  const size_t ahead = ( (extend_only && !sfile->append_log) ?
+			 shmemio_size_per_sfpe(reg, shmemio_grow_target(sfile, fpreq->size)) :
+			 exact );
+
+  if ((ahead > exact) &&
+      (shmemio_region_realloc_in_place(reg, ahead, &new_offset) == 0)) {
+    sfile->size = fpreq->size;
+    sfile->capacity = ahead * reg->sfpe_size;
+    goto ftrunc_success;
+  }
+  
+  if (shmemio_region_realloc_in_place(reg, exact, &new_offset) == 0) {
+    sfile->size = fpreq->size;
+    sfile->capacity = exact * reg->sfpe_size;
+    goto ftrunc_success;
+  }
+
   //Cannot try realloc with relocation if there is more than one
   //with file open or the flag to alloc relocation is not set
   if ((sfile->open_count > 1) || ((fpreq->ioflags & SHMEM_IO_RELOC) == 0)) {      
     return shmemio_err_resize_norelo;
   }
 
-  if (shmemio_region_realloc( &(srvr->regions[sfile->region_id]),
-			      fpreq->size,
-			      &new_offset ) == 0) {
-    sfile->size = fpreq->size;
-    sfile->offset = new_offset;
-    fpreq->offset = new_offset;
-    goto ftrunc_success;
+  if (shmemio_region_realloc(reg, ahead, &new_offset) == 0) {
+    sfile->capacity = ahead * reg->sfpe_size;
+  }
+  else if ((ahead > exact) && (shmemio_region_realloc(reg, exact, &new_offset) == 0)) {
+    sfile->capacity = exact * reg->sfpe_size;
+  }
+  else {
+    return shmemio_err_resize;
   }
 
-  return shmemio_err_resize;
+  sfile->size = fpreq->size;
+  sfile->offset = new_offset;
+  fpreq->offset = new_offset;
 
  ftrunc_success:
+  fpreq->capacity = sfile->capacity;
+  shmemio_parity_resize(srvr, sfile);
   time(&sfile->mtime);
+  shmemio_stat_publish(srvr, sfile);
   return shmemio_success;
   
 }
 
 static inline size_t
-shmemio_read_sfpe_bytes(shmemio_sfpe_mem_t *sm, size_t offset, FILE *fp, size_t size)
+shmemio_read_sfpe_bytes(shmemio_sfpe_mem_t *sm, size_t offset, FILE *fp, size_t size,
+			shmemio_lz_file_t *lz)
 {
   shmemio_log(trace, "Reading %lu bytes starting at %x+%x=%x\n",
 	      (long unsigned)size, sm->base, offset, sm->base + offset);
   
   char *addr = (void*)(sm->base + offset);
+  if (lz->on) {
+    return shmemio_lz_read(lz, fp, addr, size);
+  }
   return fread(addr, 1, size, fp);
 }
 
 static inline size_t
-shmemio_write_sfpe_bytes(shmemio_sfpe_mem_t *sm, size_t offset, FILE *fp, size_t size)
+shmemio_write_sfpe_bytes(shmemio_sfpe_mem_t *sm, size_t offset, FILE *fp, size_t size,
+			 shmemio_lz_file_t *lz)
 {
   shmemio_log(trace, "Writing %lu bytes starting at %x+%x=%x\n",
 	      (long unsigned)size, sm->base, offset, sm->base + offset);
   
   char *addr = (void*)(sm->base + offset);
+  if (lz->on) {
+    return shmemio_lz_write(lz, fp, addr, size);
+  }
   return fwrite(addr, 1, size, fp);
 }
 
 static inline int
 shmemio_rw_from_path(shmemio_server_t *srvr, shmemio_sfile_t *sfile, int do_write)
 {
-  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
-  size_t sym_offset = sfile->offset;
+  const int npieces = (sfile->nextents > 0) ? sfile->nextents : 1;
   size_t file_offset = 0;
   int ret = 0;
 
@@ -121,31 +313,62 @@ shmemio_rw_from_path(shmemio_server_t *srvr, shmemio_sfile_t *sfile, int do_writ
 
   shmemio_log(info, "RW [%s] %lu bytes of data from file path %s\n",
 	      do_write ? "write" : "read", sfile->size, sfile->sfile_key+1);
+
+  shmemio_crc_file_t crc;
+  shmemio_crc_begin(srvr, &crc, sfile->sfile_key+1, fp,
+		    srvr->regions[sfile->region_id].unit_size, do_write);
+
+  shmemio_lz_file_t lz;
+  shmemio_lz_begin(srvr, &lz, fp, sfile->sfile_key+1,
+		   srvr->regions[sfile->region_id].unit_size, do_write);
   
-  while (file_offset < sfile->size) {
-    for (int idx = 0; idx < reg->sfpe_size; idx++) {
-      size_t bytes;
+  //Extent files are read and written one extent at a time
+  for (int edx = 0; edx < npieces; edx++) {
+    shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+    size_t sym_offset = sfile->offset;
+    size_t piece_end = sfile->size;
+
+    if (sfile->nextents > 0) {
+      const shmemio_extent_t *ext = &(sfile->extents[edx]);
+      reg = &(srvr->regions[ext->region]);
+      sym_offset = ext->offset;
+      piece_end = ext->foff + ((size_t)ext->rows * reg->unit_size * reg->sfpe_size);
+    }
 
-      if (do_write) {
-	shmemio_write_sfpe_bytes(&(reg->sfpe_mems[idx]), sym_offset, fp, reg->unit_size);
-      }
-      else {
-	shmemio_read_sfpe_bytes(&(reg->sfpe_mems[idx]), sym_offset, fp, reg->unit_size);
-      }
-      
-      file_offset += bytes;
+    while ((file_offset < sfile->size) && (file_offset < piece_end)) {
+      for (int idx = 0; idx < reg->sfpe_size; idx++) {
+	size_t bytes;
+
+	if (do_write) {
+	  bytes = shmemio_write_sfpe_bytes(&(reg->sfpe_mems[idx]), sym_offset, fp, reg->unit_size, &lz);
+	}
+	else {
+	  bytes = shmemio_read_sfpe_bytes(&(reg->sfpe_mems[idx]), sym_offset, fp, reg->unit_size, &lz);
+	}
 
-      if (bytes < reg->unit_size) {
-	if (file_offset < sfile->size) {
-	  ret = -1;
+	file_offset += bytes;
+	shmemio_crc_unit(&crc, (void*)(reg->sfpe_mems[idx].base + sym_offset), bytes);
+
+	if (bytes < reg->unit_size) {
+	  if (file_offset < sfile->size) {
+	    ret = -1;
+	  }
+	  goto close_and_done;
 	}
-	goto close_and_done;
       }
+      sym_offset += reg->unit_size;
     }
-    sym_offset += reg->unit_size;
   }
 
  close_and_done:
+  if ((shmemio_lz_end(srvr, &lz, fp, sfile->sfile_key+1, do_write) != 0) && (ret == 0)) {
+    ret = -1;
+  }
+  fflush(fp);
+  if ((shmemio_crc_end(srvr, &crc, sfile->sfile_key+1, fp, do_write) != shmemio_success) &&
+      (ret == 0)) {
+    ret = shmemio_err_checksum;
+  }
   fclose(fp);
   return ret;
 }
@@ -184,17 +407,135 @@ shmemio_flush_region_bytes(shmemio_server_region_t *reg, size_t offset,
   }
 }
 
+/*
+ * Flush a byte range of a file piece placed at offset on a region. The
+ * units of the range that land on one sfpe are contiguous there, so each
+ * sfpe gets at most one flush
+ */
+static inline void
+shmemio_flush_piece_range(shmemio_server_region_t *reg, size_t offset,
+			  size_t foff, size_t len, int ioflags)
+{
+  const size_t unit = reg->unit_size;
+  const size_t nsfpe = reg->sfpe_size;
+  const size_t end = foff + len;
+  const size_t u0 = foff / unit;
+  const size_t u1 = (end - 1) / unit;
+
+  for (size_t sdx = 0; sdx < nsfpe; sdx++) {
+    //first and last units of the range on this sfpe
+    const size_t first = u0 + ((sdx + nsfpe - (u0 % nsfpe)) % nsfpe);
+    if (first > u1) {
+      continue;
+    }
+    const size_t last = u1 - (((u1 % nsfpe) + nsfpe - sdx) % nsfpe);
+
+    const size_t lo = ((first / nsfpe) * unit) + ((first == u0) ? (foff % unit) : 0);
+    const size_t hi = ((last / nsfpe) * unit) + ((last == u1) ? (((end - 1) % unit) + 1) : unit);
+
+    shmemio_flush_sfpe_bytes(&(reg->sfpe_mems[sdx]), offset + lo, hi - lo, ioflags);
+  }
+}
+
+/*
+ * Flush a byte range of a file, split over the extents it covers
+ */
+static inline void
+shmemio_flush_file_range(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
+			 size_t foff, size_t len, int ioflags)
+{
+  if (foff >= sfile->size) {
+    return;
+  }
+  if (len > (sfile->size - foff)) {
+    len = sfile->size - foff;
+  }
+  if (len == 0) {
+    return;
+  }
+
+  if (sfile->nextents == 0) {
+    shmemio_flush_piece_range(&(srvr->regions[sfile->region_id]), sfile->offset, foff, len, ioflags);
+    return;
+  }
+
+  const size_t end = foff + len;
+
+  for (int edx = 0; edx < sfile->nextents; edx++) {
+    const shmemio_extent_t *ext = &(sfile->extents[edx]);
+    shmemio_server_region_t *reg = &(srvr->regions[ext->region]);
+    const size_t ext_end = ext->foff + ((size_t)ext->rows * reg->unit_size * reg->sfpe_size);
+
+    if ((ext_end <= foff) || (ext->foff >= end)) {
+      continue;
+    }
+
+    const size_t lo = (foff > ext->foff) ? foff : ext->foff;
+    const size_t hi = (end < ext_end) ? end : ext_end;
+    shmemio_flush_piece_range(reg, ext->offset, lo - ext->foff, hi - lo, ioflags);
+  }
+}
+
+/*
+ * Copy the file from its region to every replica region when it is
+ * loaded. Replicas hold the file at the same offset as the original
+ * region. Clients reject puts to replicated regions, so the copies
+ * never go stale after this
+ */
+static inline void
+shmemio_sync_replicas(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  const size_t len = shmemio_size_per_sfpe(reg, sfile->size);
+
+  for (int rdx = 0; rdx < reg->nreplicas; rdx++) {
+    shmemio_server_region_t *rep = &(srvr->regions[reg->replicas[rdx]]);
+
+    shmemio_log(trace, "Sync replica region %d of file %s, %lu bytes per sfpe\n",
+		reg->replicas[rdx], sfile->sfile_key, (long unsigned)len);
+    
+    for (int idx = 0; idx < reg->sfpe_size; idx++) {
+      memcpy((void*)(rep->sfpe_mems[idx].base + sfile->offset),
+	     (void*)(reg->sfpe_mems[idx].base + sfile->offset), len);
+    }
+  }
+}
+
 static inline int
 shmemio_do_flush(shmemio_server_t *srvr, shmemio_fp_req_t *fpreq)
 {
   shmemio_sfile_ls_t *snode = (shmemio_sfile_ls_t *)fpreq->fkey;
   shmemio_sfile_t *sfile = snode->sfile;
 
+  //Snapshot part files are made persistent when they are made
+  if (sfile->read_only) {
+    return shmemio_success;
+  }
+
   time(&sfile->ftime);
+  shmemio_stat_publish(srvr, sfile);
+
+  for (int edx = 0; edx < sfile->nextents; edx++) {
+    const shmemio_extent_t *ext = &(sfile->extents[edx]);
+    shmemio_server_region_t *reg = &(srvr->regions[ext->region]);
+    shmemio_flush_region_bytes(reg, ext->offset, (size_t)ext->rows * reg->unit_size,
+			       fpreq->ioflags);
+  }
+  if (sfile->nextents > 0) {
+    return shmemio_success;
+  }
+
+  const uint64_t start = shmemio_nsec();
   shmemio_flush_region_bytes(&(srvr->regions[sfile->region_id]),
 			     sfile->offset,
 			     sfile->size / srvr->regions[sfile->region_id].sfpe_size,
 			     fpreq->ioflags);
+
+  //Parity time is reported against the data flushes it follows
+  if (sfile->parity_region >= 0) {
+    srvr->parity_flush_nsec += shmemio_nsec() - start;
+    shmemio_parity_update(srvr, sfile, fpreq->ioflags);
+  }
   return shmemio_success;
 }
 
@@ -236,13 +577,21 @@ shmemio_conn_close_file(shmemio_server_t* srvr, shmemio_sfile_ls_t *snode, shmem
 
   shmemio_log_sfile(info, *(sfile), "closed file");
 
+  if ((sfile->open_count == 0) && !sfile->read_only) {
+    shmemio_parity_update(srvr, sfile, 0);
+  }
+  if (sfile->open_count == 0) {
+    shmemio_stat_release(srvr, sfile);
+  }
+
   if (no_trigger == 0) {
     shmemio_trigger_unblock_actions(srvr, sfile, 0);
   }
 
   // Right now there is no way to reopen files that have no backing file
   // So they will get lost if all apps close them
-  if ( ((sfile->open_count == 0) && (!sfile->has_backing_file)) || (dealloc && (sfile->open_count == 0)) ) {
+  if ( ((sfile->open_count == 0) && (!sfile->has_backing_file) && (!sfile->read_only)) ||
+       (dealloc && (sfile->open_count == 0)) ) {
     sfile->mark_for_unload = 1;
     shmemio_log_sfile(trace, *(sfile), "marked for unloading");
   }
@@ -279,6 +628,7 @@ shmemio_conn_open_file(shmemio_server_t* srvr, ucp_ep_h ep, shmemio_sfile_t *sfi
   snode->sfile = sfile;
   snode->conn = conn;
   snode->waitcond = 0;
+  snode->waitseq = 0;
   snode->prev = NULL;
   snode->next = conn->open_sfiles;
   conn->open_sfiles = snode;
@@ -288,6 +638,14 @@ shmemio_conn_open_file(shmemio_server_t* srvr, ucp_ep_h ep, shmemio_sfile_t *sfi
 
   foreq->fkey = (uint64_t)snode;
 
+  foreq->fsize    = sfile->size;
+  foreq->capacity = sfile->capacity;
+
+  //Opens change atime, and the first gives the file its stat slot
+  shmemio_stat_publish(srvr, sfile);
+  foreq->stat_region = (sfile->stat_slot < 0) ? -1 : srvr->stat_region;
+  foreq->stat_slot   = sfile->stat_slot;
+
   shmemio_log_sfile(info, *(snode->sfile), "opened file");
 }
 
@@ -403,6 +761,7 @@ shmemio_trigger_unblock_actions(shmemio_server_t* srvr, shmemio_sfile_t *sfile,
 
       //We are about to close the file and free the snode
       ucp_ep_h ep = snode->conn->ep;
+      req.seq = snode->waitseq;
       status = shmemio_do_unblock(req.type, srvr, sfile, fpreq);
       //Endpoint for the connection that opened this file resulting in the snode
       shmemio_send_response(srvr, ep, &req, status);
@@ -416,6 +775,7 @@ shmemio_trigger_unblock_actions(shmemio_server_t* srvr, shmemio_sfile_t *sfile,
     fpreq->ioflags = snode->waitcond >> SHMEMIO_REQ_TYPE_BITS;
     req.type = ((1 << SHMEMIO_REQ_TYPE_BITS) - 1) & snode->waitcond;
     snode->waitcond = 0;
+    req.seq = snode->waitseq;
     
     shmemio_unpack_data(req.type, sfile, fpreq);
 			    
@@ -579,6 +939,7 @@ shmemio_fopen_from_preloaded(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
   foreq->unit_size  = reg->unit_size;
 
   foreq->l_region = sfile->region_id;
+  foreq->nreplicas = reg->nreplicas;
 
   foreq->offset = sfile->offset;
 
@@ -593,6 +954,12 @@ shmemio_alloc_on_region(shmemio_server_t *srvr, int regid, shmemio_fopen_req_t *
 {
   shmemio_server_region_t *reg = &(srvr->regions[regid]);
   size_t size_per_sfpe = foreq->fsize / reg->sfpe_size;
+
+  //Extents are whole rows, so the next one starts on the first sfpe.
+  //Parity is kept over whole rows too
+  if (foreq->flags & (SHMEM_FOPEN_EXTENTS | SHMEM_FOPEN_PARITY)) {
+    size_per_sfpe = shmemio_size_per_sfpe(reg, foreq->fsize);
+  }
   if (size_per_sfpe < reg->unit_size) {
     size_per_sfpe = reg->unit_size;
   }
@@ -627,7 +994,22 @@ shmemio_release_sfile(shmemio_server_t *srvr, shmemio_sfile_t* sfile)
   }
   
   shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
-  shmemio_region_free(reg, sfile->offset);
+  if (!reg->read_only) {
+    shmemio_region_free(reg, sfile->offset);
+  }
+
+  for (int rdx = 0; rdx < reg->nreplicas; rdx++) {
+    shmemio_region_free(&(srvr->regions[reg->replicas[rdx]]), sfile->offset);
+  }
+
+  shmemio_parity_release(srvr, sfile);
+  shmemio_stat_release(srvr, sfile);
+
+  //Extent 0 is the allocation at the file offset
+  for (int edx = 1; edx < sfile->nextents; edx++) {
+    shmemio_region_free(&(srvr->regions[sfile->extents[edx].region]), sfile->extents[edx].offset);
+  }
+  free(sfile->extents);
   
   free(sfile->sfile_key);
   free(sfile);
@@ -646,6 +1028,74 @@ shmemio_release_all_sfiles(shmemio_server_t *srvr)
   }
 }
 
+/*
+ * Make read-only replicas of a new file region, each on a set of sfpes
+ * that does not overlap the region or any other replica. Returns the
+ * number of replicas made, which can be less than asked for
+ */
+static inline int
+shmemio_new_replica_regions(shmemio_server_t *srvr, const char *sfile_key,
+			    int rdx, int nreplicas)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[rdx]);
+  const int start  = reg->sfpe_start;
+  const int stride = reg->sfpe_stride;
+  const int size   = reg->sfpe_size;
+  const int unit   = reg->unit_size;
+  const size_t len = reg->mem_len;
+  const int nstart = srvr->nsfpes - ((size - 1) * stride);
+  
+  const size_t keylen = strlen(sfile_key) + 16;
+  char *rep_key = malloc(keylen);
+  char *used = calloc(srvr->nsfpes, 1);
+  int *replicas = malloc(sizeof(int) * nreplicas);
+  int nrep = 0;
+
+  shmemio_assert((rep_key != NULL) && (used != NULL) && (replicas != NULL),
+		 "malloc error for replica regions\n");
+
+  for (int idx = 0; idx < size; idx++) {
+    used[start + idx * stride] = 1;
+  }
+
+  //Try starts after the original first, so replicas of different files spread out
+  for (int cdx = 1; (cdx < nstart) && (nrep < nreplicas); cdx++) {
+    const int cand = (start + cdx) % nstart;
+    int idx;
+
+    for (idx = 0; idx < size; idx++) {
+      if (used[cand + idx * stride])
+	break;
+    }
+    if (idx < size)
+      continue;
+
+    snprintf(rep_key, keylen, "%s.replica-%d", sfile_key, nrep);
+    const int ret = shmemio_new_server_region(srvr, rep_key, len, unit,
+					      cand, stride, size);
+    shmemio_log_jmp_if(error, done, ret < 0, "Failed to make replica region %d\n", nrep);
+
+    srvr->regions[ret].replica_of = rdx;
+    replicas[nrep++] = ret;
+
+    for (idx = 0; idx < size; idx++) {
+      used[cand + idx * stride] = 1;
+    }
+  }
+
+ done:
+  shmemio_log_if(warn, nrep < nreplicas, "Only room for %d of %d replicas of %s\n",
+		 nrep, nreplicas, sfile_key);
+  
+  //New regions may have moved the region array
+  srvr->regions[rdx].replicas = replicas;
+  srvr->regions[rdx].nreplicas = nrep;
+
+  free(used);
+  free(rep_key);
+  return nrep;
+}
+
 static inline int
 shmemio_fload(shmemio_server_t *srvr, const char *sfile_key,
 	      shmemio_fopen_req_t *foreq, short* status)
@@ -686,7 +1136,8 @@ shmemio_fload(shmemio_server_t *srvr, const char *sfile_key,
   const int new_reg_start  = ( ((foreq->sfpe_start < 0) || (foreq->sfpe_start > max_start)) ?
 			       ( max_start == 0 ? 0 : (rand() % max_start) ) : foreq->sfpe_start );
   
-  const size_t min_reg_len = (foreq->fsize / new_reg_size) + (foreq->fsize / new_reg_size / 10);
+  const size_t headroom = (foreq->flags & SHMEM_FOPEN_APPEND_LOG) ? SHMEMIO_LOG_HEADROOM : 1;
+  const size_t min_reg_len = headroom * ((foreq->fsize / new_reg_size) + (foreq->fsize / new_reg_size / 10));
   
   const size_t new_reg_len = ( (srvr->default_len > min_reg_len) ?
 			       srvr->default_len :
@@ -695,6 +1146,22 @@ shmemio_fload(shmemio_server_t *srvr, const char *sfile_key,
   //TODO: correct unit size if invalid
   const int new_reg_unit   = (foreq->unit_size < 0) ? srvr->default_unit : foreq->unit_size;
 
+  //Regions left empty by closed and compacted files are used again first.
+  //Replicas need the file at the offset a fresh region gives, so not for them
+  if (!(foreq->flags & SHMEM_FOPEN_REPLICATE) || (foreq->nreplicas <= 0)) {
+    const int want_start = ( ((foreq->sfpe_start < 0) || (foreq->sfpe_start > max_start)) ?
+			     -1 : foreq->sfpe_start );
+
+    ret = shmemio_find_empty_region(srvr, min_reg_len, new_reg_unit,
+				    want_start, new_reg_stride, new_reg_size);
+
+    if ((ret >= 0) && (shmemio_alloc_on_region(srvr, ret, foreq) == 0)) {
+      shmemio_log(info, "Reusing empty region %d for file %s\n", ret, sfile_key);
+      foreq->nreplicas = 0;
+      return 0;
+    }
+  }
+
 
   ret = shmemio_new_server_region(srvr, sfile_key,
 				  new_reg_len, new_reg_unit,
@@ -706,9 +1173,35 @@ shmemio_fload(shmemio_server_t *srvr, const char *sfile_key,
     return -1;
   }
 
-  ret = shmemio_alloc_on_region(srvr, ret, foreq);
+  const int rdx = ret;
+  int nreplicas = ( (foreq->flags & SHMEM_FOPEN_REPLICATE) ?
+		    foreq->nreplicas : 0 );
+  foreq->nreplicas = 0;
+
+  if ((nreplicas > 0) && (foreq->flags & SHMEM_FOPEN_EXTENTS)) {
+    shmemio_log(warn, "Extent file %s cannot be replicated, no replicas made\n", sfile_key);
+    nreplicas = 0;
+  }
+  
+  ret = shmemio_alloc_on_region(srvr, rdx, foreq);
   shmemio_assert(ret == 0, "Failed to allocate file on new region\n");
 
+  if ((nreplicas > 0) && (shmemio_new_replica_regions(srvr, sfile_key, rdx, nreplicas) > 0)) {
+    shmemio_server_region_t *reg = &(srvr->regions[rdx]);
+    size_t offset;
+
+    for (int idx = 0; idx < reg->nreplicas; idx++) {
+      //Fresh regions with the same layout give the same offset
+      ret = shmemio_region_malloc(&(srvr->regions[reg->replicas[idx]]),
+				  foreq->fsize / reg->sfpe_size, &offset);
+      shmemio_assert((ret == 0) && (offset == foreq->offset),
+		     "Replica %d of file %s not at offset %lx\n",
+		     idx, sfile_key, foreq->offset);
+    }
+
+    foreq->nreplicas = reg->nreplicas;
+  }
+
   return 0;
 }
 
@@ -738,8 +1231,17 @@ shmemio_server_fopen(shmemio_server_t *srvr, ucp_ep_h ep,
     shmemio_log(info, "Got request to open file %s, size %lu, unit_size %d on pe [%d +%d] by %d\n",
 		sfile_key, (long unsigned)foreq->fsize, foreq->unit_size,
 		foreq->sfpe_start, foreq->sfpe_size, foreq->sfpe_stride);
-    
-    sfile = shmemio_get_loaded_file(srvr, sfile_key);
+
+    //Snapshot names come before backing file paths
+    char *snap_key = strdup(sfile_key);
+    shmemio_assert(snap_key != NULL, "malloc error");
+    snap_key[0] = '#';
+    sfile = shmemio_get_loaded_file(srvr, snap_key);
+    free(snap_key);
+
+    if (sfile == NULL) {
+      sfile = shmemio_get_loaded_file(srvr, sfile_key);
+    }
   }
   
   if (sfile != NULL) {
@@ -767,15 +1269,30 @@ shmemio_server_fopen(shmemio_server_t *srvr, ucp_ep_h ep,
       sfile_key[strbytes + 1] = '\0';
     }
     
+    //A reservation hint makes room for the file to grow into
+    const size_t want = foreq->fsize;
+    if ((foreq->flags & SHMEM_FOPEN_RESERVE) && (foreq->capacity > foreq->fsize)) {
+      foreq->fsize = foreq->capacity;
+    }
+
     ret = shmemio_fload(srvr, sfile_key, foreq, status);
     shmemio_log_jmp_if(error, err_file, ret < 0, "File load failure\n");
     
     sfile->region_id        = foreq->l_region;
     sfile->sfile_key        = sfile_key;
-    sfile->size             = foreq->fsize;
+    sfile->append_log       = (foreq->flags & SHMEM_FOPEN_APPEND_LOG) != 0;
+    sfile->capacity         = foreq->fsize;
+    sfile->size             = ( (!sfile->append_log && (want < foreq->fsize)) ?
+				want : foreq->fsize );
     sfile->offset           = foreq->offset;
     sfile->has_backing_file = has_backing_file;
     sfile->mark_for_unload  = 0;
+    sfile->read_only        = 0;
+    sfile->nextents         = 0;
+    sfile->extents          = NULL;
+    sfile->parity_region    = -1;
+    sfile->parity_offset    = 0;
+    sfile->stat_slot        = -1;
     sfile->open_count       = 0;
     sfile->close_waitc      = 0;
     sfile->blocking_nonclose = NULL;
@@ -787,11 +1304,42 @@ shmemio_server_fopen(shmemio_server_t *srvr, ucp_ep_h ep,
     memcpy(&(sfile->mtime), &(sfile->ctime), sizeof(time_t));
     memcpy(&(sfile->ftime), &(sfile->ctime), sizeof(time_t));
 
-    if (has_backing_file) {
-      //This silently fails if backing file does not exist
-      //Behavior is expected since we don't want to read in garbage
-      //over persistent data
-      shmemio_read_from_path(srvr, sfile);
+    if (foreq->flags & SHMEM_FOPEN_EXTENTS) {
+      shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+      sfile->extents = malloc(sizeof(shmemio_extent_t));
+      shmemio_assert(sfile->extents != NULL, "malloc error");
+      sfile->nextents = 1;
+      sfile->extents[0].foff   = 0;
+      sfile->extents[0].offset = sfile->offset;
+      sfile->extents[0].region = sfile->region_id;
+      sfile->extents[0].rows   = shmemio_size_per_sfpe(reg, sfile->capacity) / reg->unit_size;
+    }
+
+    if (sfile->append_log) {
+      //Empty log, unless the backing file has one
+      shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+      memset((void*)(reg->sfpe_mems[0].base + sfile->offset), 0, sizeof(uint64_t));
+    }
+
+    if (has_backing_file &&
+	(shmemio_read_from_path(srvr, sfile) == shmemio_err_checksum)) {
+      //Leave the backing file as it is for whoever repairs it
+      sfile->has_backing_file = 0;
+      shmemio_release_sfile(srvr, sfile);
+      *status = shmemio_err_checksum;
+      return -1;
+    }
+    //Otherwise this silently fails if backing file does not exist
+    //Behavior is expected since we don't want to read in garbage
+    //over persistent data
+
+    shmemio_sync_replicas(srvr, sfile);
+
+    if ((foreq->flags & SHMEM_FOPEN_PARITY) && (sfile->nextents > 0)) {
+      shmemio_log(warn, "Extent file %s cannot have parity, none kept\n", sfile_key);
+    }
+    else if ((foreq->flags & SHMEM_FOPEN_PARITY) && (shmemio_parity_open(srvr, sfile) == 0)) {
+      shmemio_parity_update(srvr, sfile, 0);
     }
     
     ret = shmemio_set_loaded_file(srvr, sfile);
@@ -799,6 +1347,26 @@ shmemio_server_fopen(shmemio_server_t *srvr, ucp_ep_h ep,
     shmemio_log_sfile(info, *sfile, "opened newly loaded");
   }
   
+  //Tell the client how the file is really laid out
+  if (sfile->append_log) {
+    foreq->flags |= SHMEM_FOPEN_APPEND_LOG;
+  }
+  else {
+    foreq->flags &= ~SHMEM_FOPEN_APPEND_LOG;
+  }
+  if (sfile->nextents > 0) {
+    foreq->flags |= SHMEM_FOPEN_EXTENTS;
+  }
+  else {
+    foreq->flags &= ~SHMEM_FOPEN_EXTENTS;
+  }
+  if (sfile->parity_region >= 0) {
+    foreq->flags |= SHMEM_FOPEN_PARITY;
+  }
+  else {
+    foreq->flags &= ~SHMEM_FOPEN_PARITY;
+  }
+  
   shmemio_conn_open_file(srvr, ep, sfile, foreq);
   *status = shmemio_success;
   return 0;
@@ -810,3 +1378,306 @@ shmemio_server_fopen(shmemio_server_t *srvr, ucp_ep_h ep,
 }
   
   
+
+/*
+ * Make a named, read only, point in time copy of an open file. The copy
+ * lives in a snapshot region that shares part file blocks with the file
+ * region where the file system allows it, and is opened by name
+ */
+int
+shmemio_server_fsnapshot(shmemio_server_t *srvr, ucp_ep_h ep,
+			 shmemio_fsnap_req_t *snreq, short *status)
+{
+  int ret;
+  shmemio_sfile_t *snap = NULL;
+  char *snap_key = malloc(snreq->name_len + 2);
+  shmemio_assert(snap_key != NULL, "malloc error");
+
+  *status = shmemio_err_unknown;
+  snap_key[0] = '#';
+
+  ret = shmemio_streamrecv(srvr->worker, ep, &(snap_key[1]), snreq->name_len);
+  shmemio_log_jmp_if(error, err_snap, ret != snreq->name_len, "Failed to recv snapshot name\n");
+
+  snap_key[snreq->name_len + 1] = '\0';
+
+  shmemio_sfile_t *sfile = ((shmemio_sfile_ls_t*)snreq->fkey)->sfile;
+
+  //Snapshot regions copy one file region, extents can span many
+  if (sfile->nextents > 0) {
+    shmemio_log(info, "No snapshot %s of extent file %s\n", snap_key, sfile->sfile_key);
+    *status = shmemio_err_extents;
+    goto err_snap;
+  }
+
+  if (shmemio_get_loaded_file(srvr, snap_key) != NULL) {
+    shmemio_log(info, "Snapshot %s already exists\n", snap_key);
+    *status = shmemio_err_exists;
+    goto err_snap;
+  }
+
+  const int rdx = shmemio_new_snapshot_region(srvr, sfile->region_id, snap_key, sfile->offset,
+					      shmemio_size_per_sfpe(&(srvr->regions[sfile->region_id]),
+								    sfile->size));
+  if (rdx < 0) {
+    *status = shmemio_err_region_create;
+    goto err_snap;
+  }
+
+  snap = malloc(sizeof(shmemio_sfile_t));
+  shmemio_assert(snap != NULL, "malloc error");
+
+  snap->region_id         = rdx;
+  snap->sfile_key         = snap_key;
+  snap->size              = sfile->size;
+  snap->capacity          = sfile->size;
+  snap->offset            = sfile->offset;
+  snap->has_backing_file  = 0;
+  snap->mark_for_unload   = 0;
+  snap->read_only         = 1;
+  snap->append_log        = 0;
+  snap->nextents          = 0;
+  snap->extents           = NULL;
+  snap->parity_region     = -1;
+  snap->parity_offset     = 0;
+  snap->stat_slot         = -1;
+  snap->open_count        = 0;
+  snap->close_waitc       = 0;
+  snap->blocking_nonclose = NULL;
+  snap->blocking_data     = 0;
+  snap->iowait            = NULL;
+  snap->iowait_len        = 0;
+  time(&(snap->ctime));
+  memcpy(&(snap->atime), &(snap->ctime), sizeof(time_t));
+  memcpy(&(snap->mtime), &(sfile->mtime), sizeof(time_t));
+  memcpy(&(snap->ftime), &(snap->ctime), sizeof(time_t));
+
+  ret = shmemio_set_loaded_file(srvr, snap);
+  shmemio_assert(ret == 0, "Failed to add snapshot to lookup hash\n");
+  shmemio_log_sfile(info, *snap, "made snapshot");
+
+  *status = shmemio_success;
+  return 0;
+
+ err_snap:
+  free(snap_key);
+  return -1;
+}
+
+
+/*
+ * Flush only the listed byte ranges of an open file to persistence. Used
+ * by persistent puts, which batch several ranges into one request
+ */
+int
+shmemio_server_range_flush(shmemio_server_t *srvr, shmemio_range_flush_req_t *rfreq,
+			   short *status)
+{
+  shmemio_sfile_t *sfile = ((shmemio_sfile_ls_t *)rfreq->fkey)->sfile;
+
+  if ((rfreq->nranges < 0) || (rfreq->nranges > SHMEMIO_FLUSH_NRANGES)) {
+    shmemio_log(error, "Range flush of file %s with bad range count %d\n",
+		sfile->sfile_key, rfreq->nranges);
+    *status = shmemio_err_invalid;
+    return -1;
+  }
+
+  //Snapshot part files are made persistent when they are made
+  if (!sfile->read_only) {
+    for (int idx = 0; idx < rfreq->nranges; idx++) {
+      shmemio_log(trace, "Range flush of file %s, %lu bytes at %lu\n", sfile->sfile_key,
+		  (long unsigned)rfreq->ranges[idx].len, (long unsigned)rfreq->ranges[idx].offset);
+
+      shmemio_flush_file_range(srvr, sfile, rfreq->ranges[idx].offset,
+			       rfreq->ranges[idx].len, rfreq->ioflags);
+    }
+    time(&sfile->ftime);
+  }
+
+  *status = shmemio_success;
+  return 0;
+}
+
+
+/*
+ * Give the client the extents of a file from first on, as many as fit in
+ * one response. Total tells it how many there are in all
+ */
+int
+shmemio_server_extents(shmemio_server_t *srvr, shmemio_extents_req_t *exreq,
+		       short *status)
+{
+  shmemio_sfile_t *sfile = ((shmemio_sfile_ls_t *)exreq->fkey)->sfile;
+
+  if ((exreq->first < 0) || (exreq->first > sfile->nextents)) {
+    shmemio_log(error, "Extents of file %s from bad index %d\n",
+		sfile->sfile_key, exreq->first);
+    *status = shmemio_err_invalid;
+    return -1;
+  }
+
+  exreq->total = sfile->nextents;
+  exreq->count = sfile->nextents - exreq->first;
+  if (exreq->count > SHMEMIO_EXTENTS_PER_REQ) {
+    exreq->count = SHMEMIO_EXTENTS_PER_REQ;
+  }
+
+  memcpy(exreq->ext, &(sfile->extents[exreq->first]), exreq->count * sizeof(shmemio_extent_t));
+
+  *status = shmemio_success;
+  return 0;
+}
+
+
+/*
+ * Closed files can be moved, since no client holds a mapping of them and
+ * the next open finds the new place in the catalog. Extent files, files
+ * with replicas and snapshots stay where they are
+ */
+static inline int
+shmemio_compact_movable(shmemio_server_t *srvr, const shmemio_sfile_t *sfile)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+
+  return ( (sfile->open_count == 0) && !sfile->read_only && !sfile->mark_for_unload &&
+	   (sfile->nextents == 0) && (reg->mem_space != NULL) &&
+	   (reg->replica_of < 0) && (reg->nreplicas == 0) );
+}
+
+/*
+ * Copy a file to a new allocation and free the old one
+ */
+static inline void
+shmemio_compact_move(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
+		     int rdx, size_t offset, size_t per_sfpe)
+{
+  shmemio_server_region_t *src = &(srvr->regions[sfile->region_id]);
+  shmemio_server_region_t *dst = &(srvr->regions[rdx]);
+  size_t len = per_sfpe;
+
+  if (len > (src->mem_len - sfile->offset)) {
+    len = src->mem_len - sfile->offset;
+  }
+
+  shmemio_log(info, "Compact file %s from region %d offset %lx to region %d offset %lx\n",
+	      sfile->sfile_key, sfile->region_id, (long unsigned)sfile->offset,
+	      rdx, (long unsigned)offset);
+
+  for (int idx = 0; idx < dst->sfpe_size; idx++) {
+    memcpy((void*)(dst->sfpe_mems[idx].base + offset),
+	   (void*)(src->sfpe_mems[idx].base + sfile->offset), len);
+  }
+  shmemio_flush_region_bytes(dst, offset, len, 0);
+
+  shmemio_region_free(src, sfile->offset);
+
+  //Closed files give up space reserved to grow into
+  sfile->region_id = rdx;
+  sfile->offset = offset;
+  sfile->capacity = per_sfpe * dst->sfpe_size;
+  time(&(sfile->ctime));
+  srvr->compact_moves++;
+}
+
+/*
+ * Move a closed file into the fullest other region of its layout that
+ * has room, or else lower down in its own region. Returns 1 if it moved
+ */
+static inline int
+shmemio_compact_sfile(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  const shmemio_server_region_t *src = &(srvr->regions[sfile->region_id]);
+  const size_t per_sfpe = shmemio_size_per_sfpe(src, sfile->size);
+  mallinfo_t mi;
+  size_t offset;
+
+  shmemio_region_mallinfo(&mi, (shmemio_server_region_t*)src);
+  const size_t src_used = mi.uordblks;
+
+  int best = -1;
+  size_t best_used = 0;
+
+  for (int rdx = 0; rdx < srvr->nregions; rdx++) {
+    shmemio_server_region_t *reg = &(srvr->regions[rdx]);
+
+    //Moving to an empty region would not pack anything
+    if ( (rdx == sfile->region_id) || (reg->mem_space == NULL) || (reg->nallocs == 0) ||
+	 (reg->replica_of >= 0) || (reg->nreplicas > 0) ||
+	 (reg->unit_size != src->unit_size) || (reg->sfpe_start != src->sfpe_start) ||
+	 (reg->sfpe_stride != src->sfpe_stride) || (reg->sfpe_size != src->sfpe_size) ) {
+      continue;
+    }
+
+    shmemio_region_mallinfo(&mi, reg);
+    if ((mi.uordblks < src_used) || (mi.fordblks < per_sfpe)) {
+      continue;
+    }
+    if ((best < 0) || (mi.uordblks > best_used)) {
+      best = rdx;
+      best_used = mi.uordblks;
+    }
+  }
+
+  if ((best >= 0) && (shmemio_region_malloc(&(srvr->regions[best]), per_sfpe, &offset) == 0)) {
+    shmemio_compact_move(srvr, sfile, best, offset, per_sfpe);
+    return 1;
+  }
+
+  //Fill a hole below the file in its own region
+  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  if (shmemio_region_malloc(reg, per_sfpe, &offset) == 0) {
+    if (offset < sfile->offset) {
+      shmemio_compact_move(srvr, sfile, sfile->region_id, offset, per_sfpe);
+      return 1;
+    }
+    shmemio_region_free(reg, offset);
+  }
+
+  return 0;
+}
+
+/*
+ * Move up to max_moves closed files into denser layouts. Regions that
+ * end up empty are used again for new files. Returns the files moved
+ */
+int
+shmemio_compact_fspace(shmemio_server_t *srvr, int max_moves)
+{
+  int moves = 0;
+
+  for (khint_t k = kh_begin(srvr->l_file_hash);
+       (k != kh_end(srvr->l_file_hash)) && (moves < max_moves); ++k) {
+    if (!kh_exist(srvr->l_file_hash, k)) {
+      continue;
+    }
+
+    shmemio_sfile_t *sfile = kh_val(srvr->l_file_hash, k);
+    if (shmemio_compact_movable(srvr, sfile)) {
+      moves += shmemio_compact_sfile(srvr, sfile);
+    }
+  }
+
+  shmemio_log_if(info, moves > 0, "Compaction moved %d files, %lu in all\n",
+		 moves, srvr->compact_moves);
+  return moves;
+}
+
+/*
+ * Called when the server has no requests. Runs a compaction pass once
+ * every compact_interval seconds
+ */
+void
+shmemio_compact_idle(shmemio_server_t *srvr)
+{
+  if (srvr->compact_interval <= 0) {
+    return;
+  }
+
+  const time_t now = time(NULL);
+  if ((now - srvr->compact_last) < srvr->compact_interval) {
+    return;
+  }
+
+  srvr->compact_last = now;
+  shmemio_compact_fspace(srvr, SHMEMIO_COMPACT_MAX_MOVES);
+}
@@ -83,12 +83,19 @@ shmemio_init_region_malloc(shmemio_server_region_t* reg)
 static inline void
 shmemio_finalize_region_malloc(shmemio_server_region_t* reg)
 {
-  destroy_mspace(reg->mem_space);
+  if (reg->mem_space != NULL) {
+    destroy_mspace(reg->mem_space);
+  }
+  reg->mem_space = NULL;
 }
 
 void
 shmemio_region_mallinfo(mallinfo_t *mi, shmemio_server_region_t* reg)
 {
+  if (reg->mem_space == NULL) {
+    memset(mi, 0, sizeof(mallinfo_t));
+    return;
+  }
   *mi = mspace_mallinfo(reg->mem_space);
 }
 
@@ -100,6 +107,7 @@ shmemio_region_malloc(shmemio_server_region_t* reg, size_t size, size_t *offset)
     return -1;
   
   *offset = (size_t)addr - shmemio_region_mbase(reg);
+  reg->nallocs++;
   return 0;
 }
 
@@ -132,6 +140,7 @@ shmemio_region_free(shmemio_server_region_t* reg, size_t offset)
 {
   void *addr = (void*)(reg->sfpe_mems[0].base + offset);
   mspace_free(reg->mem_space, addr);
+  reg->nallocs--;
 }
 
 /******************************************************************************/
@@ -159,8 +168,19 @@ shmemio_release_region(shmemio_server_region_t* reg, ucp_context_h context)
     free(reg->sfpe_mems);
   }
 
+  if (reg->replicas != NULL) {
+    free(reg->replicas);
+  }
+
+  if (reg->part_key != NULL) {
+    free(reg->part_key);
+  }
+
   reg->sfpe_mems = NULL;
   reg->sfpe_size = 0;
+  reg->replicas = NULL;
+  reg->nreplicas = 0;
+  reg->part_key = NULL;
 }
 
 static inline int
@@ -179,26 +199,15 @@ shmemio_release_regions(shmemio_server_t *srvr)
   srvr->regions = NULL;
 }
 
-//TODO: each file gets a new region, with part file names set by sfile key
-int
-shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
-			  size_t len, int unit_size,
-			  int sfpe_start, int sfpe_stride, int sfpe_size)
+/*
+ * Add a region at the end of the region array, growing the array if need be.
+ * Pointers into the region array are not valid after this call
+ */
+static inline int
+shmemio_add_region_slot(shmemio_server_t *srvr)
 {
   const int nalloc = 8;
 
-  shmemio_log(info, "Adding new region (file key %s), len = %lu, unit = %d, (start,stride,size) = (%d,%d,%d)\n", sfile_key,
-	      (long unsigned)len, unit_size, sfpe_start, sfpe_stride, sfpe_size);
-  
-  shmemio_log_jmp_if(error, err,
-		     shmemio_region_len_check(srvr, len) != 0,
-		     "add server region len error\n");
-
-  shmemio_log_jmp_if(error, err,
-		     shmemio_unit_size_check(srvr, unit_size) != 0,
-		     "add server region unit size error\n");
-
-  /**** Extend the array of regions if need be ****/
   if (srvr->regions == NULL) {
     srvr->regions =
       (shmemio_server_region_t*)malloc(sizeof(shmemio_server_region_t) * nalloc);
@@ -211,17 +220,51 @@ shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
   if (srvr->nregions == srvr->maxregions) {
     shmemio_server_region_t *newreg = 
       (shmemio_server_region_t*)realloc(srvr->regions,
-					sizeof(shmemio_server_region_t) * nalloc);
+					sizeof(shmemio_server_region_t) *
+					(srvr->maxregions + nalloc));
     shmemio_assert(newreg != NULL, "failed to realloc server regions\n");
     
     srvr->regions = newreg;
     srvr->maxregions += nalloc;
   }
 
-  /**** Add the new region at the end of the array ****/
-  int rdx = srvr->nregions;
+  const int rdx = srvr->nregions;
   srvr->nregions++;
 
+  shmemio_server_region_t *reg = &(srvr->regions[rdx]);
+  reg->sfpe_mems = NULL;
+  reg->sfpe_size = 0;
+  reg->mem_space = NULL;
+  reg->nallocs = 0;
+  reg->read_only = 0;
+  reg->replica_of = -1;
+  reg->nreplicas = 0;
+  reg->replicas = NULL;
+  reg->part_key = NULL;
+  
+  return rdx;
+}
+
+//TODO: each file gets a new region, with part file names set by sfile key
+int
+shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
+			  size_t len, int unit_size,
+			  int sfpe_start, int sfpe_stride, int sfpe_size)
+{
+  shmemio_log(info, "Adding new region (file key %s), len = %lu, unit = %d, (start,stride,size) = (%d,%d,%d)\n", sfile_key,
+	      (long unsigned)len, unit_size, sfpe_start, sfpe_stride, sfpe_size);
+  
+  shmemio_log_jmp_if(error, err,
+		     shmemio_region_len_check(srvr, len) != 0,
+		     "add server region len error\n");
+
+  shmemio_log_jmp_if(error, err,
+		     shmemio_unit_size_check(srvr, unit_size) != 0,
+		     "add server region unit size error\n");
+
+  /**** Add the new region at the end of the array ****/
+  int rdx = shmemio_add_region_slot(srvr);
+
   shmemio_server_region_t *reg = &(srvr->regions[rdx]);
 
   reg->sfpe_start = sfpe_start;
@@ -229,6 +272,7 @@ shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
   reg->sfpe_size = sfpe_size;
   reg->unit_size = unit_size;
   reg->mem_len = len;
+  reg->part_key = strdup(sfile_key);
 
   reg->sfpe_mems =
     (shmemio_sfpe_mem_t*)malloc(sizeof(shmemio_sfpe_mem_t) * reg->sfpe_size);
@@ -269,6 +313,100 @@ shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
       
 }
 
+/*
+ * Undo shmemio_new_server_region of the last region, which must have
+ * nothing allocated in it
+ */
+void
+shmemio_release_last_region(shmemio_server_t *srvr)
+{
+  shmemio_release_region(&(srvr->regions[srvr->nregions - 1]), srvr->context);
+  srvr->nregions--;
+}
+
+/*
+ * Find a writable region with no files left in it and this layout, so it
+ * can be used again instead of registering more memory. A negative start
+ * matches any start. Returns the smallest that is long enough, or -1
+ */
+int
+shmemio_find_empty_region(shmemio_server_t *srvr, size_t len, int unit_size,
+			  int sfpe_start, int sfpe_stride, int sfpe_size)
+{
+  int best = -1;
+
+  for (int idx = 0; idx < srvr->nregions; idx++) {
+    const shmemio_server_region_t *reg = &(srvr->regions[idx]);
+
+    if ( (reg->mem_space == NULL) || reg->read_only || (reg->nallocs != 0) ||
+	 (reg->replica_of >= 0) || (reg->nreplicas > 0) ||
+	 (reg->mem_len < len) || (reg->unit_size != unit_size) ||
+	 (reg->sfpe_size != sfpe_size) || (reg->sfpe_stride != sfpe_stride) ||
+	 ((sfpe_start >= 0) && (reg->sfpe_start != sfpe_start)) ) {
+      continue;
+    }
+
+    if ((best < 0) || (reg->mem_len < srvr->regions[best].mem_len)) {
+      best = idx;
+    }
+  }
+
+  return best;
+}
+
+/*
+ * Make a read only copy of the bytes [offset, offset + size) on each sfpe
+ * of a region, sharing storage with the region part files where the file
+ * system allows it. The copy has no allocator, the file in it stays at
+ * the same offset as in the source region
+ */
+int
+shmemio_new_snapshot_region(shmemio_server_t *srvr, int src_rdx, const char *snap_key,
+			    size_t offset, size_t size)
+{
+  shmemio_log(info, "Adding snapshot region (key %s) of region %d\n", snap_key, src_rdx);
+
+  int rdx = shmemio_add_region_slot(srvr);
+
+  shmemio_server_region_t *src = &(srvr->regions[src_rdx]);
+  shmemio_server_region_t *reg = &(srvr->regions[rdx]);
+
+  reg->sfpe_start = src->sfpe_start;
+  reg->sfpe_stride = src->sfpe_stride;
+  reg->sfpe_size = src->sfpe_size;
+  reg->unit_size = src->unit_size;
+  reg->mem_len = src->mem_len;
+  reg->part_key = strdup(snap_key);
+  reg->read_only = 1;
+
+  reg->sfpe_mems =
+    (shmemio_sfpe_mem_t*)calloc(reg->sfpe_size, sizeof(shmemio_sfpe_mem_t));
+  shmemio_log_jmp_if(error, err_release, reg->sfpe_mems == NULL,
+		     "failed to allocate sfpe memories array\n");
+
+#ifdef SHMEMIO_SINGLE_SERVER_PROCESS
+  for (int idx = 0; idx < reg->sfpe_size; idx++) {
+    size_t len = shmemio_init_sfpe_snapshot_mem(&(reg->sfpe_mems[idx]),
+						&(src->sfpe_mems[idx]),
+						srvr->context,
+						src->part_key, snap_key, idx,
+						offset, size);
+    shmemio_log_jmp_if(error, err_release, len != reg->mem_len,
+		       "failed to snapshot sfpe %d memory for %s\n", idx, snap_key);
+  }
+#else
+  #error "Not implemented"
+#endif
+
+  return rdx;
+
+ err_release:
+  shmemio_release_region(reg, srvr->context);
+  srvr->nregions--;
+
+  return -1;
+}
+
 static inline void
 shmemio_release_sfpes(shmemio_server_t *srvr)
 {
@@ -391,6 +529,30 @@ shmemio_init_server(shmemio_server_t *srvr, ucp_context_h context,
   srvr->default_unit = default_unit;
   srvr->default_len  = default_len;
 
+  srvr->compact_interval = SHMEMIO_COMPACT_INTERVAL;
+  time(&(srvr->compact_last));
+  srvr->compact_moves    = 0;
+
+  shmemio_sched_init(srvr);
+
+  srvr->crc          = 0;
+  srvr->crc_failures = 0;
+  srvr->crc_bytes    = 0;
+  srvr->crc_nsec     = 0;
+
+  srvr->lz           = 0;
+  srvr->lz_in_bytes  = 0;
+  srvr->lz_out_bytes = 0;
+  srvr->lz_nsec      = 0;
+
+  srvr->parity_bytes      = 0;
+  srvr->parity_nsec       = 0;
+  srvr->parity_flush_nsec = 0;
+
+  srvr->filter_scan_bytes = 0;
+  srvr->filter_sent_bytes = 0;
+  srvr->filter_nsec       = 0;
+
   shmemio_log_jmp_if(warn, err,
 		     shmemio_region_len_check(srvr, default_len) != 0,
 		     "default_len error\n");
@@ -408,6 +570,8 @@ shmemio_init_server(shmemio_server_t *srvr, ucp_context_h context,
 				  0, 1, srvr->nsfpes);
   shmemio_log_jmp_if(error, err_sfpes,
 		     ret != 0, "Failed to create default region\n");
+
+  shmemio_stat_init(srvr);
   
   srvr->status = shmemio_server_init;
   return 0;
@@ -434,6 +598,7 @@ shmemio_finalize_server(shmemio_server_t *srvr)
   srvr->status = shmemio_server_err;
   ucp_worker_signal(srvr->worker);
 
+  shmemio_sched_log(srvr);
   shmemio_release_all_conns(srvr);
   shmemio_release_all_sfiles(srvr);
   
@@ -443,6 +608,7 @@ shmemio_finalize_server(shmemio_server_t *srvr)
   }
   
   shmemio_release_regions(srvr);
+  shmemio_stat_finalize(srvr);
   shmemio_release_sfpes(srvr);
 
   shmemio_mutex_destroy(&(srvr->cli_conn_ls_lock));
@@ -0,0 +1,466 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+
+/*
+ * Compressed backing files. With srvr->lz set, write-back compresses
+ * every unit into its own block with a small LZ77 codec. The file is a
+ * header, the blocks, and an index of where each block is. Loads check
+ * the header and decompress any file written this way, whatever the
+ * server setting, and read other files as they are. The index lets a
+ * load start at any file offset and decompress only the blocks of the
+ * range it reads.
+ *
+ * The codec is the LZ4 block layout: a token with the literal count and
+ * match length nibbles, the literals, a 2 byte match offset, and length
+ * bytes of 255 for counts of 15 or more. A block that does not compress
+ * is stored as is.
+ */
+
+#define SHMEMIO_LZ_MAGIC     "SHIOLZ01"
+#define SHMEMIO_LZ_MIN_MATCH 4
+#define SHMEMIO_LZ_MAX_OFF   0xFFFF
+#define SHMEMIO_LZ_HASH_BITS 12
+
+typedef struct shmemio_lz_hdr_s {
+  char magic[8];
+  uint32_t unit_size;      // bytes in every block but the last
+  uint32_t pad;
+  uint64_t size;           // uncompressed
+  uint64_t nblocks;
+  uint64_t index_offset;
+} shmemio_lz_hdr_t;
+
+static inline uint8_t *
+lz_put_len(uint8_t *op, size_t n)
+{
+  while (n >= 255) {
+    *op++ = 255;
+    n -= 255;
+  }
+  *op++ = (uint8_t)n;
+  return op;
+}
+
+/*
+ * Emit nlit literals and then a match, or only the literals if mlen is
+ * 0. Returns NULL if it does not fit before oend
+ */
+static inline uint8_t *
+lz_emit(uint8_t *op, const uint8_t *oend, const uint8_t *lit, size_t nlit,
+	size_t off, size_t mlen)
+{
+  const size_t worst = 1 + (nlit / 255) + 1 + nlit + 2 + (mlen / 255) + 1;
+  if ((size_t)(oend - op) < worst) {
+    return NULL;
+  }
+
+  uint8_t *token = op++;
+  *token = (uint8_t)(((nlit >= 15) ? 15 : nlit) << 4);
+  if (nlit >= 15) {
+    op = lz_put_len(op, nlit - 15);
+  }
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if (mlen == 0) {
+    return op;
+  }
+
+  *op++ = (uint8_t)(off & 0xFF);
+  *op++ = (uint8_t)(off >> 8);
+
+  const size_t m = mlen - SHMEMIO_LZ_MIN_MATCH;
+  *token |= (uint8_t)((m >= 15) ? 15 : m);
+  if (m >= 15) {
+    op = lz_put_len(op, m - 15);
+  }
+  return op;
+}
+
+/*
+ * Compress len bytes of src into dst. Returns the compressed size, or 0
+ * if it is not smaller than cap. The hash table holds positions in the
+ * block being compressed; entries left by earlier blocks are checked
+ * against the data before use, so it is never cleared
+ */
+static size_t
+lz_compress(uint32_t *table, const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *end = src + len;
+  const uint8_t *oend = dst + cap;
+  uint8_t *op = dst;
+  unsigned misses = 0;
+
+  while ((size_t)(end - ip) >= SHMEMIO_LZ_MIN_MATCH) {
+    uint32_t seq;
+    memcpy(&seq, ip, sizeof(seq));
+
+    const uint32_t h = (seq * 2654435761U) >> (32 - SHMEMIO_LZ_HASH_BITS);
+    const size_t pos = ip - src;
+    const size_t cand = table[h];
+    table[h] = (uint32_t)pos;
+
+    if ((cand >= pos) || ((pos - cand) > SHMEMIO_LZ_MAX_OFF) ||
+	(memcmp(src + cand, ip, SHMEMIO_LZ_MIN_MATCH) != 0)) {
+      //Step faster through data that does not compress
+      ip += 1 + (misses++ >> 6);
+      continue;
+    }
+
+    const uint8_t *ref = src + cand;
+    size_t mlen = SHMEMIO_LZ_MIN_MATCH;
+    while (((ip + mlen) < end) && (ref[mlen] == ip[mlen])) {
+      mlen++;
+    }
+
+    op = lz_emit(op, oend, anchor, ip - anchor, pos - cand, mlen);
+    if (op == NULL) {
+      return 0;
+    }
+    ip += mlen;
+    anchor = ip;
+    misses = 0;
+  }
+
+  op = lz_emit(op, oend, anchor, end - anchor, 0, 0);
+  if ((op == NULL) || (op == oend)) {
+    return 0;
+  }
+  return op - dst;
+}
+
+static inline int
+lz_get_len(const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+  uint8_t b;
+  do {
+    if (*ip >= iend) {
+      return -1;
+    }
+    b = *(*ip)++;
+    *n += b;
+  } while (b == 255);
+  return 0;
+}
+
+/*
+ * Decompress a block of clen bytes that holds exactly len bytes
+ */
+static int
+lz_decompress(const uint8_t *src, size_t clen, uint8_t *dst, size_t len)
+{
+  const uint8_t *ip = src;
+  const uint8_t *iend = src + clen;
+  uint8_t *op = dst;
+  const uint8_t *oend = dst + len;
+
+  while (ip < iend) {
+    const unsigned token = *ip++;
+
+    size_t nlit = token >> 4;
+    if ((nlit == 15) && (lz_get_len(&ip, iend, &nlit) != 0)) {
+      return -1;
+    }
+    if ((nlit > (size_t)(iend - ip)) || (nlit > (size_t)(oend - op))) {
+      return -1;
+    }
+    memcpy(op, ip, nlit);
+    op += nlit;
+    ip += nlit;
+
+    //The last sequence is only literals
+    if (ip == iend) {
+      break;
+    }
+
+    if ((iend - ip) < 2) {
+      return -1;
+    }
+    const size_t off = ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+
+    size_t mlen = token & 15;
+    if ((mlen == 15) && (lz_get_len(&ip, iend, &mlen) != 0)) {
+      return -1;
+    }
+    mlen += SHMEMIO_LZ_MIN_MATCH;
+
+    if ((off == 0) || (off > (size_t)(op - dst)) || (mlen > (size_t)(oend - op))) {
+      return -1;
+    }
+
+    //Byte by byte, the match may overlap what it writes
+    const uint8_t *ref = op - off;
+    while (mlen-- > 0) {
+      *op++ = *ref++;
+    }
+  }
+
+  return (op == oend) ? 0 : -1;
+}
+
+static inline int
+lz_alloc(shmemio_lz_file_t *lz, size_t unit_size)
+{
+  lz->buf = (uint8_t*)malloc(unit_size);
+  lz->cbuf = (uint8_t*)malloc(unit_size);
+  lz->table = (uint32_t*)calloc(1 << SHMEMIO_LZ_HASH_BITS, sizeof(uint32_t));
+  return ((lz->buf == NULL) || (lz->cbuf == NULL) || (lz->table == NULL)) ? -1 : 0;
+}
+
+static inline void
+lz_free(shmemio_lz_file_t *lz)
+{
+  free(lz->index);
+  free(lz->buf);
+  free(lz->cbuf);
+  free(lz->table);
+  lz->index = NULL;
+  lz->buf = NULL;
+  lz->cbuf = NULL;
+  lz->table = NULL;
+}
+
+/*
+ * Read the header and index of a compressed backing file. Leaves fp at
+ * the start and lz off if the file is not compressed
+ */
+static inline void
+lz_open_read(shmemio_lz_file_t *lz, FILE *fp, const char *path)
+{
+  shmemio_lz_hdr_t hdr;
+
+  if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+      (memcmp(hdr.magic, SHMEMIO_LZ_MAGIC, sizeof(hdr.magic)) != 0)) {
+    rewind(fp);
+    return;
+  }
+
+  lz->index = (shmemio_lz_block_t*)malloc(hdr.nblocks * sizeof(shmemio_lz_block_t));
+  if ((hdr.unit_size == 0) || (lz->index == NULL) || (lz_alloc(lz, hdr.unit_size) != 0) ||
+      (fseek(fp, hdr.index_offset, SEEK_SET) != 0) ||
+      (fread(lz->index, sizeof(shmemio_lz_block_t), hdr.nblocks, fp) != hdr.nblocks)) {
+    shmemio_log(error, "Failed to read block index of compressed file %s\n", path);
+    lz_free(lz);
+    //Reads find an empty file rather than the compressed bytes
+    lz->on = 1;
+    lz->bad = 1;
+    return;
+  }
+
+  lz->on = 1;
+  lz->unit_size = hdr.unit_size;
+  lz->size = hdr.size;
+  lz->nblocks = hdr.nblocks;
+  lz->cur = -1;
+}
+
+/*
+ * Start a backing file read or write of units of unit_size
+ */
+void
+shmemio_lz_begin(shmemio_server_t *srvr, shmemio_lz_file_t *lz, FILE *fp,
+		 const char *path, int unit_size, int do_write)
+{
+  memset(lz, 0, sizeof(shmemio_lz_file_t));
+
+  if (!do_write) {
+    lz_open_read(lz, fp, path);
+    return;
+  }
+
+  if (!srvr->lz) {
+    return;
+  }
+
+  shmemio_lz_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  if ((lz_alloc(lz, unit_size) != 0) || (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)) {
+    shmemio_log(warn, "Cannot compress %s, write it as is\n", path);
+    lz_free(lz);
+    rewind(fp);
+    return;
+  }
+
+  lz->on = 1;
+  lz->unit_size = unit_size;
+  lz->data_end = sizeof(hdr);
+}
+
+/*
+ * Compress and write one unit of len bytes. Returns len, or 0 on failure
+ */
+size_t
+shmemio_lz_write(shmemio_lz_file_t *lz, FILE *fp, const void *src, size_t len)
+{
+  if (lz->nblocks == lz->maxblocks) {
+    const size_t maxblocks = (lz->maxblocks > 0) ? (2 * lz->maxblocks) : 1024;
+    shmemio_lz_block_t *index = realloc(lz->index, maxblocks * sizeof(shmemio_lz_block_t));
+    if (index == NULL) {
+      return 0;
+    }
+    lz->index = index;
+    lz->maxblocks = maxblocks;
+  }
+
+  const uint64_t start = shmemio_nsec();
+  size_t clen = lz_compress(lz->table, (const uint8_t*)src, len, lz->cbuf, len);
+  lz->nsec += shmemio_nsec() - start;
+
+  const void *out = lz->cbuf;
+  if (clen == 0) {
+    clen = len;
+    out = src;
+  }
+
+  if (fwrite(out, 1, clen, fp) != clen) {
+    return 0;
+  }
+
+  shmemio_lz_block_t *blk = &(lz->index[lz->nblocks++]);
+  blk->offset = lz->data_end;
+  blk->clen = clen;
+  blk->ulen = len;
+
+  lz->data_end += clen;
+  lz->size += len;
+  lz->in_bytes += len;
+  lz->out_bytes += clen;
+  return len;
+}
+
+/*
+ * Bring block bdx into buf
+ */
+static inline int
+lz_load_block(shmemio_lz_file_t *lz, FILE *fp, size_t bdx)
+{
+  if ((long)bdx == lz->cur) {
+    return 0;
+  }
+
+  const shmemio_lz_block_t *blk = &(lz->index[bdx]);
+  if ((blk->ulen > lz->unit_size) || (blk->clen > blk->ulen) ||
+      (fseek(fp, blk->offset, SEEK_SET) != 0) ||
+      (fread(lz->cbuf, 1, blk->clen, fp) != blk->clen)) {
+    return -1;
+  }
+
+  const uint64_t start = shmemio_nsec();
+  int ret = 0;
+  if (blk->clen == blk->ulen) {
+    memcpy(lz->buf, lz->cbuf, blk->ulen);
+  }
+  else {
+    ret = lz_decompress(lz->cbuf, blk->clen, lz->buf, blk->ulen);
+  }
+  lz->nsec += shmemio_nsec() - start;
+
+  lz->in_bytes += blk->ulen;
+  lz->out_bytes += blk->clen;
+  lz->cur = (ret == 0) ? (long)bdx : -1;
+  return ret;
+}
+
+/*
+ * Read len bytes from offset of the uncompressed file into dst,
+ * decompressing only the blocks that hold them. Returns the bytes read,
+ * short at the end of the file or on a bad block
+ */
+static size_t
+lz_pread(shmemio_lz_file_t *lz, FILE *fp, void *dst, size_t len, size_t offset)
+{
+  size_t done = 0;
+
+  while ((done < len) && ((offset + done) < lz->size)) {
+    const size_t at = offset + done;
+    const size_t bdx = at / lz->unit_size;
+    const size_t boff = at % lz->unit_size;
+
+    if ((bdx >= lz->nblocks) || (lz_load_block(lz, fp, bdx) != 0)) {
+      shmemio_log(error, "Bad compressed block %lu\n", (long unsigned)bdx);
+      lz->bad = 1;
+      break;
+    }
+
+    const size_t ulen = lz->index[bdx].ulen;
+    if (boff >= ulen) {
+      break;
+    }
+    size_t n = ulen - boff;
+    if (n > (len - done)) {
+      n = len - done;
+    }
+    memcpy((char*)dst + done, lz->buf + boff, n);
+    done += n;
+  }
+
+  return done;
+}
+
+/*
+ * Read the next len bytes of the uncompressed file
+ */
+size_t
+shmemio_lz_read(shmemio_lz_file_t *lz, FILE *fp, void *dst, size_t len)
+{
+  const size_t n = lz_pread(lz, fp, dst, len, lz->pos);
+  lz->pos += n;
+  return n;
+}
+
+/*
+ * Finish a backing file read or write. A write puts the index after the
+ * blocks, fills in the header and cuts off what an older, longer file
+ * left. Returns nonzero if the file could not be written or read
+ */
+int
+shmemio_lz_end(shmemio_server_t *srvr, shmemio_lz_file_t *lz, FILE *fp,
+	       const char *path, int do_write)
+{
+  int ret = lz->bad ? -1 : 0;
+
+  if (!lz->on) {
+    lz_free(lz);
+    return ret;
+  }
+
+  if (do_write) {
+    shmemio_lz_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SHMEMIO_LZ_MAGIC, sizeof(hdr.magic));
+    hdr.unit_size    = lz->unit_size;
+    hdr.size         = lz->size;
+    hdr.nblocks      = lz->nblocks;
+    hdr.index_offset = lz->data_end;
+
+    if ((fwrite(lz->index, sizeof(shmemio_lz_block_t), lz->nblocks, fp) != lz->nblocks) ||
+	(fseek(fp, 0, SEEK_SET) != 0) ||
+	(fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+	(fflush(fp) != 0) ||
+	(ftruncate(fileno(fp), lz->data_end + (lz->nblocks * sizeof(shmemio_lz_block_t))) != 0)) {
+      shmemio_log(error, "Failed to write block index of compressed file %s\n", path);
+      ret = -1;
+    }
+  }
+
+  srvr->lz_in_bytes += lz->in_bytes;
+  srvr->lz_out_bytes += lz->out_bytes;
+  srvr->lz_nsec += lz->nsec;
+
+  shmemio_log(info, "%s %lu bytes of %s as %lu, ratio %.2f at %.1f MB/s\n",
+	      do_write ? "Compressed" : "Decompressed",
+	      (long unsigned)lz->in_bytes, path, (long unsigned)lz->out_bytes,
+	      (lz->out_bytes > 0) ? ((double)lz->in_bytes / lz->out_bytes) : 0.0,
+	      (lz->nsec > 0) ? ((double)lz->in_bytes * 1e3 / lz->nsec) : 0.0);
+
+  lz_free(lz);
+  return ret;
+}
@@ -0,0 +1,250 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+
+/*
+ * XOR parity of files opened with SHMEM_FOPEN_PARITY. A file striped over
+ * n sfpes keeps each sfpe's units in one contiguous block, row r of the
+ * file at r * unit_size in every block. The parity region sits on one
+ * sfpe outside the file's set and holds a block of the same size, the
+ * XOR of all the file's blocks, so unit r of the parity is the parity of
+ * row r.
+ *
+ * Parity is brought up to date when the file is flushed and when its
+ * last opener closes it. Any one sfpe's block can then be rebuilt as the
+ * parity XOR the other blocks, giving back the file as it was at that
+ * flush. Puts made since on the other sfpes make the rebuilt block wrong,
+ * so rebuild before writing to the file again.
+ */
+
+//XOR runs over the blocks in chunks, so the parity chunk stays in cache
+#define SHMEMIO_PARITY_CHUNK (64 * 1024)
+
+typedef uint64_t parity_vec_t __attribute__((vector_size(32)));
+
+/*
+ * dst ^= src, a vector at a time. Loads and stores go through memcpy
+ * since region memory has no alignment promise past the unit size
+ */
+static inline void
+parity_xor(char *dst, const char *src, size_t len)
+{
+  size_t idx = 0;
+
+  for (; idx + (4 * sizeof(parity_vec_t)) <= len; idx += 4 * sizeof(parity_vec_t)) {
+    parity_vec_t d[4], s[4];
+    memcpy(d, dst + idx, sizeof(d));
+    memcpy(s, src + idx, sizeof(s));
+    d[0] ^= s[0];
+    d[1] ^= s[1];
+    d[2] ^= s[2];
+    d[3] ^= s[3];
+    memcpy(dst + idx, d, sizeof(d));
+  }
+  for (; idx + sizeof(parity_vec_t) <= len; idx += sizeof(parity_vec_t)) {
+    parity_vec_t d, s;
+    memcpy(&d, dst + idx, sizeof(d));
+    memcpy(&s, src + idx, sizeof(s));
+    d ^= s;
+    memcpy(dst + idx, &d, sizeof(d));
+  }
+  for (; idx < len; idx++) {
+    dst[idx] ^= src[idx];
+  }
+}
+
+/*
+ * Bytes of the block each sfpe holds for the file, whole rows
+ */
+static inline size_t
+parity_block_len(const shmemio_server_region_t *reg, size_t size)
+{
+  const size_t row = (size_t)reg->unit_size * reg->sfpe_size;
+  return ((size + row - 1) / row) * reg->unit_size;
+}
+
+static inline char *
+parity_addr(shmemio_server_t *srvr, const shmemio_sfile_t *sfile)
+{
+  return (char*)(srvr->regions[sfile->parity_region].sfpe_mems[0].base + sfile->parity_offset);
+}
+
+/*
+ * Make the parity region of a new file on a spare sfpe. The file must
+ * be allocated with whole rows per sfpe. Returns 0, or -1 and leaves the
+ * file without parity if no sfpe is spare or there is no room
+ */
+int
+shmemio_parity_open(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  const int start  = reg->sfpe_start;
+  const int stride = reg->sfpe_stride;
+  const int size   = reg->sfpe_size;
+  const int unit   = reg->unit_size;
+  const size_t len = parity_block_len(reg, sfile->size);
+
+  sfile->parity_region = -1;
+  sfile->parity_offset = 0;
+
+  //First sfpe past the end of the set that is not in it
+  int spare = -1;
+  for (int cdx = 0; (cdx < srvr->nsfpes) && (spare < 0); cdx++) {
+    const int cand = (start + ((size - 1) * stride) + 1 + cdx) % srvr->nsfpes;
+    const int rel = cand - start;
+    if ((rel < 0) || ((rel % stride) != 0) || ((rel / stride) >= size)) {
+      spare = cand;
+    }
+  }
+  if (spare < 0) {
+    shmemio_log(warn, "No sfpe outside the set of file %s for its parity\n", sfile->sfile_key);
+    return -1;
+  }
+
+  //Sized to the parity block, like extent regions
+  const size_t min_len = ((len / srvr->sys_pagesize) + 1) * srvr->sys_pagesize;
+
+  //An empty region on the spare sfpe, left by closed files, is used again first
+  int rdx = shmemio_find_empty_region(srvr, min_len, unit, spare, 1, 1);
+  if ((rdx >= 0) &&
+      (shmemio_region_malloc(&(srvr->regions[rdx]), len, &(sfile->parity_offset)) == 0)) {
+    goto done;
+  }
+
+  const size_t keylen = strlen(sfile->sfile_key) + sizeof(".parity");
+  char *par_key = malloc(keylen);
+  shmemio_assert(par_key != NULL, "malloc error for parity region\n");
+  snprintf(par_key, keylen, "%s.parity", sfile->sfile_key);
+
+  rdx = shmemio_new_server_region(srvr, par_key, min_len, unit, spare, 1, 1);
+  free(par_key);
+  if (rdx < 0) {
+    shmemio_log(warn, "Failed to make parity region of file %s\n", sfile->sfile_key);
+    return -1;
+  }
+
+  if (shmemio_region_malloc(&(srvr->regions[rdx]), len, &(sfile->parity_offset)) != 0) {
+    shmemio_log(warn, "No room for %lu parity bytes of file %s\n",
+		(long unsigned)len, sfile->sfile_key);
+    shmemio_release_last_region(srvr);
+    return -1;
+  }
+
+ done:
+  sfile->parity_region = rdx;
+  shmemio_log(info, "Parity of file %s on sfpe %d, region %d at offset %lx\n",
+	      sfile->sfile_key, spare, rdx, (long unsigned)sfile->parity_offset);
+  return 0;
+}
+
+/*
+ * The file was resized, resize its parity block to match. Parity is
+ * stale until the next update anyway, so it may move, to another region
+ * if its own is too small
+ */
+int
+shmemio_parity_resize(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  if (sfile->parity_region < 0) {
+    return 0;
+  }
+
+  const size_t len = parity_block_len(&(srvr->regions[sfile->region_id]), sfile->size);
+  if (shmemio_region_realloc(&(srvr->regions[sfile->parity_region]), len,
+			     &(sfile->parity_offset)) == 0) {
+    return 0;
+  }
+
+  shmemio_parity_release(srvr, sfile);
+  if (shmemio_parity_open(srvr, sfile) == 0) {
+    return 0;
+  }
+
+  shmemio_log(warn, "No room for %lu parity bytes of resized file %s, parity dropped\n",
+	      (long unsigned)len, sfile->sfile_key);
+  return -1;
+}
+
+void
+shmemio_parity_release(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  if (sfile->parity_region >= 0) {
+    shmemio_region_free(&(srvr->regions[sfile->parity_region]), sfile->parity_offset);
+    sfile->parity_region = -1;
+  }
+}
+
+/*
+ * Recompute the parity of the file from its stripes and flush it
+ */
+void
+shmemio_parity_update(shmemio_server_t *srvr, shmemio_sfile_t *sfile, int ioflags)
+{
+  if (sfile->parity_region < 0) {
+    return;
+  }
+
+  const uint64_t start = shmemio_nsec();
+  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  const size_t len = parity_block_len(reg, sfile->size);
+  char *par = parity_addr(srvr, sfile);
+
+  for (size_t off = 0; off < len; off += SHMEMIO_PARITY_CHUNK) {
+    const size_t n = ((len - off) < SHMEMIO_PARITY_CHUNK) ? (len - off) : SHMEMIO_PARITY_CHUNK;
+
+    memcpy(par + off, (char*)(reg->sfpe_mems[0].base + sfile->offset + off), n);
+    for (int idx = 1; idx < reg->sfpe_size; idx++) {
+      parity_xor(par + off, (char*)(reg->sfpe_mems[idx].base + sfile->offset + off), n);
+    }
+  }
+  shmemio_flush_to_persist(par, len);
+
+  const uint64_t nsec = shmemio_nsec() - start;
+  srvr->parity_nsec += nsec;
+  srvr->parity_bytes += len * reg->sfpe_size;
+
+  shmemio_log(trace, "Parity of file %s over %d stripes of %lu bytes in %lu ns\n",
+	      sfile->sfile_key, reg->sfpe_size, (long unsigned)len, (long unsigned)nsec);
+}
+
+/*
+ * Rebuild the block of the file on the sfpe at pe_index in its set from
+ * the parity and the other blocks, and flush it
+ */
+int
+shmemio_parity_rebuild(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
+		       int pe_index, int ioflags)
+{
+  if (sfile->parity_region < 0) {
+    return shmemio_err_no_parity;
+  }
+
+  shmemio_server_region_t *reg = &(srvr->regions[sfile->region_id]);
+  shmemio_log_ret_if(error, shmemio_err_invalid, (pe_index < 0) || (pe_index >= reg->sfpe_size),
+		     "Rebuild of file %s on pe %d of %d\n",
+		     sfile->sfile_key, pe_index, reg->sfpe_size);
+
+  const size_t len = parity_block_len(reg, sfile->size);
+  const char *par = parity_addr(srvr, sfile);
+  char *lost = (char*)(reg->sfpe_mems[pe_index].base + sfile->offset);
+
+  for (size_t off = 0; off < len; off += SHMEMIO_PARITY_CHUNK) {
+    const size_t n = ((len - off) < SHMEMIO_PARITY_CHUNK) ? (len - off) : SHMEMIO_PARITY_CHUNK;
+
+    memcpy(lost + off, par + off, n);
+    for (int idx = 0; idx < reg->sfpe_size; idx++) {
+      if (idx != pe_index) {
+	parity_xor(lost + off, (char*)(reg->sfpe_mems[idx].base + sfile->offset + off), n);
+      }
+    }
+  }
+  shmemio_flush_to_persist(lost, len);
+
+  shmemio_log(info, "Rebuilt %lu bytes of file %s on pe %d from parity\n",
+	      (long unsigned)len, sfile->sfile_key, pe_index);
+  return shmemio_success;
+}
@@ -17,6 +17,11 @@
 
 #include <ctype.h>
 
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>  /* FICLONERANGE */
+#endif
+
 //Use this to switch file directories for fspace mapped files
 //This will switch from pmem to regular memory
 //TODO: make part of server config/launch
@@ -107,6 +112,88 @@ mmap_pmem_file(char *partfile, size_t length)
   return MAP_FAILED;
 }
 
+/*
+ * Make a new part file of the same length as a mapped part file, holding
+ * only the bytes [offset, offset + size) of it. Where the file system
+ * supports reflinks the range shares blocks with the old file and later
+ * writes to either copy are copy-on-write, otherwise the range is copied
+ * from the mapping. The rest of the new file is a hole
+ */
+static int
+clone_pmem_partfile(const char *src_name, const char *dst_name,
+		    const void *src_addr, size_t length,
+		    size_t offset, size_t size)
+{
+  int fd = open(dst_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    shmemio_log(error, "Could not create snapshot part file %s\n", dst_name);
+    return fd;
+  }
+
+  if (ftruncate(fd, length) != 0) {
+    shmemio_log(error, "Could not size snapshot part file %s\n", dst_name);
+    goto err_clone;
+  }
+
+  if (size == 0) {
+    return fd;
+  }
+
+#ifdef FICLONERANGE
+  int src_fd = open(src_name, O_RDONLY);
+  if (src_fd >= 0) {
+    struct stat st;
+    const size_t blk = ((fstat(src_fd, &st) == 0) && (st.st_blksize > 0)) ? st.st_blksize : 4096;
+    const size_t pg = sysconf(_SC_PAGESIZE);
+    
+    //Reflinks work on whole blocks, a clone to the end of file may end short
+    struct file_clone_range fcr;
+    fcr.src_fd = src_fd;
+    fcr.src_offset = (offset / blk) * blk;
+    fcr.dest_offset = fcr.src_offset;
+    fcr.src_length = (((offset + size + blk - 1) / blk) * blk) - fcr.src_offset;
+    if (fcr.src_offset + fcr.src_length > length) {
+      fcr.src_length = length - fcr.src_offset;
+    }
+
+    //Stores through the mapping must reach the file before blocks are shared
+    const size_t sync_start = (offset / pg) * pg;
+    msync((char*)src_addr + sync_start, offset + size - sync_start, MS_SYNC);
+    
+    int ret = ioctl(fd, FICLONERANGE, &fcr);
+    close(src_fd);
+
+    if (ret == 0) {
+      shmemio_log(info, "Reflinked %lu bytes of part file %s to %s\n",
+		  (long unsigned)fcr.src_length, src_name, dst_name);
+      return fd;
+    }
+  }
+#endif
+
+  shmemio_log(info, "No reflink for part file %s, copying %lu bytes to %s\n",
+	      src_name, (long unsigned)size, dst_name);
+  
+  size_t done = 0;
+  while (done < size) {
+    ssize_t ret = pwrite(fd, (const char*)src_addr + offset + done,
+			 size - done, offset + done);
+    if (ret <= 0) {
+      shmemio_log(error, "Snapshot part file write failed for %s\n", dst_name);
+      goto err_clone;
+    }
+    done += ret;
+  }
+  fsync(fd);
+  
+  return fd;
+
+ err_clone:
+  close(fd);
+  unlink(dst_name);
+  return -1;
+}
+
 static inline int
 create_dir (const char *dir)
 {
@@ -165,6 +252,31 @@ shmemio_free_ucp_pmem(ucp_context_h context, ucp_mem_h mem_handle)
   return 0;
 }
 
+static inline int
+shmemio_map_ucp_addr(ucp_context_h context, void *addr, size_t length,
+		     int read_only, ucp_mem_h *mem_handle)
+{
+  ucp_mem_map_params_t mp;
+
+  mp.field_mask =
+    UCP_MEM_MAP_PARAM_FIELD_LENGTH |
+    UCP_MEM_MAP_PARAM_FIELD_ADDRESS |
+    UCP_MEM_MAP_PARAM_FIELD_FLAGS;
+  
+  mp.flags   = UCP_MEM_MAP_NONBLOCK;
+  mp.address = addr;
+  mp.length  = length;
+
+#ifdef HAVE_UCP_MEM_MAP_PROT
+  if (read_only) {
+    mp.field_mask |= UCP_MEM_MAP_PARAM_FIELD_PROT;
+    mp.prot = UCP_MEM_MAP_PROT_LOCAL_READ | UCP_MEM_MAP_PROT_REMOTE_READ;
+  }
+#endif
+
+  return (ucp_mem_map(context, &mp, mem_handle) == UCS_OK) ? 0 : -1;
+}
+
 static inline int
 shmemio_map_ucp_pmem(ucp_context_h context, size_t length,
 		     const char *sfile_key, int partid,
@@ -246,6 +358,38 @@ shmemio_flush_to_persist(const void *addr, size_t len)
 }
 
 
+static size_t
+shmemio_pack_sfpe_mem(shmemio_sfpe_mem_t *sm, ucp_context_h context)
+{
+  sm->attr.field_mask =
+    UCP_MEM_ATTR_FIELD_ADDRESS |
+    UCP_MEM_ATTR_FIELD_LENGTH;
+
+  ucs_status_t s = ucp_mem_query(sm->mem_handle, &sm->attr);
+  if (s != UCS_OK) {
+    shmemio_log(error, "can't query extent of symmetric heap memory\n");
+    return 0;
+  }
+
+  sm->base = (uint64_t) sm->attr.address;
+  sm->end  = sm->base + sm->attr.length;
+  sm->len  = sm->attr.length;
+
+  s = ucp_rkey_pack(context, sm->mem_handle,
+		    &sm->packed_rkey, &sm->rkey_len);
+
+  if (s != UCS_OK) {
+    shmemio_log(error, "failed to pack rkey\n");
+    sm->rkey_len = 0;
+    return 0;
+  }
+
+  shmemio_log(trace, "Prepared sfpe memory [%x:%x] len = %d, packed key %p [%lu...], rkley_len %u\n",
+	      sm->base, sm->end, sm->len, sm->packed_rkey, *((long unsigned*)sm->packed_rkey), (unsigned)sm->rkey_len);
+  
+  return sm->len;
+}
+
 int
 shmemio_release_sfpe_mem(shmemio_sfpe_mem_t *sm, ucp_context_h context)
 {
@@ -288,33 +432,71 @@ shmemio_init_sfpe_mem(shmemio_sfpe_mem_t *sm,
     return 0;
   }
 
-  sm->attr.field_mask =
-    UCP_MEM_ATTR_FIELD_ADDRESS |
-    UCP_MEM_ATTR_FIELD_LENGTH;
+  return shmemio_pack_sfpe_mem(sm, context);
+}
 
-  ucs_status_t s = ucp_mem_query(sm->mem_handle, &sm->attr);
-  if (s != UCS_OK) {
-    shmemio_log(error, "can't query extent of symmetric heap memory\n");
+/*
+  sm        = new read only memory for a snapshot of src_sm
+  src_sm    = memory region of the same sfpe being snapshot
+  context   = server context
+  src_key   = part file key of the region being snapshot
+  snap_key  = part file key for the snapshot region
+  partid    = part id of this sfpe in both regions
+  offset    = offset of the snapshot file in the region
+  size      = bytes of the snapshot file on this sfpe
+ */
+size_t
+shmemio_init_sfpe_snapshot_mem(shmemio_sfpe_mem_t *sm, shmemio_sfpe_mem_t *src_sm,
+			       ucp_context_h context, const char *src_key,
+			       const char *snap_key, int partid,
+			       size_t offset, size_t size)
+{
+  char src_buf[2048];
+  char dst_buf[2048];
+  const size_t length = src_sm->len;
+  
+  sm->len = 0;
+  sm->rkey_len = 0;
+  
+  int fd = clone_pmem_partfile(pmem_partfile_pathn(src_buf, 2048, src_key, partid),
+			       pmem_partfile_pathn(dst_buf, 2048, snap_key, partid),
+			       (void*)src_sm->base, length, offset, size);
+  if (fd < 0) {
     return 0;
   }
 
-  sm->base = (uint64_t) sm->attr.address;
-  sm->end  = sm->base + sm->attr.length;
-  sm->len  = sm->attr.length;
+  void *addr = MAP_FAILED;
 
-  s = ucp_rkey_pack(context, sm->mem_handle,
-		    &sm->packed_rkey, &sm->rkey_len);
+#ifdef HAVE_UCP_MEM_MAP_PROT
+  //Stores to the snapshot are not allowed, map it read only
+  addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  if ( (addr != MAP_FAILED) &&
+       (shmemio_map_ucp_addr(context, addr, length, 1, &(sm->mem_handle)) != 0) ) {
+    munmap(addr, length);
+    addr = MAP_FAILED;
+  }
+#endif
 
-  if (s != UCS_OK) {
-    shmemio_log(error, "failed to pack rkey\n");
-    sm->rkey_len = 0;
+  if (addr == MAP_FAILED) {
+    //Transports may only register writable memory. Stray stores then land
+    //in private pages and never reach the snapshot part file
+    shmemio_log(info, "Registering snapshot %s as a private writable mapping\n", dst_buf);
+    
+    addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if ( (addr != MAP_FAILED) &&
+	 (shmemio_map_ucp_addr(context, addr, length, 0, &(sm->mem_handle)) != 0) ) {
+      munmap(addr, length);
+      addr = MAP_FAILED;
+    }
+  }
+  close(fd);
+  
+  if (addr == MAP_FAILED) {
+    shmemio_log(error, "can't map and register snapshot memory for %s\n", dst_buf);
     return 0;
   }
-
-  shmemio_log(trace, "Prepared sfpe memory [%x:%x] len = %d, packed key %p [%lu...], rkley_len %u\n",
-	      sm->base, sm->end, sm->len, sm->packed_rkey, *((long unsigned*)sm->packed_rkey), (unsigned)sm->rkey_len);
   
-  return sm->len;
+  return shmemio_pack_sfpe_mem(sm, context);
 }
 
 
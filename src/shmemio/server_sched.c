@@ -0,0 +1,295 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+#include "shmemio_stream_util.h"
+
+/*
+ * Request scheduling. Each client connection keeps a recv of its next
+ * request header posted. Requests hold their trailing data (paths, names,
+ * ranges) in the stream until handled, so a connection has at most one
+ * request read and waiting, and its next recv is only posted once that
+ * request was handled.
+ *
+ * Waiting requests are served in class order. Within a class the
+ * connections take turns, each serving up to its weight in requests per
+ * turn. A request that waited over SHMEMIO_SCHED_AGE_USEC counts as a
+ * latency class request. With a rate limit set, each connection has a
+ * token bucket of sched_burst requests refilled at sched_rate per second,
+ * and its requests wait while it is empty.
+ */
+
+static inline int
+sched_class(int type)
+{
+  switch (type) {
+  case shmemio_fspace_stat_req:
+  case shmemio_fp_stat_req:
+  case shmemio_region_req:
+  case shmemio_extents_req:
+    return shmemio_class_latency;
+  case shmemio_fspace_flush_req:
+  case shmemio_fsnapshot_req:
+  case shmemio_range_flush_req:
+  case shmemio_rebuild_req:
+  case shmemio_filter_req:
+    return shmemio_class_bulk;
+  default:
+    return shmemio_class_normal;
+  }
+}
+
+static inline int
+sched_conn_class(const shmemio_conn_t *conn, uint64_t now)
+{
+  if ((now - conn->arrival) > SHMEMIO_SCHED_AGE_USEC) {
+    return shmemio_class_latency;
+  }
+  return sched_class(conn->req.type);
+}
+
+static inline void
+sched_arrive(shmemio_conn_t *conn)
+{
+  conn->pending = 1;
+  conn->arrival = shmemio_nsec() / 1000;
+
+  shmemio_log(trace, "Got new request type %d [%s] from shmemio client at ep %p...\n",
+	      conn->req.type, shmemio_rt2str(conn->req.type), conn->ep);
+}
+
+/*
+ * Take the request header if its recv completed
+ */
+static inline void
+sched_check_posted(shmemio_conn_t *conn)
+{
+  shmemio_streamreq_t *request = (shmemio_streamreq_t*)conn->req_posted;
+  if ((request == NULL) || (request->complete == 0)) {
+    return;
+  }
+
+  const size_t len = request->complete - 1;
+  /* This request may be reused so initialize it for next time */
+  request->complete = 0;
+  ucp_request_free(request);
+  conn->req_posted = NULL;
+
+  if (len == sizeof(shmemio_req_t)) {
+    sched_arrive(conn);
+  }
+  else {
+    shmemio_log(warn, "Short request recv of %lu bytes on ep %p\n", (long unsigned)len, conn->ep);
+    conn->pending = -1;
+  }
+}
+
+/*
+ * Refill the token bucket, and return nonzero if the connection may
+ * have a request served
+ */
+static inline int
+sched_has_token(const shmemio_server_t *srvr, shmemio_conn_t *conn, uint64_t now)
+{
+  if (srvr->sched_rate <= 0) {
+    return 1;
+  }
+
+  conn->tokens += (double)(now - conn->tokens_time) * srvr->sched_rate / 1e6;
+  conn->tokens_time = now;
+  if (conn->tokens > srvr->sched_burst) {
+    conn->tokens = srvr->sched_burst;
+  }
+  return (conn->tokens >= 1.0);
+}
+
+static inline int
+sched_ready(const shmemio_server_t *srvr, shmemio_conn_t *conn, int cls, uint64_t now)
+{
+  return ((conn->pending > 0) && sched_has_token(srvr, conn, now) &&
+	  (sched_conn_class(conn, now) == cls));
+}
+
+static inline shmemio_conn_t *
+sched_after(const shmemio_server_t *srvr, const shmemio_conn_t *conn)
+{
+  return (shmemio_conn_t*)((conn->next != NULL) ? conn->next : srvr->cli_conns);
+}
+
+void
+shmemio_sched_init(shmemio_server_t *srvr)
+{
+  srvr->sched_weight = SHMEMIO_SCHED_WEIGHT;
+  srvr->sched_rate   = 0;
+  srvr->sched_burst  = SHMEMIO_SCHED_BURST;
+  srvr->sched_next   = NULL;
+  memset(srvr->sched_stats, 0, sizeof(srvr->sched_stats));
+}
+
+void
+shmemio_sched_conn_init(shmemio_server_t *srvr, shmemio_conn_t *conn)
+{
+  conn->req_posted  = NULL;
+  conn->pending     = 0;
+  conn->arrival     = 0;
+  conn->weight      = srvr->sched_weight;
+  conn->credit      = 0;
+  conn->tokens      = srvr->sched_burst;
+  conn->tokens_time = shmemio_nsec() / 1000;
+}
+
+/*
+ * Post the recv of the next request header on the connection. Only call
+ * once its last request was handled
+ */
+int
+shmemio_sched_post(shmemio_server_t *srvr, shmemio_conn_t *conn)
+{
+  size_t len;
+  shmemio_streamreq_t *request = ucp_stream_recv_nb(conn->ep, &(conn->req), 1,
+						    ucp_dt_make_contig(sizeof(shmemio_req_t)),
+						    stream_recv_cb, &len,
+						    UCP_STREAM_RECV_FLAG_WAITALL);
+  if (UCS_PTR_IS_ERR(request)) {
+    shmemio_log(error, "unable to recv UCX message (%s)\n",
+		ucs_status_string(UCS_PTR_STATUS(request)));
+    conn->pending = -1;
+    return -1;
+  }
+  if (UCS_PTR_STATUS(request) == UCS_OK) {
+    //Request was already here
+    sched_arrive(conn);
+    return 0;
+  }
+
+  conn->req_posted = request;
+  return 0;
+}
+
+/*
+ * The connection ep was closed, which ends its posted recv
+ */
+void
+shmemio_sched_conn_release(shmemio_server_t *srvr, shmemio_conn_t *conn)
+{
+  if (srvr->sched_next == conn) {
+    srvr->sched_next = (shmemio_conn_t*)conn->next;
+  }
+
+  shmemio_streamreq_t *request = (shmemio_streamreq_t*)conn->req_posted;
+  if (request != NULL) {
+    request->complete = 0;
+    ucp_request_free(request);
+    conn->req_posted = NULL;
+  }
+}
+
+/*
+ * Return the connection whose request to handle next, or NULL if no
+ * request can be served now. A connection with pending < 0 lost its
+ * request stream and should be released
+ */
+shmemio_conn_t *
+shmemio_sched_next(shmemio_server_t *srvr)
+{
+  const uint64_t now = shmemio_nsec() / 1000;
+  int best = shmemio_nclasses;
+  shmemio_conn_t *conn;
+
+  for (conn = (shmemio_conn_t*)srvr->cli_conns; conn != NULL; conn = (shmemio_conn_t*)conn->next) {
+    sched_check_posted(conn);
+    if (conn->pending < 0) {
+      return conn;
+    }
+    if ((conn->pending > 0) && sched_has_token(srvr, conn, now)) {
+      const int cls = sched_conn_class(conn, now);
+      if (cls < best) {
+	best = cls;
+      }
+    }
+  }
+
+  if (best == shmemio_nclasses) {
+    return NULL;
+  }
+
+  //The connection whose turn it is serves until its credit runs out or it
+  //has no request of the class, then the turn passes on. Ends within two
+  //rounds, since a passed turn refills the credit
+  conn = (srvr->sched_next != NULL) ? srvr->sched_next : (shmemio_conn_t*)srvr->cli_conns;
+  while ((conn->credit <= 0) || !sched_ready(srvr, conn, best, now)) {
+    conn->credit = (conn->weight > 0) ? conn->weight : 1;
+    conn = sched_after(srvr, conn);
+  }
+
+  conn->credit--;
+  srvr->sched_next = conn;
+  if (srvr->sched_rate > 0) {
+    conn->tokens -= 1.0;
+  }
+  return conn;
+}
+
+/*
+ * Count a handled request into the latency histogram of its class
+ */
+void
+shmemio_sched_done(shmemio_server_t *srvr, int type, uint64_t arrival)
+{
+  const unsigned long usec = (shmemio_nsec() / 1000) - arrival;
+  shmemio_sched_stat_t *st = &(srvr->sched_stats[sched_class(type)]);
+
+  //bucket b holds [2^b, 2^(b+1)) usecs, and 0 usecs in bucket 0
+  int b = 0;
+  while (((usec >> b) > 1) && (b < (SHMEMIO_SCHED_NBUCKETS - 1))) {
+    b++;
+  }
+
+  st->hist[b]++;
+  st->nreqs++;
+  if (usec > st->max_usec) {
+    st->max_usec = usec;
+  }
+}
+
+/*
+ * Latency in usecs that pct percent of the class requests were within,
+ * rounded up to the end of its histogram bucket
+ */
+unsigned long
+shmemio_sched_percentile(const shmemio_sched_stat_t *st, int pct)
+{
+  if (st->nreqs == 0) {
+    return 0;
+  }
+
+  const unsigned long rank = ((st->nreqs * pct) + 99) / 100;
+  unsigned long seen = 0;
+  for (int b = 0; b < SHMEMIO_SCHED_NBUCKETS; b++) {
+    seen += st->hist[b];
+    if (seen >= rank) {
+      const unsigned long upper = (2UL << b) - 1;
+      return (upper < st->max_usec) ? upper : st->max_usec;
+    }
+  }
+  return st->max_usec;
+}
+
+void
+shmemio_sched_log(shmemio_server_t *srvr)
+{
+  //Only built with debug logging
+  shmemio_do_info(
+    static const char *names[shmemio_nclasses] = { "latency", "normal", "bulk" };
+
+    for (int cls = 0; cls < shmemio_nclasses; cls++) {
+      const shmemio_sched_stat_t *st = &(srvr->sched_stats[cls]);
+      shmemio_log(info, "Requests of %s class: %lu, p50 %lu us, p99 %lu us, max %lu us\n",
+		  names[cls], st->nreqs, shmemio_sched_percentile(st, 50),
+		  shmemio_sched_percentile(st, 99), st->max_usec);
+    }
+  );
+}
@@ -0,0 +1,122 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#include "shmemio.h"
+#include "shmemio_server.h"
+
+#include "shmemio_test_util.h"
+
+/*
+ * Stats of open files, published where clients can get them. The server
+ * keeps one page sized region on sfpe 0 cut into slots, and gives each
+ * file a slot when it is first opened, until its last close. The slot is
+ * written whenever the stat changes, so shmem_fp_stat can read it with
+ * one get instead of a request to the server. The region holds no files,
+ * it is marked read only so it is never handed out for one.
+ */
+
+static inline shmemio_stat_slot_t *
+stat_slot_addr(shmemio_server_t *srvr, int slot)
+{
+  const shmemio_server_region_t *reg = &(srvr->regions[srvr->stat_region]);
+  return ((shmemio_stat_slot_t*)reg->sfpe_mems[0].base) + slot;
+}
+
+/*
+ * Make the stat region. Without it, clients ask the server for stats
+ */
+void
+shmemio_stat_init(shmemio_server_t *srvr)
+{
+  srvr->stat_region = -1;
+  srvr->stat_nslots = 0;
+  srvr->stat_nfree  = 0;
+  srvr->stat_free   = NULL;
+
+  const int nslots = srvr->sys_pagesize / sizeof(shmemio_stat_slot_t);
+  srvr->stat_free = malloc(nslots * sizeof(int));
+  if (srvr->stat_free == NULL) {
+    shmemio_log(warn, "Failed to allocate stat slots, stats go through requests\n");
+    return;
+  }
+
+  const int rdx = shmemio_new_server_region(srvr, "stat_region", srvr->sys_pagesize,
+					    srvr->default_unit, 0, 1, 1);
+  if (rdx < 0) {
+    shmemio_log(warn, "Failed to make stat region, stats go through requests\n");
+    free(srvr->stat_free);
+    srvr->stat_free = NULL;
+    return;
+  }
+
+  srvr->regions[rdx].read_only = 1;
+  memset((void*)srvr->regions[rdx].sfpe_mems[0].base, 0, srvr->sys_pagesize);
+
+  //Hand out low slots first
+  for (int idx = 0; idx < nslots; idx++) {
+    srvr->stat_free[idx] = nslots - 1 - idx;
+  }
+  srvr->stat_region = rdx;
+  srvr->stat_nslots = nslots;
+  srvr->stat_nfree  = nslots;
+
+  shmemio_log(info, "Stat region %d with %d slots\n", rdx, nslots);
+}
+
+void
+shmemio_stat_finalize(shmemio_server_t *srvr)
+{
+  free(srvr->stat_free);
+  srvr->stat_free = NULL;
+  srvr->stat_nfree = 0;
+}
+
+/*
+ * Write the stat of an open file to its slot, giving it one if it has
+ * none. Files left without a slot when they run out are stat by request
+ */
+void
+shmemio_stat_publish(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  if (sfile->stat_slot < 0) {
+    if (srvr->stat_nfree == 0) {
+      return;
+    }
+    sfile->stat_slot = srvr->stat_free[--(srvr->stat_nfree)];
+  }
+
+  shmemio_stat_slot_t *slot = stat_slot_addr(srvr, sfile->stat_slot);
+  const uint64_t ver = slot->ver_end + 1;
+
+  slot->ver_end = ver;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->stat.size = sfile->size;
+  memcpy(&(slot->stat.ctime), &(sfile->ctime), sizeof(time_t));
+  memcpy(&(slot->stat.atime), &(sfile->atime), sizeof(time_t));
+  memcpy(&(slot->stat.mtime), &(sfile->mtime), sizeof(time_t));
+  memcpy(&(slot->stat.ftime), &(sfile->ftime), sizeof(time_t));
+  slot->stat.capacity = sfile->capacity;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->ver = ver;
+}
+
+/*
+ * The file is closed by all, give its slot back
+ */
+void
+shmemio_stat_release(shmemio_server_t *srvr, shmemio_sfile_t *sfile)
+{
+  if (sfile->stat_slot < 0) {
+    return;
+  }
+
+  //Clients of a slot handed out again see a changed version
+  shmemio_stat_slot_t *slot = stat_slot_addr(srvr, sfile->stat_slot);
+  slot->ver_end++;
+  slot->ver = slot->ver_end;
+
+  srvr->stat_free[(srvr->stat_nfree)++] = sfile->stat_slot;
+  sfile->stat_slot = -1;
+}
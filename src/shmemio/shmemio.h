@@ -61,6 +61,68 @@ typedef struct shmem_fspace_conx_s shmem_fspace_conx_t;
 
 /************************ begin FILE POINTER STRUCTURES ***********************/
 
+/*
+ * Byte range of a file, used to batch persist requests
+ */
+typedef struct shmemio_range_s {
+  uint64_t offset;
+  uint64_t len;
+} shmemio_range_t;
+
+#define SHMEMIO_FLUSH_NRANGES 6
+
+/*
+ * Extent of a file opened with SHMEM_FOPEN_EXTENTS. Extents are whole
+ * stripe rows, laid out like the file on the same pe set, and can be on
+ * different regions
+ */
+typedef struct shmemio_extent_s {
+  uint64_t foff;    // file offset the extent starts at
+  uint64_t offset;  // offset in its region
+  uint32_t region;  // region id, the same on server and client
+  uint32_t rows;    // length in stripe rows
+} shmemio_extent_t;
+
+/*
+ * Client copy of an extent, with its local address resolved
+ */
+typedef struct shmemio_client_extent_s {
+  uint64_t foff;
+  uint64_t len;
+  char *addr;
+} shmemio_client_extent_t;
+
+/*
+ * File range being read ahead of use into a local buffer
+ */
+typedef struct shmemio_prefetch_s {
+  struct shmemio_fp_s *fp;   // NULL once the file is closed
+  size_t offset, len;
+  char *buf;
+  int own_buf;               // buffer allocated by the library
+  int readahead;             // started by the library, freed by it too
+  int nreqs;
+  void **reqs;               // outstanding gets, NULL when complete
+  struct shmemio_prefetch_s *next;
+} shmemio_prefetch_t;
+
+#define SHMEMIO_READAHEAD_DEPTH 2
+#define SHMEMIO_RA_NONE         SIZE_MAX
+
+/*
+ * Key-value store in a file, see client_kv.c
+ */
+typedef struct shmemio_kv_s {
+  struct shmem_fp_s *fp;
+  size_t nbuckets, noverflow;
+  int slots, key_size, value_size;
+  size_t slot_size;       // state word, key and value, 8 byte aligned
+  size_t bucket_size;     // next word and slots
+  size_t per_unit;        // buckets in one stripe unit
+  size_t data_off;        // file offset of bucket 0, after the header row
+  char *bbuf;             // one bucket
+} shmemio_kv_t;
+
 typedef struct shmemio_fp_s {
     /* do not move fields around in this struct */
   void *addr;
@@ -76,10 +138,35 @@ typedef struct shmemio_fp_s {
   time_t atime; //time of last file open
   time_t mtime; //time of last ftrunc or fextend
   time_t ftime; //time of last flush
+
+  size_t capacity; //bytes reserved for the file
   
   size_t offset; // offset in this region
   int l_region;  // so we don't have to look up region with address
   int fspace;    // so we don't have to look up fspace with pe
+  int oflags;    // SHMEM_FOPEN_* flags the file is open with
+  int coll_root; // pe that opened the file for shmem_open_all, or -1
+
+  int npersist;  // ranges put but not yet flushed to persistence
+  shmemio_range_t persist[SHMEMIO_FLUSH_NRANGES];
+
+  int nextents;  // extents known to this client, 0 if not an extent file
+  shmemio_client_extent_t *extents;
+
+  // read cache, pages read before the current epoch are stale
+  int cached;
+  unsigned long cache_epoch;
+  struct shmemio_fp_s *next_cached;  // other cached files in the fspace
+
+  shmemio_prefetch_t *prefetches; // prefetched ranges reads can use
+  struct shmemio_fp_s *next_prefetch; // other files with prefetches in the fspace
+  size_t ra_offset;     // last read, SHMEMIO_RA_NONE before the first
+  ssize_t ra_stride;
+  int ra_seq;           // reads in a row with the same stride
+
+  int stat_region;      // server published stat of the file, -1 if none
+  int stat_slot;
+  uint64_t stat_lease;  // time the fields from the last stat may be used until
   
 #ifdef ENABLE_DEBUG
   struct shmemio_fp_s *next_active;
@@ -88,6 +175,41 @@ typedef struct shmemio_fp_s {
 } shmemio_fp_t;
 
 
+/*
+ * Run of buffered puts to one fpe, written out as a single put
+ */
+typedef struct shmemio_wc_buf_s {
+  uint64_t dest;  // local address the run starts at
+  size_t len;
+  char *data;
+} shmemio_wc_buf_t;
+
+/*
+ * Page of a cached file, read in whole from one fpe
+ */
+typedef struct shmemio_cache_page_s {
+  uint64_t addr;     // page aligned local address
+  size_t len;        // page size, or less at the end of a file
+  int pe;
+  int valid;         // data has been read in
+  unsigned long epoch; // file epoch when the data was read
+  char *data;
+  struct shmemio_cache_page_s *next_pe;             // same address, other pes
+  struct shmemio_cache_page_s *lru_prev, *lru_next; // head is most recent
+} shmemio_cache_page_t;
+
+/*
+ * Read cache for files opened with SHMEM_FOPEN_CACHE
+ */
+typedef struct shmemio_cache_s {
+  size_t page_size;
+  size_t npages, max_pages;  // max_pages * page_size is the budget
+  khash_t(ptr2ptr) *pages;   // page address to page list
+  shmemio_cache_page_t *lru_head, *lru_tail;
+  unsigned long epoch;       // last epoch given to a file
+  unsigned long hits, misses, evictions;
+} shmemio_cache_t;
+
 typedef struct shmemio_fp_list_s {
   /* do not move fields around in this struct */
   struct shmemio_fp_list_s *next;
@@ -102,6 +224,14 @@ typedef struct shmemio_sfile_s {
   int region_id;
   int has_backing_file;
   int mark_for_unload;
+  int read_only;        //snapshot, kept loaded while closed
+  int append_log;       //tail counter header, grows in large steps
+  int nextents;         //extent file if nonzero, extent 0 is at offset
+  shmemio_extent_t *extents;
+  size_t capacity;      //bytes allocated, size grows into them with no realloc
+  int parity_region;    //region on a spare sfpe with the XOR of the stripes, or -1
+  size_t parity_offset;
+  int stat_slot;        //slot its stat is published in while open, or -1
 
   int open_count, close_waitc;
   void *blocking_nonclose;
@@ -134,6 +264,17 @@ typedef struct shmemio_sfile_s {
   ;enum { shmemio_CCAT(assert_line_, __LINE__) = 1/(int)(!!(e)) }
 #endif
 
+/*
+ * Monotonic clock in ns, for timing server work and stat leases
+ */
+static inline uint64_t
+shmemio_nsec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
 /************************ begin COMM STRUCTURES ***********************/
 
 typedef enum {
@@ -150,7 +291,17 @@ typedef enum {
   shmemio_err_invalid = -10,
   shmemio_err_send = -11,
   shmemio_err_recv = -12,
-  shmemio_num_errtypes = 13
+  shmemio_err_replicated = -13,
+  shmemio_err_readonly = -14,
+  shmemio_err_exists = -15,
+  shmemio_err_nomem = -16,
+  shmemio_err_extents = -17,
+  shmemio_err_coll_root = -18,
+  shmemio_err_checksum = -19,
+  shmemio_err_no_parity = -20,
+  shmemio_err_not_found = -21,
+  shmemio_err_full = -22,
+  shmemio_num_errtypes = 23
 } shmemio_err_code_t;
 
 static const char*
@@ -169,7 +320,17 @@ shmemio_err2str(int e, int *len) {
     "More than one file access tried to io wait without closing file",
     "Invalid argument or parameter",
     "Failed to send data",
-    "Failed to receive data"
+    "Failed to receive data",
+    "Operation not permitted on replicated file",
+    "File is read-only",
+    "Name already in use",
+    "Client out of memory",
+    "Operation not supported on extent file",
+    "File opened collectively, only the root pe may send requests for it",
+    "Backing file data failed its checksums",
+    "File was not opened with parity",
+    "Key not found",
+    "No room left in key-value store"
   };
 
   if ((-e >= 0) && (-e < shmemio_num_errtypes)) {
@@ -195,7 +356,12 @@ typedef enum {
   shmemio_fextend_req = 8,
   shmemio_region_req = 9,
   shmemio_disco_req = 10,
-  shmemio_total_req_c = 11,
+  shmemio_fsnapshot_req = 11,
+  shmemio_range_flush_req = 12,
+  shmemio_extents_req = 13,
+  shmemio_rebuild_req = 14,
+  shmemio_filter_req = 15,
+  shmemio_total_req_c = 16,
 } shmemio_req_type_t;
 
 
@@ -213,7 +379,12 @@ shmemio_rt2str(int rt) {
     "file stat",
     "file extend",
     "region request",
-    "disconnect"
+    "disconnect",
+    "file snapshot",
+    "range flush",
+    "file extents",
+    "file rebuild",
+    "file filter"
   };
 
   if (rt < shmemio_total_req_c) {
@@ -225,11 +396,12 @@ shmemio_rt2str(int rt) {
 
 #define SHMEMIO_REQ_TYPE_BITS 4
 
-#define shmemio_req_t_payload_size (128 - (2 * sizeof(short)))
+#define shmemio_req_t_payload_size (128 - (2 * sizeof(short)) - sizeof(unsigned))
 
 typedef struct shmemio_req_s {
   short type;
   short status;
+  unsigned seq;  //echoed in the response, matches responses to requests
   char payload[shmemio_req_t_payload_size];
 } shmemio_req_t;
 
@@ -240,6 +412,10 @@ typedef struct shmemio_fopen_req_s {
   int l_region;  //which region id
   size_t offset; //what is the offset within the region
   uint64_t fkey;
+  int flags;     //SHMEM_FOPEN_* flags
+  int nreplicas; //requested, then actual, replica regions after l_region
+  int stat_region, stat_slot; //where the server publishes the file stat, or -1
+  size_t capacity; //requested reservation, then bytes reserved
 } shmemio_fopen_req_t;
 
 shmemio_static_assert( (sizeof(shmemio_fopen_req_t) < shmemio_req_t_payload_size),
@@ -250,19 +426,94 @@ typedef struct shmemio_fp_req_s {
   int ioflags;
   size_t size;
   size_t offset;
+  size_t capacity; //bytes reserved, in responses
 } shmemio_fp_req_t;
 
 shmemio_static_assert( (sizeof(shmemio_fp_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for fclose request" );
 
 
+typedef struct shmemio_fsnap_req_s {
+  uint64_t fkey;
+  size_t name_len;  //snapshot name follows the request
+} shmemio_fsnap_req_t;
+
+shmemio_static_assert( (sizeof(shmemio_fsnap_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for fsnapshot request" );
+
+typedef struct shmemio_range_flush_req_s {
+  uint64_t fkey;
+  int ioflags;
+  int nranges;
+  shmemio_range_t ranges[SHMEMIO_FLUSH_NRANGES];
+} shmemio_range_flush_req_t;
+
+shmemio_static_assert( (sizeof(shmemio_range_flush_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for range flush request" );
+
+#define SHMEMIO_EXTENTS_PER_REQ 3
+
+/*
+ * Ask for the extents of a file from first on. The response carries up
+ * to SHMEMIO_EXTENTS_PER_REQ of them, and how many the file has
+ */
+typedef struct shmemio_extents_req_s {
+  uint64_t fkey;
+  int first;
+  int count;
+  int total;
+  int pad;
+  shmemio_extent_t ext[SHMEMIO_EXTENTS_PER_REQ];
+} shmemio_extents_req_t;
+
+shmemio_static_assert( (sizeof(shmemio_extents_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for extents request" );
+
+/*
+ * Rebuild the stripe of one pe of a parity file from the parity and the
+ * stripes of the other pes
+ */
+typedef struct shmemio_rebuild_req_s {
+  uint64_t fkey;
+  int ioflags;
+  int pe_index;  //position of the lost pe in the file's pe set
+} shmemio_rebuild_req_t;
+
+shmemio_static_assert( (sizeof(shmemio_rebuild_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for rebuild request" );
+
+//Matches of a filter request follow its response in the stream
+typedef struct shmemio_filter_req_s {
+  uint64_t fkey;
+  size_t rec_size;
+  size_t field_offset;
+  int type;      //SHMEM_FILTER_* field type
+  int flags;     //SHMEM_FILTER_INDEX returns indices instead of records
+  uint64_t lo, hi; //bounds as the int64, uint64 or double of the type
+  size_t start;  //first record to scan, then the next one to scan
+  size_t count;  //most matches to send, then matches sent
+  size_t nrecs;  //records in the file, in responses
+} shmemio_filter_req_t;
+
+shmemio_static_assert( (sizeof(shmemio_filter_req_t) < shmemio_req_t_payload_size), "Misconfigured request payload size for filter request" );
+
 typedef struct shmemio_fp_stat_s {
   size_t size;
   time_t ctime; //time the file was loaded into current location
   time_t atime; //time of last file open
   time_t mtime; //time of last ftrunc or fextend
   time_t ftime; //time of last flush
+  size_t capacity;
 } shmemio_fp_stat_t;
 
+/*
+ * Stat of an open file as the server publishes it for clients to get.
+ * The server bumps ver_end, writes the stat, then sets ver to match, so
+ * a get that overlaps a write sees them differ
+ */
+typedef struct shmemio_stat_slot_s {
+  uint64_t ver;
+  shmemio_fp_stat_t stat;
+  uint64_t ver_end;
+} shmemio_stat_slot_t;
+
+shmemio_static_assert( (sizeof(shmemio_stat_slot_t) == 64), "Stat slot is not one cache line" );
+
 typedef struct shmemio_connreq_s {
   int nfpes;
   int nregions;
@@ -275,6 +526,7 @@ struct shmemio_sfile_ls_s {
   shmemio_sfile_t *sfile;
   shmemio_conn_t *conn;
   unsigned waitcond;
+  unsigned waitseq;  //request seq to answer when unblocked
   shmemio_sfile_ls_t *next, *prev;
 };
 
@@ -286,6 +538,16 @@ typedef struct shmemio_conn_s {
   ucp_ep_h ep;
   shmemio_sfile_ls_t *open_sfiles;
 
+  /* request scheduling, see server_sched.c */
+  void *req_posted;        // recv of the next request header
+  int pending;             // 1 if req is not handled yet, -1 if recv failed
+  shmemio_req_t req;
+  uint64_t arrival;        // usecs, when req was received
+  int weight;              // requests served in a row when its turn comes
+  int credit;
+  double tokens;           // rate limit token bucket
+  uint64_t tokens_time;
+
   volatile shmemio_conn_t *next, *prev;
 } shmemio_conn_t;
 
@@ -326,6 +588,7 @@ typedef struct shmemio_client_fpe_s {
 
   /* fields set on fill */
   ucp_ep_h server_ep;              // create this endpoint from addr sent back from server
+  int local;                       // 1 if served from this process, 0 if not, -1 not known yet
 
 } shmemio_client_fpe_t;
 
@@ -358,6 +621,13 @@ typedef struct shmemio_client_region_s {
   int unit_size;
   
   shmemio_remote_region_t *r_regions;    // remote region array of size fpe_size
+
+  // read-only replicas of this region, gets may be sent to any of them
+  int replica_of;                        // primary region id, or -1
+  int nreplicas;
+  int *replicas;                         // replica region ids
+  int rep_policy;                        // SHMEM_FOPEN_REPLICA_LOAD or 0 for by rank
+  unsigned long *rep_hits;               // gets sent to primary [0] and each replica
   
 } shmemio_client_region_t;
 
@@ -367,7 +637,8 @@ typedef struct shmemio_fspace_s {
   shmemc_context_h ch;        // context to use for I/O
 
   /* fields set on fill */
-  ucp_ep_h       req_ep;      //where to send requests (fopen, flush, etc)
+  ucp_ep_h       req_ep;      //where to send requests (fopen, flush, etc), NULL if none
+  int lazy;                   // make fpe endpoints and unpack rkeys on first access
 
   /* fields set on connect */
   int nfpes;
@@ -380,8 +651,41 @@ typedef struct shmemio_fspace_s {
   size_t *used_addrs;
   int ua_len, ua_max;
 
+  shmemio_fp_t *cached_fps;   // files open with SHMEM_FOPEN_CACHE
+  shmemio_fp_t *prefetch_fps; // files with prefetches reads can use
+
+  /* mapped client regions, sorted by l_base for address translation */
+  int *rsorted;
+  int nsorted;
+
+  /* request/response matching, for requests in flight */
+  unsigned next_seq;
+  struct shmemio_fio_req_s *pending;   // non-blocking requests
+  unsigned wait_seq;
+  shmemio_req_t *wait_resp;            // blocking request, NULL if none
+  shmemio_streamreq_t *resp_posted;    // receive posted for next response
+  shmemio_req_t resp;
+
 } shmemio_fspace_t;
 
+/*
+ * Non-blocking file management request. The finish call runs on the
+ * client when the response is taken by test or wait
+ */
+typedef struct shmemio_fio_req_s shmemio_fio_req_t;
+typedef int (*shmemio_fio_finish_t)(shmemio_fio_req_t *);
+
+struct shmemio_fio_req_s {
+  int fspace;
+  unsigned seq;
+  int done;
+  shmemio_req_t req;            // request, then the response
+  shmemio_fp_t *fp;             // file the request is on, if any
+  struct shmem_fp_s **fp_out;   // where an open returns its file
+  shmemio_fio_finish_t finish;
+  shmemio_fio_req_t *next;
+};
+
 /************************ end CLIENT DATA STRUCTURES ***********************/
 
 /************************ begin SERVER DATA STRUCTURES ***********************/
@@ -402,7 +706,16 @@ typedef struct shmemio_server_region_s {
   int             unit_size;
 
   size_t          mem_len;
-  mspace          mem_space;
+  mspace          mem_space;       // NULL on read only regions
+  int             nallocs;         // live allocations, region is reused at 0
+
+  char           *part_key;        // names the part files of this region
+  int             read_only;
+
+  // read-only copies kept on disjoint sfpe sets
+  int             replica_of;
+  int             nreplicas;
+  int            *replicas;
   
   // parallel memory region array of size sfpe_size
   // like a team heap where the sfpe set is the team
@@ -427,6 +740,84 @@ typedef enum {
   shmemio_server_stopped = 5
 } shmemio_server_status_t;
 
+/*
+ * Default seconds between compaction passes, and the most files one pass
+ * moves so the server is not away from requests for long
+ */
+#define SHMEMIO_COMPACT_INTERVAL  10
+#define SHMEMIO_COMPACT_MAX_MOVES 4
+
+/*
+ * Server request classes. Pending requests are served in class order,
+ * and requests of one class by weighted round robin over connections
+ */
+typedef enum {
+  shmemio_class_latency = 0,  // stat, region and extents lookups
+  shmemio_class_normal  = 1,  // open, close, flush and resize of one file
+  shmemio_class_bulk    = 2,  // fspace flush, snapshots and range flushes
+  shmemio_nclasses      = 3
+} shmemio_req_class_t;
+
+/*
+ * A request waiting longer than this many usecs is served as a latency
+ * class request, so bulk work is never starved
+ */
+#define SHMEMIO_SCHED_AGE_USEC 100000
+
+/*
+ * Default weight of a client connection, and the requests it may save up
+ * under a rate limit
+ */
+#define SHMEMIO_SCHED_WEIGHT 1
+#define SHMEMIO_SCHED_BURST  32
+
+/* Log2 usec buckets of the server request latency histograms */
+#define SHMEMIO_SCHED_NBUCKETS 32
+
+typedef struct shmemio_sched_stat_s {
+  unsigned long nreqs;
+  unsigned long max_usec;
+  unsigned long hist[SHMEMIO_SCHED_NBUCKETS];
+} shmemio_sched_stat_t;
+
+
+/*
+ * Checksums of one backing file read or write, see server_crc.c
+ */
+typedef struct shmemio_crc_file_s {
+  int on;
+  int verify;           // reading, crcs hold the checksums to check
+  int unit_size;
+  size_t nunits, maxunits;
+  uint32_t *crcs;
+  size_t bad;
+  uint64_t bytes, nsec;
+} shmemio_crc_file_t;
+
+/*
+ * Compressed backing file read or write, see server_lz.c
+ */
+typedef struct shmemio_lz_block_s {
+  uint64_t offset;      // in the backing file
+  uint32_t clen;        // stored bytes, ulen if stored as is
+  uint32_t ulen;
+} shmemio_lz_block_t;
+
+typedef struct shmemio_lz_file_s {
+  int on;
+  int bad;
+  size_t unit_size;
+  size_t size;                 // uncompressed
+  size_t nblocks, maxblocks;
+  shmemio_lz_block_t *index;
+  long cur;                    // block held in buf, -1 if none
+  size_t pos;                  // next uncompressed offset to read
+  uint64_t data_end;           // end of the blocks written
+  uint8_t *buf, *cbuf;
+  uint32_t *table;
+  uint64_t in_bytes, out_bytes, nsec;
+} shmemio_lz_file_t;
+
 
 typedef struct shmemio_server_s {
   ucp_context_h   context;
@@ -462,6 +853,39 @@ typedef struct shmemio_server_s {
   uint16_t        port;
 
   size_t          default_unit, default_len;
+
+  // closed files are moved into dense layouts when the server is idle
+  time_t          compact_interval; // seconds between passes, 0 is off
+  time_t          compact_last;
+  unsigned long   compact_moves;
+
+  // request scheduling over client connections
+  int             sched_weight;     // weight of new connections
+  double          sched_rate;       // requests per sec per connection, 0 is off
+  double          sched_burst;      // requests a connection may save up
+  shmemio_conn_t *sched_next;       // connection whose turn it is
+  shmemio_sched_stat_t sched_stats[shmemio_nclasses];
+
+  // CRC32C checksums of backing file units, off if 0
+  int             crc;
+  unsigned long   crc_failures;     // backing file loads that failed checks
+  uint64_t        crc_bytes, crc_nsec;
+
+  // Compressed write-back to backing files, off if 0
+  int             lz;
+  uint64_t        lz_in_bytes, lz_out_bytes, lz_nsec;
+
+  // XOR parity of files opened with SHMEM_FOPEN_PARITY, and the time
+  // their data flushes took for comparison
+  uint64_t        parity_bytes, parity_nsec, parity_flush_nsec;
+
+  // Filter requests, bytes scanned and matching bytes sent
+  uint64_t        filter_scan_bytes, filter_sent_bytes, filter_nsec;
+
+  // Stat slots of open files, in a region clients get them from
+  int             stat_region;      // -1 if none
+  int             stat_nslots, stat_nfree;
+  int            *stat_free;        // stack of free slots
   
 } shmemio_server_t;
 
@@ -499,8 +923,49 @@ typedef struct shmemio_server_s {
 
 int shmemio_addr_accessible(const void *addr, int pe);
 
-void secondary_remote_key_and_addr(uint64_t local_addr, int pe,
-				   ucp_rkey_h *rkey_p, uint64_t *raddr_p);
+int secondary_remote_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int pe,
+				  ucp_rkey_h *rkey_p, uint64_t *raddr_p);
+
+int secondary_remote_read_key_and_addr(shmemc_context_h ch, uint64_t local_addr, int *pe_p,
+				       ucp_rkey_h *rkey_p, uint64_t *raddr_p);
+
+void *shmemio_addr_ptr(shmemc_context_h ch, uint64_t local_addr, int pe);
+
+shmemio_wc_buf_t *shmemio_wc_get_buf(shmemc_context_h ch, int fpe_idx);
+
+void shmemio_wc_release(shmemc_context_h ch);
+
+/* client_prefetch.c */
+
+void shmemio_prefetch_fp_init(shmemio_fp_t *fp);
+
+int shmemio_prefetch_read(shmemio_fp_t *fp, size_t offset, void *buf, size_t len);
+
+void shmemio_prefetch_drop(shmemio_fp_t *fp, size_t offset, size_t len);
+
+void shmemio_prefetch_fp_release(shmemio_fp_t *fp);
+
+void shmemio_prefetch_put(uint64_t addr, size_t nbytes, int pe);
+
+/* client_cache.c */
+
+void shmemio_cache_init();
+
+void shmemio_cache_finalize();
+
+void shmemio_cache_lock();
+
+void shmemio_cache_unlock();
+
+void shmemio_cache_add_fp(shmemio_fspace_t *fio, shmemio_fp_t *fp);
+
+void shmemio_cache_remove_fp(shmemio_fp_t *fp);
+
+void shmemio_cache_new_epoch(shmemio_fp_t *fp);
+
+shmemio_cache_page_t *shmemio_cache_page(uint64_t addr, int pe);
+
+void shmemio_cache_update(uint64_t addr, const void *src, size_t nbytes, int pe);
 
 
 
@@ -512,6 +977,14 @@ void shmemio_init_client();
 
 void shmemio_finalize_client();
 
+/* server_embed.c */
+
+void shmemio_embed_init();
+
+void shmemio_embed_finalize();
+
+int shmemio_embed_is_local(const ucp_address_t *addr, size_t addr_len);
+
 
 /************************ SERVER FUNCTIONS ***********************/
 
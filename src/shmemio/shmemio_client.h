@@ -7,7 +7,29 @@
 
 int shmemio_connect_fspace(shmem_fspace_conx_t *conx, int fid);
 
-int shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp, int *err);
+int shmemio_client_fopen(shmemio_fspace_t *fio, const char *file, shmemio_fp_t *fp,
+			 const shmem_fopen_attr_t *attr, shmemio_req_t *req, int *err);
+
+void shmemio_client_fopen_req(shmemio_fspace_t *fio, const char *file, const shmemio_fp_t *fp,
+			      const shmem_fopen_attr_t *attr, shmemio_req_t *req);
+
+int shmemio_client_fopen_finish(shmemio_fspace_t *fio, shmemio_fp_t *fp,
+				shmemio_req_t *req, int *err);
+
+int shmemio_client_fetch_extents(shmemio_fspace_t *fio, shmemio_fp_t *fp);
+
+int shmemio_client_sync_extents(shmemio_fp_t *fp, size_t end);
+
+ssize_t shmemio_client_pack_regions(shmemio_fspace_t *fio, int rstart, int rmax,
+				    char *buf, size_t maxlen);
+
+int shmemio_client_unpack_regions(shmemio_fspace_t *fio, int rstart, int rmax,
+				  const char *buf, size_t len);
+
+char *shmemio_client_pack_fspace(shmemio_fspace_t *fio, size_t *len);
+
+int shmemio_client_unpack_fspace(shmemio_fspace_t *fio, int fid, int nfpes, int nregions,
+				 const char *buf, size_t len);
 
 void update_fp_status(shmemio_req_t *req, shmemio_fp_req_t *fpreq, shmem_fp_t *infp);
 
@@ -23,11 +45,21 @@ int shmemio_fill_regions(shmemio_fspace_t* fio, int start, int rmax);
 
 int shmemio_fill_fspace(int fid);
 
+int shmemio_fill_remote_region(shmemio_fspace_t *fio, int fpe, shmemio_remote_region_t *r_reg);
 
+/******************************************************************************/
 
+/* client_fio.c */
 
+int shmemio_fio_send(shmemio_fspace_t *fio, shmemio_req_t *req);
 
+int shmemio_fio_recv(shmemio_fspace_t *fio, shmemio_req_t *req);
 
+void shmemio_fio_drain(shmemio_fspace_t *fio);
 
+shmemio_fio_req_t *shmemio_fio_start(int fspace, const shmemio_req_t *req,
+				     const void *data, size_t data_len,
+				     shmemio_fp_t *fp, shmemio_fio_finish_t finish);
 
+void shmemio_fio_detach_fp(shmemio_fspace_t *fio, const shmemio_fp_t *fp);
 
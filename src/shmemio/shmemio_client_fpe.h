@@ -81,6 +81,7 @@ fpe_range_reset(int start, int end, int fid)
 
     fpe->server_addr = NULL;
     fpe->server_ep = NULL;
+    fpe->local = -1;
   }
 }
 
@@ -64,6 +64,27 @@ insert_fspace_addr_range(shmemio_fspace_t *fio, size_t new1, size_t new2)
   }
 #endif
 }
+/*
+ * Add a newly mapped client region to the translation index, which keeps
+ * region ids sorted by l_base so an address is found by binary search
+ */
+static inline void
+insert_fspace_region_index(shmemio_fspace_t *fio, int rdx)
+{
+  int *arr = (int*)realloc(fio->rsorted, sizeof(int) * (fio->nsorted + 1));
+  shmemio_assert(arr != NULL, "region index realloc error");
+  fio->rsorted = arr;
+
+  const uint64_t base = fio->l_regions[rdx].l_base;
+  int idx = fio->nsorted;
+  while ((idx > 0) && (fio->l_regions[arr[idx-1]].l_base > base)) {
+    arr[idx] = arr[idx-1];
+    idx--;
+  }
+  arr[idx] = rdx;
+  fio->nsorted++;
+}
+
 /*
  * Find an appropriate sized unused range in the local address regions for this shmem pe
  * This range will be associated with a connected filespace
@@ -178,12 +199,17 @@ client_region_release(shmemio_client_region_t* reg)
 
     free(reg->r_regions);
   }
+
+  if (reg->replicas != NULL) {
+    free(reg->replicas);
+    free(reg->rep_hits);
+  }
 }
 
 static inline int
 client_region_recv_init(shmemio_client_region_t* reg,
 			int fpe_start, int fpe_stride, int fpe_size,
-			int unit_size)
+			int unit_size, int replica_of)
 {
   reg->l_base = 0;
   reg->l_end = 0;
@@ -193,6 +219,12 @@ client_region_recv_init(shmemio_client_region_t* reg,
   reg->fpe_stride = fpe_stride;
   reg->fpe_size = fpe_size;
   reg->unit_size = unit_size;
+
+  reg->replica_of = replica_of;
+  reg->nreplicas = 0;
+  reg->replicas = NULL;
+  reg->rep_policy = 0;
+  reg->rep_hits = NULL;
   
   reg->r_regions =
     (shmemio_remote_region_t*)malloc(sizeof(shmemio_remote_region_t) * reg->fpe_size);
@@ -222,12 +254,14 @@ client_region_fill(shmemio_fspace_t *fio, shmemio_client_region_t *l_reg)
   l_reg->l_base = base;
   l_reg->l_end = base + len;
   insert_fspace_addr_range(fio, l_reg->l_base, l_reg->l_end);
+  insert_fspace_region_index(fio, l_reg - fio->l_regions);
 
   shmemio_log(info, "Mapped new client region with addresses [%x:%x], len=%u\n",
 	      l_reg->l_base, l_reg->l_end, l_reg->len);
 
+  //Lazy fspaces unpack rkeys on first access
   int fpe = l_reg->fpe_start;
-  for (int idx = 0; idx < l_reg->fpe_size; idx++) {
+  for (int idx = 0; (idx < l_reg->fpe_size) && !fio->lazy; idx++) {
     shmemio_log(trace, "Client [%x:%x] fill remote region %d of %d [fpe %d, pe %d]\n",
 		l_reg->l_base, l_reg->l_end, 0, l_reg->fpe_size, fpe, fpe_to_pe_index(fpe));
     
@@ -282,9 +316,54 @@ fspace_extend_client_regions(shmemio_fspace_t *fio, unsigned nnew) {
     fio->l_regions[idx].len = 0;
     fio->l_regions[idx].fpe_size = 0;
     fio->l_regions[idx].r_regions = NULL;
+    fio->l_regions[idx].replica_of = -1;
+    fio->l_regions[idx].nreplicas = 0;
+    fio->l_regions[idx].replicas = NULL;
   }
 
   return nold;
 }
 
+/*
+ * Collect the replica regions the server made for a primary region so
+ * gets on the primary can be spread over them
+ */
+static inline int
+client_region_link_replicas(shmemio_fspace_t *fio, int rdx, int policy)
+{
+  shmemio_client_region_t *l_reg = &(fio->l_regions[rdx]);
+  l_reg->rep_policy = policy;
+
+  if (l_reg->replicas != NULL) {
+    return l_reg->nreplicas;
+  }
+
+  int nrep = 0;
+  for (int idx = 0; idx < fio->nregions; idx++) {
+    if (fio->l_regions[idx].replica_of == rdx)
+      nrep++;
+  }
+
+  if (nrep == 0) {
+    return 0;
+  }
+
+  l_reg->replicas = (int*)malloc(sizeof(int) * nrep);
+  l_reg->rep_hits = (unsigned long*)calloc(nrep + 1, sizeof(unsigned long));
+  shmemio_log_ret_if(error, -1, (l_reg->replicas == NULL) || (l_reg->rep_hits == NULL),
+		     "replica list malloc error\n");
+
+  for (int idx = 0; idx < fio->nregions; idx++) {
+    const shmemio_client_region_t *rep = &(fio->l_regions[idx]);
+    if (rep->replica_of == rdx) {
+      shmemio_assert((rep->fpe_size == l_reg->fpe_size) && (rep->len == l_reg->len),
+		     "replica region %d does not match primary region %d\n", idx, rdx);
+      l_reg->replicas[l_reg->nreplicas++] = idx;
+    }
+  }
+
+  shmemio_log(info, "Linked %d replicas to region %d\n", l_reg->nreplicas, rdx);
+  return l_reg->nreplicas;
+}
+
 #endif
@@ -0,0 +1,84 @@
+/* For license: see LICENSE file at top-level */
+// Copyright (c) 2018 - 2020 Arm, Ltd
+
+#ifndef SHMEMIO_CLIENT_STRIPE_H
+#define SHMEMIO_CLIENT_STRIPE_H
+
+/*
+ * Files are laid out across their pe set in unit_size stripes, the same
+ * way the server reads and writes backing files: unit u of the file lives
+ * on pe (u % pe_size), at symmetric offset (u / pe_size) * unit_size.
+ * Extent files are striped the same way within each extent, and extents
+ * hold whole rows, so only the base address changes from one to the next
+ */
+
+/*
+ * Find the extent holding file offset foff, the last one if it is past
+ * the extents known
+ */
+static inline const shmemio_client_extent_t *
+fp_extent_find(const shmemio_fp_t *fp, size_t foff)
+{
+  int lo = 0, hi = fp->nextents - 1;
+  while (lo < hi) {
+    const int mid = (lo + hi + 1) / 2;
+    if (fp->extents[mid].foff <= foff)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &(fp->extents[lo]);
+}
+
+/*
+ * Map a byte offset in the file to the pe and address that hold it.
+ * Returns the number of bytes left in that unit
+ */
+static inline size_t
+fp_stripe_locate(const shmem_fp_t *fp, size_t foff, int *pe, void **addr)
+{
+  const shmemio_fp_t *fpio = (const shmemio_fp_t*)fp;
+  const size_t unit = fp->unit_size;
+  char *base = (char*)fp->addr;
+
+  if (fpio->nextents > 0) {
+    const shmemio_client_extent_t *ext = fp_extent_find(fpio, foff);
+    base = ext->addr;
+    foff -= ext->foff;
+  }
+
+  const size_t udx = foff / unit;
+  const int sdx = udx % fp->pe_size;
+
+  *pe = fp->pe_start + (sdx * fp->pe_stride);
+  *addr = base + ((udx / fp->pe_size) * unit) + (foff % unit);
+
+  return unit - (foff % unit);
+}
+
+/*
+ * Is pe one of the pes the file is striped over
+ */
+static inline int
+fp_stripe_has_pe(const shmem_fp_t *fp, int pe)
+{
+  const int sdx = pe - fp->pe_start;
+  return ((sdx >= 0) && ((sdx % fp->pe_stride) == 0) && ((sdx / fp->pe_stride) < fp->pe_size));
+}
+
+/*
+ * Bytes in one full stripe row across the pe set
+ */
+static inline size_t
+fp_stripe_row(const shmem_fp_t *fp)
+{
+  return (size_t)fp->unit_size * fp->pe_size;
+}
+
+/*
+ * Append log files keep a header in the first stripe row. The 64-bit
+ * tail counter at the start of the file counts bytes reserved in the log
+ */
+#define fp_log_header_size(_fp_) fp_stripe_row(_fp_)
+
+#endif
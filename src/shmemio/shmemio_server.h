@@ -49,6 +49,14 @@ int shmemio_new_server_region(shmemio_server_t *srvr, const char *sfile_key,
 			      size_t len, int unit_size,
 			      int sfpe_start, int sfpe_stride, int sfpe_size);
 
+void shmemio_release_last_region(shmemio_server_t *srvr);
+
+int shmemio_new_snapshot_region(shmemio_server_t *srvr, int src_rdx, const char *snap_key,
+				size_t offset, size_t size);
+
+int shmemio_find_empty_region(shmemio_server_t *srvr, size_t len, int unit_size,
+			      int sfpe_start, int sfpe_stride, int sfpe_size);
+
 
 /******************************************************************************/
 /* server_fopen.c */
@@ -71,6 +79,100 @@ int shmemio_release_sfile(shmemio_server_t *srvr, shmemio_sfile_t* sfile);
 
 int shmemio_release_all_sfiles(shmemio_server_t *srvr);
 
+int shmemio_server_fsnapshot(shmemio_server_t *srvr, ucp_ep_h ep,
+			     shmemio_fsnap_req_t *snreq, short *status);
+
+int shmemio_server_range_flush(shmemio_server_t *srvr, shmemio_range_flush_req_t *rfreq,
+			       short *status);
+
+int shmemio_server_extents(shmemio_server_t *srvr, shmemio_extents_req_t *exreq,
+			   short *status);
+
+int shmemio_compact_fspace(shmemio_server_t *srvr, int max_moves);
+
+void shmemio_compact_idle(shmemio_server_t *srvr);
+
+
+/******************************************************************************/
+/* server_crc.c */
+
+uint32_t shmemio_crc32c(uint32_t crc, const void *buf, size_t len);
+
+void shmemio_crc_begin(shmemio_server_t *srvr, shmemio_crc_file_t *cf,
+		       const char *path, FILE *fp, int unit_size, int do_write);
+
+int shmemio_crc_unit(shmemio_crc_file_t *cf, const void *addr, size_t len);
+
+int shmemio_crc_end(shmemio_server_t *srvr, shmemio_crc_file_t *cf,
+		    const char *path, FILE *fp, int do_write);
+
+
+/******************************************************************************/
+/* server_lz.c */
+
+void shmemio_lz_begin(shmemio_server_t *srvr, shmemio_lz_file_t *lz, FILE *fp,
+		      const char *path, int unit_size, int do_write);
+
+size_t shmemio_lz_write(shmemio_lz_file_t *lz, FILE *fp, const void *src, size_t len);
+
+size_t shmemio_lz_read(shmemio_lz_file_t *lz, FILE *fp, void *dst, size_t len);
+
+int shmemio_lz_end(shmemio_server_t *srvr, shmemio_lz_file_t *lz, FILE *fp,
+		   const char *path, int do_write);
+
+
+/******************************************************************************/
+/* server_parity.c */
+
+int shmemio_parity_open(shmemio_server_t *srvr, shmemio_sfile_t *sfile);
+
+int shmemio_parity_resize(shmemio_server_t *srvr, shmemio_sfile_t *sfile);
+
+void shmemio_parity_release(shmemio_server_t *srvr, shmemio_sfile_t *sfile);
+
+void shmemio_parity_update(shmemio_server_t *srvr, shmemio_sfile_t *sfile, int ioflags);
+
+int shmemio_parity_rebuild(shmemio_server_t *srvr, shmemio_sfile_t *sfile,
+			   int pe_index, int ioflags);
+
+
+/******************************************************************************/
+/* server_filter.c */
+
+int shmemio_server_filter(shmemio_server_t *srvr, ucp_ep_h ep, shmemio_req_t *req);
+
+
+/******************************************************************************/
+/* server_stat.c */
+
+void shmemio_stat_init(shmemio_server_t *srvr);
+
+void shmemio_stat_finalize(shmemio_server_t *srvr);
+
+void shmemio_stat_publish(shmemio_server_t *srvr, shmemio_sfile_t *sfile);
+
+void shmemio_stat_release(shmemio_server_t *srvr, shmemio_sfile_t *sfile);
+
+
+/******************************************************************************/
+/* server_sched.c */
+
+void shmemio_sched_init(shmemio_server_t *srvr);
+
+void shmemio_sched_conn_init(shmemio_server_t *srvr, shmemio_conn_t *conn);
+
+int shmemio_sched_post(shmemio_server_t *srvr, shmemio_conn_t *conn);
+
+void shmemio_sched_conn_release(shmemio_server_t *srvr, shmemio_conn_t *conn);
+
+shmemio_conn_t *shmemio_sched_next(shmemio_server_t *srvr);
+
+void shmemio_sched_done(shmemio_server_t *srvr, int type, uint64_t arrival);
+
+unsigned long shmemio_sched_percentile(const shmemio_sched_stat_t *st, int pct);
+
+void shmemio_sched_log(shmemio_server_t *srvr);
+
 
 /******************************************************************************/
 /* server_pmem.c */
@@ -83,6 +185,11 @@ size_t shmemio_init_sfpe_mem(shmemio_sfpe_mem_t *sm,
 			     ucp_context_h context, size_t length,
 			     const char *sfile_key, int idx);
 
+size_t shmemio_init_sfpe_snapshot_mem(shmemio_sfpe_mem_t *sm, shmemio_sfpe_mem_t *src_sm,
+				      ucp_context_h context, const char *src_key,
+				      const char *snap_key, int partid,
+				      size_t offset, size_t size);
+
 #endif
 
 #undef SHMEMIO_EXPORT_ONLY